@@ -0,0 +1,279 @@
+#include "assetpack.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// the table of contents is mapped as it is, so it must not depend on padding
+static_assert(sizeof(AssetPackHeader) == 16, "asset pack header must be packed");
+static_assert(sizeof(AssetPackEntry) == 64, "asset pack entry must be packed");
+
+// LZ4 sequences: a match is at least 4 bytes, the last 5 bytes are always
+// literals and the last match starts at least 12 bytes before the end
+const int LZ4_MIN_MATCH = 4;
+const int LZ4_LAST_LITERALS = 5;
+const int LZ4_MATCH_LIMIT = 12;
+const int LZ4_MAX_OFFSET = 65535;
+const int LZ4_HASH_BITS = 12;
+
+static unsigned int read32(const unsigned char* bytes)
+{
+   unsigned int value;
+   memcpy(&value, bytes, 4);
+   return value;
+}
+
+// a length past the 15 its token holds, as bytes of 255 and the rest
+static void writeLength(size_t length, vector<unsigned char>* out)
+{
+   for (; length >= 255; length -= 255)
+      out->push_back(255);
+   out->push_back((unsigned char)length);
+}
+
+static void writeSequence(const unsigned char* literals, size_t literalCount, size_t offset, size_t matchLength,
+   vector<unsigned char>* out)
+{
+   size_t matchCode = matchLength ? matchLength - LZ4_MIN_MATCH : 0;
+   out->push_back((unsigned char)((std::min(literalCount, size_t(15)) << 4) | std::min(matchCode, size_t(15))));
+   if (literalCount >= 15)
+      writeLength(literalCount - 15, out);
+   out->insert(out->end(), literals, literals + literalCount);
+   if (!matchLength)
+      return;
+   out->push_back((unsigned char)(offset & 0xff));
+   out->push_back((unsigned char)(offset >> 8));
+   if (matchCode >= 15)
+      writeLength(matchCode - 15, out);
+}
+
+void CompressLZ4(const unsigned char* data, size_t size, vector<unsigned char>* compressed)
+{
+   // greedy: each position takes the last one with the same 4 bytes
+   compressed->clear();
+   vector<int> table(size_t(1) << LZ4_HASH_BITS, -1);
+   size_t anchor = 0;
+   if (size > size_t(LZ4_MATCH_LIMIT))
+   {
+      size_t limit = size - LZ4_MATCH_LIMIT;
+      size_t i = 0;
+      while (i < limit)
+      {
+         unsigned int sequence = read32(data + i);
+         unsigned int hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+         int candidate = table[hash];
+         table[hash] = int(i);
+         if (candidate < 0 || i - candidate > size_t(LZ4_MAX_OFFSET) || read32(data + candidate) != sequence)
+         {
+            i++;
+            continue;
+         }
+
+         size_t length = LZ4_MIN_MATCH;
+         size_t longest = size - LZ4_LAST_LITERALS - i;
+         while (length < longest && data[candidate + length] == data[i + length])
+            length++;
+         writeSequence(data + anchor, i - anchor, i - candidate, length, compressed);
+         i += length;
+         anchor = i;
+      }
+   }
+   writeSequence(data + anchor, size - anchor, 0, 0, compressed);
+}
+
+bool DecompressLZ4(const unsigned char* compressed, size_t compressedSize, unsigned char* data, size_t size)
+{
+   const unsigned char* in = compressed;
+   const unsigned char* inEnd = compressed + compressedSize;
+   size_t out = 0;
+   while (in < inEnd)
+   {
+      unsigned char token = *in++;
+      size_t literalCount = token >> 4;
+      if (literalCount == 15)
+      {
+         unsigned char byte;
+         do
+         {
+            if (in >= inEnd)
+               return false;
+            byte = *in++;
+            literalCount += byte;
+         } while (byte == 255);
+      }
+      if (literalCount > size_t(inEnd - in) || literalCount > size - out)
+         return false;
+      memcpy(data + out, in, literalCount);
+      in += literalCount;
+      out += literalCount;
+
+      // the last sequence has no match
+      if (in == inEnd)
+         break;
+      if (inEnd - in < 2)
+         return false;
+      size_t offset = in[0] | (size_t(in[1]) << 8);
+      in += 2;
+      size_t matchLength = token & 15;
+      if (matchLength == 15)
+      {
+         unsigned char byte;
+         do
+         {
+            if (in >= inEnd)
+               return false;
+            byte = *in++;
+            matchLength += byte;
+         } while (byte == 255);
+      }
+      matchLength += LZ4_MIN_MATCH;
+      if (offset == 0 || offset > out || matchLength > size - out)
+         return false;
+
+      // byte by byte, a match may overlap the bytes it writes
+      for (size_t i = 0; i < matchLength; i++, out++)
+         data[out] = data[out - offset];
+   }
+   return out == size;
+}
+
+bool WriteAssetPack(const char* filename, const vector<string>& files, bool isCompressed)
+{
+   // the table is sorted by name, the lookups search it
+   vector<string> names(files);
+   for (size_t i = 0; i < names.size(); i++)
+      std::replace(names[i].begin(), names[i].end(), '\\', '/');
+   std::sort(names.begin(), names.end());
+   names.erase(std::unique(names.begin(), names.end()), names.end());
+
+   AssetPackHeader header;
+   memcpy(header.magic, "PACK", 4);
+   header.version = ASSET_PACK_VERSION;
+   header.assetCount = (unsigned int)(names.size());
+   header.alignment = ASSET_PACK_ALIGNMENT;
+
+   vector<AssetPackEntry> entries(names.size());
+   vector<vector<unsigned char> > stored(names.size());
+   size_t offset = sizeof(header) + sizeof(AssetPackEntry) * entries.size();
+   for (size_t i = 0; i < names.size(); i++)
+   {
+      const string& name = names[i];
+      if (name.size() >= size_t(ASSET_NAME_SIZE))
+      {
+         cout << "ERROR: asset name " << name << " is longer than " << ASSET_NAME_SIZE - 1 << " characters" << endl;
+         return false;
+      }
+      ifstream file(name.c_str(), ios::binary);
+      if (!file)
+      {
+         cout << "ERROR: Could not read asset " << name << endl;
+         return false;
+      }
+      vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+      AssetPackEntry& entry = entries[i];
+      memset(entry.name, 0, sizeof(entry.name));
+      memcpy(entry.name, name.c_str(), name.size());
+      entry.size = (unsigned int)(bytes.size());
+      if (isCompressed)
+         CompressLZ4(bytes.data(), bytes.size(), &stored[i]);
+      if (!isCompressed || stored[i].size() >= bytes.size())
+         stored[i].swap(bytes);
+      entry.storedSize = (unsigned int)(stored[i].size());
+
+      offset = (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+      entry.offset = (unsigned int)(offset);
+      offset += stored[i].size();
+      if (offset > 0xffffffffu)
+      {
+         cout << "ERROR: asset pack " << filename << " would be larger than 4 GB" << endl;
+         return false;
+      }
+   }
+
+   ofstream file(filename, ios::binary);
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   file.write(reinterpret_cast<const char*>(entries.data()), sizeof(AssetPackEntry) * entries.size());
+   static const char padding[ASSET_PACK_ALIGNMENT] = {};
+   size_t written = sizeof(header) + sizeof(AssetPackEntry) * entries.size();
+   for (size_t i = 0; i < entries.size(); i++)
+   {
+      file.write(padding, entries[i].offset - written);
+      file.write(reinterpret_cast<const char*>(stored[i].data()), stored[i].size());
+      written = entries[i].offset + stored[i].size();
+   }
+   if (!file)
+   {
+      cout << "ERROR: could not write asset pack " << filename << endl;
+      return false;
+   }
+   return true;
+}
+
+bool AssetPack::open(const char* filename)
+{
+   close();
+   if (!file_.open(filename) || file_.size() < sizeof(AssetPackHeader))
+   {
+      close();
+      return false;
+   }
+
+   // a pack that does not add up is treated like a missing one, and the
+   // assets are read from their files
+   const AssetPackHeader* header = reinterpret_cast<const AssetPackHeader*>(file_.data());
+   if (memcmp(header->magic, "PACK", 4) != 0 || header->version != ASSET_PACK_VERSION ||
+      (file_.size() - sizeof(AssetPackHeader)) / sizeof(AssetPackEntry) < header->assetCount)
+   {
+      cout << "ERROR: " << filename << " is not an asset pack" << endl;
+      close();
+      return false;
+   }
+   const AssetPackEntry* entries = reinterpret_cast<const AssetPackEntry*>(header + 1);
+   for (unsigned int i = 0; i < header->assetCount; i++)
+   {
+      const AssetPackEntry& entry = entries[i];
+      if (entry.name[ASSET_NAME_SIZE - 1] != 0 || entry.offset > file_.size() ||
+         entry.storedSize > file_.size() - entry.offset ||
+         (i > 0 && strcmp(entries[i - 1].name, entry.name) >= 0))
+      {
+         cout << "ERROR: asset pack " << filename << " is corrupt" << endl;
+         close();
+         return false;
+      }
+   }
+   entries_ = entries;
+   count_ = header->assetCount;
+   return true;
+}
+
+const AssetPackEntry* AssetPack::find(const string& name) const
+{
+   const AssetPackEntry* end = entries_ + count_;
+   const AssetPackEntry* entry = std::lower_bound(entries_, end, name.c_str(),
+      [](const AssetPackEntry& entry, const char* name) { return strcmp(entry.name, name) < 0; });
+   if (entry == end || name != entry->name)
+      return 0;
+   return entry;
+}
+
+const unsigned char* AssetPack::load(const string& name, size_t* size, vector<unsigned char>* buffer) const
+{
+   const AssetPackEntry* entry = find(name);
+   if (!entry)
+      return 0;
+   const unsigned char* stored = file_.data() + entry->offset;
+   *size = entry->size;
+   if (entry->storedSize == entry->size)
+      return stored;
+
+   buffer->resize(entry->size);
+   if (!DecompressLZ4(stored, entry->storedSize, buffer->data(), buffer->size()))
+   {
+      cout << "ERROR: packed asset " << name << " is corrupt" << endl;
+      return 0;
+   }
+   return buffer->data();
+}
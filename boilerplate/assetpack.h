@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+
+// Asset pack file: a header, a table of contents sorted by name, then the
+// assets' bytes, each starting on a multiple of ASSET_PACK_ALIGNMENT so
+// an asset stored as it is can be handed to OpenGL straight from the
+// mapping. An asset is stored LZ4-compressed (the block format, without
+// frames) when the packer was asked to and that made it smaller.
+const unsigned int ASSET_PACK_VERSION = 1;
+const unsigned int ASSET_PACK_ALIGNMENT = 256;
+const int ASSET_NAME_SIZE = 52;
+
+struct AssetPackHeader
+{
+   char magic[4];             // "PACK"
+   unsigned int version;      // ASSET_PACK_VERSION
+   unsigned int assetCount;
+   unsigned int alignment;    // ASSET_PACK_ALIGNMENT
+};
+
+struct AssetPackEntry
+{
+   char name[ASSET_NAME_SIZE];   // relative path with '/', zero padded
+   unsigned int offset;          // from the start of the file
+   unsigned int size;            // of the asset
+   unsigned int storedSize;      // in the file, size unless compressed
+};
+
+// packs files under the names they are given by, returning true if
+// successful; isCompressed tries LZ4 on each of them
+bool WriteAssetPack(const char* filename, const std::vector<std::string>& files, bool isCompressed);
+
+// LZ4 block format, for the pack's compressed assets
+void CompressLZ4(const unsigned char* data, size_t size, std::vector<unsigned char>* compressed);
+bool DecompressLZ4(const unsigned char* compressed, size_t compressedSize, unsigned char* data, size_t size);
+
+// An asset pack mapped read-only into memory. Lookups only read the
+// mapping, so any thread can make them once the pack is open.
+class AssetPack{
+public:
+   AssetPack() : entries_(0), count_(0) {}
+
+   // maps the pack and checks its header and table of contents, returning
+   // false (with nothing mapped) if it is missing or not a valid pack
+   bool open(const char* filename);
+   void close() { file_.close(); entries_ = 0; count_ = 0; }
+   bool isOpen() const { return file_.isOpen(); }
+
+   // the entry of an asset, or null if it is not packed
+   const AssetPackEntry* find(const std::string& name) const;
+
+   // the bytes of an asset: in the mapping if it is stored as it is, else
+   // decompressed into buffer; null if it is not packed or is corrupt
+   const unsigned char* load(const std::string& name, size_t* size, std::vector<unsigned char>* buffer) const;
+
+   int assetCount() const { return int(count_); }
+   const AssetPackEntry& entry(int index) const { return entries_[index]; }
+
+private:
+   AssetPack(const AssetPack&);
+   AssetPack& operator=(const AssetPack&);
+
+   MappedFile file_;
+   const AssetPackEntry* entries_;
+   unsigned int count_;
+};
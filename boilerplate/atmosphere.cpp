@@ -0,0 +1,373 @@
+#include "atmosphere.h"
+#include "jobs.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "glm/glm.hpp"
+
+using namespace std;
+using namespace glm;
+
+static_assert(sizeof(AtmosphereFileHeader) == 28, "atmosphere file header must be packed");
+
+// the earth's atmosphere, per kilometre, from Bruneton's 2017 demo: air
+// (Rayleigh) and aerosols (Mie) thin out exponentially with height, ozone
+// peaks in a layer around 25 km and only absorbs
+static const dvec3 RAYLEIGH_SCATTERING(5.802e-3, 13.558e-3, 33.1e-3);
+static const double RAYLEIGH_SCALE_HEIGHT = 8.0;
+static const double MIE_SCATTERING = 3.996e-3;
+static const double MIE_EXTINCTION = 4.440e-3;
+static const double MIE_SCALE_HEIGHT = 1.2;
+static const dvec3 OZONE_ABSORPTION(0.650e-3, 1.881e-3, 0.085e-3);
+static const double OZONE_CENTRE = 25.0;
+static const double OZONE_HALF_WIDTH = 15.0;
+
+// the sun is tabulated down to this cosine of its zenith angle, a little
+// past the horizon, below which nothing it lights is visible
+static const double MU_S_MIN = -0.2;
+static const double SUN_ANGULAR_RADIUS = 0.004675;
+
+// integration steps along a ray
+static const int TRANSMITTANCE_STEPS = 500;
+static const int SCATTERING_STEPS = 50;
+
+// scattering rows (one height, one view angle) per job
+static const int SCATTERING_ROWS_PER_JOB = 16;
+
+static const double BOTTOM = ATMOSPHERE_BOTTOM;
+static const double TOP = ATMOSPHERE_TOP;
+
+// the texture coordinate of x in [0, 1] on a table of size texels, so 0
+// and 1 fall on the centres of the first and last texels, and back
+static double coordFromUnit(double x, int size)
+{
+   return 0.5 / size + x * (1.0 - 1.0 / size);
+}
+
+static double unitFromCoord(double u, int size)
+{
+   return (u - 0.5 / size) / (1.0 - 1.0 / size);
+}
+
+static double clampCosine(double mu)
+{
+   return std::max(-1.0, std::min(mu, 1.0));
+}
+
+static double clampRadius(double r)
+{
+   return std::max(BOTTOM, std::min(r, TOP));
+}
+
+static double safeSqrt(double x)
+{
+   return sqrt(std::max(x, 0.0));
+}
+
+static double distanceToTop(double r, double mu)
+{
+   return std::max(-r * mu + safeSqrt(r * r * (mu * mu - 1.0) + TOP * TOP), 0.0);
+}
+
+static double distanceToBottom(double r, double mu)
+{
+   return std::max(-r * mu - safeSqrt(r * r * (mu * mu - 1.0) + BOTTOM * BOTTOM), 0.0);
+}
+
+// --------------------------------------------------------------------------
+// Transmittance
+
+static double ozoneDensity(double altitude)
+{
+   return std::max(0.0, 1.0 - fabs(altitude - OZONE_CENTRE) / OZONE_HALF_WIDTH);
+}
+
+// transmittance from height r along mu to the top, integrated with the
+// trapezoidal rule
+static dvec3 computeTransmittance(double r, double mu)
+{
+   double dx = distanceToTop(r, mu) / TRANSMITTANCE_STEPS;
+   double rayleigh = 0.0, mie = 0.0, ozone = 0.0;
+   for (int i = 0; i <= TRANSMITTANCE_STEPS; i++)
+   {
+      double d = i * dx;
+      double altitude = sqrt(d * d + 2.0 * r * mu * d + r * r) - BOTTOM;
+      double weight = i == 0 || i == TRANSMITTANCE_STEPS ? 0.5 : 1.0;
+      rayleigh += weight * exp(-altitude / RAYLEIGH_SCALE_HEIGHT);
+      mie += weight * exp(-altitude / MIE_SCALE_HEIGHT);
+      ozone += weight * ozoneDensity(altitude);
+   }
+   dvec3 opticalDepth = RAYLEIGH_SCATTERING * rayleigh * dx + dvec3(MIE_EXTINCTION * mie * dx) +
+      OZONE_ABSORPTION * ozone * dx;
+   return exp(-opticalDepth);
+}
+
+// (r, mu) of a point of the transmittance table, x along mu and y along r
+// in [0, 1]: r by the distance to the horizon, mu by the distance to the
+// top between its least and most, which packs texels near the horizon
+static void transmittanceRMu(double x, double y, double* r, double* mu)
+{
+   double h = sqrt(TOP * TOP - BOTTOM * BOTTOM);
+   double rho = h * y;
+   *r = sqrt(rho * rho + BOTTOM * BOTTOM);
+   double dMin = TOP - *r;
+   double dMax = rho + h;
+   double d = dMin + x * (dMax - dMin);
+   *mu = d == 0.0 ? 1.0 : clampCosine((h * h - rho * rho - d * d) / (2.0 * *r * d));
+}
+
+static void transmittanceCoord(double r, double mu, double* u, double* v)
+{
+   double h = sqrt(TOP * TOP - BOTTOM * BOTTOM);
+   double rho = safeSqrt(r * r - BOTTOM * BOTTOM);
+   double dMin = TOP - r;
+   double dMax = rho + h;
+   double x = (distanceToTop(r, mu) - dMin) / (dMax - dMin);
+   *u = coordFromUnit(x, TRANSMITTANCE_WIDTH);
+   *v = coordFromUnit(rho / h, TRANSMITTANCE_HEIGHT);
+}
+
+// the table's bilinear lookup, as the shader's texture() does it, so the
+// scattering is integrated against the transmittance the shader sees
+static dvec3 lookupTransmittance(const vector<float>& table, double r, double mu)
+{
+   double u, v;
+   transmittanceCoord(clampRadius(r), mu, &u, &v);
+   double x = std::max(0.0, std::min(u * TRANSMITTANCE_WIDTH - 0.5, TRANSMITTANCE_WIDTH - 1.0));
+   double y = std::max(0.0, std::min(v * TRANSMITTANCE_HEIGHT - 0.5, TRANSMITTANCE_HEIGHT - 1.0));
+   int x0 = std::min(int(x), TRANSMITTANCE_WIDTH - 2);
+   int y0 = std::min(int(y), TRANSMITTANCE_HEIGHT - 2);
+   double fx = x - x0, fy = y - y0;
+   const float* t00 = &table[3 * (y0 * TRANSMITTANCE_WIDTH + x0)];
+   const float* t01 = t00 + 3 * TRANSMITTANCE_WIDTH;
+   dvec3 result;
+   for (int c = 0; c < 3; c++)
+   {
+      double bottom = t00[c] + fx * (t00[c + 3] - t00[c]);
+      double top = t01[c] + fx * (t01[c + 3] - t01[c]);
+      result[c] = bottom + fy * (top - bottom);
+   }
+   return result;
+}
+
+// transmittance between the point at height r and the one d along mu
+static dvec3 transmittanceBetween(const vector<float>& table, double r, double mu, double d, bool isGround)
+{
+   double rD = clampRadius(sqrt(d * d + 2.0 * r * mu * d + r * r));
+   double muD = clampCosine((r * mu + d) / rD);
+   if (isGround)
+      return min(lookupTransmittance(table, rD, -muD) / lookupTransmittance(table, r, -mu), dvec3(1.0));
+   return min(lookupTransmittance(table, r, mu) / lookupTransmittance(table, rD, muD), dvec3(1.0));
+}
+
+// transmittance to the sun, faded out as the sun sets behind the horizon
+static dvec3 transmittanceToSun(const vector<float>& table, double r, double muS)
+{
+   double sinHorizon = BOTTOM / r;
+   double cosHorizon = -safeSqrt(1.0 - sinHorizon * sinHorizon);
+   double edge = sinHorizon * SUN_ANGULAR_RADIUS;
+   double t = std::max(0.0, std::min((muS - cosHorizon + edge) / (2.0 * edge), 1.0));
+   return lookupTransmittance(table, r, muS) * (t * t * (3.0 - 2.0 * t));
+}
+
+// --------------------------------------------------------------------------
+// Single scattering
+
+// (r, mu, muS, nu) of a point of the scattering table, each coordinate in
+// [0, 1]; the lower half of mu holds the rays that hit the ground
+static void scatteringRMuMuSNu(double uNu, double uMuS, double uMu, double uR,
+   double* r, double* mu, double* muS, double* nu, bool* isGround)
+{
+   double h = sqrt(TOP * TOP - BOTTOM * BOTTOM);
+   double rho = h * unitFromCoord(uR, SCATTERING_R);
+   *r = sqrt(rho * rho + BOTTOM * BOTTOM);
+   if (uMu < 0.5)
+   {
+      double dMin = *r - BOTTOM;
+      double dMax = rho;
+      double d = dMin + (dMax - dMin) * unitFromCoord(1.0 - 2.0 * uMu, SCATTERING_MU / 2);
+      *mu = d == 0.0 ? -1.0 : clampCosine(-(rho * rho + d * d) / (2.0 * *r * d));
+      *isGround = true;
+   }
+   else
+   {
+      double dMin = TOP - *r;
+      double dMax = rho + h;
+      double d = dMin + (dMax - dMin) * unitFromCoord(2.0 * uMu - 1.0, SCATTERING_MU / 2);
+      *mu = d == 0.0 ? 1.0 : clampCosine((h * h - rho * rho - d * d) / (2.0 * *r * d));
+      *isGround = false;
+   }
+
+   double x = unitFromCoord(uMuS, SCATTERING_MU_S);
+   double dMin = TOP - BOTTOM;
+   double dMax = h;
+   double farthest = (distanceToTop(BOTTOM, MU_S_MIN) - dMin) / (dMax - dMin);
+   double a = (farthest - x * farthest) / (1.0 + x * farthest);
+   double d = dMin + std::min(a, farthest) * (dMax - dMin);
+   *muS = d == 0.0 ? 1.0 : clampCosine((h * h - d * d) / (2.0 * BOTTOM * d));
+   *nu = clampCosine(uNu * 2.0 - 1.0);
+}
+
+// the steps along a view ray, which every texel of a scattering row shares:
+// how far each is, its height, and the transmittance back to the start
+struct ScatteringSteps
+{
+   double dx;
+   double d[SCATTERING_STEPS + 1];
+   double r[SCATTERING_STEPS + 1];
+   dvec3 transmittance[SCATTERING_STEPS + 1];
+};
+
+static void computeSteps(const vector<float>& table, double r, double mu, bool isGround, ScatteringSteps* steps)
+{
+   steps->dx = (isGround ? distanceToBottom(r, mu) : distanceToTop(r, mu)) / SCATTERING_STEPS;
+   for (int i = 0; i <= SCATTERING_STEPS; i++)
+   {
+      double d = i * steps->dx;
+      steps->d[i] = d;
+      steps->r[i] = clampRadius(sqrt(d * d + 2.0 * r * mu * d + r * r));
+      steps->transmittance[i] = transmittanceBetween(table, r, mu, d, isGround);
+   }
+}
+
+// Rayleigh (rgb) and Mie (red) light scattered once towards height r from
+// along the steps' ray, integrated with the trapezoidal rule
+static dvec4 computeScattering(const vector<float>& table, const ScatteringSteps& steps, double r, double muS,
+   double nu)
+{
+   dvec3 rayleigh(0.0);
+   dvec3 mie(0.0);
+   for (int i = 0; i <= SCATTERING_STEPS; i++)
+   {
+      double rD = steps.r[i];
+      double muSD = clampCosine((r * muS + steps.d[i] * nu) / rD);
+      dvec3 transmittance = steps.transmittance[i] * transmittanceToSun(table, rD, muSD);
+      double weight = i == 0 || i == SCATTERING_STEPS ? 0.5 : 1.0;
+      rayleigh += weight * transmittance * exp(-(rD - BOTTOM) / RAYLEIGH_SCALE_HEIGHT);
+      mie += weight * transmittance * exp(-(rD - BOTTOM) / MIE_SCALE_HEIGHT);
+   }
+   rayleigh *= steps.dx * RAYLEIGH_SCATTERING;
+   mie *= steps.dx * MIE_SCATTERING;
+   return dvec4(rayleigh, mie.r);
+}
+
+void ComputeAtmosphereTables(AtmosphereTables* tables)
+{
+   vector<float>& transmittance = tables->transmittance;
+   transmittance.resize(3 * TRANSMITTANCE_WIDTH * TRANSMITTANCE_HEIGHT);
+   ParallelFor("atmosphere transmittance", TRANSMITTANCE_HEIGHT, 1, [&](int begin, int end) {
+      for (int y = begin; y < end; y++)
+      {
+         for (int x = 0; x < TRANSMITTANCE_WIDTH; x++)
+         {
+            double r, mu;
+            transmittanceRMu(unitFromCoord((x + 0.5) / TRANSMITTANCE_WIDTH, TRANSMITTANCE_WIDTH),
+               unitFromCoord((y + 0.5) / TRANSMITTANCE_HEIGHT, TRANSMITTANCE_HEIGHT), &r, &mu);
+            dvec3 t = computeTransmittance(r, mu);
+            float* texel = &transmittance[3 * (y * TRANSMITTANCE_WIDTH + x)];
+            texel[0] = float(t.r);
+            texel[1] = float(t.g);
+            texel[2] = float(t.b);
+         }
+      }
+   });
+
+   // rows along x hold every nu in turn, each a run of every muS
+   const int width = SCATTERING_NU * SCATTERING_MU_S;
+   vector<float>& scattering = tables->scattering;
+   scattering.resize(4 * width * SCATTERING_MU * SCATTERING_R);
+   ParallelFor("atmosphere scattering", SCATTERING_MU * SCATTERING_R, SCATTERING_ROWS_PER_JOB, [&](int begin, int end) {
+      ScatteringSteps steps;
+      for (int row = begin; row < end; row++)
+      {
+         // a row has one height and view angle, so one view ray
+         int y = row % SCATTERING_MU;
+         int z = row / SCATTERING_MU;
+         for (int x = 0; x < width; x++)
+         {
+            double r, mu, muS, nu;
+            bool isGround;
+            scatteringRMuMuSNu(double(x / SCATTERING_MU_S) / (SCATTERING_NU - 1),
+               (x % SCATTERING_MU_S + 0.5) / SCATTERING_MU_S, (y + 0.5) / SCATTERING_MU,
+               (z + 0.5) / SCATTERING_R, &r, &mu, &muS, &nu, &isGround);
+            if (x == 0)
+               computeSteps(transmittance, r, mu, isGround, &steps);
+
+            // nu is only free within the angles mu and muS allow
+            double spread = safeSqrt((1.0 - mu * mu) * (1.0 - muS * muS));
+            nu = std::max(mu * muS - spread, std::min(nu, mu * muS + spread));
+
+            dvec4 s = computeScattering(transmittance, steps, r, muS, nu);
+            float* texel = &scattering[4 * ((size_t(z) * SCATTERING_MU + y) * width + x)];
+            texel[0] = float(s.r);
+            texel[1] = float(s.g);
+            texel[2] = float(s.b);
+            texel[3] = float(s.a);
+         }
+      }
+   });
+}
+
+// --------------------------------------------------------------------------
+// Table files
+
+static AtmosphereFileHeader atmosphereHeader()
+{
+   AtmosphereFileHeader header;
+   memcpy(header.magic, "ATMO", 4);
+   header.version = ATMOSPHERE_FILE_VERSION;
+   header.transmittanceSize = TRANSMITTANCE_WIDTH << 16 | TRANSMITTANCE_HEIGHT;
+   header.scatteringSize[0] = SCATTERING_NU;
+   header.scatteringSize[1] = SCATTERING_MU_S;
+   header.scatteringSize[2] = SCATTERING_MU;
+   header.scatteringSize[3] = SCATTERING_R;
+   return header;
+}
+
+bool WriteAtmosphereFile(const char* filename, const AtmosphereTables& tables)
+{
+   AtmosphereFileHeader header = atmosphereHeader();
+   ofstream file(filename, ios::binary);
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   file.write(reinterpret_cast<const char*>(tables.transmittance.data()), sizeof(float) * tables.transmittance.size());
+   file.write(reinterpret_cast<const char*>(tables.scattering.data()), sizeof(float) * tables.scattering.size());
+   if (!file)
+   {
+      cout << "ERROR: could not write atmosphere file " << filename << endl;
+      return false;
+   }
+   return true;
+}
+
+bool ReadAtmosphereFile(const char* filename, const AssetPack* assets, AtmosphereTables* tables)
+{
+   vector<unsigned char> buffer;
+   size_t size = 0;
+   const unsigned char* bytes = assets ? assets->load(filename, &size, &buffer) : 0;
+   if (!bytes)
+   {
+      ifstream file(filename, ios::binary);
+      if (!file)
+         return false;
+      buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+      bytes = buffer.data();
+      size = buffer.size();
+   }
+
+   AtmosphereFileHeader header;
+   AtmosphereFileHeader expected = atmosphereHeader();
+   size_t transmittanceCount = 3 * TRANSMITTANCE_WIDTH * TRANSMITTANCE_HEIGHT;
+   size_t scatteringCount = size_t(4) * SCATTERING_NU * SCATTERING_MU_S * SCATTERING_MU * SCATTERING_R;
+   if (size != sizeof(header) + sizeof(float) * (transmittanceCount + scatteringCount))
+      return false;
+   memcpy(&header, bytes, sizeof(header));
+   if (memcmp(&header, &expected, sizeof(header)) != 0)
+      return false;
+
+   const float* floats = reinterpret_cast<const float*>(bytes + sizeof(header));
+   tables->transmittance.assign(floats, floats + transmittanceCount);
+   tables->scattering.assign(floats + transmittanceCount, floats + transmittanceCount + scatteringCount);
+   return true;
+}
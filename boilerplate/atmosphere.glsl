@@ -0,0 +1,270 @@
+// ==========================================================================
+// Fragment program for the earth's atmosphere, drawn on a shell around the
+// earth at the top of the atmosphere after the rest of the scene. For the
+// ray through each pixel it looks up, in the tables of atmosphere.cpp, the
+// light scattered towards the eye (added) and the transmittance of what
+// lies behind (multiplied, through the second blend source), up to the
+// ground if the ray hits the earth, else through the whole atmosphere.
+// ==========================================================================
+#version 410
+
+in vec3 Position; // Position in world space.
+
+uniform vec3 eye;              // world space
+uniform vec3 light;            // the sun's position in world space
+uniform vec3 earthCentre;      // world space
+uniform float kmPerUnit;       // kilometres per world unit at the earth
+uniform float sunIntensity;    // radiance of sunlight scattered at full strength
+
+// the near side of the shell is drawn depth tested, so what is in front of
+// the atmosphere stays clear of it; from inside, or so close that the near
+// plane would cut into the near side, the far side is drawn over everything
+uniform bool isFarSide;
+
+uniform sampler2D transmittanceTable;
+uniform sampler3D scatteringTable;
+
+// the occluders of fragment.glsl, the earth first; its own shadow is
+// already in the tables
+const int MAX_OCCLUDERS = 8;
+uniform vec4 occluders[MAX_OCCLUDERS];
+uniform int occluderCount;
+uniform float sunRadius;
+
+layout(location = 0, index = 0) out vec4 FragmentColour;
+layout(location = 0, index = 1) out vec4 FragmentTransmittance;
+
+// ATMOSPHERE_BOTTOM, ATMOSPHERE_TOP and the table sizes of atmosphere.h,
+// the scattering coefficients and MU_S_MIN of atmosphere.cpp
+const float BOTTOM = 6360.0;
+const float TOP = 6420.0;
+const int TRANSMITTANCE_WIDTH = 256;
+const int TRANSMITTANCE_HEIGHT = 64;
+const int SCATTERING_R = 32;
+const int SCATTERING_MU = 128;
+const int SCATTERING_MU_S = 32;
+const int SCATTERING_NU = 8;
+const vec3 RAYLEIGH_SCATTERING = vec3(5.802e-3, 13.558e-3, 33.1e-3);
+const vec3 MIE_SCATTERING = vec3(3.996e-3);
+const float MU_S_MIN = -0.2;
+const float MIE_G = 0.8;
+const float PI = 3.14159265;
+
+float coordFromUnit(float x, int size)
+{
+    return 0.5 / float(size) + x * (1.0 - 1.0 / float(size));
+}
+
+float safeSqrt(float x)
+{
+    return sqrt(max(x, 0.0));
+}
+
+float distanceToTop(float r, float mu)
+{
+    return max(-r * mu + safeSqrt(r * r * (mu * mu - 1.0) + TOP * TOP), 0.0);
+}
+
+bool intersectsGround(float r, float mu)
+{
+    return mu < 0.0 && r * r * (mu * mu - 1.0) + BOTTOM * BOTTOM >= 0.0;
+}
+
+vec3 transmittanceToTop(float r, float mu)
+{
+    float h = sqrt(TOP * TOP - BOTTOM * BOTTOM);
+    float rho = safeSqrt(r * r - BOTTOM * BOTTOM);
+    float dMin = TOP - r;
+    float dMax = rho + h;
+    float x = (distanceToTop(r, mu) - dMin) / (dMax - dMin);
+    vec2 uv = vec2(coordFromUnit(x, TRANSMITTANCE_WIDTH), coordFromUnit(rho / h, TRANSMITTANCE_HEIGHT));
+    return texture(transmittanceTable, uv).rgb;
+}
+
+// between the point at height r and the one d along mu
+vec3 transmittanceBetween(float r, float mu, float d, bool isGround)
+{
+    float rD = clamp(sqrt(d * d + 2.0 * r * mu * d + r * r), BOTTOM, TOP);
+    float muD = clamp((r * mu + d) / rD, -1.0, 1.0);
+    if (isGround)
+        return min(transmittanceToTop(rD, -muD) / transmittanceToTop(r, -mu), vec3(1.0));
+    return min(transmittanceToTop(r, mu) / transmittanceToTop(rD, muD), vec3(1.0));
+}
+
+// the two texels of the scattering table nearest nu, blended
+vec4 scatteringTexel(float r, float mu, float muS, float nu, bool isGround)
+{
+    float h = sqrt(TOP * TOP - BOTTOM * BOTTOM);
+    float rho = safeSqrt(r * r - BOTTOM * BOTTOM);
+    float uR = coordFromUnit(rho / h, SCATTERING_R);
+
+    float rMu = r * mu;
+    float discriminant = rMu * rMu - r * r + BOTTOM * BOTTOM;
+    float uMu;
+    if (isGround)
+    {
+        float d = -rMu - safeSqrt(discriminant);
+        float dMin = r - BOTTOM;
+        float dMax = rho;
+        uMu = 0.5 - 0.5 * coordFromUnit(dMax == dMin ? 0.0 : (d - dMin) / (dMax - dMin), SCATTERING_MU / 2);
+    }
+    else
+    {
+        float d = -rMu + safeSqrt(discriminant + h * h);
+        float dMin = TOP - r;
+        float dMax = rho + h;
+        uMu = 0.5 + 0.5 * coordFromUnit((d - dMin) / (dMax - dMin), SCATTERING_MU / 2);
+    }
+
+    float dMin = TOP - BOTTOM;
+    float dMax = h;
+    float a = (distanceToTop(BOTTOM, muS) - dMin) / (dMax - dMin);
+    float farthest = (distanceToTop(BOTTOM, MU_S_MIN) - dMin) / (dMax - dMin);
+    float uMuS = coordFromUnit(max(1.0 - a / farthest, 0.0) / (1.0 + a), SCATTERING_MU_S);
+
+    float x = (nu + 1.0) / 2.0 * float(SCATTERING_NU - 1);
+    float column = floor(x);
+    vec4 first = texture(scatteringTable, vec3((column + uMuS) / float(SCATTERING_NU), uMu, uR));
+    vec4 second = texture(scatteringTable, vec3((column + 1.0 + uMuS) / float(SCATTERING_NU), uMu, uR));
+    return mix(first, second, x - column);
+}
+
+float rayleighPhase(float nu)
+{
+    return 3.0 / (16.0 * PI) * (1.0 + nu * nu);
+}
+
+float miePhase(float nu)
+{
+    float g2 = MIE_G * MIE_G;
+    return 3.0 / (8.0 * PI) * (1.0 - g2) / (2.0 + g2) * (1.0 + nu * nu) /
+        pow(1.0 + g2 - 2.0 * MIE_G * nu, 1.5);
+}
+
+// Rayleigh in rgb, Mie in the second, which the table only holds the red
+// of: the two scatter alike but for their coefficients
+void scattering(float r, float mu, float muS, float nu, bool isGround, out vec3 rayleigh, out vec3 mie)
+{
+    vec4 texel = scatteringTexel(r, mu, muS, nu, isGround);
+    rayleigh = texel.rgb;
+    mie = texel.r < 1e-6 ? vec3(0.0) : texel.rgb * texel.a / texel.r *
+        (RAYLEIGH_SCATTERING.r / MIE_SCATTERING.r) * (MIE_SCATTERING / RAYLEIGH_SCATTERING);
+}
+
+// area of the overlap of two discs of radii a and b, d apart
+float discOverlap(float a, float b, float d)
+{
+    if (d >= a + b)
+        return 0.0;
+    if (d <= abs(a - b))
+        return 3.14159265 * min(a, b) * min(a, b);
+    float alpha = acos(clamp((d * d + a * a - b * b) / (2.0 * d * a), -1.0, 1.0));
+    float beta = acos(clamp((d * d + b * b - a * a) / (2.0 * d * b), -1.0, 1.0));
+    return a * a * (alpha - 0.5 * sin(2.0 * alpha)) + b * b * (beta - 0.5 * sin(2.0 * beta));
+}
+
+// sunlight() of fragment.glsl without the earth: the fraction of the sun's
+// disc the moon and bodies leave visible from point, in world space
+float sunlight(vec3 point)
+{
+    vec3 toSun = light - point;
+    float sunDistance = length(toSun);
+    float sunAngle = asin(min(sunRadius / sunDistance, 1.0));
+    float visible = 1.0;
+    for (int i = 1; i < occluderCount; i++)
+    {
+        vec3 toOccluder = occluders[i].xyz - point;
+        float along = dot(toOccluder, toSun);
+        float occluderDistance = length(toOccluder);
+        if (along <= 0.0 || occluderDistance > sunDistance)
+            continue;
+        float occluderAngle = asin(min(occluders[i].w / occluderDistance, 1.0));
+        float separation = atan(length(cross(toOccluder, toSun)), along);
+        float hidden = discOverlap(sunAngle, occluderAngle, separation) / (3.14159265 * sunAngle * sunAngle);
+        visible *= 1.0 - min(hidden, 1.0);
+    }
+    return visible;
+}
+
+// light scattered towards camera along the ray from it up to rayLength
+// (out of the atmosphere if the ray misses the ground), with transmittance
+// receiving that of the same stretch; camera relative to the earth's centre
+vec3 skyRadiance(vec3 camera, vec3 ray, float rayLength, vec3 sun, out vec3 transmittance)
+{
+    // from outside, the ray starts where it enters the atmosphere
+    float r = length(camera);
+    float rMu = dot(camera, ray);
+    float entry = -rMu - safeSqrt(rMu * rMu - r * r + TOP * TOP);
+    if (entry > 0.0)
+    {
+        camera += ray * entry;
+        rayLength -= entry;
+        r = TOP;
+        rMu += entry;
+    }
+    else if (r > TOP)
+    {
+        transmittance = vec3(1.0);
+        return vec3(0.0);
+    }
+
+    float mu = rMu / r;
+    float muS = dot(camera, sun) / r;
+    float nu = dot(ray, sun);
+    bool isGround = intersectsGround(r, mu);
+    vec3 rayleigh, mie;
+    scattering(r, mu, muS, nu, isGround, rayleigh, mie);
+
+    // up to a point short of the ray's end, less what that point gathers
+    // from beyond it
+    if (isGround || rayLength < distanceToTop(r, mu))
+    {
+        transmittance = transmittanceBetween(r, mu, rayLength, isGround);
+        float rP = clamp(sqrt(rayLength * rayLength + 2.0 * r * mu * rayLength + r * r), BOTTOM, TOP);
+        float muP = clamp((r * mu + rayLength) / rP, -1.0, 1.0);
+        float muSP = clamp((r * muS + rayLength * nu) / rP, -1.0, 1.0);
+        vec3 rayleighP, mieP;
+        scattering(rP, muP, muSP, nu, isGround, rayleighP, mieP);
+        rayleigh = max(rayleigh - transmittance * rayleighP, vec3(0.0));
+        mie = max(mie - transmittance * mieP, vec3(0.0));
+
+        // the difference of two large Mie values is unreliable with the
+        // sun below the horizon, so it fades out there
+        mie *= smoothstep(0.0, 0.01, muS);
+    }
+    else
+    {
+        transmittance = transmittanceToTop(r, mu);
+    }
+    return rayleigh * rayleighPhase(nu) + mie * miePhase(nu);
+}
+
+void main(void)
+{
+    vec3 camera = (eye - earthCentre) * kmPerUnit;
+    vec3 shell = (Position - earthCentre) * kmPerUnit;
+    vec3 ray = normalize(shell - camera);
+    vec3 sun = normalize(light - earthCentre);
+
+    // only one side of the shell is drawn, whichever way its triangles wind
+    bool isNearSide = dot(shell, ray) < 0.0;
+    if (isNearSide == isFarSide)
+        discard;
+
+    // up to the ground if the ray hits it, else through the atmosphere
+    float rMu = dot(camera, ray);
+    float discriminant = rMu * rMu - dot(camera, camera) + BOTTOM * BOTTOM;
+    float ground = discriminant >= 0.0 ? -rMu - sqrt(discriminant) : -1.0;
+    float rayLength = ground > 0.0 ? ground : 1e9;
+
+    vec3 transmittance;
+    vec3 radiance = skyRadiance(camera, ray, rayLength, sun, transmittance);
+
+    // in an eclipse the air is lit as much as the sun shows at the ray's
+    // lowest point, where most of its light is scattered; without this the
+    // sky would fill the moon's shadow on the ground back in
+    float lowest = ground > 0.0 ? ground : max(-rMu, 0.0);
+    radiance *= sunlight(earthCentre + (camera + ray * lowest) / kmPerUnit);
+    FragmentColour = vec4(radiance * sunIntensity, 1.0);
+    FragmentTransmittance = vec4(transmittance, 1.0);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include "assetpack.h"
+
+// Precomputed scattering of the earth's atmosphere, after Bruneton and
+// Neyret's "Precomputed Atmospheric Scattering" (in its 2017 revision):
+// the light a ray gathers through the atmosphere depends only on the
+// height it starts at and its angles to the zenith and the sun, so it is
+// integrated once, into tables that atmosphere.glsl looks up instead of
+// marching rays per pixel. Distances are in kilometres; the ground is a
+// sphere of ATMOSPHERE_BOTTOM and the atmosphere ends at ATMOSPHERE_TOP.
+// Only single scattering is tabulated, of a white sun of irradiance 1.
+const float ATMOSPHERE_BOTTOM = 6360.0f;
+const float ATMOSPHERE_TOP = 6420.0f;
+
+// the table sizes and the lookups' parameterization are mirrored in
+// atmosphere.glsl
+const int TRANSMITTANCE_WIDTH = 256;    // cosine of the view zenith angle
+const int TRANSMITTANCE_HEIGHT = 64;    // height
+const int SCATTERING_R = 32;            // height
+const int SCATTERING_MU = 128;          // view zenith, half for rays hitting the ground
+const int SCATTERING_MU_S = 32;         // sun zenith
+const int SCATTERING_NU = 8;            // angle between the view and the sun
+
+// Atmosphere table file: a header, then the transmittance table's RGB
+// floats, then the scattering table's RGBA floats, in the layouts of
+// AtmosphereTables.
+const unsigned int ATMOSPHERE_FILE_VERSION = 1;
+
+struct AtmosphereFileHeader
+{
+   char magic[4];                   // "ATMO"
+   unsigned int version;            // ATMOSPHERE_FILE_VERSION
+   unsigned int transmittanceSize;  // TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT
+   unsigned int scatteringSize[4];  // SCATTERING_NU, _MU_S, _MU, _R
+};
+
+struct AtmosphereTables
+{
+   // transmittance from a height to the top of the atmosphere, RGB,
+   // TRANSMITTANCE_WIDTH by TRANSMITTANCE_HEIGHT
+   std::vector<float> transmittance;
+
+   // light scattered once towards a point from along a ray, Rayleigh in
+   // RGB and Mie's red in A (the shader extrapolates Mie's green and blue
+   // from it), without the phase functions; a 3D texture SCATTERING_NU *
+   // SCATTERING_MU_S wide, SCATTERING_MU high and SCATTERING_R deep
+   std::vector<float> scattering;
+};
+
+// integrates both tables, the scattering as jobs over its rows
+void ComputeAtmosphereTables(AtmosphereTables* tables);
+
+// writes a table file, returning true if successful
+bool WriteAtmosphereFile(const char* filename, const AtmosphereTables& tables);
+
+// reads a table file, from the asset pack if it is packed there (assets
+// may be null), returning false if it is missing or of other table sizes
+// or versions
+bool ReadAtmosphereFile(const char* filename, const AssetPack* assets, AtmosphereTables* tables);
@@ -0,0 +1,19 @@
+// ==========================================================================
+// Vertex program for the earth's atmosphere: the sphere mesh, scaled to
+// the top of the atmosphere, passing on world positions for atmosphere.glsl
+// to cast rays through
+// ==========================================================================
+#version 410
+
+layout(location = 0) in vec3 VertexPosition;
+
+out vec3 Position; // Position in world space.
+
+uniform mat4 model;
+uniform mat4 mvp;           // proj*view*model, from the CPU per draw
+
+void main()
+{
+    Position = (model * vec4(VertexPosition, 1.0)).xyz;
+    gl_Position = mvp * vec4(VertexPosition, 1.0);
+}
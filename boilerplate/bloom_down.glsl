@@ -0,0 +1,44 @@
+// ==========================================================================
+// Fragment program for the bloom's downsampling passes (dual Kawase): each
+// pixel of the half size level averages five bilinear taps of the level
+// above, its centre and its four diagonal corners, which together cover
+// the 4x4 source texels around it. The first pass reads the HDR target and
+// keeps only what is brighter than the threshold.
+// ==========================================================================
+#version 410
+
+in vec2 UV;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;      // 1 / the source's size
+uniform bool isPrefilter;      // the first pass, from the HDR target
+uniform float threshold;       // brightness where bloom is at full strength
+uniform float knee;            // below the threshold, over which it eases in
+
+out vec4 FragmentColour;
+
+// the part of colour over the threshold, with a quadratic soft knee so
+// bloom grows in smoothly instead of switching on
+vec3 brightPart(vec3 colour)
+{
+    float brightness = max(colour.r, max(colour.g, colour.b));
+    float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+    soft = soft * soft / (4.0 * knee + 1e-4);
+    float contribution = max(soft, brightness - threshold) / max(brightness, 1e-4);
+    return colour * contribution;
+}
+
+void main(void)
+{
+    vec3 sum = texture(source, UV).rgb * 4.0;
+    sum += texture(source, UV + vec2(-1.0, -1.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2( 1.0, -1.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2(-1.0,  1.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2( 1.0,  1.0) * sourceTexel).rgb;
+    vec3 colour = sum / 8.0;
+
+    if (isPrefilter)
+        colour = brightPart(colour);
+
+    FragmentColour = vec4(colour, 1.0);
+}
@@ -0,0 +1,29 @@
+// ==========================================================================
+// Fragment program for the bloom's upsampling passes (dual Kawase): each
+// pixel of the twice as large level takes an eight tap tent of the level
+// below, added by blending to what the downsampling left there, so every
+// level carries the blur of all the coarser ones.
+// ==========================================================================
+#version 410
+
+in vec2 UV;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;      // 1 / the source's size
+
+out vec4 FragmentColour;
+
+void main(void)
+{
+    // edges a texel out at weight 1, diagonals half a texel out at 2
+    vec3 sum = texture(source, UV + vec2(-1.0, 0.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2(1.0, 0.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2(0.0, -1.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2(0.0, 1.0) * sourceTexel).rgb;
+    sum += texture(source, UV + vec2(-0.5, -0.5) * sourceTexel).rgb * 2.0;
+    sum += texture(source, UV + vec2(0.5, -0.5) * sourceTexel).rgb * 2.0;
+    sum += texture(source, UV + vec2(-0.5, 0.5) * sourceTexel).rgb * 2.0;
+    sum += texture(source, UV + vec2(0.5, 0.5) * sourceTexel).rgb * 2.0;
+
+    FragmentColour = vec4(sum / 12.0, 1.0);
+}
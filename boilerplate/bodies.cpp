@@ -0,0 +1,236 @@
+#include "bodies.h"
+#include "jobs.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static const float TWO_PI = 6.28318530718f;
+
+// bodies per job of the orbit update
+static const int UPDATE_GRAIN = 8192;
+
+// belt members get eccentricities up to this, enough to visibly cross paths
+static const float BELT_MAX_ECCENTRICITY = 0.1f;
+
+static float randomFloat(float lo, float hi)
+{
+   return lo + (hi - lo) * (rand() / float(RAND_MAX));
+}
+
+BodySystem::BodySystem()
+   : staticChanged_(false)
+   , time_(0.0)
+{}
+
+int BodySystem::addBody(int parentIndex, float bodyRadius, const OrbitalElements& orbit,
+   float spin, float axisTilt, int layer)
+{
+   if (parentIndex >= size())
+      return -1;
+
+   dvec3 p, q;
+   OrbitBasis(orbit, p, q);
+   double e = orbit.eccentricity;
+
+   parent.push_back(parentIndex);
+   radius.push_back(bodyRadius);
+   semiMajorAxis.push_back(orbit.semiMajorAxis);
+   semiMinorAxis.push_back(orbit.semiMajorAxis * std::sqrt(1.0 - e * e));
+   eccentricity.push_back(e);
+   meanMotion.push_back(orbit.meanMotion);
+   meanAnomalyAtEpoch.push_back(orbit.meanAnomalyAtEpoch);
+   px.push_back(p.x);
+   py.push_back(p.y);
+   pz.push_back(p.z);
+   qx.push_back(q.x);
+   qy.push_back(q.y);
+   qz.push_back(q.z);
+   spinRate.push_back(spin);
+   tilt.push_back(axisTilt);
+   textureLayer.push_back(layer);
+   x.push_back(0.0f);
+   y.push_back(0.0f);
+   z.push_back(0.0f);
+   spinAngle.push_back(0.0f);
+
+   meanAnomaly_.push_back(0.0);
+   E_.push_back(0.0);
+   sinE_.push_back(0.0);
+   cosE_.push_back(1.0);
+   worldX_.push_back(0.0);
+   worldY_.push_back(0.0);
+   worldZ_.push_back(0.0);
+
+   static_.push_back(vec4(bodyRadius, axisTilt, spin, float(layer)));
+   staticChanged_ = true;
+   return size() - 1;
+}
+
+void BodySystem::addBelt(int parentIndex, int count, float innerRadius, float outerRadius,
+   float maxInclination, float minSize, float maxSize, int layer)
+{
+   for (int i = 0; i < count; i++)
+   {
+      OrbitalElements orbit;
+      orbit.semiMajorAxis = randomFloat(innerRadius, outerRadius);
+      orbit.eccentricity = randomFloat(0.0f, BELT_MAX_ECCENTRICITY);
+      orbit.inclination = randomFloat(-maxInclination, maxInclination);
+      orbit.ascendingNode = randomFloat(0.0f, TWO_PI);
+      orbit.argPeriapsis = randomFloat(0.0f, TWO_PI);
+      orbit.meanAnomalyAtEpoch = randomFloat(0.0f, TWO_PI);
+
+      // Kepler's third law keeps the inner belt moving faster than the outer
+      orbit.meanMotion = 0.5 / std::pow(orbit.semiMajorAxis / innerRadius, 1.5);
+
+      int body = addBody(parentIndex, randomFloat(minSize, maxSize), orbit,
+         randomFloat(-2.0f, 2.0f), randomFloat(0.0f, 3.14159f), layer);
+      if (body < 0)
+         return;
+   }
+}
+
+bool BodySystem::loadFromFile(const char* filename)
+{
+   std::ifstream input(filename);
+   if (!input)
+   {
+      std::cout << "ERROR: Could not load bodies from file " << filename << std::endl;
+      return false;
+   }
+
+   std::string line;
+   int lineNumber = 0;
+   while (std::getline(input, line))
+   {
+      lineNumber++;
+      line = line.substr(0, line.find('#'));
+
+      std::istringstream fields(line);
+      std::string kind;
+      if (!(fields >> kind))
+         continue;
+
+      bool ok = false;
+      if (kind == "body")
+      {
+         int parentIndex, layer;
+         float bodyRadius, spinPeriod, axisTilt;
+         double distance, period, e, inclination, node, periapsis;
+         if (fields >> parentIndex >> bodyRadius >> distance >> period >> e >> inclination
+            >> node >> periapsis >> spinPeriod >> axisTilt >> layer && e >= 0.0 && e < 1.0)
+         {
+            OrbitalElements orbit = CircularOrbit(distance, period, radians(inclination), radians(node));
+            orbit.eccentricity = e;
+            orbit.argPeriapsis = radians(periapsis);
+            float spin = spinPeriod != 0.0f ? TWO_PI / spinPeriod : 0.0f;
+            ok = addBody(parentIndex, bodyRadius, orbit, spin, radians(axisTilt), layer) >= 0;
+         }
+      }
+      else if (kind == "belt")
+      {
+         int parentIndex, count, layer;
+         float inner, outer, maxInclination, minSize, maxSize;
+         if (fields >> parentIndex >> count >> inner >> outer >> maxInclination >> minSize >> maxSize >> layer)
+         {
+            addBelt(parentIndex, count, inner, outer, radians(maxInclination), minSize, maxSize, layer);
+            ok = parentIndex < size();
+         }
+      }
+
+      if (!ok)
+      {
+         std::cout << "ERROR: " << filename << ":" << lineNumber << ": could not read '" << line << "'" << std::endl;
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void BodySystem::clear()
+{
+   *this = BodySystem();
+}
+
+bool BodySystem::takeStaticChanged()
+{
+   bool changed = staticChanged_;
+   staticChanged_ = false;
+   return changed;
+}
+
+void BodySystem::update(double t)
+{
+   int count = size();
+   time_ = t;
+   if (count == 0)
+      return;
+
+   // every orbit is independent, so the solve and the position relative
+   // to the focus, a (cos E - e) p + b sin E q, run as parallel jobs. The
+   // solve starts from the last update's E, which a frame's step leaves
+   // one Newton step away; seeks and fast warps fall back to a fresh start.
+   ParallelFor("body orbits", count, UPDATE_GRAIN, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+         meanAnomaly_[i] = meanAnomalyAtEpoch[i] + meanMotion[i] * t;
+
+      RefineKeplerBatch(&meanAnomaly_[begin], &eccentricity[begin], &E_[begin], &sinE_[begin],
+         &cosE_[begin], end - begin);
+
+      for (int i = begin; i < end; i++)
+      {
+         double u = semiMajorAxis[i] * (cosE_[i] - eccentricity[i]);
+         double v = semiMinorAxis[i] * sinE_[i];
+         worldX_[i] = u * px[i] + v * qx[i];
+         worldY_[i] = u * py[i] + v * qy[i];
+         worldZ_[i] = u * pz[i] + v * qz[i];
+      }
+   });
+
+   // parents precede children, so one ordered pass makes positions world
+   for (int i = 0; i < count; i++)
+   {
+      int p = parent[i];
+      if (p >= 0)
+      {
+         worldX_[i] += worldX_[p];
+         worldY_[i] += worldY_[p];
+         worldZ_[i] += worldZ_[p];
+      }
+      x[i] = float(worldX_[i]);
+      y[i] = float(worldY_[i]);
+      z[i] = float(worldZ_[i]);
+   }
+}
+
+void BodySystem::updateSpins(double t)
+{
+   // TWO_PI in float would be off by enough to drift over many turns
+   const double turn = 6.28318530717958647692;
+   ParallelFor("body spins", size(), UPDATE_GRAIN, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+         double angle = double(spinRate[i]) * t;
+         spinAngle[i] = float(angle - turn * std::floor(angle / turn));
+      }
+   });
+}
+
+dvec3 BodySystem::getOrbitalVelocity(int i, double t, double mu) const
+{
+   double a = semiMajorAxis[i];
+   if (a <= 0.0 || mu <= 0.0)
+      return dvec3(0.0);
+
+   // d/dt of a (cos E - e) p + b sin E q, with dE/dt = n / (1 - e cos E)
+   double e = eccentricity[i];
+   double E = SolveKepler(meanAnomalyAtEpoch[i] + meanMotion[i] * t, e);
+   double n = std::sqrt(mu / (a * a * a));
+   double rate = (meanMotion[i] < 0.0 ? -n : n) / (1.0 - e * std::cos(E));
+   double u = -a * std::sin(E) * rate;
+   double v = semiMinorAxis[i] * std::cos(E) * rate;
+   return dvec3(u * px[i] + v * qx[i], u * py[i] + v * qy[i], u * pz[i] + v * qz[i]);
+}
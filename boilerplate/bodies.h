@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "kepler.h"
+
+using namespace glm;
+
+// Data-oriented store of orbiting bodies. Every property lives in its own
+// contiguous array indexed by body, so the per-frame update streams through
+// memory, and Kepler's equation is solved for all of them in one batch.
+// Orbits are evaluated directly at an absolute time in double precision,
+// so seeking and large time warps cost the same as a normal frame. Parents
+// always come before their children, so world positions resolve in the
+// same pass.
+class BodySystem{
+public:
+   // per-body properties, angles in radians and rates in radians per second
+   std::vector<int>   parent;        // index of the body orbited, -1 for the origin
+   std::vector<float> radius;
+   std::vector<double> semiMajorAxis;
+   std::vector<double> semiMinorAxis;
+   std::vector<double> eccentricity;
+   std::vector<double> meanMotion;
+   std::vector<double> meanAnomalyAtEpoch;
+   std::vector<double> px, py, pz;   // direction of periapsis
+   std::vector<double> qx, qy, qz;   // 90 degrees further along the orbit
+   std::vector<float> spinRate;
+   std::vector<float> tilt;          // spin axis tilt
+   std::vector<int>   textureLayer;
+
+   // world positions, updated by update()
+   std::vector<float> x, y, z;
+
+   // spin angles in [0, 2 pi), updated by updateSpins()
+   std::vector<float> spinAngle;
+
+   BodySystem();
+
+   // adds a body on the given orbit and returns its index, or -1 if the
+   // parent does not exist yet
+   int addBody(int parent, float radius, const OrbitalElements& orbit,
+      float spinRate = 0.0f, float tilt = 0.0f, int textureLayer = 0);
+
+   // adds count small bodies on random, slightly eccentric orbits between
+   // innerRadius and outerRadius around parent, inclined by up to maxInclination
+   void addBelt(int parent, int count, float innerRadius, float outerRadius,
+      float maxInclination, float minSize, float maxSize, int textureLayer = 0);
+
+   // reads bodies and belts from a text file, one per line:
+   //   body <parent> <radius> <semiMajorAxis> <orbitPeriod> <eccentricity> <inclination>
+   //        <node> <argPeriapsis> <spinPeriod> <tilt> <layer>
+   //   belt <parent> <count> <inner> <outer> <maxInclination> <minSize> <maxSize> <layer>
+   // periods are in seconds and angles in degrees, '#' starts a comment
+   bool loadFromFile(const char* filename);
+
+   void clear();
+   int size() const { return int(parent.size()); }
+
+   // evaluate every orbit at time t seconds and recompute world positions
+   void update(double t);
+
+   // spin every body to its angle at time t, reduced to one turn in double
+   // so it keeps its precision at large times
+   void updateSpins(double t);
+
+   // velocity of body i relative to its parent at time t, along its orbit
+   // but at the speed a parent of gravitational parameter mu (G M) gives,
+   // instead of the stored mean motion; starts gravity simulations
+   dvec3 getOrbitalVelocity(int i, double t, double mu) const;
+
+   // time of the last update
+   double getTime() const { return time_; }
+
+   // per-instance data that only changes when bodies are added, one vec4
+   // per body: (radius, tilt, spin rate, texture layer)
+   const std::vector<vec4>& getStaticInstances() const { return static_; }
+
+   // true once after bodies were added, so the static data can be re-uploaded
+   bool takeStaticChanged();
+
+private:
+   // the batched Kepler solve's inputs and its last solution, which the
+   // next update starts from
+   std::vector<double> meanAnomaly_, E_, sinE_, cosE_;
+   // world positions in double, so distant bodies keep their precision
+   // until the final conversion
+   std::vector<double> worldX_, worldY_, worldZ_;
+
+   std::vector<vec4> static_;
+   bool staticChanged_;
+   double time_;
+};
@@ -1,683 +1,2647 @@
-// ==========================================================================
-// Barebones OpenGL Core Profile Boilerplate
-//    using the GLFW windowing system (http://www.glfw.org)
-//
-// Loosely based on
-//  - Chris Wellons' example (https://github.com/skeeto/opengl-demo) and
-//  - Camilla Berglund's example (http://www.glfw.org/docs/latest/quick.html)
-//
-// Author:  Sonny Chan, University of Calgary
-// Date:    December 2015
-// ==========================================================================
-
-#include <iostream>
-#include <fstream>
-#include <algorithm>
-#include <string>
-#include <iterator>
-#include <vector>
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <cstdlib>
-#include <ctime>
-#include "camera.h"
-
-// Specify that we want the OpenGL core profile before including GLFW headers
-#ifdef _WIN32
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#else
-#include <glad/glad.h>
-#define GLFW_INCLUDE_GLCOREARB
-#define GL_GLEXT_PROTOTYPES
-#include <GLFW/glfw3.h>
-#endif
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
-#define _USE_MATH_DEFINES
-#include <math.h>
-
-using namespace glm;
-using namespace std;
-
-// --------------------------------------------------------------------------
-// OpenGL utility and support function prototypes
-
-void QueryGLVersion();
-bool CheckGLErrors();
-
-string LoadSource(const string &filename);
-GLuint CompileShader(GLenum shaderType, const string &source);
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
-
-Camera cam_;
-bool isPaused_ = false;
-
-// --------------------------------------------------------------------------
-// Functions to set up OpenGL shader programs for rendering
-
-struct MyShader
-{
-   // OpenGL names for vertex and fragment shaders, shader program
-   GLuint  vertex;
-   GLuint  fragment;
-   GLuint  program;
-
-   // initialize shader and program names to zero (OpenGL reserved value)
-   MyShader() : vertex(0), fragment(0), program(0)
-   {}
-};
-
-// load, compile, and link shaders, returning true if successful
-bool InitializeShaders(MyShader *shader)
-{
-   // load shader source from files
-   string vertexSource = LoadSource("vertex.glsl");
-   string fragmentSource = LoadSource("fragment.glsl");
-   if (vertexSource.empty() || fragmentSource.empty()) return false;
-
-   // compile shader source into shader objects
-   shader->vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
-   shader->fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
-
-   // link shader program
-   shader->program = LinkProgram(shader->vertex, shader->fragment);
-
-   // check for OpenGL errors and return false if error occurred
-   return !CheckGLErrors();
-}
-
-// deallocate shader-related objects
-void DestroyShaders(MyShader *shader)
-{
-   // unbind any shader programs and destroy shader objects
-   glUseProgram(0);
-   glDeleteProgram(shader->program);
-   glDeleteShader(shader->vertex);
-   glDeleteShader(shader->fragment);
-}
-
-// --------------------------------------------------------------------------
-// Functions to set up OpenGL buffers for storing textures
-
-struct MyTexture
-{
-   GLuint textureID;
-   GLuint target;
-   int width;
-   int height;
-
-   // initialize object names to zero (OpenGL reserved value)
-   MyTexture() : textureID(0), target(0), width(0), height(0)
-   {}
-};
-
-bool InitializeTexture(MyTexture* texture, const char* filename, GLuint target = GL_TEXTURE_2D)
-{
-   int numComponents;
-   stbi_set_flip_vertically_on_load(true);
-   unsigned char *data = stbi_load(filename, &texture->width, &texture->height, &numComponents, 0);
-   if (data != nullptr)
-   {
-      texture->target = target;
-      glGenTextures(1, &texture->textureID);
-      glBindTexture(texture->target, texture->textureID);
-      GLuint format = GL_RGB;
-      switch (numComponents)
-      {
-      case 4:
-         format = GL_RGBA;
-         break;
-      case 3:
-         format = GL_RGB;
-         break;
-      case 2:
-         format = GL_RG;
-         break;
-      case 1:
-         format = GL_RED;
-         break;
-      default:
-         cout << "Invalid Texture Format" << endl;
-         break;
-      };
-      glTexImage2D(texture->target, 0, format, texture->width, texture->height, 0, format, GL_UNSIGNED_BYTE, data);
-
-      // Note: Only wrapping modes supported for GL_TEXTURE_RECTANGLE when defining
-      // GL_TEXTURE_WRAP are GL_CLAMP_TO_EDGE or GL_CLAMP_TO_BORDER
-      glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-      // Clean up
-      glBindTexture(texture->target, 0);
-      stbi_image_free(data);
-      return !CheckGLErrors();
-   }
-   return true; //error
-}
-
-// deallocate texture-related objects
-void DestroyTexture(MyTexture *texture)
-{
-   glBindTexture(texture->target, 0);
-   glDeleteTextures(1, &texture->textureID);
-}
-
-// --------------------------------------------------------------------------
-// Functions to set up OpenGL buffers for storing geometry data
-
-struct MyGeometry
-{
-   // OpenGL names for array buffer objects, vertex array object
-   GLuint  vertexBuffer;
-   GLuint  textureBuffer;
-   GLuint  elementBuffer;
-   GLuint  normalBuffer;
-   GLuint  vertexArray;
-   GLsizei elementCount;
-
-   // initialize object names to zero (OpenGL reserved value)
-   MyGeometry() : vertexBuffer(0), elementBuffer(0), normalBuffer(0), vertexArray(0), elementCount(0)
-   {}
-};
-
-void generateSphere(vector<vec3>& points, vector<vec3>& normals,
-   vector<unsigned int>& indices, float r, int uDivisions, int vDivisions)
-{
-   float uStep = 1.f / (float)(uDivisions - 1);
-   float vStep = 1.f / (float)(vDivisions - 1);
-
-   float u = 0.f;
-   vec3 center = vec3(0.0f);
-
-   // Traversing u
-   for (int i = 0; i < uDivisions; i++)
-   {
-      // Traversing v
-      float v = 0.f;
-      for (int j = 0; j < vDivisions; j++)
-      {
-         vec3 pos = vec3(r * sin(2.0f * M_PI * u) * cos(2.0f * M_PI * v),
-            r * cos(2.0f * M_PI * u) * cos(2.0f * M_PI * v),
-            r * sin(2.0f * M_PI * v));
-
-         vec3 normal = normalize(pos - center);
-
-         points.push_back(pos);
-         normals.push_back(normal);
-         v += vStep;
-      }
-
-      u += uStep;
-   }
- 
-   for (int i = 0; i < uDivisions - 1; i++)
-   {
-      for (int j = 0; j < vDivisions - 1; j++)
-      {
-         unsigned int p00 = i*vDivisions + j;
-         unsigned int p01 = i*vDivisions + j + 1;
-         unsigned int p10 = (i + 1)* vDivisions + j;
-         unsigned int p11 = (i + 1) * vDivisions + j + 1;
-
-         indices.push_back(p00);
-         indices.push_back(p10);
-         indices.push_back(p01);
-
-         indices.push_back(p01);
-         indices.push_back(p10);
-         indices.push_back(p11);
-      }
-   }
-}
-
-// create buffers and fill with geometry data, returning true if successful
-bool InitializeGeometry(MyGeometry *geometry)
-{
-   vector<vec3> points;
-   vector<vec3> normals;
-   vector<unsigned int> indices;
-
-   generateSphere(points, normals, indices, 1.0f, 200, 100);
-
-   geometry->elementCount = indices.size();
-
-   // these vertex attribute indices correspond to those specified for the
-   // input variables in the vertex shader
-   const GLuint VERTEX_INDEX = 0;
-   const GLuint NORMAL_INDEX = 1;
-
-   // create an array buffer object for storing our vertices
-   glGenBuffers(1, &geometry->vertexBuffer);
-   glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-   glBufferData(GL_ARRAY_BUFFER, sizeof(vec3)*points.size(), points.data(), GL_STATIC_DRAW);
-
-   //Buffer the vertex normals
-   glGenBuffers(1, &geometry->normalBuffer);
-   glBindBuffer(GL_ARRAY_BUFFER, geometry->normalBuffer);
-   glBufferData(GL_ARRAY_BUFFER, sizeof(vec3)*normals.size(), normals.data(), GL_STATIC_DRAW);
-
-   // create a vertex array object encapsulating all our vertex attributes
-   glGenVertexArrays(1, &geometry->vertexArray);
-   glBindVertexArray(geometry->vertexArray);
-
-   // make element array buffer
-   glGenBuffers(1, &geometry->elementBuffer);
-   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBuffer);
-   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
-
-   // associate the position array with the vertex array object
-   glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-   glVertexAttribPointer(VERTEX_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-   glEnableVertexAttribArray(VERTEX_INDEX);
-
-   // Normal Buffer
-   glBindBuffer(GL_ARRAY_BUFFER, geometry->normalBuffer);
-   glVertexAttribPointer(NORMAL_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-   glEnableVertexAttribArray(NORMAL_INDEX);
-
-   // unbind our buffers, resetting to default state
-   glBindBuffer(GL_ARRAY_BUFFER, 0);
-   glBindVertexArray(0);
-
-   // check for OpenGL errors and return false if error occurred
-   return !CheckGLErrors();
-}
-
-// deallocate geometry-related objects
-void DestroyGeometry(MyGeometry *geometry)
-{
-   // unbind and destroy our vertex array object and associated buffers
-   glBindVertexArray(0);
-   glDeleteVertexArrays(1, &geometry->vertexArray);
-   glDeleteBuffers(1, &geometry->vertexBuffer);
-   glDeleteBuffers(1, &geometry->normalBuffer);
-   glDeleteBuffers(1, &geometry->elementBuffer);
-   glDeleteBuffers(1, &geometry->textureBuffer);
-}
-
-// --------------------------------------------------------------------------
-// Rendering function that draws our scene to the frame buffer
-
-void RenderScene(MyGeometry *geometry, MyShader *shader, MyTexture* texture, 
-   mat4 proj, mat4 view, mat4 model, vec3 light, bool isShaded)
-{
-   // bind our shader program and the vertex array object
-   glBindTexture(texture->target, texture->textureID);
-   glUseProgram(shader->program);
-   glBindVertexArray(geometry->vertexArray);
-
-   // Get uniforms
-   GLint modelUniform = glGetUniformLocation(shader->program, "model");
-   GLint viewUniform = glGetUniformLocation(shader->program, "view");
-   GLint projUniform = glGetUniformLocation(shader->program, "proj");
-   GLint lightUniform = glGetUniformLocation(shader->program, "light");
-   GLint isShadedUniform = glGetUniformLocation(shader->program, "isShaded");
-
-   glUniformMatrix4fv(modelUniform, 1, false, value_ptr(model));
-   glUniformMatrix4fv(viewUniform, 1, false, value_ptr(view));
-   glUniformMatrix4fv(projUniform, 1, false, value_ptr(proj));
-   glUniform3fv(lightUniform, 1, value_ptr(light));
-   glUniform1i(isShadedUniform, isShaded);
-
-   // tell OpenGL to draw our geometry
-   glDrawElements(GL_TRIANGLES, geometry->elementCount, GL_UNSIGNED_INT, 0);
-
-   // reset state to default (no shader or geometry bound)
-   glBindTexture(texture->target, 0);
-   glBindVertexArray(0);
-   glUseProgram(0);
-
-   // check for an report any OpenGL errors
-   CheckGLErrors();
-}
-
-// --------------------------------------------------------------------------
-// GLFW callback functions
-
-// reports GLFW errors
-void ErrorCallback(int error, const char* description)
-{
-   cout << "GLFW ERROR " << error << ":" << endl;
-   cout << description << endl;
-}
-
-// handles keyboard input events
-void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-   float move = 0.1f;
-   float angle = 5.0f;
-
-   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-   {
-      glfwSetWindowShouldClose(window, GL_TRUE);
-   }
-   else if (key == GLFW_KEY_E)
-   {
-      cam_.pos -= cam_.dir * move;
-   }
-   else if (key == GLFW_KEY_Q)
-   {
-      cam_.pos += cam_.dir * move;
-   }
-   else if (key == GLFW_KEY_D)
-   {
-      cam_.cameraRotation(radians(angle), 0.0f);
-   }
-   else if (key == GLFW_KEY_A)
-   {
-      cam_.cameraRotation(-radians(angle), 0.0f);
-   }
-   else if (key == GLFW_KEY_W)
-   {
-      cam_.cameraRotation(0.0f, radians(angle));
-   }
-   else if (key == GLFW_KEY_S)
-   {
-      cam_.cameraRotation(0.0f, -radians(angle));
-   }
-   else if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
-   {
-      isPaused_ = !isPaused_;
-   }
-}
-
-void timeStep(double& lastTime, double& accumulator)
-{
-   double now = glfwGetTime();
-   double delta = now - lastTime;
-   lastTime = now;
-   accumulator += delta;
-
-   while (accumulator >= (1. / 60.))
-   {
-      accumulator -= (1. / 60.);
-   }
-}
-
-// ==========================================================================
-// PROGRAM ENTRY POINT
-
-int main(int argc, char *argv[])
-{
-   // initialize the GLFW windowing system
-   if (!glfwInit()) {
-      cout << "ERROR: GLFW failed to initialize, TERMINATING" << endl;
-      return -1;
-   }
-   glfwSetErrorCallback(ErrorCallback);
-
-   // attempt to create a window with an OpenGL 4.1 core profile context
-   GLFWwindow *window = 0;
-   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-   window = glfwCreateWindow(512, 512, "CPSC 453 OpenGL Assignment 5", 0, 0);
-   if (!window) {
-      cout << "Program failed to create GLFW window, TERMINATING" << endl;
-      glfwTerminate();
-      return -1;
-   }
-
-   // set keyboard callback function and make our context current (active)
-   glfwSetKeyCallback(window, KeyCallback);
-   glfwMakeContextCurrent(window);
-
-   //Intialize GLAD
-   if (!gladLoadGL())
-   {
-      cout << "GLAD init failed" << endl;
-      return -1;
-   }
-
-   // query and print out information about our OpenGL environment
-   QueryGLVersion();
-
-   // call function to load and compile shader programs
-   MyShader shader;
-   if (!InitializeShaders(&shader)) {
-      cout << "Program could not initialize shaders, TERMINATING" << endl;
-      return -1;
-   }
-
-   // call function to create and fill buffers with geometry data
-   MyGeometry geometry;
-   if (!InitializeGeometry(&geometry)) {
-      cout << "Program failed to intialize geometry!" << endl;   
-      return -1;
-   }
-
-   // Load textures
-   MyTexture sunTexture;
-   InitializeTexture(&sunTexture, "textures/texture_sun.jpg");
-   MyTexture earthTexture;
-   InitializeTexture(&earthTexture, "textures/texture_earth_surface.jpg");
-   MyTexture moonTexture;
-   InitializeTexture(&moonTexture, "textures/texture_moon.jpg");
-   MyTexture galaxyTexture;
-   InitializeTexture(&galaxyTexture, "textures/stars_milkyway.jpg");
-
-   // Enable Depth Testing
-   glEnable(GL_DEPTH_TEST);
-
-   // Setup Camera
-   mat4  I(1.0f);
-   cam_ = Camera(vec3(0.f, 1.f, -1.f), vec3(0.f, 10.f, -10.f));
-
-   // make a projection matrix   
-   mat4 proj = perspective(radians(80.0f), 1.0f, 0.1f, 1000.0f);
-
-   // Angles
-   float earthAxis = radians(23.f);
-   float moonAxis = radians(6.68f);
-   float moonInclination = radians(6.68f);
-   float sunAngle = 0.f;
-   float earthAngle = 0.f;
-   float moonAngle = 0.f;
-   float earthOrbit = 0.f;
-   float moonOrbit = 0.f;
-
-   // run an event-triggered main loop
-   while (!glfwWindowShouldClose(window))
-   {
-      // clear screen to a dark grey colour
-      glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-      glEnable(GL_DEPTH_TEST);
-      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-      glUseProgram(shader.program);
-
-      // make a view matrix
-      mat4 view = cam_.getViewMatrix();
-
-      
-      if (!isPaused_)
-      {
-         sunAngle += radians(0.24f);
-         earthAngle += radians(0.1f);
-         moonAngle += radians(0.22f);
-         earthOrbit -= radians(0.22f);
-         moonOrbit += radians(0.2f);
-      }
-
-      // Setup Models
-      mat4 sunModel = translate(I, vec3(0.0f)) * 
-         rotate(I, sunAngle, vec3(0, 1, 0));
-
-      mat4 earthModel = scale(sunModel, vec3(0.65f, 0.65f, 0.65f)) *
-         rotate(I, earthOrbit, vec3(0, 1, 0)) *
-         translate(I, vec3(12.0f, 0.0f, 0.0f)) *
-         rotate(I, earthAxis, vec3(1, 0, 0)) *
-         rotate(I, earthAngle, vec3(0, 1, 0));
-
-      vec4 earthUpVec = earthModel * vec4(0, 1, 0, 0);
-      vec3 earthUp = vec3(earthUpVec.x, earthUpVec.y, earthUpVec.z);
-
-      mat4 moonModel = scale(earthModel, vec3(0.5f, 0.5f, 0.5f)) *
-         translate(earthModel, vec3(0.0f, 0.0f, 0.0f)) *
-         rotate(I, moonOrbit, earthUp) *
-         rotate(I, earthAxis, vec3(0, 1, 0)) *
-         rotate(I, moonAngle, vec3(0, 1, 0));
-
-      mat4 galaxyModel = translate(I, vec3(0.0f)) *
-         scale(I, vec3(50.f, 50.f, 50.f));
-
-      // Sun 
-      RenderScene(&geometry, &shader, &sunTexture, proj, view, sunModel, vec3(0.0f), false);
-
-      // Earth
-      RenderScene(&geometry, &shader, &earthTexture, proj, view, earthModel, vec3(0.0f), true);
-
-      // Moon
-      RenderScene(&geometry, &shader, &moonTexture, proj, view, moonModel, vec3(0.0f), true);
-
-      // Galaxy
-      RenderScene(&geometry, &shader, &galaxyTexture, proj, view, galaxyModel, vec3(0.0f), false);
-
-      // Timing
-      double lastTime = 0.0;
-      double accumulator = 0.0;
-      timeStep(lastTime, accumulator);
-
-      glfwSwapBuffers(window);
-      glfwPollEvents();
-   }
-
-   // clean up allocated resources before exit
-   DestroyGeometry(&geometry);
-   DestroyShaders(&shader);
-   glfwDestroyWindow(window);
-   glfwTerminate();
-
-   cout << "Goodbye!" << endl;
-   return 0;
-}
-
-// ==========================================================================
-// SUPPORT FUNCTION DEFINITIONS
-
-// --------------------------------------------------------------------------
-// OpenGL utility functions
-
-void QueryGLVersion()
-{
-   // query opengl version and renderer information
-   string version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
-   string glslver = reinterpret_cast<const char *>(glGetString(GL_SHADING_LANGUAGE_VERSION));
-   string renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
-
-   cout << "OpenGL [ " << version << " ] "
-      << "with GLSL [ " << glslver << " ] "
-      << "on renderer [ " << renderer << " ]" << endl;
-}
-
-bool CheckGLErrors()
-{
-   bool error = false;
-   for (GLenum flag = glGetError(); flag != GL_NO_ERROR; flag = glGetError())
-   {
-      cout << "OpenGL ERROR:  ";
-      switch (flag) {
-      case GL_INVALID_ENUM:
-         cout << "GL_INVALID_ENUM" << endl; break;
-      case GL_INVALID_VALUE:
-         cout << "GL_INVALID_VALUE" << endl; break;
-      case GL_INVALID_OPERATION:
-         cout << "GL_INVALID_OPERATION" << endl; break;
-      case GL_INVALID_FRAMEBUFFER_OPERATION:
-         cout << "GL_INVALID_FRAMEBUFFER_OPERATION" << endl; break;
-      case GL_OUT_OF_MEMORY:
-         cout << "GL_OUT_OF_MEMORY" << endl; break;
-      default:
-         cout << "[unknown error code]" << endl;
-      }
-      error = true;
-   }
-   return error;
-}
-
-// --------------------------------------------------------------------------
-// OpenGL shader support functions
-
-// reads a text file with the given name into a string
-string LoadSource(const string &filename)
-{
-   string source;
-
-   ifstream input(filename.c_str());
-   if (input) {
-      copy(istreambuf_iterator<char>(input),
-         istreambuf_iterator<char>(),
-         back_inserter(source));
-      input.close();
-   }
-   else {
-      cout << "ERROR: Could not load shader source from file "
-         << filename << endl;
-   }
-
-   return source;
-}
-
-// creates and returns a shader object compiled from the given source
-GLuint CompileShader(GLenum shaderType, const string &source)
-{
-   // allocate shader object name
-   GLuint shaderObject = glCreateShader(shaderType);
-
-   // try compiling the source as a shader of the given type
-   const GLchar *source_ptr = source.c_str();
-   glShaderSource(shaderObject, 1, &source_ptr, 0);
-   glCompileShader(shaderObject);
-
-   // retrieve compile status
-   GLint status;
-   glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &status);
-   if (status == GL_FALSE)
-   {
-      GLint length;
-      glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
-      string info(length, ' ');
-      glGetShaderInfoLog(shaderObject, info.length(), &length, &info[0]);
-      cout << "ERROR compiling shader:" << endl << endl;
-      cout << source << endl;
-      cout << info << endl;
-   }
-
-   return shaderObject;
-}
-
-// creates and returns a program object linked from vertex and fragment shaders
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
-{
-   // allocate program object name
-   GLuint programObject = glCreateProgram();
-
-   // attach provided shader objects to this program
-   if (vertexShader)   glAttachShader(programObject, vertexShader);
-   if (fragmentShader) glAttachShader(programObject, fragmentShader);
-
-   // try linking the program with given attachments
-   glLinkProgram(programObject);
-
-   // retrieve link status
-   GLint status;
-   glGetProgramiv(programObject, GL_LINK_STATUS, &status);
-   if (status == GL_FALSE)
-   {
-      GLint length;
-      glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
-      string info(length, ' ');
-      glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
-      cout << "ERROR linking shader program:" << endl;
-      cout << info << endl;
-   }
-
-   return programObject;
+// ==========================================================================
+// Barebones OpenGL Core Profile Boilerplate
+//    using the GLFW windowing system (http://www.glfw.org)
+//
+// Loosely based on
+//  - Chris Wellons' example (https://github.com/skeeto/opengl-demo) and
+//  - Camilla Berglund's example (http://www.glfw.org/docs/latest/quick.html)
+//
+// Author:  Sonny Chan, University of Calgary
+// Date:    December 2015
+// ==========================================================================
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/intersect.hpp>
+#include <cstdlib>
+#include <cfloat>
+#include <ctime>
+#include <cstdio>
+#include "camera.h"
+#include "scenegraph.h"
+#include "transformbatch.h"
+#include "bodies.h"
+#include "nbody.h"
+#include "jobs.h"
+#include "simulation.h"
+#include "bvh.h"
+#include "meshfile.h"
+#include "assetpack.h"
+#include "meshgen.h"
+#include "terrain.h"
+#include "virtualtexture.h"
+#include "texturemanager.h"
+#include "jpegdecode.h"
+#include "resample.h"
+#include "atmosphere.h"
+
+// Specify that we want the OpenGL core profile before including GLFW headers
+#ifdef _WIN32
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#else
+#include <glad/glad.h>
+#define GLFW_INCLUDE_GLCOREARB
+#define GL_GLEXT_PROTOTYPES
+#include <GLFW/glfw3.h>
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+using namespace glm;
+using namespace std;
+
+// --------------------------------------------------------------------------
+// OpenGL utility and support function prototypes
+
+void QueryGLVersion();
+bool CheckGLErrors();
+
+string LoadSource(const string &filename);
+GLuint CompileShader(GLenum shaderType, const string &source);
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader,
+   GLuint tessControlShader = 0, GLuint tessEvalShader = 0);
+
+// how the planet spheres are drawn
+enum SphereMode
+{
+   SPHERE_MESH,         // indexed 200x100 grid from GenerateUVSphere()
+   SPHERE_PROCEDURAL,   // bufferless grid rebuilt from gl_VertexID
+   SPHERE_TESSELLATED,  // icosahedron patches refined by the tessellator
+   SPHERE_MODE_COUNT
+};
+
+Simulation* simulation_ = 0;  // receives the keys that drive the simulation
+SphereMode sphereMode_ = SPHERE_MESH;
+bool isTerrain_ = true;          // the earth drawn as terrain, not a sphere
+bool isFollowingEarth_ = false;  // the camera orbits the earth, not the sun
+bool isVirtualTexture_ = true;   // the earth's imagery from its virtual texture
+bool isBloom_ = true;            // the sun's glow spread by the bloom passes
+bool isPickRequested_ = false;  // left click not yet picked, at pickCursor_
+dvec2 pickCursor_;
+const AssetPack* assets_ = 0;    // shaders and images, if they are packed
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL shader programs for rendering
+
+struct MyShader
+{
+   // OpenGL names for vertex and fragment shaders, shader program
+   GLuint  vertex;
+   GLuint  fragment;
+   GLuint  program;
+
+   // optional tessellation stages
+   GLuint  tessControl;
+   GLuint  tessEval;
+
+   // initialize shader and program names to zero (OpenGL reserved value)
+   MyShader() : vertex(0), fragment(0), program(0), tessControl(0), tessEval(0)
+   {}
+};
+
+// load, compile, and link shaders, returning true if successful
+bool InitializeShaders(MyShader *shader, const string& vertexFile = "vertex.glsl",
+   const string& fragmentFile = "fragment.glsl")
+{
+   // load shader source from files
+   string vertexSource = LoadSource(vertexFile);
+   string fragmentSource = LoadSource(fragmentFile);
+   if (vertexSource.empty() || fragmentSource.empty()) return false;
+
+   // compile shader source into shader objects
+   shader->vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
+   shader->fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+   // link shader program
+   shader->program = LinkProgram(shader->vertex, shader->fragment);
+
+   // check for OpenGL errors and return false if error occurred
+   return !CheckGLErrors();
+}
+
+// load, compile, and link the tessellated sphere program, returning true if successful
+bool InitializeTessellationShaders(MyShader *shader)
+{
+   // load shader source from files
+   string vertexSource = LoadSource("tess_vertex.glsl");
+   string tessControlSource = LoadSource("tess_control.glsl");
+   string tessEvalSource = LoadSource("tess_eval.glsl");
+   string fragmentSource = LoadSource("fragment.glsl");
+   if (vertexSource.empty() || tessControlSource.empty() ||
+      tessEvalSource.empty() || fragmentSource.empty()) return false;
+
+   // compile shader source into shader objects
+   shader->vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
+   shader->tessControl = CompileShader(GL_TESS_CONTROL_SHADER, tessControlSource);
+   shader->tessEval = CompileShader(GL_TESS_EVALUATION_SHADER, tessEvalSource);
+   shader->fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+   // link shader program
+   shader->program = LinkProgram(shader->vertex, shader->fragment,
+      shader->tessControl, shader->tessEval);
+
+   // check for OpenGL errors and return false if error occurred
+   return !CheckGLErrors();
+}
+
+// deallocate shader-related objects
+void DestroyShaders(MyShader *shader)
+{
+   // unbind any shader programs and destroy shader objects
+   glUseProgram(0);
+   glDeleteProgram(shader->program);
+   glDeleteShader(shader->vertex);
+   glDeleteShader(shader->fragment);
+   glDeleteShader(shader->tessControl);
+   glDeleteShader(shader->tessEval);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL buffers for storing textures
+
+struct MyTexture
+{
+   GLuint textureID;
+   GLuint target;
+   int width;
+   int height;
+
+   // initialize object names to zero (OpenGL reserved value)
+   MyTexture() : textureID(0), target(0), width(0), height(0)
+   {}
+};
+
+// pixels decoded on the CPU
+struct MyImage
+{
+   unsigned char* data;
+   int width;
+   int height;
+   int components;
+
+   MyImage() : data(0), width(0), height(0), components(0)
+   {}
+};
+
+// decodes an image file without touching OpenGL, so it can run as a job;
+// stbi_set_flip_vertically_on_load() has to be set beforehand
+bool LoadImage(MyImage* image, const char* filename)
+{
+   vector<unsigned char> buffer;
+   size_t size;
+   const unsigned char* packed = assets_ ? assets_->load(filename, &size, &buffer) : 0;
+   image->data = packed ?
+      DecodeImageParallel(packed, size, &image->width, &image->height, &image->components) :
+      LoadImageParallel(filename, &image->width, &image->height, &image->components);
+   if (!image->data)
+   {
+      cout << "ERROR: Could not load image " << filename << endl;
+      return false;
+   }
+   return true;
+}
+
+// the pixel format of pixels with numComponents bytes each
+GLuint TextureFormat(int numComponents)
+{
+   switch (numComponents)
+   {
+   case 4:
+      return GL_RGBA;
+   case 3:
+      return GL_RGB;
+   case 2:
+      return GL_RG;
+   case 1:
+      return GL_RED;
+   default:
+      cout << "Invalid Texture Format" << endl;
+      return GL_RGB;
+   };
+}
+
+// uploads pixels into a new texture, with a full mip chain if isMipmapped
+bool InitializeTexture(MyTexture* texture, const unsigned char* data, int width, int height, int numComponents,
+   bool isMipmapped, GLuint target = GL_TEXTURE_2D)
+{
+   texture->width = width;
+   texture->height = height;
+   if (data != nullptr)
+   {
+      texture->target = target;
+      glGenTextures(1, &texture->textureID);
+      glBindTexture(texture->target, texture->textureID);
+      GLuint format = TextureFormat(numComponents);
+      // rows of odd width are not padded to 4 bytes
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage2D(texture->target, 0, format, texture->width, texture->height, 0, format, GL_UNSIGNED_BYTE, data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+      // Note: Only wrapping modes supported for GL_TEXTURE_RECTANGLE when defining
+      // GL_TEXTURE_WRAP are GL_CLAMP_TO_EDGE or GL_CLAMP_TO_BORDER
+      glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, isMipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+      glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      if (isMipmapped)
+         glGenerateMipmap(texture->target);
+
+      // Clean up
+      glBindTexture(texture->target, 0);
+      return !CheckGLErrors();
+   }
+   return true; //error
+}
+
+// deallocate texture-related objects
+void DestroyTexture(MyTexture *texture)
+{
+   glBindTexture(texture->target, 0);
+   glDeleteTextures(1, &texture->textureID);
+}
+
+// bytes of texture mips uploaded per frame, past the first; a mip is
+// never split, so a frame uploads at least one
+const size_t TEXTURE_UPLOAD_BYTES_PER_FRAME = size_t(1) << 20;
+
+// a decoded image being uploaded a mip at a time, coarsest first
+struct MyTextureFill
+{
+   int handle;
+   MyTexture texture;
+   int mip;           // finest mip uploaded so far
+};
+
+// the textures of the texture manager's handles, indexed by handle, and a
+// grey texel drawn in place of those not resident; images being uploaded
+// are drawn in place of their handle's texture once they are as fine
+struct MyManagedTextures
+{
+   vector<MyTexture> textures;
+   vector<MyTextureFill> fills;
+   MyTexture placeholder;
+};
+
+// create the placeholder texel, returning true if successful
+bool InitializeManagedTextures(MyManagedTextures *textures)
+{
+   const unsigned char grey[3] = { 128, 128, 128 };
+   return InitializeTexture(&textures->placeholder, grey, 1, 1, 3, false);
+}
+
+// allocates every mip of an image in a new texture, none of them filled
+bool InitializeMipStorage(MyTexture* texture, const TextureImage& image)
+{
+   GLuint format = TextureFormat(image.components);
+   texture->target = GL_TEXTURE_2D;
+   texture->width = image.width;
+   texture->height = image.height;
+   glGenTextures(1, &texture->textureID);
+   glBindTexture(texture->target, texture->textureID);
+   for (int mip = 0; mip < int(image.mips.size()); mip++)
+   {
+      glTexImage2D(texture->target, mip, format, image.mipWidth(mip), image.mipHeight(mip), 0, format,
+         GL_UNSIGNED_BYTE, nullptr);
+   }
+   glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+   glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(texture->target, GL_TEXTURE_MAX_LEVEL, int(image.mips.size()) - 1);
+   glBindTexture(texture->target, 0);
+   return !CheckGLErrors();
+}
+
+// fills the next finer mip of an image being uploaded and lets the texture
+// sample from it down, returning the bytes uploaded
+size_t UploadNextMip(MyTextureFill *fill, const TextureImage& image)
+{
+   GLuint format = TextureFormat(image.components);
+   int mip = --fill->mip;
+   glBindTexture(fill->texture.target, fill->texture.textureID);
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   glTexSubImage2D(fill->texture.target, mip, 0, 0, image.mipWidth(mip), image.mipHeight(mip), format,
+      GL_UNSIGNED_BYTE, image.mips[mip].data());
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+   glTexParameteri(fill->texture.target, GL_TEXTURE_BASE_LEVEL, mip);
+   glBindTexture(fill->texture.target, 0);
+   return image.mips[mip].size();
+}
+
+// deletes the textures the manager evicted and uploads the images it
+// decoded, a mip at a time from the coarsest and about bytes of them; an
+// image is drawn once its finest mip uploaded is as wide as the texture it
+// replaces, and becomes resident once all of them are
+void UpdateManagedTextures(MyManagedTextures *textures, TextureManager *manager,
+   size_t bytes = TEXTURE_UPLOAD_BYTES_PER_FRAME)
+{
+   textures->textures.resize(manager->textureCount());
+   int texture;
+   while ((texture = manager->nextEviction()) >= 0)
+   {
+      if (textures->textures[texture].textureID)
+         DestroyTexture(&textures->textures[texture]);
+      textures->textures[texture] = MyTexture();
+   }
+   while ((texture = manager->nextUpload()) >= 0)
+   {
+      MyTextureFill fill;
+      fill.handle = texture;
+      fill.mip = int(manager->uploadImage(texture).mips.size());
+      InitializeMipStorage(&fill.texture, manager->uploadImage(texture));
+      textures->fills.push_back(fill);
+   }
+
+   size_t uploaded = 0;
+   while (!textures->fills.empty() && uploaded < bytes)
+   {
+      MyTextureFill& fill = textures->fills.front();
+      const TextureImage& image = manager->uploadImage(fill.handle);
+      uploaded += UploadNextMip(&fill, image);
+
+      MyTexture& drawn = textures->textures[fill.handle];
+      if (drawn.textureID != fill.texture.textureID && (image.mipWidth(fill.mip) >= drawn.width || fill.mip == 0))
+      {
+         if (drawn.textureID)
+            DestroyTexture(&drawn);
+         drawn = fill.texture;
+      }
+      if (drawn.textureID == fill.texture.textureID)
+         drawn.width = image.mipWidth(fill.mip);
+      if (fill.mip == 0)
+      {
+         manager->finishUpload(fill.handle);
+         textures->fills.erase(textures->fills.begin());
+      }
+   }
+}
+
+// the texture to bind for a handle
+MyTexture* ManagedTexture(MyManagedTextures *textures, int texture)
+{
+   if (texture < int(textures->textures.size()) && textures->textures[texture].textureID)
+      return &textures->textures[texture];
+   return &textures->placeholder;
+}
+
+// deallocate every managed texture
+void DestroyManagedTextures(MyManagedTextures *textures)
+{
+   for (size_t i = 0; i < textures->fills.size(); i++)
+   {
+      MyTextureFill& fill = textures->fills[i];
+      if (textures->textures[fill.handle].textureID != fill.texture.textureID)
+         DestroyTexture(&fill.texture);
+   }
+   textures->fills.clear();
+   for (size_t i = 0; i < textures->textures.size(); i++)
+   {
+      if (textures->textures[i].textureID)
+         DestroyTexture(&textures->textures[i]);
+   }
+   textures->textures.clear();
+   DestroyTexture(&textures->placeholder);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL buffers for storing geometry data
+
+struct MyGeometry
+{
+   // OpenGL names for array buffer objects, vertex array object
+   GLuint  vertexBuffer;
+   GLuint  textureBuffer;
+   GLuint  elementBuffer;
+   GLuint  normalBuffer;
+   GLuint  vertexArray;
+   GLsizei elementCount;
+
+   // primitive type, GL_PATCHES for geometry fed to the tessellator
+   GLenum  primitive;
+
+   // procedural geometry has no buffers, vertices are built in the shader
+   bool    isProcedural;
+
+   // initialize object names to zero (OpenGL reserved value)
+   MyGeometry() : vertexBuffer(0), textureBuffer(0), elementBuffer(0), normalBuffer(0), vertexArray(0), elementCount(0),
+      primitive(GL_TRIANGLES), isProcedural(false)
+   {}
+};
+
+// create buffers and fill with geometry data, the interleaved vertices
+// going into one buffer, returning true if successful
+bool InitializeGeometry(MyGeometry *geometry, const MeshVertex* vertices, unsigned int vertexCount,
+   const unsigned int* indices, unsigned int indexCount)
+{
+   geometry->elementCount = indexCount;
+
+   // these vertex attribute indices correspond to those specified for the
+   // input variables in the vertex shader
+   const GLuint VERTEX_INDEX = 0;
+   const GLuint NORMAL_INDEX = 1;
+
+   // create an array buffer object for storing our vertices
+   glGenBuffers(1, &geometry->vertexBuffer);
+   glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+   glBufferData(GL_ARRAY_BUFFER, sizeof(MeshVertex)*vertexCount, vertices, GL_STATIC_DRAW);
+
+   // create a vertex array object encapsulating all our vertex attributes
+   glGenVertexArrays(1, &geometry->vertexArray);
+   glBindVertexArray(geometry->vertexArray);
+
+   // make element array buffer
+   glGenBuffers(1, &geometry->elementBuffer);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBuffer);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indexCount, indices, GL_STATIC_DRAW);
+
+   // positions and normals interleaved in the one buffer
+   glVertexAttribPointer(VERTEX_INDEX, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+      (const GLvoid*)offsetof(MeshVertex, position));
+   glEnableVertexAttribArray(VERTEX_INDEX);
+   glVertexAttribPointer(NORMAL_INDEX, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+      (const GLvoid*)offsetof(MeshVertex, normal));
+   glEnableVertexAttribArray(NORMAL_INDEX);
+
+   // unbind our buffers, resetting to default state
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindVertexArray(0);
+
+   // check for OpenGL errors and return false if error occurred
+   return !CheckGLErrors();
+}
+
+// create buffers straight from a mapped mesh file; the mapping is the
+// source of the copy the driver makes, there is no intermediate copy
+bool InitializeGeometry(MyGeometry *geometry, const MappedMesh& mesh)
+{
+   return InitializeGeometry(geometry, mesh.vertices, mesh.header->vertexCount,
+      mesh.indices, mesh.header->indexCount);
+}
+
+// create buffers from a generated mesh
+bool InitializeGeometry(MyGeometry *geometry, const MeshData& mesh)
+{
+   return InitializeGeometry(geometry, mesh.vertices.data(), (unsigned int)(mesh.vertices.size()),
+      mesh.indices.data(), (unsigned int)(mesh.indices.size()));
+}
+
+// create an empty vertex array object for the bufferless sphere, whose
+// vertices are reconstructed from gl_VertexID in the vertex shader
+bool InitializeProceduralGeometry(MyGeometry *geometry)
+{
+   // the core profile still requires a vertex array object to be bound
+   glGenVertexArrays(1, &geometry->vertexArray);
+   geometry->elementCount = 0;
+   geometry->isProcedural = true;
+
+   return !CheckGLErrors();
+}
+
+// create the coarse icosahedron patch mesh for the tessellated sphere,
+// returning true if successful
+bool InitializeTessellatedGeometry(MyGeometry *geometry)
+{
+   vector<vec3> points;
+   vector<unsigned int> indices;
+
+   GenerateIcosahedron(points, indices);
+
+   geometry->elementCount = indices.size();
+   geometry->primitive = GL_PATCHES;
+
+   const GLuint VERTEX_INDEX = 0;
+
+   glGenBuffers(1, &geometry->vertexBuffer);
+   glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+   glBufferData(GL_ARRAY_BUFFER, sizeof(vec3)*points.size(), points.data(), GL_STATIC_DRAW);
+
+   glGenVertexArrays(1, &geometry->vertexArray);
+   glBindVertexArray(geometry->vertexArray);
+
+   glGenBuffers(1, &geometry->elementBuffer);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBuffer);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
+
+   glVertexAttribPointer(VERTEX_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
+   glEnableVertexAttribArray(VERTEX_INDEX);
+
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindVertexArray(0);
+
+   return !CheckGLErrors();
+}
+
+// pick a sphere grid resolution from the body's size on screen
+ivec2 SphereResolution(const mat4& model, vec3 eye)
+{
+   float radius = length(vec3(model[0]));
+   float distance = std::max(length(vec3(model[3]) - eye), radius);
+
+   // roughly one division per few pixels of the silhouette, kept in the
+   // range of the old fixed 200x100 grid
+   int u = clamp(int(400.f * radius / distance), 16, 200);
+   return ivec2(u, u / 2);
+}
+
+// about how many pixels across the body is drawn, or 0 if it is outside
+// the view frustum; height is the framebuffer's
+float SpherePixels(const mat4& model, const mat4& proj, const mat4& viewProj, vec3 eye, int height)
+{
+   vec3 centre = vec3(model[3]);
+   float radius = length(vec3(model[0]));
+   float distance = length(centre - eye);
+   if (distance <= radius)
+      return FLT_MAX;
+
+   // the frustum planes are sums and differences of the rows of viewProj
+   mat4 rows = transpose(viewProj);
+   for (int i = 0; i < 6; i++)
+   {
+      vec4 plane = rows[3] + (i % 2 ? -rows[i / 2] : rows[i / 2]);
+      if (dot(vec3(plane), centre) + plane.w < -radius * length(vec3(plane)))
+         return 0.0f;
+   }
+   return radius / distance * proj[1][1] * float(height);
+}
+
+// deallocate geometry-related objects
+void DestroyGeometry(MyGeometry *geometry)
+{
+   // unbind and destroy our vertex array object and associated buffers
+   glBindVertexArray(0);
+   glDeleteVertexArrays(1, &geometry->vertexArray);
+   glDeleteBuffers(1, &geometry->vertexBuffer);
+   glDeleteBuffers(1, &geometry->normalBuffer);
+   glDeleteBuffers(1, &geometry->elementBuffer);
+   glDeleteBuffers(1, &geometry->textureBuffer);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL buffers for instanced bodies
+
+struct MyBodyInstances
+{
+   // one buffer per position and spin array of the body system plus the
+   // static data
+   GLuint  xBuffer;
+   GLuint  yBuffer;
+   GLuint  zBuffer;
+   GLuint  spinBuffer;
+   GLuint  staticBuffer;
+   GLuint  vertexArray;
+   GLsizei count;
+
+   // frame packet and static data version last uploaded
+   int     sequence;
+   int     staticVersion;
+
+   // initialize object names to zero (OpenGL reserved value)
+   MyBodyInstances() : xBuffer(0), yBuffer(0), zBuffer(0), spinBuffer(0), staticBuffer(0), vertexArray(0),
+      count(0), sequence(0), staticVersion(0)
+   {}
+};
+
+// create the per-instance buffers, drawn as bufferless procedural spheres so
+// only instance attributes are bound, returning true if successful
+bool InitializeBodyInstances(MyBodyInstances *instances)
+{
+   // these attribute indices correspond to the instance inputs of the vertex shader
+   const GLuint X_INDEX = 2;
+   const GLuint Y_INDEX = 3;
+   const GLuint Z_INDEX = 4;
+   const GLuint STATIC_INDEX = 5;
+   const GLuint SPIN_INDEX = 6;
+
+   glGenVertexArrays(1, &instances->vertexArray);
+   glBindVertexArray(instances->vertexArray);
+
+   GLuint* buffers[4] = { &instances->xBuffer, &instances->yBuffer, &instances->zBuffer, &instances->spinBuffer };
+   GLuint indices[4] = { X_INDEX, Y_INDEX, Z_INDEX, SPIN_INDEX };
+   for (int i = 0; i < 4; i++)
+   {
+      glGenBuffers(1, buffers[i]);
+      glBindBuffer(GL_ARRAY_BUFFER, *buffers[i]);
+      glVertexAttribPointer(indices[i], 1, GL_FLOAT, GL_FALSE, 0, 0);
+      glVertexAttribDivisor(indices[i], 1);
+      glEnableVertexAttribArray(indices[i]);
+   }
+
+   glGenBuffers(1, &instances->staticBuffer);
+   glBindBuffer(GL_ARRAY_BUFFER, instances->staticBuffer);
+   glVertexAttribPointer(STATIC_INDEX, 4, GL_FLOAT, GL_FALSE, 0, 0);
+   glVertexAttribDivisor(STATIC_INDEX, 1);
+   glEnableVertexAttribArray(STATIC_INDEX);
+
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindVertexArray(0);
+
+   return !CheckGLErrors();
+}
+
+// upload the packet's body positions and spins if it is a new one, and the static
+// data when bodies were added
+void UpdateBodyInstances(MyBodyInstances *instances, const FramePacket *frame)
+{
+   if (frame->sequence == instances->sequence)
+      return;
+   instances->sequence = frame->sequence;
+   instances->count = GLsizei(frame->bodyX.size());
+   if (instances->count == 0)
+      return;
+
+   // the SoA arrays go up as they are, with no packing pass; respecifying
+   // the whole store lets the driver orphan last frame's data
+   const vector<float>* arrays[4] = { &frame->bodyX, &frame->bodyY, &frame->bodyZ, &frame->bodySpin };
+   GLuint buffers[4] = { instances->xBuffer, instances->yBuffer, instances->zBuffer, instances->spinBuffer };
+   for (int i = 0; i < 4; i++)
+   {
+      glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(float)*instances->count, arrays[i]->data(), GL_STREAM_DRAW);
+   }
+
+   if (frame->bodyStaticVersion != instances->staticVersion)
+   {
+      instances->staticVersion = frame->bodyStaticVersion;
+      const vector<vec4>& data = *frame->bodyStatic;
+      glBindBuffer(GL_ARRAY_BUFFER, instances->staticBuffer);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(vec4)*data.size(), data.data(), GL_STATIC_DRAW);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// deallocate instance-related objects
+void DestroyBodyInstances(MyBodyInstances *instances)
+{
+   glBindVertexArray(0);
+   glDeleteVertexArrays(1, &instances->vertexArray);
+   glDeleteBuffers(1, &instances->xBuffer);
+   glDeleteBuffers(1, &instances->yBuffer);
+   glDeleteBuffers(1, &instances->zBuffer);
+   glDeleteBuffers(1, &instances->spinBuffer);
+   glDeleteBuffers(1, &instances->staticBuffer);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL buffers for the planet terrain
+
+// chunk meshes uploaded per frame at most, so a burst of finished builds
+// does not stall a frame
+const int TERRAIN_UPLOADS_PER_FRAME = 8;
+
+struct MyTerrain
+{
+   // a vertex buffer and vertex array per chunk slot of the terrain, all
+   // sharing the one element buffer
+   GLuint  elementBuffer;
+   vector<GLuint> vertexBuffers;
+   vector<GLuint> vertexArrays;
+
+   // initialize object names to zero (OpenGL reserved value)
+   MyTerrain() : elementBuffer(0), vertexBuffers(TERRAIN_MAX_CHUNKS, 0), vertexArrays(TERRAIN_MAX_CHUNKS, 0)
+   {}
+};
+
+// create the shared element buffer and a vertex array per chunk slot, the
+// vertex buffers getting their data as chunks are uploaded, returning true
+// if successful
+bool InitializeTerrain(MyTerrain *terrain)
+{
+   // these vertex attribute indices correspond to those specified for the
+   // input variables in the terrain vertex shader
+   const GLuint VERTEX_INDEX = 0;
+   const GLuint NORMAL_INDEX = 1;
+   const GLuint MORPH_OFFSET_INDEX = 2;
+   const GLuint MORPH_NORMAL_INDEX = 3;
+
+   vector<unsigned int> indices;
+   PlanetTerrain::gridIndices(indices);
+   glGenBuffers(1, &terrain->elementBuffer);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain->elementBuffer);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
+
+   glGenBuffers(TERRAIN_MAX_CHUNKS, terrain->vertexBuffers.data());
+   glGenVertexArrays(TERRAIN_MAX_CHUNKS, terrain->vertexArrays.data());
+   for (int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+   {
+      glBindVertexArray(terrain->vertexArrays[i]);
+      glBindBuffer(GL_ARRAY_BUFFER, terrain->vertexBuffers[i]);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain->elementBuffer);
+      glVertexAttribPointer(VERTEX_INDEX, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+         (const GLvoid*)offsetof(TerrainVertex, position));
+      glEnableVertexAttribArray(VERTEX_INDEX);
+      glVertexAttribPointer(NORMAL_INDEX, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+         (const GLvoid*)offsetof(TerrainVertex, normal));
+      glEnableVertexAttribArray(NORMAL_INDEX);
+      glVertexAttribPointer(MORPH_OFFSET_INDEX, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+         (const GLvoid*)offsetof(TerrainVertex, morphOffset));
+      glEnableVertexAttribArray(MORPH_OFFSET_INDEX);
+      glVertexAttribPointer(MORPH_NORMAL_INDEX, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+         (const GLvoid*)offsetof(TerrainVertex, morphNormal));
+      glEnableVertexAttribArray(MORPH_NORMAL_INDEX);
+   }
+
+   // unbind our buffers, resetting to default state
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindVertexArray(0);
+
+   return !CheckGLErrors();
+}
+
+// upload chunk meshes the terrain's jobs have finished, a few per frame
+void UpdateTerrain(MyTerrain *terrain, PlanetTerrain *planet)
+{
+   int chunk;
+   for (int i = 0; i < TERRAIN_UPLOADS_PER_FRAME && (chunk = planet->nextUpload()) >= 0; i++)
+   {
+      const vector<TerrainVertex>& vertices = planet->chunkVertices(chunk);
+      glBindBuffer(GL_ARRAY_BUFFER, terrain->vertexBuffers[chunk]);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(TerrainVertex)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
+      planet->finishUpload(chunk);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// deallocate terrain-related objects
+void DestroyTerrain(MyTerrain *terrain)
+{
+   glBindVertexArray(0);
+   glDeleteVertexArrays(TERRAIN_MAX_CHUNKS, terrain->vertexArrays.data());
+   glDeleteBuffers(TERRAIN_MAX_CHUNKS, terrain->vertexBuffers.data());
+   glDeleteBuffers(1, &terrain->elementBuffer);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL objects for the earth's virtual texture
+
+// tiles uploaded per frame at most, like TERRAIN_UPLOADS_PER_FRAME
+const int VT_UPLOADS_PER_FRAME = 16;
+
+// the feedback pass is drawn at this fraction of the framebuffer's size
+const int FEEDBACK_SCALE = 4;
+
+struct MyVirtualTexture
+{
+   // the cache of resident tiles, and the page table with a mip level per
+   // level of the virtual texture
+   GLuint  tileCache;
+   GLuint  pageTable;
+
+   // the feedback pass: its framebuffer with an integer tile attachment,
+   // and two pixel pack buffers taking turns, each read back a frame after
+   // it was filled so the read does not wait on the GPU
+   GLuint  feedbackFramebuffer;
+   GLuint  feedbackTiles;
+   GLuint  feedbackDepth;
+   GLuint  feedbackBuffers[2];
+   int     feedbackWidth;
+   int     feedbackHeight;
+   int     feedbackFrame;
+
+   // initialize object names to zero (OpenGL reserved value)
+   MyVirtualTexture() : tileCache(0), pageTable(0), feedbackFramebuffer(0), feedbackTiles(0), feedbackDepth(0),
+      feedbackWidth(0), feedbackHeight(0), feedbackFrame(0)
+   {
+      feedbackBuffers[0] = feedbackBuffers[1] = 0;
+   }
+};
+
+// upload loaded tiles into the cache, a few per frame, and the page table
+// entries that changed
+void UpdateVirtualTexture(MyVirtualTexture *vt, VirtualTexture *texture)
+{
+   glBindTexture(GL_TEXTURE_2D, vt->tileCache);
+   int slot;
+   for (int i = 0; i < VT_UPLOADS_PER_FRAME && (slot = texture->nextUpload()) >= 0; i++)
+   {
+      ivec2 position = texture->slotPosition(slot) * VT_TILE_STRIDE;
+      glTexSubImage2D(GL_TEXTURE_2D, 0, position.x, position.y, VT_TILE_STRIDE, VT_TILE_STRIDE,
+         GL_RGB, GL_UNSIGNED_BYTE, texture->slotPixels(slot));
+      texture->finishUpload(slot);
+   }
+
+   // only the rectangle of each level that changed
+   texture->updatePageTable();
+   glBindTexture(GL_TEXTURE_2D, vt->pageTable);
+   for (int level = 0; level < texture->levels(); level++)
+   {
+      ivec4 rect;
+      if (!texture->takeDirty(level, &rect))
+         continue;
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->tiles(level).x);
+      glPixelStorei(GL_UNPACK_SKIP_PIXELS, rect.x);
+      glPixelStorei(GL_UNPACK_SKIP_ROWS, rect.y);
+      glTexSubImage2D(GL_TEXTURE_2D, level, rect.x, rect.y, rect.z, rect.w, GL_RGBA, GL_UNSIGNED_BYTE,
+         texture->pageTable(level));
+   }
+   glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+   glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+   glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+   glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// create the tile cache, the page table and the feedback pass for a
+// framebuffer of width by height, then upload the texture's coarsest
+// level, returning true if successful
+bool InitializeVirtualTexture(MyVirtualTexture *vt, VirtualTexture *texture, int width, int height)
+{
+   int cacheSize = texture->cacheSide() * VT_TILE_STRIDE;
+   glGenTextures(1, &vt->tileCache);
+   glBindTexture(GL_TEXTURE_2D, vt->tileCache);
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, cacheSize, cacheSize, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+   // entries are fetched by texelFetch, never filtered
+   glGenTextures(1, &vt->pageTable);
+   glBindTexture(GL_TEXTURE_2D, vt->pageTable);
+   for (int level = 0; level < texture->levels(); level++)
+   {
+      ivec2 tiles = texture->tiles(level);
+      glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, tiles.x, tiles.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+   }
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->levels() - 1);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+   vt->feedbackWidth = std::max(width / FEEDBACK_SCALE, 1);
+   vt->feedbackHeight = std::max(height / FEEDBACK_SCALE, 1);
+   glGenTextures(1, &vt->feedbackTiles);
+   glBindTexture(GL_TEXTURE_2D, vt->feedbackTiles);
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, vt->feedbackWidth, vt->feedbackHeight, 0,
+      GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   glBindTexture(GL_TEXTURE_2D, 0);
+
+   glGenRenderbuffers(1, &vt->feedbackDepth);
+   glBindRenderbuffer(GL_RENDERBUFFER, vt->feedbackDepth);
+   glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, vt->feedbackWidth, vt->feedbackHeight);
+   glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+   glGenFramebuffers(1, &vt->feedbackFramebuffer);
+   glBindFramebuffer(GL_FRAMEBUFFER, vt->feedbackFramebuffer);
+   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, vt->feedbackTiles, 0);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, vt->feedbackDepth);
+   bool isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   if (!isComplete)
+   {
+      cout << "ERROR: virtual texture feedback framebuffer is incomplete" << endl;
+      return false;
+   }
+
+   glGenBuffers(2, vt->feedbackBuffers);
+   for (int i = 0; i < 2; i++)
+   {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedbackBuffers[i]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, 4 * sizeof(GLushort) * vt->feedbackWidth * vt->feedbackHeight,
+         0, GL_STREAM_READ);
+   }
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   UpdateVirtualTexture(vt, texture);
+   return !CheckGLErrors();
+}
+
+// switches a program using fragment.glsl or vt_feedback.glsl to sampling
+// the virtual texture, or back; levelBias is the feedback pass's
+void UseVirtualTexture(MyVirtualTexture *vt, const VirtualTexture& texture, MyShader *shader, bool isVirtual,
+   float levelBias = 0.0f)
+{
+   isVirtual = isVirtual && texture.isOpen();
+   glUseProgram(shader->program);
+   glUniform1i(glGetUniformLocation(shader->program, "isVirtual"), isVirtual);
+   if (isVirtual)
+   {
+      ivec2 tiles = texture.tiles(0);
+      glUniform1i(glGetUniformLocation(shader->program, "pageTable"), 1);
+      glUniform1i(glGetUniformLocation(shader->program, "tileCache"), 2);
+      glUniform2iv(glGetUniformLocation(shader->program, "virtualTiles"), 1, value_ptr(tiles));
+      glUniform1i(glGetUniformLocation(shader->program, "virtualLevels"), texture.levels());
+      glUniform2f(glGetUniformLocation(shader->program, "virtualSize"), float(texture.width()), float(texture.height()));
+      glUniform1f(glGetUniformLocation(shader->program, "levelBias"), levelBias);
+
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, vt->pageTable);
+      glActiveTexture(GL_TEXTURE2);
+      glBindTexture(GL_TEXTURE_2D, vt->tileCache);
+      glActiveTexture(GL_TEXTURE0);
+   }
+   glUseProgram(0);
+}
+
+// binds the feedback framebuffer, cleared to no tiles; viewport receives
+// the one to restore afterwards
+void BeginFeedback(MyVirtualTexture *vt, GLint viewport[4])
+{
+   const GLuint noTile[4] = { 0, 0, 0, 0 };
+   const GLfloat farDepth = 1.0f;
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   glBindFramebuffer(GL_FRAMEBUFFER, vt->feedbackFramebuffer);
+   glViewport(0, 0, vt->feedbackWidth, vt->feedbackHeight);
+   glClearBufferuiv(GL_COLOR, 0, noTile);
+   glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+// starts reading back this frame's feedback, and requests the tiles of the
+// last frame's, which has had a frame to arrive
+void EndFeedback(MyVirtualTexture *vt, VirtualTexture *texture, const GLint viewport[4])
+{
+   int current = vt->feedbackFrame % 2;
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedbackBuffers[current]);
+   glReadPixels(0, 0, vt->feedbackWidth, vt->feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+   if (vt->feedbackFrame > 0)
+   {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedbackBuffers[1 - current]);
+      const GLushort* pixels = (const GLushort*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+      if (pixels)
+      {
+         // neighbouring pixels mostly want the same tile, asked for once
+         const GLushort* last = 0;
+         for (int i = 0; i < vt->feedbackWidth * vt->feedbackHeight; i++)
+         {
+            const GLushort* pixel = pixels + 4 * i;
+            if (pixel[3] == 0)
+               continue;
+            if (last && pixel[0] == last[0] && pixel[1] == last[1] && pixel[2] == last[2])
+               continue;
+            texture->request(pixel[2], pixel[0], pixel[1]);
+            last = pixel;
+         }
+         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+   }
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   vt->feedbackFrame++;
+}
+
+// deallocate virtual texture objects
+void DestroyVirtualTexture(MyVirtualTexture *vt)
+{
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   glDeleteFramebuffers(1, &vt->feedbackFramebuffer);
+   glDeleteRenderbuffers(1, &vt->feedbackDepth);
+   glDeleteBuffers(2, vt->feedbackBuffers);
+   glDeleteTextures(1, &vt->feedbackTiles);
+   glDeleteTextures(1, &vt->pageTable);
+   glDeleteTextures(1, &vt->tileCache);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL objects for the earth's atmosphere
+
+// radiance of sunlight scattered at full strength, which puts a clear sky
+// of atmosphere.glsl at about 0.4 in blue
+const float SUN_INTENSITY = 12.0f;
+
+// from this close to the shell, in shell radii, its far side is drawn
+// instead of its near one, which the near plane would cut into
+const float ATMOSPHERE_FAR_SIDE_DISTANCE = 1.1f;
+
+struct MyAtmosphere
+{
+   // the tables of atmosphere.h
+   GLuint transmittance;
+   GLuint scattering;
+
+   MyShader shader;
+
+   MyAtmosphere() : transmittance(0), scattering(0)
+   {}
+};
+
+// uploads the tables and compiles the shell's shaders, returning true if
+// successful
+bool InitializeAtmosphere(MyAtmosphere *atmosphere, const AtmosphereTables& tables)
+{
+   if (!InitializeShaders(&atmosphere->shader, "atmosphere_vertex.glsl", "atmosphere.glsl"))
+      return false;
+
+   glGenTextures(1, &atmosphere->transmittance);
+   glBindTexture(GL_TEXTURE_2D, atmosphere->transmittance);
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT, 0, GL_RGB, GL_FLOAT,
+      tables.transmittance.data());
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glBindTexture(GL_TEXTURE_2D, 0);
+
+   // half floats on the GPU, which halves what each of the shader's
+   // fetches reads
+   glGenTextures(1, &atmosphere->scattering);
+   glBindTexture(GL_TEXTURE_3D, atmosphere->scattering);
+   glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, SCATTERING_NU * SCATTERING_MU_S, SCATTERING_MU, SCATTERING_R, 0,
+      GL_RGBA, GL_FLOAT, tables.scattering.data());
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+   glBindTexture(GL_TEXTURE_3D, 0);
+
+   return !CheckGLErrors();
+}
+
+// draws the atmosphere's shell over the scene around the earth, adding the
+// light the atmosphere scatters towards the eye and dimming what is behind
+// it, the earth included, by its transmittance; sphere is the unit sphere
+// mesh, eye and light in world space
+void RenderAtmosphere(MyAtmosphere *atmosphere, MyGeometry *sphere, mat4 viewProj, mat4 earthModel,
+   vec3 eye, vec3 light)
+{
+   float earthRadius = length(vec3(earthModel[0]));
+   vec3 earthCentre = vec3(earthModel[3]);
+   float shellScale = ATMOSPHERE_TOP / ATMOSPHERE_BOTTOM;
+   mat4 model = scale(earthModel, vec3(shellScale));
+   bool isFarSide = distance(eye, earthCentre) < earthRadius * shellScale * ATMOSPHERE_FAR_SIDE_DISTANCE;
+
+   GLuint program = atmosphere->shader.program;
+   glUseProgram(program);
+   glBindVertexArray(sphere->vertexArray);
+   glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, false, value_ptr(model));
+   glUniformMatrix4fv(glGetUniformLocation(program, "mvp"), 1, false, value_ptr(viewProj * model));
+   glUniform3fv(glGetUniformLocation(program, "eye"), 1, value_ptr(eye));
+   glUniform3fv(glGetUniformLocation(program, "light"), 1, value_ptr(light));
+   glUniform3fv(glGetUniformLocation(program, "earthCentre"), 1, value_ptr(earthCentre));
+   glUniform1f(glGetUniformLocation(program, "kmPerUnit"), ATMOSPHERE_BOTTOM / earthRadius);
+   glUniform1f(glGetUniformLocation(program, "sunIntensity"), SUN_INTENSITY);
+   glUniform1i(glGetUniformLocation(program, "isFarSide"), isFarSide);
+   glUniform1i(glGetUniformLocation(program, "transmittanceTable"), 0);
+   glUniform1i(glGetUniformLocation(program, "scatteringTable"), 1);
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_3D, atmosphere->scattering);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, atmosphere->transmittance);
+
+   // colour = scattered light + colour * transmittance
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_ONE, GL_SRC1_COLOR);
+   glDepthMask(GL_FALSE);
+   if (isFarSide)
+      glDisable(GL_DEPTH_TEST);
+
+   glDrawElements(sphere->primitive, sphere->elementCount, GL_UNSIGNED_INT, 0);
+
+   // reset state to default (no shader, geometry or texture bound)
+   glEnable(GL_DEPTH_TEST);
+   glDepthMask(GL_TRUE);
+   glDisable(GL_BLEND);
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_3D, 0);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glBindVertexArray(0);
+   glUseProgram(0);
+
+   CheckGLErrors();
+}
+
+// deallocate atmosphere objects
+void DestroyAtmosphere(MyAtmosphere *atmosphere)
+{
+   glDeleteTextures(1, &atmosphere->transmittance);
+   glDeleteTextures(1, &atmosphere->scattering);
+   DestroyShaders(&atmosphere->shader);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up the eclipse shadows of fragment.glsl
+
+// spheres a frame passes to the shaded programs as occluders of the sun:
+// the earth and the moon, then the largest bodies
+const int MAX_OCCLUDERS = 8;
+
+struct MyOccluders
+{
+   vec4 spheres[MAX_OCCLUDERS];   // world centre, radius
+   int count;
+   float sunRadius;
+
+   // bodies by radius, largest first, while bodyStaticVersion is current
+   vector<int> largestBodies;
+   int bodyStaticVersion;
+
+   MyOccluders() : count(0), sunRadius(0.0f), bodyStaticVersion(-1)
+   {}
+};
+
+// this frame's occluders
+void UpdateOccluders(MyOccluders *occluders, const FramePacket* frame)
+{
+   const mat4& earthModel = frame->model[OBJECT_EARTH];
+   const mat4& moonModel = frame->model[OBJECT_MOON];
+   occluders->sunRadius = length(vec3(frame->model[OBJECT_SUN][0]));
+   occluders->spheres[0] = vec4(vec3(earthModel[3]), length(vec3(earthModel[0])));
+   occluders->spheres[1] = vec4(vec3(moonModel[3]), length(vec3(moonModel[0])));
+   occluders->count = 2;
+   if (!frame->bodyStatic)
+      return;
+
+   // the bodies only change size when bodies are added
+   const vector<vec4>& bodies = *frame->bodyStatic;
+   if (occluders->bodyStaticVersion != frame->bodyStaticVersion)
+   {
+      occluders->bodyStaticVersion = frame->bodyStaticVersion;
+      vector<int>& largest = occluders->largestBodies;
+      largest.clear();
+      for (int i = 0; i < int(bodies.size()); i++)
+      {
+         if (bodies[i].x > 0.0f)
+            largest.push_back(i);
+      }
+      size_t kept = std::min(largest.size(), size_t(MAX_OCCLUDERS - occluders->count));
+      partial_sort(largest.begin(), largest.begin() + kept, largest.end(),
+         [&](int a, int b) { return bodies[a].x > bodies[b].x; });
+      largest.resize(kept);
+   }
+
+   for (size_t i = 0; i < occluders->largestBodies.size(); i++)
+   {
+      int body = occluders->largestBodies[i];
+      if (body >= int(frame->bodyX.size()))
+         continue;
+      occluders->spheres[occluders->count++] = vec4(frame->bodyX[body], frame->bodyY[body], frame->bodyZ[body],
+         bodies[body].x);
+   }
+}
+
+// hands the occluders to a program using fragment.glsl or atmosphere.glsl
+void UseOccluders(const MyOccluders& occluders, MyShader *shader)
+{
+   glUseProgram(shader->program);
+   glUniform4fv(glGetUniformLocation(shader->program, "occluders"), occluders.count, &occluders.spheres[0].x);
+   glUniform1i(glGetUniformLocation(shader->program, "occluderCount"), occluders.count);
+   glUniform1f(glGetUniformLocation(shader->program, "sunRadius"), occluders.sunRadius);
+   glUseProgram(0);
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up the HDR target, its bloom and the tonemapping resolve
+
+// the sun's texture is this many times brighter than the most an 8-bit
+// framebuffer shows; the excess is what blooms
+const float SUN_EMISSION = 4.0f;
+
+// the bloom chain starts at half the target's size, each level half the
+// last, until a side would be under BLOOM_MIN_SIZE
+const int BLOOM_MAX_LEVELS = 6;
+const int BLOOM_MIN_SIZE = 8;
+
+// what blooms: colour brighter than the threshold, easing in over the knee
+// below it, added back at the strength
+const float BLOOM_THRESHOLD = 1.5f;
+const float BLOOM_KNEE = 0.5f;
+const float BLOOM_STRENGTH = 0.6f;
+
+// GPU milliseconds the bloom passes may take together; over it the chain
+// starts a level coarser, under half of it a level finer again, at most
+// once every BLOOM_SETTLE_FRAMES so the timings catch up in between
+const float BLOOM_BUDGET_MS = 0.5f;
+const int BLOOM_SETTLE_FRAMES = 60;
+
+// the passes of a frame timed on the GPU
+enum RenderPass
+{
+   PASS_SCENE,          // everything drawn into the HDR target
+   PASS_BLOOM_DOWN,
+   PASS_BLOOM_UP,
+   PASS_RESOLVE,        // tonemapping to the screen
+   PASS_COUNT
+};
+
+// frames of timer queries in flight; results are read back this many
+// frames late, by when they are ready, so reading never stalls
+const int PASS_TIMER_FRAMES = 3;
+
+struct MyPassTimer
+{
+   GLuint queries[PASS_TIMER_FRAMES][PASS_COUNT];
+   bool isIssued[PASS_TIMER_FRAMES][PASS_COUNT];
+   int frame;
+   bool isTiming;                // a pass's query has begun and not ended
+
+   double totals[PASS_COUNT];    // milliseconds over every frame read back
+   float recent[PASS_COUNT];     // milliseconds, smoothed over the last frames
+   int samples[PASS_COUNT];
+
+   MyPassTimer() : frame(0), isTiming(false)
+   {
+      for (int pass = 0; pass < PASS_COUNT; pass++)
+      {
+         for (int f = 0; f < PASS_TIMER_FRAMES; f++)
+         {
+            queries[f][pass] = 0;
+            isIssued[f][pass] = false;
+         }
+         totals[pass] = 0.0;
+         recent[pass] = 0.0f;
+         samples[pass] = 0;
+      }
+   }
+};
+
+bool InitializePassTimer(MyPassTimer *timer)
+{
+   glGenQueries(PASS_TIMER_FRAMES * PASS_COUNT, &timer->queries[0][0]);
+   return !CheckGLErrors();
+}
+
+// only one GL_TIME_ELAPSED query runs at a time, so passes do not nest.
+// The first frame is not timed: it waits on shader compiles and uploads,
+// and Mesa's llvmpipe returns garbage for a context's first query, which
+// would then dominate the smoothed times for hundreds of frames.
+void BeginPass(MyPassTimer *timer, RenderPass pass)
+{
+   if (timer->frame == 0)
+      return;
+   int current = timer->frame % PASS_TIMER_FRAMES;
+   glBeginQuery(GL_TIME_ELAPSED, timer->queries[current][pass]);
+   timer->isIssued[current][pass] = true;
+   timer->isTiming = true;
+}
+
+// ends the pass begun last, if any; ending a query that is not running is
+// a GL error
+void EndPass(MyPassTimer *timer)
+{
+   if (!timer->isTiming)
+      return;
+   glEndQuery(GL_TIME_ELAPSED);
+   timer->isTiming = false;
+}
+
+// collects the oldest frame's timings, skipping any not yet available,
+// and moves on to the next frame's queries
+void EndPassFrame(MyPassTimer *timer)
+{
+   timer->frame++;
+   int oldest = timer->frame % PASS_TIMER_FRAMES;
+   for (int pass = 0; pass < PASS_COUNT; pass++)
+   {
+      if (!timer->isIssued[oldest][pass])
+         continue;
+      GLint isAvailable = 0;
+      glGetQueryObjectiv(timer->queries[oldest][pass], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+      if (!isAvailable)
+         continue;
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(timer->queries[oldest][pass], GL_QUERY_RESULT, &nanoseconds);
+      timer->isIssued[oldest][pass] = false;
+
+      float milliseconds = float(nanoseconds * 1e-6);
+      timer->totals[pass] += milliseconds;
+      timer->recent[pass] = timer->samples[pass] == 0 ? milliseconds :
+         0.9f * timer->recent[pass] + 0.1f * milliseconds;
+      timer->samples[pass]++;
+   }
+}
+
+void PrintPassTimings(const MyPassTimer& timer)
+{
+   const char* names[PASS_COUNT] = { "scene", "bloom down", "bloom up", "resolve" };
+   printf("GPU pass timings\n");
+   printf("  %-24s %10s %14s %12s\n", "pass", "frames", "ms per frame", "ms recently");
+   for (int pass = 0; pass < PASS_COUNT; pass++)
+      printf("  %-24s %10d %14.3f %12.3f\n", names[pass], timer.samples[pass],
+         timer.samples[pass] > 0 ? timer.totals[pass] / timer.samples[pass] : 0.0, timer.recent[pass]);
+}
+
+void DestroyPassTimer(MyPassTimer *timer)
+{
+   glDeleteQueries(PASS_TIMER_FRAMES * PASS_COUNT, &timer->queries[0][0]);
+}
+
+struct MyHDR
+{
+   // the scene renders here, in linear RGBA16F with its own depth
+   GLuint framebuffer;
+   GLuint colour;
+   GLuint depth;
+   int width;
+   int height;
+
+   // the bloom chain, R11F_G11F_B10F, which is half the bandwidth
+   int bloomLevels;
+   int bloomStart;               // the finest level in use, raised to fit the budget
+   int bloomSettle;              // frames until the start may move again
+   GLuint bloomFramebuffers[BLOOM_MAX_LEVELS];
+   GLuint bloomTextures[BLOOM_MAX_LEVELS];
+   ivec2 bloomSizes[BLOOM_MAX_LEVELS];
+
+   // full-screen passes draw one triangle from gl_VertexID, but core
+   // profile still wants a vertex array bound
+   GLuint screenVertexArray;
+   MyShader downsample;
+   MyShader upsample;
+   MyShader resolve;
+
+   MyHDR() : framebuffer(0), colour(0), depth(0), width(0), height(0),
+      bloomLevels(0), bloomStart(0), bloomSettle(0), screenVertexArray(0)
+   {
+      for (int level = 0; level < BLOOM_MAX_LEVELS; level++)
+      {
+         bloomFramebuffers[level] = 0;
+         bloomTextures[level] = 0;
+      }
+   }
+};
+
+// a linear filtered, edge clamped texture of the given format and size
+GLuint CreateRenderTexture(GLenum format, int width, int height)
+{
+   GLuint texture;
+   glGenTextures(1, &texture);
+   glBindTexture(GL_TEXTURE_2D, texture);
+   glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGB, GL_FLOAT, 0);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   return texture;
+}
+
+// frees the HDR target and bloom chain, which ResizeHDR() makes again
+void DestroyHDRTargets(MyHDR *hdr)
+{
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   glDeleteFramebuffers(1, &hdr->framebuffer);
+   glDeleteTextures(1, &hdr->colour);
+   glDeleteRenderbuffers(1, &hdr->depth);
+   glDeleteFramebuffers(hdr->bloomLevels, hdr->bloomFramebuffers);
+   glDeleteTextures(hdr->bloomLevels, hdr->bloomTextures);
+   hdr->framebuffer = hdr->colour = hdr->depth = 0;
+   hdr->bloomLevels = 0;
+}
+
+// (re)allocates the HDR target and bloom chain for a framebuffer of width
+// by height, returning true if they are complete
+bool ResizeHDR(MyHDR *hdr, int width, int height)
+{
+   DestroyHDRTargets(hdr);
+   hdr->width = std::max(width, 1);
+   hdr->height = std::max(height, 1);
+
+   hdr->colour = CreateRenderTexture(GL_RGBA16F, hdr->width, hdr->height);
+   glGenRenderbuffers(1, &hdr->depth);
+   glBindRenderbuffer(GL_RENDERBUFFER, hdr->depth);
+   glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, hdr->width, hdr->height);
+   glBindRenderbuffer(GL_RENDERBUFFER, 0);
+   glGenFramebuffers(1, &hdr->framebuffer);
+   glBindFramebuffer(GL_FRAMEBUFFER, hdr->framebuffer);
+   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hdr->colour, 0);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, hdr->depth);
+   bool isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+   ivec2 size = ivec2(hdr->width, hdr->height) / 2;
+   while (hdr->bloomLevels < BLOOM_MAX_LEVELS && std::min(size.x, size.y) >= BLOOM_MIN_SIZE)
+   {
+      int level = hdr->bloomLevels++;
+      hdr->bloomSizes[level] = size;
+      hdr->bloomTextures[level] = CreateRenderTexture(GL_R11F_G11F_B10F, size.x, size.y);
+      glGenFramebuffers(1, &hdr->bloomFramebuffers[level]);
+      glBindFramebuffer(GL_FRAMEBUFFER, hdr->bloomFramebuffers[level]);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hdr->bloomTextures[level], 0);
+      isComplete = isComplete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+      size /= 2;
+   }
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   hdr->bloomStart = std::max(std::min(hdr->bloomStart, hdr->bloomLevels - 1), 0);
+
+   if (!isComplete)
+      cout << "ERROR: HDR framebuffer incomplete" << endl;
+   return isComplete && !CheckGLErrors();
+}
+
+bool InitializeHDR(MyHDR *hdr, int width, int height)
+{
+   if (!InitializeShaders(&hdr->downsample, "screen_vertex.glsl", "bloom_down.glsl") ||
+      !InitializeShaders(&hdr->upsample, "screen_vertex.glsl", "bloom_up.glsl") ||
+      !InitializeShaders(&hdr->resolve, "screen_vertex.glsl", "tonemap.glsl"))
+      return false;
+   glGenVertexArrays(1, &hdr->screenVertexArray);
+   return ResizeHDR(hdr, width, height);
+}
+
+// binds the HDR target for the scene, first resized if the framebuffer was
+void BeginHDR(MyHDR *hdr, int width, int height)
+{
+   width = std::max(width, 1);
+   height = std::max(height, 1);
+   if (width != hdr->width || height != hdr->height)
+      ResizeHDR(hdr, width, height);
+   glBindFramebuffer(GL_FRAMEBUFFER, hdr->framebuffer);
+   glViewport(0, 0, hdr->width, hdr->height);
+}
+
+// moves the chain's finest level by the last frames' bloom time
+void FitBloomToBudget(MyHDR *hdr, const MyPassTimer& timer)
+{
+   if (hdr->bloomSettle > 0)
+   {
+      hdr->bloomSettle--;
+      return;
+   }
+   float milliseconds = timer.recent[PASS_BLOOM_DOWN] + timer.recent[PASS_BLOOM_UP];
+   if (milliseconds > BLOOM_BUDGET_MS && hdr->bloomStart < hdr->bloomLevels - 2)
+      hdr->bloomStart++;
+   else if (milliseconds < 0.5f * BLOOM_BUDGET_MS && hdr->bloomStart > 0)
+      hdr->bloomStart--;
+   else
+      return;
+   hdr->bloomSettle = BLOOM_SETTLE_FRAMES;
+}
+
+void DrawScreenPass(MyShader *shader, GLuint source, ivec2 sourceSize)
+{
+   glBindTexture(GL_TEXTURE_2D, source);
+   glUniform2f(glGetUniformLocation(shader->program, "sourceTexel"), 1.0f / sourceSize.x, 1.0f / sourceSize.y);
+   glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// blurs what is bright in the HDR target down the bloom chain and back up,
+// then tonemaps the two onto the default framebuffer
+void ResolveHDR(MyHDR *hdr, MyPassTimer *timer, bool isBloom)
+{
+   glDisable(GL_DEPTH_TEST);
+   glBindVertexArray(hdr->screenVertexArray);
+   glActiveTexture(GL_TEXTURE0);
+   int levels = isBloom ? hdr->bloomLevels - hdr->bloomStart : 0;
+
+   // down: the first level from the HDR target, prefiltered, each other
+   // from the one above it
+   BeginPass(timer, PASS_BLOOM_DOWN);
+   glUseProgram(hdr->downsample.program);
+   glUniform1i(glGetUniformLocation(hdr->downsample.program, "source"), 0);
+   glUniform1f(glGetUniformLocation(hdr->downsample.program, "threshold"), BLOOM_THRESHOLD);
+   glUniform1f(glGetUniformLocation(hdr->downsample.program, "knee"), BLOOM_KNEE);
+   GLint isPrefilterUniform = glGetUniformLocation(hdr->downsample.program, "isPrefilter");
+   for (int level = hdr->bloomStart; level < hdr->bloomStart + levels; level++)
+   {
+      bool isFirst = level == hdr->bloomStart;
+      glBindFramebuffer(GL_FRAMEBUFFER, hdr->bloomFramebuffers[level]);
+      glViewport(0, 0, hdr->bloomSizes[level].x, hdr->bloomSizes[level].y);
+      glUniform1i(isPrefilterUniform, isFirst);
+      if (isFirst)
+         DrawScreenPass(&hdr->downsample, hdr->colour, ivec2(hdr->width, hdr->height));
+      else
+         DrawScreenPass(&hdr->downsample, hdr->bloomTextures[level - 1], hdr->bloomSizes[level - 1]);
+   }
+   EndPass(timer);
+
+   // up: each level added into the one above it, back to the first
+   BeginPass(timer, PASS_BLOOM_UP);
+   glUseProgram(hdr->upsample.program);
+   glUniform1i(glGetUniformLocation(hdr->upsample.program, "source"), 0);
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_ONE, GL_ONE);
+   for (int level = hdr->bloomStart + levels - 2; level >= hdr->bloomStart; level--)
+   {
+      glBindFramebuffer(GL_FRAMEBUFFER, hdr->bloomFramebuffers[level]);
+      glViewport(0, 0, hdr->bloomSizes[level].x, hdr->bloomSizes[level].y);
+      DrawScreenPass(&hdr->upsample, hdr->bloomTextures[level + 1], hdr->bloomSizes[level + 1]);
+   }
+   glDisable(GL_BLEND);
+   EndPass(timer);
+
+   // the first level sums every level's blur, so its strength is shared
+   // out between them
+   BeginPass(timer, PASS_RESOLVE);
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   glViewport(0, 0, hdr->width, hdr->height);
+   glUseProgram(hdr->resolve.program);
+   glUniform1i(glGetUniformLocation(hdr->resolve.program, "scene"), 0);
+   glUniform1i(glGetUniformLocation(hdr->resolve.program, "bloom"), 1);
+   glUniform1f(glGetUniformLocation(hdr->resolve.program, "bloomStrength"),
+      levels > 0 ? BLOOM_STRENGTH / levels : 0.0f);
+   glUniform1f(glGetUniformLocation(hdr->resolve.program, "exposure"), 1.0f);
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_2D, levels > 0 ? hdr->bloomTextures[hdr->bloomStart] : 0);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, hdr->colour);
+   glDrawArrays(GL_TRIANGLES, 0, 3);
+   EndPass(timer);
+
+   // reset state to default (no shader, geometry or texture bound)
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glBindVertexArray(0);
+   glUseProgram(0);
+   glEnable(GL_DEPTH_TEST);
+
+   CheckGLErrors();
+}
+
+// deallocate HDR objects
+void DestroyHDR(MyHDR *hdr)
+{
+   DestroyHDRTargets(hdr);
+   glDeleteVertexArrays(1, &hdr->screenVertexArray);
+   DestroyShaders(&hdr->downsample);
+   DestroyShaders(&hdr->upsample);
+   DestroyShaders(&hdr->resolve);
+}
+
+// --------------------------------------------------------------------------
+// Rendering function that draws our scene to the frame buffer
+
+void RenderScene(MyGeometry *geometry, MyShader *shader, MyTexture* texture, 
+   mat4 proj, mat4 view, mat4 model, mat4 mvp, mat4 normalMatrix, vec3 light, bool isShaded,
+   ivec2 resolution = ivec2(0), bool isSelected = false, float emission = 1.0f)
+{
+   // bind our shader program and the vertex array object
+   glBindTexture(texture->target, texture->textureID);
+   glUseProgram(shader->program);
+   glBindVertexArray(geometry->vertexArray);
+
+   // Get uniforms
+   GLint modelUniform = glGetUniformLocation(shader->program, "model");
+   GLint viewUniform = glGetUniformLocation(shader->program, "view");
+   GLint projUniform = glGetUniformLocation(shader->program, "proj");
+   GLint mvpUniform = glGetUniformLocation(shader->program, "mvp");
+   GLint normalMatrixUniform = glGetUniformLocation(shader->program, "normalMatrix");
+   GLint lightUniform = glGetUniformLocation(shader->program, "light");
+   GLint isShadedUniform = glGetUniformLocation(shader->program, "isShaded");
+   GLint isProceduralUniform = glGetUniformLocation(shader->program, "isProcedural");
+   GLint resolutionUniform = glGetUniformLocation(shader->program, "resolution");
+   GLint viewportUniform = glGetUniformLocation(shader->program, "viewport");
+   GLint edgePixelsUniform = glGetUniformLocation(shader->program, "edgePixels");
+   GLint isInstancedUniform = glGetUniformLocation(shader->program, "isInstanced");
+   GLint isSelectedUniform = glGetUniformLocation(shader->program, "isSelected");
+   GLint emissionUniform = glGetUniformLocation(shader->program, "emission");
+
+   glUniformMatrix4fv(modelUniform, 1, false, value_ptr(model));
+   glUniformMatrix4fv(viewUniform, 1, false, value_ptr(view));
+   glUniformMatrix4fv(projUniform, 1, false, value_ptr(proj));
+   glUniformMatrix4fv(mvpUniform, 1, false, value_ptr(mvp));
+   glUniformMatrix4fv(normalMatrixUniform, 1, false, value_ptr(normalMatrix));
+   glUniform3fv(lightUniform, 1, value_ptr(light));
+   glUniform1i(isShadedUniform, isShaded);
+   glUniform1i(isProceduralUniform, geometry->isProcedural);
+   glUniform1i(isInstancedUniform, false);
+   glUniform1i(isSelectedUniform, isSelected);
+   glUniform1f(emissionUniform, emission);
+   glUniform2iv(resolutionUniform, 1, value_ptr(resolution));
+
+   if (geometry->primitive == GL_PATCHES)
+   {
+      GLint viewport[4];
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      glUniform2f(viewportUniform, float(viewport[2]), float(viewport[3]));
+      glUniform1f(edgePixelsUniform, 8.0f);
+      glPatchParameteri(GL_PATCH_VERTICES, 3);
+   }
+
+   // tell OpenGL to draw our geometry
+   if (geometry->isProcedural)
+   {
+      // two triangles per grid quad, no buffers bound
+      glDrawArrays(GL_TRIANGLES, 0, 6 * (resolution.x - 1) * (resolution.y - 1));
+   }
+   else
+   {
+      glDrawElements(geometry->primitive, geometry->elementCount, GL_UNSIGNED_INT, 0);
+   }
+
+   // reset state to default (no shader or geometry bound)
+   glBindTexture(texture->target, 0);
+   glBindVertexArray(0);
+   glUseProgram(0);
+
+   // check for an report any OpenGL errors
+   CheckGLErrors();
+}
+
+// draws every body of the body system as a small procedural sphere, one
+// instanced draw call for all of them
+void RenderBodies(MyBodyInstances *instances, MyShader *shader, MyTexture* texture,
+   mat4 proj, mat4 view, vec3 light, ivec2 resolution)
+{
+   if (instances->count == 0)
+      return;
+
+   glBindTexture(texture->target, texture->textureID);
+   glUseProgram(shader->program);
+   glBindVertexArray(instances->vertexArray);
+
+   glUniformMatrix4fv(glGetUniformLocation(shader->program, "view"), 1, false, value_ptr(view));
+   glUniformMatrix4fv(glGetUniformLocation(shader->program, "proj"), 1, false, value_ptr(proj));
+   glUniform3fv(glGetUniformLocation(shader->program, "light"), 1, value_ptr(light));
+   glUniform1i(glGetUniformLocation(shader->program, "isShaded"), true);
+   glUniform1i(glGetUniformLocation(shader->program, "isProcedural"), true);
+   glUniform1i(glGetUniformLocation(shader->program, "isInstanced"), true);
+   glUniform1i(glGetUniformLocation(shader->program, "isSelected"), false);
+   glUniform1f(glGetUniformLocation(shader->program, "emission"), 1.0f);
+   glUniform2iv(glGetUniformLocation(shader->program, "resolution"), 1, value_ptr(resolution));
+
+   glDrawArraysInstanced(GL_TRIANGLES, 0, 6 * (resolution.x - 1) * (resolution.y - 1), instances->count);
+
+   // reset state to default (no shader or geometry bound)
+   glUniform1i(glGetUniformLocation(shader->program, "isInstanced"), false);
+   glBindTexture(texture->target, 0);
+   glBindVertexArray(0);
+   glUseProgram(0);
+
+   CheckGLErrors();
+}
+
+// draws the chunks the terrain selected this frame, each quadrant run in
+// one call; eyeViewProj takes positions relative to the eye in the
+// planet's object space to clip space
+void RenderTerrain(MyTerrain *terrain, const PlanetTerrain& planet, MyShader *shader, MyTexture* texture,
+   mat4 eyeViewProj, mat4 model, mat4 normalMatrix, vec3 eye, vec3 eyeObject, vec3 light, bool isSelected)
+{
+   glBindTexture(texture->target, texture->textureID);
+   glUseProgram(shader->program);
+
+   glUniformMatrix4fv(glGetUniformLocation(shader->program, "eyeViewProj"), 1, false, value_ptr(eyeViewProj));
+   glUniformMatrix4fv(glGetUniformLocation(shader->program, "model"), 1, false, value_ptr(model));
+   glUniformMatrix4fv(glGetUniformLocation(shader->program, "normalMatrix"), 1, false, value_ptr(normalMatrix));
+   glUniform3fv(glGetUniformLocation(shader->program, "eye"), 1, value_ptr(eye));
+   glUniform3fv(glGetUniformLocation(shader->program, "eyeObject"), 1, value_ptr(eyeObject));
+   glUniform3fv(glGetUniformLocation(shader->program, "light"), 1, value_ptr(light));
+   glUniform1i(glGetUniformLocation(shader->program, "isShaded"), true);
+   glUniform1i(glGetUniformLocation(shader->program, "isSelected"), isSelected);
+   GLint chunkOffsetUniform = glGetUniformLocation(shader->program, "chunkOffset");
+   GLint morphRangeUniform = glGetUniformLocation(shader->program, "morphRange");
+
+   for (size_t i = 0; i < planet.draws.size(); i++)
+   {
+      const TerrainDraw& draw = planet.draws[i];
+      glUniform3fv(chunkOffsetUniform, 1, value_ptr(draw.offset));
+      glUniform2fv(morphRangeUniform, 1, value_ptr(draw.morphRange));
+      glBindVertexArray(terrain->vertexArrays[draw.chunk]);
+      for (int q = 0; q < 4; q++)
+      {
+         if (!(draw.quadrants & (1 << q)))
+            continue;
+         int first = q;
+         while (q < 3 && (draw.quadrants & (1 << (q + 1))))
+            q++;
+         glDrawElements(GL_TRIANGLES, (q - first + 1) * TERRAIN_QUADRANT_INDICES, GL_UNSIGNED_INT,
+            (const GLvoid*)(sizeof(unsigned int) * first * TERRAIN_QUADRANT_INDICES));
+      }
+   }
+
+   // reset state to default (no shader or geometry bound)
+   glBindTexture(texture->target, 0);
+   glBindVertexArray(0);
+   glUseProgram(0);
+
+   CheckGLErrors();
+}
+
+// --------------------------------------------------------------------------
+// GLFW callback functions
+
+// reports GLFW errors
+void ErrorCallback(int error, const char* description)
+{
+   cout << "GLFW ERROR " << error << ":" << endl;
+   cout << description << endl;
+}
+
+// handles keyboard input events; everything but quitting and the sphere
+// mode is queued for the simulation thread. Camera keys are not events,
+// they are polled every frame by KeyAxis().
+void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+   {
+      glfwSetWindowShouldClose(window, GL_TRUE);
+   }
+   else if (key == GLFW_KEY_P && action == GLFW_PRESS)
+   {
+      sphereMode_ = SphereMode((sphereMode_ + 1) % SPHERE_MODE_COUNT);
+   }
+   else if (key == GLFW_KEY_T && action == GLFW_PRESS)
+   {
+      isTerrain_ = !isTerrain_;
+   }
+   else if (key == GLFW_KEY_F && action == GLFW_PRESS)
+   {
+      isFollowingEarth_ = !isFollowingEarth_;
+   }
+   else if (key == GLFW_KEY_V && action == GLFW_PRESS)
+   {
+      isVirtualTexture_ = !isVirtualTexture_;
+   }
+   else if (key == GLFW_KEY_B && action == GLFW_PRESS)
+   {
+      isBloom_ = !isBloom_;
+   }
+   else if (!simulation_)
+   {
+      return;
+   }
+   else if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+   {
+      simulation_->queueCommand(TOGGLE_PAUSE);
+   }
+   else if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS)
+   {
+      simulation_->queueCommand(WARP_SLOWER);
+   }
+   else if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS)
+   {
+      simulation_->queueCommand(WARP_FASTER);
+   }
+   else if (key == GLFW_KEY_BACKSPACE && action == GLFW_PRESS)
+   {
+      simulation_->queueCommand(RESET_TIME);
+   }
+   else if (key == GLFW_KEY_G && action == GLFW_PRESS)
+   {
+      simulation_->queueCommand(TOGGLE_GRAVITY);
+   }
+   else if (key == GLFW_KEY_H && action == GLFW_PRESS)
+   {
+      simulation_->queueCommand(TOGGLE_DIRECT_SUM);
+   }
+}
+
+// remembers where the left button went down, picked on the next frame
+void MouseButtonCallback(GLFWwindow* window, int button, int action, int)
+{
+   if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+   {
+      glfwGetCursorPos(window, &pickCursor_.x, &pickCursor_.y);
+      isPickRequested_ = true;
+   }
+}
+
+// 1 while only the positive key is held, -1 for only the negative one
+float KeyAxis(GLFWwindow* window, int positive, int negative)
+{
+   return float(glfwGetKey(window, positive) == GLFW_PRESS) -
+      float(glfwGetKey(window, negative) == GLFW_PRESS);
+}
+
+// --------------------------------------------------------------------------
+// Picking
+
+// what the last click hit; at most one of the two is set
+struct Selection
+{
+   int object;  // a SceneObject, or -1
+   int body;    // index into the frame packet's bodies, or -1
+
+   Selection() : object(-1), body(-1) {}
+};
+
+// bodies are only a pixel or two across, so they are picked as if they
+// were at least this many pixels in radius at the camera's target distance
+const float PICK_PIXELS = 4.0f;
+
+// radius in world units of PICK_PIXELS at the camera's target distance
+float PickRadius(const Camera& camera, const mat4& proj, int height)
+{
+   return PICK_PIXELS * 2.0f * camera.distance / (proj[1][1] * float(height));
+}
+
+// casts a ray from the camera through cursor at the sun, earth and moon
+// and at the frame's bodies, refitting their hierarchy to the packet's
+// positions first, and selects the nearest hit
+Selection Pick(GLFWwindow* window, dvec2 cursor, const Camera& camera, const mat4& proj,
+   const mat4& view, const FramePacket* frame, SphereBVH* bvh)
+{
+   int width, height;
+   glfwGetWindowSize(window, &width, &height);
+   vec2 ndc(2.0f * float(cursor.x) / float(width) - 1.0f, 1.0f - 2.0f * float(cursor.y) / float(height));
+   vec4 farPoint = inverse(proj * view) * vec4(ndc, 1.0f, 1.0f);
+   vec3 origin = camera.pos;
+   vec3 direction = normalize(vec3(farPoint) / farPoint.w - origin);
+
+   Selection selection;
+   float nearest = FLT_MAX;
+   for (int i = OBJECT_SUN; i <= OBJECT_MOON; i++)
+   {
+      const mat4& model = frame->model[i];
+      float radius = length(vec3(model[0]));
+      float distance;
+      if (intersectRaySphere(origin, direction, vec3(model[3]), radius * radius, distance) && distance < nearest)
+      {
+         nearest = distance;
+         selection.object = i;
+      }
+   }
+
+   int count = int(frame->bodyX.size());
+   if (count > 0)
+   {
+      bvh->update(frame->bodyX.data(), frame->bodyY.data(), frame->bodyZ.data(),
+         frame->bodyStatic->data(), count, PickRadius(camera, proj, height));
+      float distance;
+      int body = bvh->intersect(origin, direction, &distance);
+      if (body >= 0 && distance < nearest)
+      {
+         selection.object = -1;
+         selection.body = body;
+      }
+   }
+   return selection;
+}
+
+// the files --build-pack packs: the shaders, the textures and whichever of
+// the textures' thumbnails and the atmosphere's tables have been written
+vector<string> PackedAssets()
+{
+   const char* shaders[] = { "vertex.glsl", "fragment.glsl", "terrain_vertex.glsl", "tess_vertex.glsl",
+      "tess_control.glsl", "tess_eval.glsl", "vt_feedback.glsl", "screen_vertex.glsl", "bloom_down.glsl",
+      "bloom_up.glsl", "tonemap.glsl", "atmosphere_vertex.glsl", "atmosphere.glsl" };
+   const char* textures[] = { "textures/texture_sun.jpg", "textures/texture_earth_surface.jpg",
+      "textures/texture_moon.jpg", "textures/stars_milkyway.jpg" };
+   vector<string> files(shaders, shaders + sizeof(shaders) / sizeof(shaders[0]));
+   if (ifstream("atmosphere.lut"))
+      files.push_back("atmosphere.lut");
+   for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); i++)
+   {
+      files.push_back(textures[i]);
+      string thumbnail = string(textures[i]) + ".thumb";
+      if (ifstream(thumbnail.c_str()))
+         files.push_back(thumbnail);
+   }
+   return files;
+}
+
+// ==========================================================================
+// PROGRAM ENTRY POINT
+
+int main(int argc, char *argv[])
+{
+   // the scene, bodies and gravity, stepped on their own thread once the
+   // window is up
+   Simulation simulation;
+   simulation_ = &simulation;
+   double simulationRate = 120.0;
+
+   // worker threads for the job system, all hardware threads by default
+   InitializeJobs();
+
+   // the JPEG decoder's kernels for this CPU, before anything is decoded
+   InstallJpegKernels();
+   bool isJobTiming = false;
+   bool isGPUTiming = false;
+
+   // the earth's surface, its chunks built by jobs as the camera needs them
+   PlanetTerrain terrain;
+   string heightMapFile;
+
+   // shaders and textures come from the asset pack if there is one, else
+   // from their files
+   AssetPack assets;
+   string packFile = "assets.pack";
+
+   // textures of the sun, earth, moon and galaxy, kept within a budget
+   TextureManager textures;
+
+   // the earth's imagery, streamed in tiles from a virtual texture file;
+   // the default one is built from the earth texture on the first run
+   VirtualTexture virtualTexture;
+   const char* defaultVirtualFile = "earth_surface.vtex";
+   string virtualFile = defaultVirtualFile;
+   int cacheSide = 16;
+
+   // command line benchmarks run without opening a window
+   for (int i = 1; i < argc; i++)
+   {
+      string arg = argv[i];
+      if (arg == "--threads" && i + 1 < argc)
+      {
+         InitializeJobs(atoi(argv[++i]));
+      }
+      else if (arg == "--job-timing")
+      {
+         isJobTiming = true;
+         SetJobTiming(true);
+      }
+      else if (arg == "--gpu-timing")
+      {
+         isGPUTiming = true;
+      }
+      else if (arg == "--bench-transforms")
+      {
+         BenchmarkTransforms(100000);
+         return 0;
+      }
+      else if (arg == "--bodies" && i + 1 < argc)
+      {
+         if (!simulation.bodies.loadFromFile(argv[++i]))
+            return -1;
+      }
+      else if (arg == "--belt" && i + 1 < argc)
+      {
+         simulation.bodies.addBelt(simulation.sunBody, atoi(argv[++i]), 16.0f, 24.0f, radians(4.0f), 0.02f, 0.08f);
+      }
+      else if (arg == "--time" && i + 1 < argc)
+      {
+         simulation.time = atof(argv[++i]);
+      }
+      else if (arg == "--bench-kepler" && i + 1 < argc)
+      {
+         BenchmarkKepler(atoi(argv[++i]));
+         return 0;
+      }
+      else if (arg == "--bench-nbody" && i + 1 < argc)
+      {
+         BenchmarkNBody(atoi(argv[++i]));
+         return 0;
+      }
+      else if (arg == "--bench-picking" && i + 1 < argc)
+      {
+         BenchmarkPicking(atoi(argv[++i]));
+         return 0;
+      }
+      else if (arg == "--bench-meshes" && i + 1 < argc)
+      {
+         BenchmarkMeshGeneration(atoi(argv[++i]));
+         return 0;
+      }
+      else if (arg == "--bench-jpeg" && i + 1 < argc)
+      {
+         int iterations = atoi(argv[++i]);
+         const char* extraFile = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : 0;
+         BenchmarkJpegDecode(iterations, extraFile);
+         return 0;
+      }
+      else if (arg == "--bench-terrain" && i + 1 < argc)
+      {
+         BenchmarkTerrain(atoi(argv[++i]));
+         return 0;
+      }
+      else if (arg == "--heightmap" && i + 1 < argc)
+      {
+         heightMapFile = argv[++i];
+      }
+      else if (arg == "--terrain-height" && i + 1 < argc)
+      {
+         terrain.heights.scale = float(atof(argv[++i]));
+      }
+      else if (arg == "--build-vt" && i + 2 < argc)
+      {
+         stbi_set_flip_vertically_on_load(true);
+         const char* imageFile = argv[++i];
+         const char* file = argv[++i];
+         return BuildVirtualTexture(imageFile, file) ? 0 : -1;
+      }
+      else if (arg == "--earth-vt" && i + 1 < argc)
+      {
+         virtualFile = argv[++i];
+      }
+      else if (arg == "--vt-cache" && i + 1 < argc)
+      {
+         cacheSide = atoi(argv[++i]);
+      }
+      else if (arg == "--texture-budget" && i + 1 < argc)
+      {
+         textures.budget = size_t(atof(argv[++i]) * 1048576.0);
+      }
+      else if (arg == "--max-texture-size" && i + 1 < argc)
+      {
+         textures.maxSize = atoi(argv[++i]);
+      }
+      else if (arg == "--bench-resample" && i + 1 < argc)
+      {
+         BenchmarkResample(atoi(argv[++i]));
+         return 0;
+      }
+      else if (arg == "--build-pack" && i + 1 < argc)
+      {
+         return WriteAssetPack(argv[++i], PackedAssets(), true) ? 0 : -1;
+      }
+      else if (arg == "--pack" && i + 1 < argc)
+      {
+         packFile = argv[++i];
+      }
+      else if (arg == "--nbody")
+      {
+         simulation.isGravity = true;
+      }
+      else if (arg == "--direct")
+      {
+         simulation.isDirectSum = true;
+      }
+      else if (arg == "--theta" && i + 1 < argc)
+      {
+         simulation.gravity.theta = float(atof(argv[++i]));
+      }
+      else if (arg == "--sim-rate" && i + 1 < argc)
+      {
+         simulationRate = atof(argv[++i]);
+      }
+   }
+
+   if (assets.open(packFile.c_str()))
+   {
+      assets_ = &assets;
+      textures.assets = &assets;
+   }
+
+   // initialize the GLFW windowing system
+   if (!glfwInit()) {
+      cout << "ERROR: GLFW failed to initialize, TERMINATING" << endl;
+      return -1;
+   }
+   glfwSetErrorCallback(ErrorCallback);
+
+   // attempt to create a window with an OpenGL 4.1 core profile context
+   GLFWwindow *window = 0;
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+   window = glfwCreateWindow(512, 512, "CPSC 453 OpenGL Assignment 5", 0, 0);
+   if (!window) {
+      cout << "Program failed to create GLFW window, TERMINATING" << endl;
+      glfwTerminate();
+      return -1;
+   }
+
+   // set keyboard callback function and make our context current (active)
+   glfwSetKeyCallback(window, KeyCallback);
+   glfwSetMouseButtonCallback(window, MouseButtonCallback);
+   glfwMakeContextCurrent(window);
+
+   //Intialize GLAD
+   if (!gladLoadGL())
+   {
+      cout << "GLAD init failed" << endl;
+      return -1;
+   }
+
+   // query and print out information about our OpenGL environment
+   QueryGLVersion();
+
+   // textures larger than the GPU takes are resampled down as they decode
+   GLint maxTextureSize = 0;
+   glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+   textures.maxSize = textures.maxSize > 0 ? std::min(textures.maxSize, int(maxTextureSize)) : int(maxTextureSize);
+
+   // the textures' thumbnails go up right away; the textures themselves
+   // decode as jobs, at full resolution as far as the budget goes, and
+   // fill in over the first frames, as do the sphere mesh while this
+   // thread compiles the shaders
+   JobCounter loading;
+   stbi_set_flip_vertically_on_load(true);
+   int sunTexture = textures.acquire("textures/texture_sun.jpg");
+   int earthTexture = textures.acquire("textures/texture_earth_surface.jpg");
+   int moonTexture = textures.acquire("textures/texture_moon.jpg");
+   int galaxyTexture = textures.acquire("textures/stars_milkyway.jpg");
+   MyManagedTextures managedTextures;
+   if (!InitializeManagedTextures(&managedTextures)) {
+      cout << "Program failed to intialize textures!" << endl;
+      return -1;
+   }
+   UpdateManagedTextures(&managedTextures, &textures, ~size_t(0));
+   for (int i = 0; i < textures.textureCount(); i++)
+      textures.use(i, FLT_MAX);
+   textures.update();
+
+   // the earth's pixels once more, for the terrain's land mask
+   MyImage earthImage;
+   RunJob("decode texture", [&]() { LoadImage(&earthImage, "textures/texture_earth_surface.jpg"); }, &loading);
+   if (!heightMapFile.empty())
+      RunJob("decode heightmap", [&]() { terrain.heights.loadHeightMap(heightMapFile.c_str()); }, &loading);
+
+   // the sphere mesh comes from its cache file, which is generated and
+   // written on the first run
+   const char* sphereFile = "uvsphere_200x100.mesh";
+   MappedMesh sphereMesh;
+   MeshData sphereData;
+   RunJob("load sphere", [&]() {
+      if (sphereMesh.open(sphereFile))
+         return;
+      GenerateUVSphere(&sphereData, 1.0f, 200, 100);
+      if (WriteMeshFile(sphereFile, sphereData.vertices, sphereData.indices))
+         sphereMesh.open(sphereFile);
+   }, &loading);
+   RunJob("open virtual texture", [&]() {
+      if (virtualTexture.open(virtualFile.c_str(), cacheSide) || virtualFile != defaultVirtualFile)
+         return;
+      if (BuildVirtualTexture("textures/texture_earth_surface.jpg", defaultVirtualFile))
+         virtualTexture.open(defaultVirtualFile, cacheSide);
+   }, &loading);
+
+   // the atmosphere's tables come from their cache file, which is computed
+   // and written on the first run
+   const char* atmosphereFile = "atmosphere.lut";
+   AtmosphereTables atmosphereTables;
+   RunJob("load atmosphere", [&]() {
+      if (ReadAtmosphereFile(atmosphereFile, assets_, &atmosphereTables))
+         return;
+      ComputeAtmosphereTables(&atmosphereTables);
+      WriteAtmosphereFile(atmosphereFile, atmosphereTables);
+   }, &loading);
+
+   // call function to load and compile shader programs
+   MyShader shader;
+   if (!InitializeShaders(&shader)) {
+      cout << "Program could not initialize shaders, TERMINATING" << endl;
+      return -1;
+   }
+   MyShader tessShader;
+   if (!InitializeTessellationShaders(&tessShader)) {
+      cout << "Program could not initialize tessellation shaders, TERMINATING" << endl;
+      return -1;
+   }
+   MyShader terrainShader;
+   if (!InitializeShaders(&terrainShader, "terrain_vertex.glsl")) {
+      cout << "Program could not initialize terrain shaders, TERMINATING" << endl;
+      return -1;
+   }
+   MyShader feedbackShader;
+   MyShader terrainFeedbackShader;
+   if (!InitializeShaders(&feedbackShader, "vertex.glsl", "vt_feedback.glsl") ||
+      !InitializeShaders(&terrainFeedbackShader, "terrain_vertex.glsl", "vt_feedback.glsl")) {
+      cout << "Program could not initialize feedback shaders, TERMINATING" << endl;
+      return -1;
+   }
+
+   // the rest needs the jobs' results
+   WaitForCounter(&loading);
+
+   // call function to create and fill buffers with geometry data
+   MyGeometry geometry;
+   bool isGeometry = sphereMesh.isOpen() ? InitializeGeometry(&geometry, sphereMesh) :
+      InitializeGeometry(&geometry, sphereData);
+   sphereMesh.close();
+   if (!isGeometry) {
+      cout << "Program failed to intialize geometry!" << endl;   
+      return -1;
+   }
+   MyGeometry proceduralGeometry;
+   if (!InitializeProceduralGeometry(&proceduralGeometry)) {
+      cout << "Program failed to intialize procedural geometry!" << endl;
+      return -1;
+   }
+   MyGeometry tessGeometry;
+   if (!InitializeTessellatedGeometry(&tessGeometry)) {
+      cout << "Program failed to intialize tessellated geometry!" << endl;
+      return -1;
+   }
+   MyBodyInstances bodyInstances;
+   if (!InitializeBodyInstances(&bodyInstances)) {
+      cout << "Program failed to intialize body instances!" << endl;
+      return -1;
+   }
+
+   // the terrain's heights follow the earth texture's land unless a
+   // heightmap was given; the root chunks are built and uploaded now
+   terrain.heights.setLandMask(earthImage.data, earthImage.width, earthImage.height, earthImage.components);
+   stbi_image_free(earthImage.data);
+   terrain.initialize();
+   MyTerrain terrainBuffers;
+   if (!InitializeTerrain(&terrainBuffers)) {
+      cout << "Program failed to intialize terrain!" << endl;
+      return -1;
+   }
+   UpdateTerrain(&terrainBuffers, &terrain);
+
+   // without its virtual texture the earth keeps its ordinary one
+   MyVirtualTexture vtBuffers;
+   if (virtualTexture.isOpen())
+   {
+      int width, height;
+      glfwGetFramebufferSize(window, &width, &height);
+      if (!InitializeVirtualTexture(&vtBuffers, &virtualTexture, width, height)) {
+         cout << "Program failed to intialize the virtual texture!" << endl;
+         return -1;
+      }
+   }
+
+   MyAtmosphere atmosphere;
+   bool isAtmosphere = InitializeAtmosphere(&atmosphere, atmosphereTables);
+   atmosphereTables = AtmosphereTables();
+   if (!isAtmosphere) {
+      cout << "Program failed to intialize the atmosphere!" << endl;
+      return -1;
+   }
+
+   // the scene renders in HDR, resolved to the screen through the bloom
+   // and tonemapping passes, each timed on the GPU
+   MyHDR hdr;
+   MyPassTimer passTimer;
+   {
+      int width, height;
+      glfwGetFramebufferSize(window, &width, &height);
+      if (!InitializeHDR(&hdr, width, height) || !InitializePassTimer(&passTimer)) {
+         cout << "Program failed to intialize the HDR target!" << endl;
+         return -1;
+      }
+   }
+
+   // Enable Depth Testing
+   glEnable(GL_DEPTH_TEST);
+
+   // Setup Camera
+   Camera camera(vec3(0.f, 1.f, -1.f), vec3(0.f, 10.f, -10.f));
+
+   // from here on the simulation thread owns the simulation's state, this
+   // thread only reads the frame packets it publishes
+   simulation.start(simulationRate);
+   const FramePacket* frame = simulation.latestFrame();
+   while (!frame)
+   {
+      this_thread::yield();
+      frame = simulation.latestFrame();
+   }
+   int frames = 0;
+   double lastTime = glfwGetTime();
+   SphereBVH bodyBVH;
+   Selection selection;
+   MyOccluders occluders;
+
+   // run an event-triggered main loop
+   while (!glfwWindowShouldClose(window))
+   {
+      // draw the latest state, or the last one again if no step finished
+      frame = simulation.latestFrame();
+
+      // following the earth, the camera orbits it and keeps above the
+      // ground under it
+      const mat4& earthModel = frame->model[OBJECT_EARTH];
+      if (isFollowingEarth_)
+      {
+         camera.target = vec3(earthModel[3]);
+         dvec3 down = dvec3(normalize(inverse(mat3(earthModel)) * camera.dir));
+         float ground = isTerrain_ ? 1.0f + float(terrain.heights.height(down)) : 1.0f;
+         camera.surface = length(vec3(earthModel[0])) * ground;
+      }
+      else
+      {
+         camera.target = vec3(0.0f);
+         camera.surface = 0.0f;
+      }
+
+      // the camera moves by the held keys for as long as the last frame
+      // took, capped so a stall does not throw it across the scene
+      double now = glfwGetTime();
+      float dt = float(std::min(now - lastTime, 0.1));
+      lastTime = now;
+      camera.update(dt,
+         vec2(KeyAxis(window, GLFW_KEY_D, GLFW_KEY_A), KeyAxis(window, GLFW_KEY_W, GLFW_KEY_S)),
+         KeyAxis(window, GLFW_KEY_E, GLFW_KEY_Q));
+
+      // make a projection matrix, the near plane coming in with the
+      // camera's height above the surface it orbits
+      float nearPlane = std::min(0.1f, 0.5f * (camera.distance - camera.surface));
+      mat4 proj = perspective(radians(80.0f), 1.0f, nearPlane, 1000.0f);
+
+      // clear the HDR target to a dark grey colour
+      int framebufferWidth, framebufferHeight;
+      glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+      BeginHDR(&hdr, framebufferWidth, framebufferHeight);
+      BeginPass(&passTimer, PASS_SCENE);
+      glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+      glEnable(GL_DEPTH_TEST);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      glUseProgram(shader.program);
+
+      UpdateBodyInstances(&bodyInstances, frame);
+
+      // the spheres that can eclipse the sun, for every shaded program
+      UpdateOccluders(&occluders, frame);
+      UseOccluders(occluders, &shader);
+      UseOccluders(occluders, &tessShader);
+      UseOccluders(occluders, &terrainShader);
+      UseOccluders(occluders, &atmosphere.shader);
+
+      mat4 view = camera.getViewMatrix();
+      const mat4& sunModel = frame->model[OBJECT_SUN];
+      const mat4& moonModel = frame->model[OBJECT_MOON];
+      const mat4& galaxyModel = frame->model[OBJECT_GALAXY];
+      mat4 viewProj = proj * view;
+
+      if (isPickRequested_)
+      {
+         isPickRequested_ = false;
+         selection = Pick(window, pickCursor_, camera, proj, view, frame, &bodyBVH);
+      }
+
+      MyGeometry* sphere = &geometry;
+      MyShader* sphereShader = &shader;
+      if (sphereMode_ == SPHERE_PROCEDURAL)
+      {
+         sphere = &proceduralGeometry;
+      }
+      else if (sphereMode_ == SPHERE_TESSELLATED)
+      {
+         sphere = &tessGeometry;
+         sphereShader = &tessShader;
+      }
+
+      // the textures drawn this frame and how large, which decide what the
+      // texture manager loads and evicts; the earth's is not drawn while
+      // its virtual texture is
+      bool isEarthVirtual = virtualTexture.isOpen() && isVirtualTexture_;
+      float sunPixels = SpherePixels(sunModel, proj, viewProj, camera.pos, framebufferHeight);
+      float earthPixels = SpherePixels(earthModel, proj, viewProj, camera.pos, framebufferHeight);
+      float moonPixels = SpherePixels(moonModel, proj, viewProj, camera.pos, framebufferHeight);
+      if (sunPixels > 0.0f)
+         textures.use(sunTexture, sunPixels);
+      if (earthPixels > 0.0f && !isEarthVirtual)
+         textures.use(earthTexture, earthPixels);
+      if (moonPixels > 0.0f)
+         textures.use(moonTexture, moonPixels);
+      if (bodyInstances.count > 0)
+         textures.use(moonTexture, 1.0f);
+      textures.use(galaxyTexture, FLT_MAX);
+      textures.update();
+      UpdateManagedTextures(&managedTextures, &textures);
+
+      // Sun 
+      RenderScene(sphere, sphereShader, ManagedTexture(&managedTextures, sunTexture), proj, view, sunModel,
+         viewProj * sunModel, frame->normal[OBJECT_SUN], vec3(0.0f), false,
+         SphereResolution(sunModel, camera.pos), selection.object == OBJECT_SUN, SUN_EMISSION);
+
+      // Earth, with the eye relative to it from the camera's own offset,
+      // which stays exact close to the ground while following it
+      vec3 eyeOffset = camera.target - vec3(earthModel[3]) + camera.dir * camera.distance;
+      vec3 eyeObject = inverse(mat3(earthModel)) * eyeOffset;
+      mat4 eyeViewProj = proj * mat4(mat3(view) * mat3(earthModel));
+      MyShader* earthShader = isTerrain_ ? &terrainShader : sphereShader;
+      UseVirtualTexture(&vtBuffers, virtualTexture, earthShader, isVirtualTexture_);
+      if (isTerrain_)
+      {
+         terrain.update(dvec3(eyeObject), eyeViewProj);
+         RenderTerrain(&terrainBuffers, terrain, &terrainShader, ManagedTexture(&managedTextures, earthTexture), eyeViewProj, earthModel,
+            frame->normal[OBJECT_EARTH], camera.pos, eyeObject, frame->light, selection.object == OBJECT_EARTH);
+         UpdateTerrain(&terrainBuffers, &terrain);
+      }
+      else
+      {
+         RenderScene(sphere, sphereShader, ManagedTexture(&managedTextures, earthTexture), proj, view, earthModel,
+            viewProj * earthModel, frame->normal[OBJECT_EARTH], frame->light, true,
+            SphereResolution(earthModel, camera.pos), selection.object == OBJECT_EARTH);
+      }
+      UseVirtualTexture(&vtBuffers, virtualTexture, earthShader, false);
+
+      // Moon
+      RenderScene(sphere, sphereShader, ManagedTexture(&managedTextures, moonTexture), proj, view, moonModel,
+         viewProj * moonModel, frame->normal[OBJECT_MOON], frame->light, true,
+         SphereResolution(moonModel, camera.pos), selection.object == OBJECT_MOON);
+
+      // Belts and loaded bodies, all in one instanced draw
+      RenderBodies(&bodyInstances, &shader, ManagedTexture(&managedTextures, moonTexture), proj, view, frame->light,
+         ivec2(10, 6));
+
+      // the picked body again over the top, tinted and no smaller than it
+      // had to be to pick it
+      if (selection.body >= 0 && selection.body < int(frame->bodyX.size()))
+      {
+         int width, height;
+         glfwGetWindowSize(window, &width, &height);
+         int body = selection.body;
+         float radius = std::max((*frame->bodyStatic)[body].x, PickRadius(camera, proj, height));
+         mat4 model = scale(translate(mat4(1.0f), vec3(frame->bodyX[body], frame->bodyY[body],
+            frame->bodyZ[body])), vec3(radius));
+         mat4 normal = mat4(transpose(inverse(mat3(model))));
+         RenderScene(sphere, sphereShader, ManagedTexture(&managedTextures, moonTexture), proj, view, model,
+            viewProj * model, normal, frame->light, true, SphereResolution(model, camera.pos), true);
+      }
+
+      // Galaxy (seen from the inside, so always at full resolution)
+      RenderScene(sphere, sphereShader, ManagedTexture(&managedTextures, galaxyTexture), proj, view, galaxyModel,
+         viewProj * galaxyModel, frame->normal[OBJECT_GALAXY], vec3(0.0f), false,
+         ivec2(200, 100));
+
+      // the earth's atmosphere, over the earth and whatever is seen through it
+      RenderAtmosphere(&atmosphere, &geometry, viewProj, earthModel, camera.pos, frame->light);
+      EndPass(&passTimer);
+
+      // bloom and tonemap onto the screen, the bloom chain starting coarser
+      // while it runs over its time budget
+      ResolveHDR(&hdr, &passTimer, isBloom_);
+      EndPassFrame(&passTimer);
+      FitBloomToBudget(&hdr, passTimer);
+
+      // the earth once more into the feedback pass, which tells the
+      // virtual texture the tiles its pixels want; the tessellated sphere
+      // stands in as the mesh one, which covers the same pixels
+      if (isEarthVirtual)
+      {
+         GLint viewport[4];
+         float levelBias = -log2(float(FEEDBACK_SCALE));
+         BeginFeedback(&vtBuffers, viewport);
+         if (isTerrain_)
+         {
+            UseVirtualTexture(&vtBuffers, virtualTexture, &terrainFeedbackShader, true, levelBias);
+            RenderTerrain(&terrainBuffers, terrain, &terrainFeedbackShader, &managedTextures.placeholder, eyeViewProj, earthModel,
+               frame->normal[OBJECT_EARTH], camera.pos, eyeObject, frame->light, false);
+         }
+         else
+         {
+            MyGeometry* feedbackSphere = sphereMode_ == SPHERE_TESSELLATED ? &geometry : sphere;
+            UseVirtualTexture(&vtBuffers, virtualTexture, &feedbackShader, true, levelBias);
+            RenderScene(feedbackSphere, &feedbackShader, &managedTextures.placeholder, proj, view, earthModel,
+               viewProj * earthModel, frame->normal[OBJECT_EARTH], frame->light, true,
+               SphereResolution(earthModel, camera.pos));
+         }
+         EndFeedback(&vtBuffers, &virtualTexture, viewport);
+         virtualTexture.update();
+         UpdateVirtualTexture(&vtBuffers, &virtualTexture);
+      }
+
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+      frames++;
+   }
+
+   simulation.stop();
+   simulation_ = 0;
+   terrain.waitForBuilds();
+   virtualTexture.waitForLoads();
+   textures.waitForLoads();
+   if (isJobTiming)
+      PrintJobTimings(frames);
+   if (isGPUTiming)
+      PrintPassTimings(passTimer);
+
+   // clean up allocated resources before exit
+   DestroyGeometry(&geometry);
+   DestroyGeometry(&proceduralGeometry);
+   DestroyGeometry(&tessGeometry);
+   DestroyBodyInstances(&bodyInstances);
+   DestroyTerrain(&terrainBuffers);
+   DestroyVirtualTexture(&vtBuffers);
+   DestroyHDR(&hdr);
+   DestroyAtmosphere(&atmosphere);
+   DestroyPassTimer(&passTimer);
+   textures.release(sunTexture);
+   textures.release(earthTexture);
+   textures.release(moonTexture);
+   textures.release(galaxyTexture);
+   textures.update();
+   UpdateManagedTextures(&managedTextures, &textures, 0);
+   DestroyManagedTextures(&managedTextures);
+   DestroyShaders(&terrainShader);
+   DestroyShaders(&feedbackShader);
+   DestroyShaders(&terrainFeedbackShader);
+   DestroyShaders(&shader);
+   DestroyShaders(&tessShader);
+   glfwDestroyWindow(window);
+   glfwTerminate();
+   DestroyJobs();
+
+   cout << "Goodbye!" << endl;
+   return 0;
+}
+
+// ==========================================================================
+// SUPPORT FUNCTION DEFINITIONS
+
+// --------------------------------------------------------------------------
+// OpenGL utility functions
+
+void QueryGLVersion()
+{
+   // query opengl version and renderer information
+   string version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+   string glslver = reinterpret_cast<const char *>(glGetString(GL_SHADING_LANGUAGE_VERSION));
+   string renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+
+   cout << "OpenGL [ " << version << " ] "
+      << "with GLSL [ " << glslver << " ] "
+      << "on renderer [ " << renderer << " ]" << endl;
+}
+
+bool CheckGLErrors()
+{
+   bool error = false;
+   for (GLenum flag = glGetError(); flag != GL_NO_ERROR; flag = glGetError())
+   {
+      cout << "OpenGL ERROR:  ";
+      switch (flag) {
+      case GL_INVALID_ENUM:
+         cout << "GL_INVALID_ENUM" << endl; break;
+      case GL_INVALID_VALUE:
+         cout << "GL_INVALID_VALUE" << endl; break;
+      case GL_INVALID_OPERATION:
+         cout << "GL_INVALID_OPERATION" << endl; break;
+      case GL_INVALID_FRAMEBUFFER_OPERATION:
+         cout << "GL_INVALID_FRAMEBUFFER_OPERATION" << endl; break;
+      case GL_OUT_OF_MEMORY:
+         cout << "GL_OUT_OF_MEMORY" << endl; break;
+      default:
+         cout << "[unknown error code]" << endl;
+      }
+      error = true;
+   }
+   return error;
+}
+
+// --------------------------------------------------------------------------
+// OpenGL shader support functions
+
+// reads a text file with the given name into a string
+string LoadSource(const string &filename)
+{
+   string source;
+
+   // a packed shader is already in memory
+   vector<unsigned char> buffer;
+   size_t size;
+   const unsigned char* packed = assets_ ? assets_->load(filename, &size, &buffer) : 0;
+   if (packed) {
+      source.assign(reinterpret_cast<const char*>(packed), size);
+      return source;
+   }
+
+   ifstream input(filename.c_str());
+   if (input) {
+      stringstream contents;
+      contents << input.rdbuf();
+      source = contents.str();
+      input.close();
+   }
+   else {
+      cout << "ERROR: Could not load shader source from file "
+         << filename << endl;
+   }
+
+   return source;
+}
+
+// creates and returns a shader object compiled from the given source
+GLuint CompileShader(GLenum shaderType, const string &source)
+{
+   // allocate shader object name
+   GLuint shaderObject = glCreateShader(shaderType);
+
+   // try compiling the source as a shader of the given type
+   const GLchar *source_ptr = source.c_str();
+   glShaderSource(shaderObject, 1, &source_ptr, 0);
+   glCompileShader(shaderObject);
+
+   // retrieve compile status
+   GLint status;
+   glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &status);
+   if (status == GL_FALSE)
+   {
+      GLint length;
+      glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
+      string info(length, ' ');
+      glGetShaderInfoLog(shaderObject, info.length(), &length, &info[0]);
+      cout << "ERROR compiling shader:" << endl << endl;
+      cout << source << endl;
+      cout << info << endl;
+   }
+
+   return shaderObject;
+}
+
+// creates and returns a program object linked from vertex and fragment shaders,
+// plus tessellation control and evaluation shaders when given
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader,
+   GLuint tessControlShader, GLuint tessEvalShader)
+{
+   // allocate program object name
+   GLuint programObject = glCreateProgram();
+
+   // attach provided shader objects to this program
+   if (vertexShader)   glAttachShader(programObject, vertexShader);
+   if (tessControlShader) glAttachShader(programObject, tessControlShader);
+   if (tessEvalShader) glAttachShader(programObject, tessEvalShader);
+   if (fragmentShader) glAttachShader(programObject, fragmentShader);
+
+   // try linking the program with given attachments
+   glLinkProgram(programObject);
+
+   // retrieve link status
+   GLint status;
+   glGetProgramiv(programObject, GL_LINK_STATUS, &status);
+   if (status == GL_FALSE)
+   {
+      GLint length;
+      glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
+      string info(length, ' ');
+      glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
+      cout << "ERROR linking shader program:" << endl;
+      cout << info << endl;
+   }
+
+   return programObject;
 }
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include "bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "glm/gtx/intersect.hpp"
+
+const int LEAF_SIZE = 8;
+
+// refitted boxes may grow to this multiple of their built area before the
+// tree is built again
+const float REBUILD_GROWTH = 2.0f;
+
+// deep enough for a median split tree of 2^60 leaves
+const int MAX_DEPTH = 64;
+
+// distance along the ray to where it enters the box, FLT_MAX if it misses
+static float boxEntry(vec3 lower, vec3 upper, vec3 origin, vec3 inverse)
+{
+   vec3 t0 = (lower - origin) * inverse;
+   vec3 t1 = (upper - origin) * inverse;
+   vec3 entries = min(t0, t1);
+   vec3 exits = max(t0, t1);
+   float entry = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+   float exit = std::min(std::min(exits.x, exits.y), exits.z);
+   return entry <= exit ? entry : FLT_MAX;
+}
+
+SphereBVH::SphereBVH()
+   : builtArea_(0.0f)
+   , buildCount_(0)
+{}
+
+void SphereBVH::update(const float* x, const float* y, const float* z, const vec4* properties,
+   int count, float minRadius)
+{
+   if (count != size())
+   {
+      build(x, y, z, count);
+      builtArea_ = refit(x, y, z, properties, minRadius);
+      return;
+   }
+
+   float area = refit(x, y, z, properties, minRadius);
+   if (area > REBUILD_GROWTH * builtArea_)
+   {
+      build(x, y, z, count);
+      builtArea_ = refit(x, y, z, properties, minRadius);
+   }
+}
+
+int SphereBVH::intersect(vec3 origin, vec3 direction, float* distance) const
+{
+   int hit = -1;
+   float nearest = FLT_MAX;
+   if (nodes_.empty())
+      return hit;
+
+   // depth first, the nearer child first, skipping boxes entered beyond
+   // the nearest hit so far
+   vec3 inverse = 1.0f / direction;
+   int stack[MAX_DEPTH];
+   int top = 0;
+   stack[top++] = 0;
+   while (top > 0)
+   {
+      int index = stack[--top];
+      const Node& node = nodes_[index];
+      if (node.count > 0)
+      {
+         for (int i = node.start; i < node.start + node.count; i++)
+         {
+            float t;
+            const vec4& sphere = spheres_[i];
+            if (intersectRaySphere(origin, direction, vec3(sphere), sphere.w * sphere.w, t) && t < nearest)
+            {
+               nearest = t;
+               hit = order_[i];
+            }
+         }
+         continue;
+      }
+
+      int left = index + 1;
+      int right = node.start;
+      float leftEntry = boxEntry(nodes_[left].lower, nodes_[left].upper, origin, inverse);
+      float rightEntry = boxEntry(nodes_[right].lower, nodes_[right].upper, origin, inverse);
+      if (leftEntry > rightEntry)
+      {
+         std::swap(left, right);
+         std::swap(leftEntry, rightEntry);
+      }
+      if (rightEntry < nearest)
+         stack[top++] = right;
+      if (leftEntry < nearest)
+         stack[top++] = left;
+   }
+
+   if (hit >= 0 && distance)
+      *distance = nearest;
+   return hit;
+}
+
+void SphereBVH::build(const float* x, const float* y, const float* z, int count)
+{
+   order_.resize(count);
+   for (int i = 0; i < count; i++)
+      order_[i] = i;
+   spheres_.resize(count);
+
+   nodes_.clear();
+   nodes_.reserve(2 * count / LEAF_SIZE + 1);
+   const float* centres[3] = { x, y, z };
+   if (count > 0)
+      buildNode(0, count, centres);
+   buildCount_++;
+}
+
+// splits at the median centre along the axis the centres spread most
+int SphereBVH::buildNode(int begin, int end, const float* centres[3])
+{
+   int index = int(nodes_.size());
+   nodes_.push_back(Node());
+   if (end - begin <= LEAF_SIZE)
+   {
+      nodes_[index].start = begin;
+      nodes_[index].count = end - begin;
+      return index;
+   }
+
+   vec3 lower(FLT_MAX);
+   vec3 upper(-FLT_MAX);
+   for (int i = begin; i < end; i++)
+   {
+      int sphere = order_[i];
+      vec3 centre(centres[0][sphere], centres[1][sphere], centres[2][sphere]);
+      lower = min(lower, centre);
+      upper = max(upper, centre);
+   }
+   vec3 extent = upper - lower;
+   int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+   const float* key = centres[axis];
+   int middle = begin + (end - begin) / 2;
+   std::nth_element(order_.begin() + begin, order_.begin() + middle, order_.begin() + end,
+      [key](int a, int b) { return key[a] < key[b]; });
+
+   buildNode(begin, middle, centres);
+   int right = buildNode(middle, end, centres);
+   nodes_[index].start = right;
+   nodes_[index].count = 0;
+   return index;
+}
+
+// gathers the spheres in leaf order and recomputes every box, children
+// before parents; returns the box area summed over the inner nodes
+float SphereBVH::refit(const float* x, const float* y, const float* z, const vec4* properties,
+   float minRadius)
+{
+   for (int i = 0; i < size(); i++)
+   {
+      int sphere = order_[i];
+      spheres_[i] = vec4(x[sphere], y[sphere], z[sphere], std::max(properties[sphere].x, minRadius));
+   }
+
+   float area = 0.0f;
+   for (int i = int(nodes_.size()) - 1; i >= 0; i--)
+   {
+      Node& node = nodes_[i];
+      if (node.count > 0)
+      {
+         vec3 lower(FLT_MAX);
+         vec3 upper(-FLT_MAX);
+         for (int j = node.start; j < node.start + node.count; j++)
+         {
+            vec3 centre(spheres_[j]);
+            lower = min(lower, centre - spheres_[j].w);
+            upper = max(upper, centre + spheres_[j].w);
+         }
+         node.lower = lower;
+         node.upper = upper;
+      }
+      else
+      {
+         const Node& left = nodes_[i + 1];
+         const Node& right = nodes_[node.start];
+         node.lower = min(left.lower, right.lower);
+         node.upper = max(left.upper, right.upper);
+         vec3 extent = node.upper - node.lower;
+         area += extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+      }
+   }
+   return area;
+}
+
+// --------------------------------------------------------------------------
+// Benchmark
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+static float randomFloat(float lo, float hi)
+{
+   return lo + (hi - lo) * (rand() / float(RAND_MAX));
+}
+
+void BenchmarkPicking(int count)
+{
+   // a belt like the one --belt adds, seen from the default camera
+   std::vector<float> x(count), y(count), z(count);
+   std::vector<vec4> properties(count);
+   srand(453);
+   for (int i = 0; i < count; i++)
+   {
+      float angle = randomFloat(0.0f, 6.2831853f);
+      float radius = randomFloat(16.0f, 24.0f);
+      x[i] = radius * cos(angle);
+      y[i] = randomFloat(-1.0f, 1.0f);
+      z[i] = radius * sin(angle);
+      properties[i] = vec4(randomFloat(0.02f, 0.08f), 0.0f, 0.0f, 0.0f);
+   }
+   vec3 eye(0.0f, 10.0f, -10.0f);
+
+   SphereBVH bvh;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   bvh.update(x.data(), y.data(), z.data(), properties.data(), count);
+   double buildTime = millisecondsSince(start);
+
+   // a frame's worth of motion, small enough not to trigger a rebuild
+   for (int i = 0; i < count; i++)
+   {
+      x[i] += randomFloat(-0.05f, 0.05f);
+      z[i] += randomFloat(-0.05f, 0.05f);
+   }
+   start = std::chrono::steady_clock::now();
+   bvh.update(x.data(), y.data(), z.data(), properties.data(), count);
+   double refitTime = millisecondsSince(start);
+
+   // rays aimed near random bodies, checked against testing every sphere
+   const int RAYS = 1000;
+   std::vector<vec3> directions(RAYS);
+   for (int i = 0; i < RAYS; i++)
+   {
+      int target = rand() % count;
+      vec3 aim = vec3(x[target], y[target], z[target]) + vec3(randomFloat(-0.05f, 0.05f));
+      directions[i] = normalize(aim - eye);
+   }
+   std::vector<int> hits(RAYS);
+   start = std::chrono::steady_clock::now();
+   for (int i = 0; i < RAYS; i++)
+      hits[i] = bvh.intersect(eye, directions[i], 0);
+   double rayTime = millisecondsSince(start) / RAYS;
+
+   int mismatches = 0;
+   int hitCount = 0;
+   for (int i = 0; i < RAYS; i++)
+   {
+      int nearest = -1;
+      float nearestDistance = FLT_MAX;
+      for (int j = 0; j < count; j++)
+      {
+         float t;
+         float r = properties[j].x;
+         if (intersectRaySphere(eye, directions[i], vec3(x[j], y[j], z[j]), r * r, t) && t < nearestDistance)
+         {
+            nearest = j;
+            nearestDistance = t;
+         }
+      }
+      mismatches += nearest != hits[i];
+      hitCount += hits[i] >= 0;
+   }
+
+   printf("%d spheres: build %.2f ms, refit %.3f ms, ray %.2f us (%d of %d rays hit, %d differ from brute force)\n",
+      count, buildTime, refitTime, rayTime * 1000.0, hitCount, RAYS, mismatches);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+using namespace glm;
+
+// Bounding volume hierarchy over spheres, for casting rays at the bodies.
+// Nodes are boxes stored depth first, so a node's left child follows it
+// and a reverse pass over the array visits children before parents; that
+// pass is all a refit needs when the spheres move. The tree is only built
+// again when the spheres are added or removed, or when refitting has let
+// the boxes grow to twice the size they had after the last build.
+class SphereBVH{
+public:
+   SphereBVH();
+
+   // sphere i is centred at x, y, z[i] with the radius in properties[i].x
+   // (the layout of BodySystem's static instance data), but never smaller
+   // than minRadius. Refits, or builds if needed.
+   void update(const float* x, const float* y, const float* z, const vec4* properties,
+      int count, float minRadius = 0.0f);
+
+   // index of the nearest sphere hit by the ray, -1 for none, with the
+   // distance along direction (which must be normalized)
+   int intersect(vec3 origin, vec3 direction, float* distance) const;
+
+   int size() const { return int(order_.size()); }
+   int getBuildCount() const { return buildCount_; }
+
+private:
+   struct Node
+   {
+      vec3 lower;
+      int start;     // leaf: first slot in order_, inner: right child
+      vec3 upper;
+      int count;     // spheres in a leaf, 0 for an inner node
+   };
+
+   void build(const float* x, const float* y, const float* z, int count);
+   int buildNode(int begin, int end, const float* centres[3]);
+   float refit(const float* x, const float* y, const float* z, const vec4* properties,
+      float minRadius);
+
+   std::vector<Node> nodes_;
+   std::vector<int> order_;       // sphere index of each leaf slot
+   std::vector<vec4> spheres_;    // centre and radius per leaf slot
+   float builtArea_;              // box area summed over inner nodes after a build
+   int buildCount_;
+};
+
+// times building, refitting and ray casts over count random spheres
+void BenchmarkPicking(int count);
@@ -1,49 +1,97 @@
 #include "camera.h"
-#include <cstdio>
+#include <algorithm>
+#include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 
-Camera::Camera()
-   : dir(vec3(0, 0, -1))
-	, right(vec3(1, 0, 0))
-	, up(vec3(0, 1, 0))
-	, pos(vec3(0, 0, 0))
-{}
+// top speeds, and how fast they are reached and lost again
+const float TURN_SPEED = radians(120.0f);
+const float TURN_ACCELERATION = TURN_SPEED * 6.0f;
+const float ZOOM_SPEED = 1.0f;
+const float ZOOM_ACCELERATION = ZOOM_SPEED * 6.0f;
 
-Camera::Camera(vec3 dir, vec3 pos)
-   : dir(normalize(dir)) 
-   , pos(pos)
+const float MIN_DISTANCE = 1.0f;
+const float MAX_DISTANCE = 400.0f;
+
+// closest the camera comes to a surface, in its radii
+const float MIN_ALTITUDE = 1e-4f;
+
+// how close to straight up or down the camera may look
+const float MAX_ELEVATION = 0.98f;
+
+// moves value towards goal by at most step
+static float approach(float value, float goal, float step)
 {
-	right = normalize(cross(dir, vec3(0, 1, 0)));
-	up =  normalize(cross(right, dir));
+   return value + clamp(goal - value, -step, step);
 }
 
-mat4 Camera::getViewMatrix()
+Camera::Camera()
+   : distance(1.0f)
+   , target(0.0f)
+   , surface(0.0f)
+   , turnVelocity(0.0f)
+   , zoomVelocity(0.0f)
 {
-   return lookAt(pos, vec3(0.0f), up);
+   updateVectors();
 }
 
-void Camera::cameraRotation(float x, float y)
+Camera::Camera(vec3 dir, vec3 pos)
+   : distance(length(pos))
+   , target(0.0f)
+   , surface(0.0f)
+   , turnVelocity(0.0f)
+   , zoomVelocity(0.0f)
 {
-   mat4 rotateAroundY = rotateAbout(up, x);
-   mat4 rotateAroundX = rotateAbout(right, y);
+   // the camera's z axis points back along the view, from the target
+   vec3 back = normalize(dir);
+   vec3 right = normalize(cross(vec3(0, 1, 0), back));
+   vec3 up = cross(back, right);
+   orientation = normalize(quat_cast(mat3(right, up, back)));
+   updateVectors();
+}
 
-   vec3 prevPos = pos;
-   pos = rotateAroundX * rotateAroundY * vec4(pos, 0);
-   dir = normalize(pos);
-   if ((dir.y < -0.98f && y < 0.0f) || (dir.y > 0.98f && y > 0.0f))
+void Camera::update(float dt, vec2 turn, float zoom)
+{
+   turnVelocity.x = approach(turnVelocity.x, turn.x * TURN_SPEED, TURN_ACCELERATION * dt);
+   turnVelocity.y = approach(turnVelocity.y, turn.y * TURN_SPEED, TURN_ACCELERATION * dt);
+   zoomVelocity = approach(zoomVelocity, zoom * ZOOM_SPEED, ZOOM_ACCELERATION * dt);
+
+   // close to a surface the camera turns slower, as much as it is closer
+   // than a radius; the surface below may have risen since the last frame
+   float lowest = surface > 0.0f ? surface * MIN_ALTITUDE : MIN_DISTANCE;
+   float altitude = std::max(distance - surface, lowest);
+   float turnScale = surface > 0.0f ? std::min(altitude / surface, 1.0f) : 1.0f;
+
+   // yaw in world space, pitch in camera space; orbiting up means turning
+   // the view down, about the camera's -x
+   quat yaw = angleAxis(turnVelocity.x * turnScale * dt, vec3(0, 1, 0));
+   quat pitch = angleAxis(-turnVelocity.y * turnScale * dt, vec3(1, 0, 0));
+   quat turned = normalize(yaw * orientation * pitch);
+
+   // stop at the poles rather than flipping over them
+   float elevation = (turned * vec3(0, 0, 1)).y;
+   if (abs(elevation) > MAX_ELEVATION && elevation * turnVelocity.y > 0.0f)
    {
-      pos = prevPos;
-      dir = normalize(pos);
-   }
-   else
-   {      
-      right = normalize(cross(dir, vec3(0, 1, 0)));
-      up = normalize(cross(right, dir));
+      turned = normalize(yaw * orientation);
+      turnVelocity.y = 0.0f;
    }
+   orientation = turned;
+
+   // zooming is in log height above the surface (the distance when there
+   // is none), so it feels the same near and far
+   distance = surface + clamp(altitude * std::exp(-zoomVelocity * dt), lowest, MAX_DISTANCE);
+   updateVectors();
+}
+
+mat4 Camera::getViewMatrix() const
+{
+   return lookAt(pos, target, up);
 }
 
-mat4 Camera::rotateAbout(vec3 axis, float radians)
+void Camera::updateVectors()
 {
-   mat4 I(1.0f);
-   return rotate(I, radians, axis);
+   mat3 axes = mat3_cast(orientation);
+   right = axes[0];
+   up = axes[1];
+   dir = axes[2];
+   pos = target + dir * distance;
 }
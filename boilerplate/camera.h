@@ -1,22 +1,43 @@
 #pragma once
 
 #include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
 
 using namespace glm;
 
+// Orbit camera around a target point. The orientation is a quaternion,
+// yawed about the world's y axis and pitched about the camera's own x
+// axis, and the distance to the target is kept apart from it. Turning and
+// zooming speeds ease towards what the held keys ask for and everything
+// is scaled by the frame time, so movement is the same at any frame rate.
+// Over a surface, zooming and orbiting slow down with the height above it,
+// so the ground moves by about the same amount on screen from any height.
 class Camera{
 public:
-	vec3 dir;
-	vec3 up;
-	vec3 right;
-	vec3 pos;
+   quat orientation;       // camera space to world space, looking down -z
+   float distance;         // from target
+   vec3 target;
+   float surface;          // radius of the body at target, 0 for none;
+                           // zooming then moves in height above it
 
-	Camera();
-	Camera(vec3 dir, vec3 pos);
+   vec2 turnVelocity;      // yaw, pitch in radians per second
+   float zoomVelocity;     // log distance per second, positive moves in
 
-   mat4 getViewMatrix();
-   void cameraRotation(float x, float y);
+   // derived from the above by update()
+   vec3 dir;               // from the target to the camera
+   vec3 up;
+   vec3 right;
+   vec3 pos;
+
+   Camera();
+   Camera(vec3 dir, vec3 pos);
+
+   // advances dt seconds with the held inputs, each from -1 to 1: turn.x
+   // orbits right, turn.y orbits up and zoom moves in
+   void update(float dt, vec2 turn, float zoom);
+
+   mat4 getViewMatrix() const;
 
 private:
-   mat4 rotateAbout(vec3 axis, float radians);
+   void updateVectors();
 };
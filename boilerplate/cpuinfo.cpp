@@ -0,0 +1,61 @@
+#include "cpuinfo.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(int info[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+   __cpuidex(info, leaf, subleaf);
+#else
+   unsigned int a, b, c, d;
+   __cpuid_count(leaf, subleaf, a, b, c, d);
+   info[0] = int(a);
+   info[1] = int(b);
+   info[2] = int(c);
+   info[3] = int(d);
+#endif
+}
+
+// extended control register 0, which register states the OS saves
+static unsigned long long xgetbv0()
+{
+#ifdef _MSC_VER
+   return _xgetbv(0);
+#else
+   unsigned int lo, hi;
+   __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+   return (unsigned long long)(hi) << 32 | lo;
+#endif
+}
+
+static bool detectAVX2()
+{
+   int info[4];
+   cpuid(info, 0, 0);
+   if (info[0] < 7)
+      return false;
+
+   // OSXSAVE, AVX and FMA, then the OS has to save the xmm and ymm state
+   cpuid(info, 1, 0);
+   const int osxsave = 1 << 27, avx = 1 << 28, fma = 1 << 12;
+   if ((info[2] & (osxsave | avx | fma)) != (osxsave | avx | fma))
+      return false;
+   if ((xgetbv0() & 6) != 6)
+      return false;
+
+   cpuid(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+}
+
+// detected once at startup, before any worker threads exist
+static const bool hasAVX2 = detectAVX2();
+
+bool CpuHasAVX2()
+{
+   return hasAVX2;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Runtime checks for instruction set extensions beyond what the build
+// targets. Code compiled for a newer extension lives in its own source file
+// and is only called after checking here, so the program still runs on
+// older CPUs.
+
+// AVX2 and FMA, with the OS saving the 256-bit registers
+bool CpuHasAVX2();
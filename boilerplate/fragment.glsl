@@ -1,37 +1,146 @@
-// ==========================================================================
-// Vertex program for barebones GLFW boilerplate
-//
-// Author:  Sonny Chan, University of Calgary
-// Date:    December 2015
-// ==========================================================================
-#version 410
-
-in vec3 Normal; // Surface normal in world space.
-in vec3 VertNormal; // Normal in object space
-in vec3 Position; // Position in world space.
-
-uniform vec3 light; // Light's position in world space.
-uniform bool isShaded;
-
-out vec4 FragmentColour;
-
-uniform sampler2D tex;
-float PI = 3.1459;
-
-void main(void)
-{
-    // Compute the diffuse term.
-    vec3 L = normalize(light - Position);
-    float diffuse = max(dot(Normal, L), 0);
-    
-	// Compute surface colour
-	float x = atan(VertNormal.x, VertNormal.z) / (2.0f * PI) + 0.5f;
-	float y = asin(VertNormal.y)/ PI + 0.5f;
-
-    FragmentColour = texture(tex, vec2(x, y));
-
-	if(isShaded)
-	{
-		FragmentColour = FragmentColour * (0.3f + diffuse);
-	}
+// ==========================================================================
+// Vertex program for barebones GLFW boilerplate
+//
+// Author:  Sonny Chan, University of Calgary
+// Date:    December 2015
+// ==========================================================================
+#version 410
+
+in vec3 Normal; // Surface normal in world space.
+in vec3 VertNormal; // Normal in object space
+in vec3 Position; // Position in world space.
+
+uniform vec3 light; // Light's position in world space.
+uniform bool isShaded;
+uniform bool isSelected; // picked with the mouse, drawn tinted
+
+// scales unshaded surfaces; the sun's is over 1, which the HDR target
+// keeps and the bloom spreads
+uniform float emission = 1.0;
+
+out vec4 FragmentColour;
+
+uniform sampler2D tex;
+float PI = 3.1459;
+
+// spheres that can hide the sun from shaded surfaces, world centre in xyz
+// and radius in w; MAX_OCCLUDERS of boilerplate.cpp
+const int MAX_OCCLUDERS = 8;
+uniform vec4 occluders[MAX_OCCLUDERS];
+uniform int occluderCount;
+uniform float sunRadius;
+
+// area of the overlap of two discs of radii a and b, d apart
+float discOverlap(float a, float b, float d)
+{
+    if (d >= a + b)
+        return 0.0;
+    if (d <= abs(a - b))
+        return 3.14159265 * min(a, b) * min(a, b);
+    float alpha = acos(clamp((d * d + a * a - b * b) / (2.0 * d * a), -1.0, 1.0));
+    float beta = acos(clamp((d * d + b * b - a * a) / (2.0 * d * b), -1.0, 1.0));
+    return a * a * (alpha - 0.5 * sin(2.0 * alpha)) + b * b * (beta - 0.5 * sin(2.0 * beta));
+}
+
+// the fraction of the sun's disc the occluders leave visible from point:
+// each hides the overlap of its disc with the sun's on the sky, which
+// gives eclipses their umbra and penumbra without any shadow map
+float sunlight(vec3 point)
+{
+    vec3 toSun = light - point;
+    float sunDistance = length(toSun);
+    float sunAngle = asin(min(sunRadius / sunDistance, 1.0));
+    float visible = 1.0;
+    for (int i = 0; i < occluderCount; i++)
+    {
+        // only spheres between the point and the sun; a body's own centre
+        // is behind its lit side, which keeps it from shadowing itself
+        vec3 toOccluder = occluders[i].xyz - point;
+        float along = dot(toOccluder, toSun);
+        float occluderDistance = length(toOccluder);
+        if (along <= 0.0 || occluderDistance > sunDistance)
+            continue;
+        float occluderAngle = asin(min(occluders[i].w / occluderDistance, 1.0));
+        float separation = atan(length(cross(toOccluder, toSun)), along);
+        float hidden = discOverlap(sunAngle, occluderAngle, separation) / (3.14159265 * sunAngle * sunAngle);
+        visible *= 1.0 - min(hidden, 1.0);
+    }
+    return visible;
+}
+
+// the earth's imagery can come from a virtual texture instead of tex: the
+// page table gives, per tile and level, the cache slot holding it (or its
+// nearest resident ancestor) and that tile's level
+uniform bool isVirtual;
+uniform sampler2D pageTable;
+uniform sampler2D tileCache;
+uniform ivec2 virtualTiles;    // tiles across level 0
+uniform int virtualLevels;
+uniform vec2 virtualSize;      // texels across level 0
+
+// VT_TILE_SIZE and VT_TILE_BORDER of virtualtexture.h
+const float TILE_SIZE = 128.0;
+const float TILE_BORDER = 4.0;
+
+// mip level of the virtual texture for texture coordinates uv
+float virtualLevel(vec2 uv)
+{
+    // u jumps from 1 to 0 across the seam, u shifted by a half does not
+    // jump there, so the smaller of the two derivatives is the true one
+    float shifted = fract(uv.x + 0.5);
+    vec2 dx = vec2(min(abs(dFdx(uv.x)), abs(dFdx(shifted))), dFdx(uv.y)) * virtualSize;
+    vec2 dy = vec2(min(abs(dFdy(uv.x)), abs(dFdy(shifted))), dFdy(uv.y)) * virtualSize;
+    return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+vec4 virtualTexel(vec2 uv, int level)
+{
+    ivec2 tiles = virtualTiles >> level;
+    ivec2 tile = clamp(ivec2(uv * vec2(tiles)), ivec2(0), tiles - 1);
+    vec4 entry = texelFetch(pageTable, tile, level) * 255.0;
+
+    // where uv falls in the tile actually resident, which may be coarser
+    vec2 residentTiles = vec2(virtualTiles >> int(entry.b + 0.5));
+    vec2 inTile = uv * residentTiles - min(floor(uv * residentTiles), residentTiles - 1.0);
+    vec2 texel = floor(entry.rg + 0.5) * (TILE_SIZE + 2.0 * TILE_BORDER) + TILE_BORDER + inTile * TILE_SIZE;
+    return textureLod(tileCache, texel / vec2(textureSize(tileCache, 0)), 0.0);
+}
+
+// trilinear: bilinear within the cached tiles of the two nearest levels
+vec4 virtualTexture(vec2 uv)
+{
+    float level = clamp(virtualLevel(uv), 0.0, float(virtualLevels - 1));
+    int fine = int(level);
+    int coarse = min(fine + 1, virtualLevels - 1);
+    return mix(virtualTexel(uv, fine), virtualTexel(uv, coarse), level - float(fine));
+}
+
+void main(void)
+{
+    // Compute the diffuse term.
+    vec3 L = normalize(light - Position);
+    float diffuse = max(dot(Normal, L), 0);
+    
+	// Compute surface colour
+	float x = atan(VertNormal.x, VertNormal.z) / (2.0f * PI) + 0.5f;
+	float y = asin(VertNormal.y)/ PI + 0.5f;
+
+    if (isVirtual)
+        FragmentColour = virtualTexture(vec2(x, y));
+    else
+        FragmentColour = texture(tex, vec2(x, y));
+
+	if(isShaded)
+	{
+		FragmentColour = FragmentColour * (0.3f + diffuse * sunlight(Position));
+	}
+	else
+	{
+		FragmentColour.rgb *= emission;
+	}
+
+	if(isSelected)
+	{
+		FragmentColour = mix(FragmentColour, vec4(1.0f, 0.8f, 0.2f, 1.0f), 0.5f);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "jobs.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <thread>
+
+// VS2013 has no thread_local, only the compiler specific forms for PODs
+#ifdef _MSC_VER
+#define JOB_THREAD_LOCAL __declspec(thread)
+#else
+#define JOB_THREAD_LOCAL __thread
+#endif
+
+struct Job
+{
+   std::function<void()> fn;
+   JobCounter* counter;
+   const char* name;
+};
+
+struct JobTiming
+{
+   const char* name;
+   int runs;
+   double milliseconds;
+};
+
+struct Worker
+{
+   std::mutex mutex;
+   std::deque<Job> jobs;
+
+   std::mutex timingMutex;
+   std::vector<JobTiming> timings;
+};
+
+static std::vector<std::unique_ptr<Worker> > workers_;
+static std::vector<std::thread> threads_;
+static std::atomic<bool> running_(false);
+static std::atomic<int> queued_(0);
+static std::mutex sleepMutex_;
+static std::condition_variable wakeUp_;
+static std::atomic<bool> isTiming_(false);
+
+// threads outside the pool share worker 0's deque, which is safe since
+// every deque has its own lock
+static JOB_THREAD_LOCAL int workerIndex_ = 0;
+
+static void pushJob(Job& job)
+{
+   Worker& worker = *workers_[workerIndex_];
+   {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.jobs.push_back(std::move(job));
+   }
+   queued_++;
+
+   // taking the lock orders this against a worker about to sleep
+   { std::lock_guard<std::mutex> lock(sleepMutex_); }
+   wakeUp_.notify_one();
+}
+
+// own deque from the back, then the others' from the front; with counter
+// given, only a job of that counter
+static bool takeJob(Job& job, const JobCounter* counter = 0)
+{
+   int count = int(workers_.size());
+   for (int k = 0; k < count; k++)
+   {
+      int index = (workerIndex_ + k) % count;
+      Worker& worker = *workers_[index];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      std::deque<Job>& jobs = worker.jobs;
+      if (jobs.empty())
+         continue;
+
+      std::deque<Job>::iterator taken = jobs.end();
+      if (!counter)
+      {
+         taken = k == 0 ? jobs.end() - 1 : jobs.begin();
+      }
+      else if (k == 0)
+      {
+         for (std::deque<Job>::iterator it = jobs.end(); it != jobs.begin() && taken == jobs.end(); )
+            if ((--it)->counter == counter)
+               taken = it;
+      }
+      else
+      {
+         taken = std::find_if(jobs.begin(), jobs.end(), [=](const Job& j) { return j.counter == counter; });
+      }
+      if (taken == jobs.end())
+         continue;
+
+      job = std::move(*taken);
+      jobs.erase(taken);
+      queued_--;
+      return true;
+   }
+   return false;
+}
+
+static void recordTiming(const char* name, double milliseconds)
+{
+   Worker& worker = *workers_[workerIndex_];
+   std::lock_guard<std::mutex> lock(worker.timingMutex);
+   for (size_t i = 0; i < worker.timings.size(); i++)
+   {
+      if (worker.timings[i].name == name)
+      {
+         worker.timings[i].runs++;
+         worker.timings[i].milliseconds += milliseconds;
+         return;
+      }
+   }
+   JobTiming timing = { name, 1, milliseconds };
+   worker.timings.push_back(timing);
+}
+
+// lowers the job's counter and queues whatever was waiting for it to reach
+// zero. The counter's lock is held across the decrement, and waiters take
+// it once before returning, so the counter outlives this function.
+void finishJob(Job& job)
+{
+   JobCounter* counter = job.counter;
+   if (!counter)
+      return;
+
+   std::vector<Job*> ready;
+   {
+      std::lock_guard<std::mutex> lock(counter->mutex_);
+      if (--counter->pending_ == 0)
+         ready.swap(counter->waiting_);
+   }
+   for (size_t i = 0; i < ready.size(); i++)
+   {
+      pushJob(*ready[i]);
+      delete ready[i];
+   }
+}
+
+static void runJob(Job& job)
+{
+   if (isTiming_)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      job.fn();
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      recordTiming(job.name, elapsed.count());
+   }
+   else
+      job.fn();
+   finishJob(job);
+}
+
+static void workerMain(int index)
+{
+   workerIndex_ = index;
+   while (running_)
+   {
+      Job job;
+      if (takeJob(job))
+      {
+         runJob(job);
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleepMutex_);
+      wakeUp_.wait(lock, []() { return !running_ || queued_ > 0; });
+   }
+}
+
+void InitializeJobs(int threadCount)
+{
+   DestroyJobs();
+   if (threadCount <= 0)
+      threadCount = std::max(int(std::thread::hardware_concurrency()), 1);
+
+   for (int i = 0; i < threadCount; i++)
+      workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+   workerIndex_ = 0;
+   running_ = true;
+   for (int i = 1; i < threadCount; i++)
+      threads_.push_back(std::thread(workerMain, i));
+}
+
+void DestroyJobs()
+{
+   {
+      std::lock_guard<std::mutex> lock(sleepMutex_);
+      running_ = false;
+   }
+   wakeUp_.notify_all();
+   for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+   threads_.clear();
+   workers_.clear();
+   queued_ = 0;
+}
+
+int JobThreadCount()
+{
+   return std::max(int(workers_.size()), 1);
+}
+
+void RunJob(const char* name, std::function<void()> fn, JobCounter* counter, JobCounter* dependency)
+{
+   Job job;
+   job.fn = std::move(fn);
+   job.counter = counter;
+   job.name = name;
+   if (counter)
+      counter->pending_++;
+
+   // without workers everything runs right away on the caller
+   if (workers_.empty())
+   {
+      if (dependency)
+         WaitForCounter(dependency);
+      runJob(job);
+      return;
+   }
+
+   if (dependency)
+   {
+      std::lock_guard<std::mutex> lock(dependency->mutex_);
+      if (dependency->pending_ > 0)
+      {
+         dependency->waiting_.push_back(new Job(std::move(job)));
+         return;
+      }
+   }
+   pushJob(job);
+}
+
+void WaitForCounter(JobCounter* counter)
+{
+   while (counter->pending_ > 0)
+   {
+      // without worker threads nothing else would run the jobs a held back
+      // one depends on, so then any job is fair game
+      Job job;
+      if (!workers_.empty() && (takeJob(job, counter) || (threads_.empty() && takeJob(job))))
+         runJob(job);
+      else
+         std::this_thread::yield();
+   }
+   std::lock_guard<std::mutex> lock(counter->mutex_);
+}
+
+void SetJobTiming(bool enabled)
+{
+   isTiming_ = enabled;
+}
+
+void PrintJobTimings(int frames)
+{
+   // merge the workers' tables by name
+   std::vector<JobTiming> totals;
+   for (size_t w = 0; w < workers_.size(); w++)
+   {
+      std::lock_guard<std::mutex> lock(workers_[w]->timingMutex);
+      for (size_t i = 0; i < workers_[w]->timings.size(); i++)
+      {
+         const JobTiming& timing = workers_[w]->timings[i];
+         size_t t = 0;
+         while (t < totals.size() && strcmp(totals[t].name, timing.name) != 0)
+            t++;
+         if (t == totals.size())
+         {
+            JobTiming empty = { timing.name, 0, 0.0 };
+            totals.push_back(empty);
+         }
+         totals[t].runs += timing.runs;
+         totals[t].milliseconds += timing.milliseconds;
+      }
+   }
+
+   frames = std::max(frames, 1);
+   printf("Job timings over %d frames, %d threads\n", frames, JobThreadCount());
+   printf("  %-24s %10s %12s %14s %12s\n", "job", "runs", "total ms", "ms per frame", "us per run");
+   for (size_t t = 0; t < totals.size(); t++)
+      printf("  %-24s %10d %12.2f %14.3f %12.2f\n", totals[t].name, totals[t].runs, totals[t].milliseconds,
+         totals[t].milliseconds / frames, 1000.0 * totals[t].milliseconds / totals[t].runs);
+}
+
+// joins the workers when the program exits without calling DestroyJobs(),
+// e.g. after a command line benchmark; defined last so it is destroyed
+// before the state above
+static struct JobShutdown
+{
+   ~JobShutdown() { DestroyJobs(); }
+} shutdown_;
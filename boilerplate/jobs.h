@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Work-stealing job system. Every worker thread owns a deque of jobs: it
+// pushes and pops its own jobs at the back, while idle workers steal from
+// the front of the others', so freshly split work stays on the core that
+// split it and thieves take the biggest pieces. A thread waiting for a
+// counter runs that counter's queued jobs meanwhile, so jobs may start and
+// wait for jobs of their own, but never picks up unrelated work: a
+// simulation step waiting on its ParallelFor does not end up decoding a
+// texture. The thread that calls InitializeJobs() counts as worker 0.
+
+struct Job;
+
+// counts the unfinished jobs of a group; jobs can also be held back until
+// a counter reaches zero, which is how dependencies are expressed
+class JobCounter{
+public:
+   JobCounter() : pending_(0) {}
+   bool isDone() const { return pending_.load() == 0; }
+
+private:
+   friend void RunJob(const char*, std::function<void()>, JobCounter*, JobCounter*);
+   friend void WaitForCounter(JobCounter*);
+   friend void finishJob(Job&);
+
+   JobCounter(const JobCounter&);
+   JobCounter& operator=(const JobCounter&);
+
+   std::atomic<int> pending_;
+   std::mutex mutex_;
+   std::vector<Job*> waiting_;
+};
+
+// starts threadCount - 1 worker threads beside the calling thread, 0 uses
+// every hardware thread; calling it again restarts with the new count
+void InitializeJobs(int threadCount = 0);
+void DestroyJobs();
+int JobThreadCount();
+
+// queues fn to run on any worker. counter, if given, goes up now and down
+// when fn returns. With dependency given, fn is only queued once that
+// counter has reached zero.
+void RunJob(const char* name, std::function<void()> fn, JobCounter* counter = 0,
+   JobCounter* dependency = 0);
+
+// runs counter's queued jobs on this thread until it reaches zero; jobs
+// held back on a dependency are left to the workers, unless there are no
+// worker threads, when the wait runs any queued job
+void WaitForCounter(JobCounter* counter);
+
+// per-name totals of time spent in jobs, collected while enabled
+void SetJobTiming(bool enabled);
+void PrintJobTimings(int frames);
+
+// splits [begin, end) in halves down to grain, queueing the upper halves
+// as jobs, and calls fn(begin, end) on what is left
+template <typename Fn>
+void ParallelForRange(const char* name, int begin, int end, int grain, const Fn* fn, JobCounter* counter)
+{
+   while (end - begin > grain)
+   {
+      int middle = begin + (end - begin) / 2;
+      RunJob(name, [=]() { ParallelForRange(name, middle, end, grain, fn, counter); }, counter);
+      end = middle;
+   }
+   (*fn)(begin, end);
+}
+
+// calls fn(begin, end) over [0, count) in ranges of at most grain items,
+// spread over the workers, and returns when all of them are done
+template <typename Fn>
+void ParallelFor(const char* name, int count, int grain, const Fn& fn)
+{
+   if (count <= 0)
+      return;
+
+   JobCounter counter;
+   const Fn* body = &fn;
+   RunJob(name, [=, &counter]() { ParallelForRange(name, 0, count, grain, body, &counter); }, &counter);
+   WaitForCounter(&counter);
+}
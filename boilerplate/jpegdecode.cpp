@@ -0,0 +1,377 @@
+#include "jpegdecode.h"
+#include "cpuinfo.h"
+#include "jobs.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stb_image.h>
+
+using namespace std;
+
+// rows of upsampling and colour conversion per job
+const int JPEG_ROWS_PER_JOB = 64;
+
+// strips per worker, so a slow strip does not hold the rest up
+const int JPEG_STRIPS_PER_THREAD = 2;
+
+static void parallelRows(void* context, int count, void(*body)(void* context, int begin, int end))
+{
+   ParallelFor("convert jpeg rows", count, JPEG_ROWS_PER_JOB, [=](int begin, int end) {
+      body(context, begin, end);
+   });
+}
+
+bool InstallJpegKernels()
+{
+   stbi_set_jpeg_parallel_for(parallelRows);
+   if (!CpuHasAVX2())
+      return false;
+   stbi_set_jpeg_kernels(IdctBlockAVX2, YCbCrToRGBAVX2, ResampleRowHV2AVX2);
+   return true;
+}
+
+// where a baseline JPEG with restart markers can be cut: its headers, and
+// the entropy-coded bytes of each restart interval, without the markers
+struct JpegLayout
+{
+   size_t heightField;        // offset of the frame header's height
+   size_t scanStart;          // first entropy-coded byte
+   vector<size_t> begins;     // of each interval's bytes
+   vector<size_t> ends;
+   int width;
+   int height;
+   int mcuHeight;             // pixel rows per MCU row
+   int mcusX;                 // MCUs per MCU row
+   int mcusY;
+   int restartInterval;       // MCUs per interval
+   bool isSubsampledV;        // chroma rows are upsampled from neighbours
+};
+
+static int readWord(const unsigned char* bytes)
+{
+   return (bytes[0] << 8) | bytes[1];
+}
+
+// false for anything but a single interleaved baseline scan with restart
+// markers that add up
+static bool parseJpeg(const unsigned char* bytes, size_t size, JpegLayout* layout)
+{
+   if (size < 4 || bytes[0] != 0xff || bytes[1] != 0xd8)
+      return false;
+
+   int components = 0, maxH = 1, maxV = 1, minV = 4;
+   layout->restartInterval = 0;
+   layout->scanStart = 0;
+   size_t pos = 2;
+   while (!layout->scanStart)
+   {
+      if (pos + 4 > size || bytes[pos] != 0xff)
+         return false;
+      int marker = bytes[pos + 1];
+      if (marker == 0xff)
+      {
+         pos++;
+         continue;
+      }
+      size_t length = size_t(readWord(bytes + pos + 2));
+      if (length < 2 || pos + 2 + length > size)
+         return false;
+      const unsigned char* segment = bytes + pos + 4;
+
+      if (marker == 0xc0 || marker == 0xc1)
+      {
+         // baseline or extended sequential, Huffman coded
+         if (length < 8)
+            return false;
+         layout->heightField = pos + 5;
+         layout->height = readWord(segment + 1);
+         layout->width = readWord(segment + 3);
+         components = segment[5];
+         if (components < 1 || length < size_t(8 + 3 * components))
+            return false;
+         for (int c = 0; c < components; c++)
+         {
+            int h = segment[7 + 3 * c] >> 4, v = segment[7 + 3 * c] & 15;
+            if (h < 1 || v < 1)
+               return false;
+            maxH = std::max(maxH, h);
+            maxV = std::max(maxV, v);
+            minV = std::min(minV, v);
+         }
+      }
+      else if ((marker >= 0xc2 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) ||
+         marker == 0xdc)
+      {
+         // progressive, lossless, arithmetic coded or a DNL height
+         return false;
+      }
+      else if (marker == 0xdd && length >= 4)
+      {
+         layout->restartInterval = readWord(segment);
+      }
+      else if (marker == 0xda)
+      {
+         if (!components || segment[0] != components)
+            return false;
+         layout->scanStart = pos + 2 + length;
+      }
+      pos += 2 + length;
+   }
+   if (layout->restartInterval <= 0 || layout->width <= 0 || layout->height <= 0)
+      return false;
+
+   // a single component's MCU is one block, whatever its sampling
+   if (components == 1)
+      maxH = maxV = minV = 1;
+   layout->mcuHeight = 8 * maxV;
+   layout->mcusX = (layout->width + 8 * maxH - 1) / (8 * maxH);
+   layout->mcusY = (layout->height + layout->mcuHeight - 1) / layout->mcuHeight;
+   layout->isSubsampledV = minV < maxV;
+
+   // restart markers split the intervals; stuffed zeros and fill bytes
+   // are part of the data, any other marker ends it
+   layout->begins.assign(1, layout->scanStart);
+   layout->ends.clear();
+   for (pos = layout->scanStart; pos + 1 < size; pos++)
+   {
+      if (bytes[pos] != 0xff || bytes[pos + 1] == 0x00 || bytes[pos + 1] == 0xff)
+         continue;
+      layout->ends.push_back(pos);
+      if (bytes[pos + 1] < 0xd0 || bytes[pos + 1] > 0xd7)
+         break;
+      layout->begins.push_back(pos + 2);
+      pos++;
+   }
+   size_t intervals = (size_t(layout->mcusX) * layout->mcusY + layout->restartInterval - 1) / layout->restartInterval;
+   return layout->ends.size() == layout->begins.size() && layout->begins.size() == intervals;
+}
+
+// a standalone JPEG of MCU rows [begin, end), which start and end on
+// restart intervals
+static void buildStrip(const unsigned char* bytes, const JpegLayout& layout, int begin, int end,
+   vector<unsigned char>* strip)
+{
+   size_t first = size_t(begin) * layout.mcusX / layout.restartInterval;
+   size_t last = std::min(layout.begins.size(),
+      (size_t(end) * layout.mcusX + layout.restartInterval - 1) / layout.restartInterval);
+   int height = std::min(layout.height, end * layout.mcuHeight) - begin * layout.mcuHeight;
+
+   strip->assign(bytes, bytes + layout.scanStart);
+   (*strip)[layout.heightField] = (unsigned char)(height >> 8);
+   (*strip)[layout.heightField + 1] = (unsigned char)(height & 0xff);
+   for (size_t i = first; i < last; i++)
+   {
+      if (i > first)
+      {
+         strip->push_back(0xff);
+         strip->push_back((unsigned char)(0xd0 + ((i - first - 1) & 7)));
+      }
+      strip->insert(strip->end(), bytes + layout.begins[i], bytes + layout.ends[i]);
+   }
+   strip->push_back(0xff);
+   strip->push_back(0xd9);
+}
+
+static int greatestCommonDivisor(int a, int b)
+{
+   while (b)
+   {
+      int remainder = a % b;
+      a = b;
+      b = remainder;
+   }
+   return a;
+}
+
+unsigned char* DecodeImageParallel(const unsigned char* bytes, size_t size, int* width, int* height,
+   int* components, int requiredComponents)
+{
+   // restart intervals line up with the start of an MCU row every
+   // alignment rows, which is where strips can start
+   JpegLayout layout;
+   int threads = JobThreadCount();
+   if (threads <= 1 || !parseJpeg(bytes, size, &layout))
+      return stbi_load_from_memory(bytes, int(size), width, height, components, requiredComponents);
+   int alignment = layout.restartInterval / greatestCommonDivisor(layout.restartInterval, layout.mcusX);
+   int stripRows = (layout.mcusY + threads * JPEG_STRIPS_PER_THREAD - 1) / (threads * JPEG_STRIPS_PER_THREAD);
+   stripRows = (stripRows + alignment - 1) / alignment * alignment;
+   if (stripRows >= layout.mcusY)
+      return stbi_load_from_memory(bytes, int(size), width, height, components, requiredComponents);
+
+   // with chroma upsampled from the rows above and below, each strip also
+   // decodes the aligned rows around it and keeps only its own
+   int overlap = layout.isSubsampledV ? alignment : 0;
+   int stripCount = (layout.mcusY + stripRows - 1) / stripRows;
+   bool isFlipped = stbi_get_flip_vertically_on_load() != 0;
+   unsigned char* pixels = 0;
+   std::atomic<int> pixelComponents(0);
+   std::atomic<bool> isFailed(false);
+   int channels = 0;                  // in the pixels, set with them
+   std::mutex allocation;
+   ParallelFor("decode jpeg strips", stripCount, 1, [&](int begin, int end) {
+      for (int s = begin; s < end && !isFailed; s++)
+      {
+         int first = s * stripRows;
+         int last = std::min(first + stripRows, layout.mcusY);
+         int decodeFirst = std::max(first - overlap, 0);
+         int decodeLast = std::min(last + overlap, layout.mcusY);
+         vector<unsigned char> strip;
+         buildStrip(bytes, layout, decodeFirst, decodeLast, &strip);
+
+         int stripWidth, stripHeight, stripComponents;
+         unsigned char* decoded = stbi_load_from_memory(strip.data(), int(strip.size()), &stripWidth, &stripHeight,
+            &stripComponents, requiredComponents);
+         if (!decoded || stripWidth != layout.width)
+         {
+            isFailed = true;
+            stbi_image_free(decoded);
+            return;
+         }
+         {
+            std::lock_guard<std::mutex> lock(allocation);
+            if (!pixels)
+            {
+               channels = requiredComponents ? requiredComponents : stripComponents;
+               pixels = (unsigned char*)malloc(size_t(layout.width) * layout.height * channels);
+               pixelComponents = stripComponents;
+            }
+         }
+         if (!pixels || stripComponents != pixelComponents)
+         {
+            isFailed = true;
+            stbi_image_free(decoded);
+            return;
+         }
+
+         // a flipped strip is upside down, and belongs upside down
+         size_t rowBytes = size_t(layout.width) * channels;
+         int top = decodeFirst * layout.mcuHeight;
+         int rowEnd = std::min(last * layout.mcuHeight, layout.height);
+         for (int y = first * layout.mcuHeight; y < rowEnd; y++)
+         {
+            int stripRow = isFlipped ? stripHeight - 1 - (y - top) : y - top;
+            int row = isFlipped ? layout.height - 1 - y : y;
+            memcpy(pixels + row * rowBytes, decoded + stripRow * rowBytes, rowBytes);
+         }
+         stbi_image_free(decoded);
+      }
+   });
+
+   // a strip that would not decode leaves it to the decoder as a whole
+   if (isFailed || !pixels)
+   {
+      free(pixels);
+      return stbi_load_from_memory(bytes, int(size), width, height, components, requiredComponents);
+   }
+   *width = layout.width;
+   *height = layout.height;
+   *components = pixelComponents;
+   return pixels;
+}
+
+unsigned char* LoadImageParallel(const char* filename, int* width, int* height, int* components,
+   int requiredComponents)
+{
+   ifstream file(filename, ios::binary);
+   if (!file)
+      return 0;
+   vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+   return DecodeImageParallel(bytes.data(), bytes.size(), width, height, components, requiredComponents);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+void BenchmarkJpegDecode(int iterations, const char* extraFile)
+{
+   vector<string> files;
+   files.push_back("textures/texture_sun.jpg");
+   files.push_back("textures/texture_earth_surface.jpg");
+   files.push_back("textures/texture_moon.jpg");
+   files.push_back("textures/stars_milkyway.jpg");
+   if (extraFile)
+      files.push_back(extraFile);
+   bool isAVX2 = CpuHasAVX2();
+   printf("JPEG decode, %d iterations, kernels on one thread, parallel on %d threads\n", iterations,
+      JobThreadCount());
+   if (!isAVX2)
+      printf("  avx2 not supported by this CPU\n");
+
+   // from memory, so the file system is not part of the time
+   const char* names[] = { "builtin", "avx2", "parallel" };
+   double totalTimes[3] = { 0.0, 0.0, 0.0 };
+   double totalPixels = 0.0;
+   for (size_t f = 0; f < files.size(); f++)
+   {
+      ifstream file(files[f].c_str(), ios::binary);
+      vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+      if (bytes.empty())
+      {
+         printf("  %s could not be read\n", files[f].c_str());
+         continue;
+      }
+      JpegLayout layout;
+      bool isRestartable = parseJpeg(bytes.data(), bytes.size(), &layout);
+
+      double times[3] = { 0.0, 0.0, 0.0 };
+      vector<unsigned char> decoded[3];
+      int width = 0, height = 0, components = 0;
+      for (int k = 0; k < 3; k++)
+      {
+         if (k == 1 && !isAVX2)
+            continue;
+         stbi_set_jpeg_parallel_for(0);
+         stbi_set_jpeg_kernels(0, 0, 0);
+         if (k > 0)
+            InstallJpegKernels();
+         if (k < 2)
+            stbi_set_jpeg_parallel_for(0);
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+         for (int i = 0; i < iterations; i++)
+         {
+            unsigned char* data = k < 2 ?
+               stbi_load_from_memory(bytes.data(), int(bytes.size()), &width, &height, &components, 0) :
+               DecodeImageParallel(bytes.data(), bytes.size(), &width, &height, &components);
+            if (i == 0 && data)
+               decoded[k].assign(data, data + size_t(width) * height * components);
+            stbi_image_free(data);
+         }
+         times[k] = millisecondsSince(start) / iterations;
+         totalTimes[k] += times[k];
+      }
+      double megapixels = double(width) * height * 1e-6;
+      totalPixels += megapixels;
+
+      printf("  %s, %dx%d, %s\n", files[f].c_str(), width, height,
+         isRestartable ? "restart intervals, decoded in strips" : "no restart intervals, rows in parallel");
+      for (int k = 0; k < 3; k++)
+      {
+         if (k == 1 && !isAVX2)
+            continue;
+         printf("    %-8s  %8.2f ms  %7.1f MP/s  %5.2fx  %s\n", names[k], times[k], megapixels / times[k] * 1e3,
+            times[0] / times[k], decoded[k] == decoded[0] ? "identical" : "DIFFERENT");
+      }
+   }
+   printf("  all\n");
+   for (int k = 0; k < 3; k++)
+   {
+      if (k == 1 && !isAVX2)
+         continue;
+      printf("    %-8s  %8.2f ms  %7.1f MP/s  %5.2fx\n", names[k], totalTimes[k], totalPixels / totalTimes[k] * 1e3,
+         totalTimes[0] / totalTimes[k]);
+   }
+
+   // the program goes on with the fastest decoding
+   InstallJpegKernels();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+// JPEG decoding goes through stb_image, whose decoder takes its IDCT,
+// colour conversion and chroma upsampling kernels from here when the CPU
+// has an instruction set newer than the build targets, and spreads its
+// upsampling and colour conversion over the job system's workers.
+
+// hands the AVX2 kernels to stb_image if the CPU has AVX2, returning true
+// if it did, and the job system for its rows; call before anything is
+// decoded, after InitializeJobs()
+bool InstallJpegKernels();
+
+// decodes an image like stbi_load_from_memory(), on the job system: a baseline JPEG with restart markers is cut at restart
+// intervals into strips of MCU rows, standalone JPEGs decoded side by
+// side; anything else decodes as a whole. Free with stbi_image_free().
+unsigned char* DecodeImageParallel(const unsigned char* bytes, size_t size, int* width, int* height,
+   int* components, int requiredComponents = 0);
+
+// the same for an image file
+unsigned char* LoadImageParallel(const char* filename, int* width, int* height, int* components,
+   int requiredComponents = 0);
+
+// the kernels, eight or sixteen pixels wide, built with AVX2 enabled in
+// jpegdecode_avx2.cpp; they give exactly the bytes stb_image's own kernels
+// give. Only call them when CpuHasAVX2().
+void IdctBlockAVX2(unsigned char* out, int outStride, short data[64]);
+void YCbCrToRGBAVX2(unsigned char* out, const unsigned char* y, const unsigned char* cb, const unsigned char* cr,
+   int count, int step);
+unsigned char* ResampleRowHV2AVX2(unsigned char* out, unsigned char* inNear, unsigned char* inFar, int width, int hs);
+
+// decodes the shipped textures from memory, iterations times each, with
+// stb_image's kernels and the AVX2 ones on one thread, and in parallel,
+// printing the throughput of each and whether they agree; a file given
+// is benchmarked besides them
+void BenchmarkJpegDecode(int iterations, const char* extraFile = 0);
@@ -0,0 +1,228 @@
+#include "jpegdecode.h"
+#include <cstring>
+#include <immintrin.h>
+
+// This file is compiled with AVX2 enabled (see the project settings), so
+// nothing here may run before CpuHasAVX2() said yes. The arithmetic is
+// stb_image's, in 32-bit lanes, so the results are bit for bit the same.
+
+// stb_image's fixed point constants, 12 fractional bits
+#define FIX12(x) int((x) * 4096 + 0.5)
+
+// one 1D pass of stb_image's integer IDCT (jidctint's DCT_ISLOW) over
+// eight lanes, the outputs rounded with bias and shifted down by shift
+static inline void idct1D(const __m256i s[8], __m256i bias, int shift, __m256i out[8])
+{
+   __m256i p1 = _mm256_mullo_epi32(_mm256_add_epi32(s[2], s[6]), _mm256_set1_epi32(FIX12(0.5411961f)));
+   __m256i t2 = _mm256_add_epi32(p1, _mm256_mullo_epi32(s[6], _mm256_set1_epi32(FIX12(-1.847759065f))));
+   __m256i t3 = _mm256_add_epi32(p1, _mm256_mullo_epi32(s[2], _mm256_set1_epi32(FIX12(0.765366865f))));
+   __m256i t0 = _mm256_slli_epi32(_mm256_add_epi32(s[0], s[4]), 12);
+   __m256i t1 = _mm256_slli_epi32(_mm256_sub_epi32(s[0], s[4]), 12);
+   __m256i x0 = _mm256_add_epi32(_mm256_add_epi32(t0, t3), bias);
+   __m256i x3 = _mm256_add_epi32(_mm256_sub_epi32(t0, t3), bias);
+   __m256i x1 = _mm256_add_epi32(_mm256_add_epi32(t1, t2), bias);
+   __m256i x2 = _mm256_add_epi32(_mm256_sub_epi32(t1, t2), bias);
+
+   __m256i p3 = _mm256_add_epi32(s[7], s[3]);
+   __m256i p4 = _mm256_add_epi32(s[5], s[1]);
+   p1 = _mm256_add_epi32(s[7], s[1]);
+   __m256i p2 = _mm256_add_epi32(s[5], s[3]);
+   __m256i p5 = _mm256_mullo_epi32(_mm256_add_epi32(p3, p4), _mm256_set1_epi32(FIX12(1.175875602f)));
+   t0 = _mm256_mullo_epi32(s[7], _mm256_set1_epi32(FIX12(0.298631336f)));
+   t1 = _mm256_mullo_epi32(s[5], _mm256_set1_epi32(FIX12(2.053119869f)));
+   t2 = _mm256_mullo_epi32(s[3], _mm256_set1_epi32(FIX12(3.072711026f)));
+   t3 = _mm256_mullo_epi32(s[1], _mm256_set1_epi32(FIX12(1.501321110f)));
+   p1 = _mm256_add_epi32(p5, _mm256_mullo_epi32(p1, _mm256_set1_epi32(FIX12(-0.899976223f))));
+   p2 = _mm256_add_epi32(p5, _mm256_mullo_epi32(p2, _mm256_set1_epi32(FIX12(-2.562915447f))));
+   p3 = _mm256_mullo_epi32(p3, _mm256_set1_epi32(FIX12(-1.961570560f)));
+   p4 = _mm256_mullo_epi32(p4, _mm256_set1_epi32(FIX12(-0.390180644f)));
+   t3 = _mm256_add_epi32(t3, _mm256_add_epi32(p1, p4));
+   t2 = _mm256_add_epi32(t2, _mm256_add_epi32(p2, p3));
+   t1 = _mm256_add_epi32(t1, _mm256_add_epi32(p2, p4));
+   t0 = _mm256_add_epi32(t0, _mm256_add_epi32(p1, p3));
+
+   out[0] = _mm256_srai_epi32(_mm256_add_epi32(x0, t3), shift);
+   out[7] = _mm256_srai_epi32(_mm256_sub_epi32(x0, t3), shift);
+   out[1] = _mm256_srai_epi32(_mm256_add_epi32(x1, t2), shift);
+   out[6] = _mm256_srai_epi32(_mm256_sub_epi32(x1, t2), shift);
+   out[2] = _mm256_srai_epi32(_mm256_add_epi32(x2, t1), shift);
+   out[5] = _mm256_srai_epi32(_mm256_sub_epi32(x2, t1), shift);
+   out[3] = _mm256_srai_epi32(_mm256_add_epi32(x3, t0), shift);
+   out[4] = _mm256_srai_epi32(_mm256_sub_epi32(x3, t0), shift);
+}
+
+// transposes eight rows of eight 32-bit values
+static inline void transpose8x8(__m256i r[8])
+{
+   __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+   __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+   __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+   __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+   __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+   __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+   __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+   __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+   __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+   __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+   __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+   __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+   __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+   __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+   __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+   __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+   r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+   r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+   r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+   r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+   r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+   r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+   r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+   r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+void IdctBlockAVX2(unsigned char* out, int outStride, short data[64])
+{
+   // columns: a row of coefficients per register, a column per lane,
+   // keeping 2 extra bits of precision
+   __m256i rows[8], columns[8];
+   for (int i = 0; i < 8; i++)
+      rows[i] = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 8 * i)));
+   idct1D(rows, _mm256_set1_epi32(512), 10, columns);
+
+   // rows: removing the 1 << 17 of scaling, rounded, with the 128 that
+   // brings -128..127 to 0..255
+   transpose8x8(columns);
+   idct1D(columns, _mm256_set1_epi32(65536 + (128 << 17)), 17, rows);
+   transpose8x8(rows);
+   for (int i = 0; i < 8; i++, out += outStride)
+   {
+      __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(rows[i]), _mm256_extracti128_si256(rows[i], 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(words, words));
+   }
+}
+
+// stb_image's reduced precision YCbCr constants, 20 fractional bits
+#define FIX20(x) (int((x) * 4096.0f + 0.5f) << 8)
+
+void YCbCrToRGBAVX2(unsigned char* out, const unsigned char* y, const unsigned char* cb, const unsigned char* cr,
+   int count, int step)
+{
+   int i = 0;
+   if (step == 3 || step == 4)
+   {
+      const __m256i bias = _mm256_set1_epi32(128);
+      const __m256i rounding = _mm256_set1_epi32(1 << 19);
+      const __m256i crR = _mm256_set1_epi32(FIX20(1.40200f));
+      const __m256i crG = _mm256_set1_epi32(-FIX20(0.71414f));
+      const __m256i cbG = _mm256_set1_epi32(-FIX20(0.34414f));
+      const __m256i cbB = _mm256_set1_epi32(FIX20(1.77200f));
+      const __m256i highWord = _mm256_set1_epi32(int(0xffff0000));
+      const __m256i zero = _mm256_setzero_si256();
+      const __m256i maximum = _mm256_set1_epi32(255);
+      const __m256i alpha = _mm256_set1_epi32(int(0xff000000));
+      const __m256i dropAlpha = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+      for (; i + 7 < count; i += 8)
+      {
+         __m256i luma = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + i)));
+         __m256i blue = _mm256_sub_epi32(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cb + i))), bias);
+         __m256i red = _mm256_sub_epi32(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cr + i))), bias);
+         __m256i fixed = _mm256_add_epi32(_mm256_slli_epi32(luma, 20), rounding);
+         __m256i r = _mm256_add_epi32(fixed, _mm256_mullo_epi32(red, crR));
+         __m256i g = _mm256_add_epi32(_mm256_add_epi32(fixed, _mm256_mullo_epi32(red, crG)),
+            _mm256_and_si256(_mm256_mullo_epi32(blue, cbG), highWord));
+         __m256i b = _mm256_add_epi32(fixed, _mm256_mullo_epi32(blue, cbB));
+         r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 20), zero), maximum);
+         g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 20), zero), maximum);
+         b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 20), zero), maximum);
+
+         // a pixel per lane, RGBA in memory order
+         __m256i pixels = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+            _mm256_or_si256(_mm256_slli_epi32(b, 16), alpha));
+         if (step == 4)
+         {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), pixels);
+            out += 32;
+            continue;
+         }
+
+         // twelve bytes from each half; the first store's last four bytes
+         // are overwritten by the second half's
+         __m256i packed = _mm256_shuffle_epi8(pixels, dropAlpha);
+         __m128i high = _mm256_extracti128_si256(packed, 1);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+         _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 12), high);
+         int last = _mm_extract_epi32(high, 2);
+         memcpy(out + 20, &last, 4);
+         out += 24;
+      }
+   }
+
+   for (; i < count; i++)
+   {
+      int fixed = (y[i] << 20) + (1 << 19);
+      int red = cr[i] - 128;
+      int blue = cb[i] - 128;
+      int r = (fixed + red * FIX20(1.40200f)) >> 20;
+      int g = (fixed + red * -FIX20(0.71414f) + ((blue * -FIX20(0.34414f)) & int(0xffff0000))) >> 20;
+      int b = (fixed + blue * FIX20(1.77200f)) >> 20;
+      out[0] = (unsigned char)(r < 0 ? 0 : r > 255 ? 255 : r);
+      out[1] = (unsigned char)(g < 0 ? 0 : g > 255 ? 255 : g);
+      out[2] = (unsigned char)(b < 0 ? 0 : b > 255 ? 255 : b);
+      if (step == 4)
+         out[3] = 255;
+      out += step;
+   }
+}
+
+unsigned char* ResampleRowHV2AVX2(unsigned char* out, unsigned char* inNear, unsigned char* inFar, int width, int hs)
+{
+   (void)hs;
+
+   // each input sample, weighted 3:1 with its vertical neighbour, makes
+   // two outputs weighted 3:1 with the samples either side
+   if (width == 1)
+   {
+      out[0] = out[1] = (unsigned char)((3 * inNear[0] + inFar[0] + 2) >> 2);
+      return out;
+   }
+   out[0] = (unsigned char)((3 * inNear[0] + inFar[0] + 2) >> 2);
+   out[1] = (unsigned char)((3 * (3 * inNear[0] + inFar[0]) + 3 * inNear[1] + inFar[1] + 8) >> 4);
+
+   // sixteen samples at a time, each with the one before and after it
+   const __m256i three = _mm256_set1_epi16(3);
+   const __m256i bias = _mm256_set1_epi16(8);
+   int i = 1;
+   for (; i + 16 < width; i += 16)
+   {
+      __m256i samples[3];
+      for (int k = 0; k < 3; k++)
+      {
+         __m256i nearRow = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(inNear + i - 1 + k)));
+         __m256i farRow = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(inFar + i - 1 + k)));
+         samples[k] = _mm256_add_epi16(_mm256_mullo_epi16(nearRow, three), farRow);
+      }
+      __m256i current = _mm256_add_epi16(_mm256_mullo_epi16(samples[1], three), bias);
+      __m256i even = _mm256_srli_epi16(_mm256_add_epi16(current, samples[0]), 4);
+      __m256i odd = _mm256_srli_epi16(_mm256_add_epi16(current, samples[2]), 4);
+
+      // interleaving within each half keeps the halves in order
+      __m256i low = _mm256_unpacklo_epi16(even, odd);
+      __m256i high = _mm256_unpackhi_epi16(even, odd);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_packus_epi16(low, high));
+   }
+
+   for (; i < width; i++)
+   {
+      int previous = 3 * inNear[i - 1] + inFar[i - 1];
+      int current = 3 * inNear[i] + inFar[i];
+      out[2 * i] = (unsigned char)((3 * current + previous + 8) >> 4);
+      if (i + 1 < width)
+         out[2 * i + 1] = (unsigned char)((3 * current + 3 * inNear[i + 1] + inFar[i + 1] + 8) >> 4);
+      else
+         out[2 * i + 1] = (unsigned char)((current + 2) >> 2);
+   }
+   return out;
+}
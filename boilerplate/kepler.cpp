@@ -0,0 +1,431 @@
+#include "kepler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+#define KEPLER_SIMD
+#endif
+
+static const double PI = 3.14159265358979323846;
+static const double TWO_PI = 2.0 * PI;
+
+// Newton's method from Danby's starting guess converges for every e < 1;
+// near-circular orbits need two or three steps, e = 0.99 about eight
+static const int MAX_ITERATIONS = 16;
+static const double TOLERANCE = 1e-14;
+
+// below this eccentricity the batch solver starts from the third order
+// series E = M + e sin M (1 + e cos M), which is within e^3 of the root
+static const double SERIES_START_MAX_E = 0.8;
+
+// Newton steps smaller than this rotate the known sine and cosine of E by
+// the step with a Taylor series instead of evaluating them again, and steps
+// below TINY_STEP only need the series to third order
+static const double SMALL_STEP = 1e-2;
+static const double TINY_STEP = 1e-4;
+
+// a warm start steps from the previous solution by the change in mean
+// anomaly over 1 - e cos E; its error grows with the square of the step, so
+// beyond this the usual starting guess is as good
+static const double WARM_MAX_STEP = 0.1;
+
+// orbits the batch solver iterates together, small enough for the list of
+// those still converging to live on the stack and the block to stay in L1
+static const int BLOCK_SIZE = 256;
+
+static double wrapAngle(double a)
+{
+   return a - TWO_PI * std::floor(a / TWO_PI + 0.5);
+}
+
+OrbitalElements CircularOrbit(double radius, double period, double inclination, double ascendingNode)
+{
+   OrbitalElements orbit;
+   orbit.semiMajorAxis = radius;
+   orbit.inclination = inclination;
+   orbit.ascendingNode = ascendingNode;
+   orbit.meanMotion = period != 0.0 ? TWO_PI / period : 0.0;
+   return orbit;
+}
+
+double SolveKepler(double meanAnomaly, double e)
+{
+   double M = wrapAngle(meanAnomaly);
+   double E = M + (M < 0.0 ? -0.85 : 0.85) * e;
+   for (int i = 0; i < MAX_ITERATIONS; i++)
+   {
+      double delta = (E - e * std::sin(E) - M) / (1.0 - e * std::cos(E));
+      E -= delta;
+      if (std::abs(delta) < TOLERANCE)
+         break;
+   }
+   return E;
+}
+
+void OrbitBasis(const OrbitalElements& orbit, dvec3& p, dvec3& q)
+{
+   double cn = std::cos(orbit.ascendingNode), sn = std::sin(orbit.ascendingNode);
+   double cw = std::cos(orbit.argPeriapsis), sw = std::sin(orbit.argPeriapsis);
+   double ci = std::cos(orbit.inclination), si = std::sin(orbit.inclination);
+
+   // the usual perifocal to reference frame rotation, with the reference
+   // plane mapped onto the scene's xz plane and its pole onto y
+   p = dvec3(cn * cw - sn * sw * ci, sw * si, sn * cw + cn * sw * ci);
+   q = dvec3(-cn * sw - sn * cw * ci, cw * si, -sn * sw + cn * cw * ci);
+}
+
+dvec3 OrbitPosition(const OrbitalElements& orbit, double t)
+{
+   double e = orbit.eccentricity;
+   double E = SolveKepler(orbit.meanAnomalyAtEpoch + orbit.meanMotion * t, e);
+
+   dvec3 p, q;
+   OrbitBasis(orbit, p, q);
+   double a = orbit.semiMajorAxis;
+   return a * (std::cos(E) - e) * p + a * std::sqrt(1.0 - e * e) * std::sin(E) * q;
+}
+
+#ifdef KEPLER_SIMD
+// two-wide double precision sine and cosine, Cephes polynomials with an
+// octant range reduction, for |x| up to a few thousand
+static inline void sincos2(__m128d x, __m128d* s, __m128d* c)
+{
+   const __m128d signMask = _mm_castsi128_pd(_mm_set_epi32(0x80000000, 0, 0x80000000, 0));
+
+   __m128d signSin = _mm_and_pd(x, signMask);
+   x = _mm_andnot_pd(signMask, x);
+
+   // octant index, rounded up to even, in the low two 32 bit lanes
+   __m128i j = _mm_cvttpd_epi32(_mm_mul_pd(x, _mm_set1_pd(4.0 / PI)));
+   j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+   __m128d y = _mm_cvtepi32_pd(j);
+
+   // widen the per-lane flags to 64 bits, sign flags into bit 63
+   __m128i zero = _mm_setzero_si128();
+   __m128i flipSin = _mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29);
+   __m128i flipCos = _mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29);
+   __m128i polySin = _mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), zero);
+   __m128d swapSignSin = _mm_castsi128_pd(_mm_unpacklo_epi32(zero, flipSin));
+   __m128d signCos = _mm_castsi128_pd(_mm_unpacklo_epi32(zero, flipCos));
+   __m128d usePolySin = _mm_castsi128_pd(_mm_unpacklo_epi32(polySin, polySin));
+   signSin = _mm_xor_pd(signSin, swapSignSin);
+
+   // extended precision x - y * pi/4
+   x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(7.85398125648498535156e-1)));
+   x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(3.77489470793079817668e-8)));
+   x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(2.69515142907905952645e-15)));
+   __m128d z = _mm_mul_pd(x, x);
+
+   __m128d pc = _mm_set1_pd(-1.13585365213876817300e-11);
+   pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(2.08757008419747316778e-9));
+   pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(-2.75573141792967388112e-7));
+   pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(2.48015872888517045348e-5));
+   pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(-1.38888888888730564116e-3));
+   pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(4.16666666666665929218e-2));
+   pc = _mm_mul_pd(_mm_mul_pd(pc, z), z);
+   pc = _mm_add_pd(_mm_sub_pd(pc, _mm_mul_pd(z, _mm_set1_pd(0.5))), _mm_set1_pd(1.0));
+
+   __m128d ps = _mm_set1_pd(1.58962301576546568060e-10);
+   ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-2.50507477628578072866e-8));
+   ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(2.75573136213857245213e-6));
+   ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-1.98412698295895385996e-4));
+   ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(8.33333333332211858878e-3));
+   ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-1.66666666666666307295e-1));
+   ps = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(ps, z), x), x);
+
+   __m128d sinValue = _mm_or_pd(_mm_and_pd(usePolySin, ps), _mm_andnot_pd(usePolySin, pc));
+   __m128d cosValue = _mm_or_pd(_mm_and_pd(usePolySin, pc), _mm_andnot_pd(usePolySin, ps));
+   *s = _mm_xor_pd(sinValue, signSin);
+   *c = _mm_xor_pd(cosValue, signCos);
+}
+#endif
+
+#ifdef KEPLER_SIMD
+// sine and cosine of x - d given sine and cosine of x, for |d| < SMALL_STEP;
+// the series run to d^7 and d^6, leaving errors below 1e-20
+static inline void rotateBack(__m128d d, __m128d* s, __m128d* c)
+{
+   const __m128d one = _mm_set1_pd(1.0);
+   __m128d d2 = _mm_mul_pd(d, d);
+
+   __m128d sd = _mm_sub_pd(one, _mm_mul_pd(d2, _mm_set1_pd(1.0 / 42.0)));
+   sd = _mm_sub_pd(one, _mm_mul_pd(_mm_mul_pd(d2, _mm_set1_pd(1.0 / 20.0)), sd));
+   sd = _mm_sub_pd(one, _mm_mul_pd(_mm_mul_pd(d2, _mm_set1_pd(1.0 / 6.0)), sd));
+   sd = _mm_mul_pd(d, sd);
+
+   __m128d cd = _mm_sub_pd(one, _mm_mul_pd(d2, _mm_set1_pd(1.0 / 30.0)));
+   cd = _mm_sub_pd(one, _mm_mul_pd(_mm_mul_pd(d2, _mm_set1_pd(1.0 / 12.0)), cd));
+   cd = _mm_sub_pd(one, _mm_mul_pd(_mm_mul_pd(d2, _mm_set1_pd(0.5)), cd));
+
+   __m128d rs = _mm_sub_pd(_mm_mul_pd(*s, cd), _mm_mul_pd(*c, sd));
+   *c = _mm_add_pd(_mm_mul_pd(*c, cd), _mm_mul_pd(*s, sd));
+   *s = rs;
+}
+
+// as rotateBack, for |d| < TINY_STEP where the error of the short series
+// is below d^4 / 24
+static inline void rotateBackTiny(__m128d d, __m128d* s, __m128d* c)
+{
+   __m128d d2 = _mm_mul_pd(d, d);
+   __m128d sd = _mm_mul_pd(d, _mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(d2, _mm_set1_pd(1.0 / 6.0))));
+   __m128d cd = _mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(d2, _mm_set1_pd(0.5)));
+
+   __m128d rs = _mm_sub_pd(_mm_mul_pd(*s, cd), _mm_mul_pd(*c, sd));
+   *c = _mm_add_pd(_mm_mul_pd(*c, cd), _mm_mul_pd(*s, sd));
+   *s = rs;
+}
+
+// mean anomaly reduced into [-pi, pi] by the same operations as wrapAngle,
+// so both paths agree exactly. SSE2 has no floor and the int conversion
+// overflows past 2^31 turns, which time warp reaches, so the magnitude
+// rounds through adding 2^52 instead; turns beyond that are already whole.
+static inline __m128d reduceAnomaly(__m128d M)
+{
+   const __m128d signMask = _mm_set1_pd(-0.0);
+   const __m128d twoTo52 = _mm_set1_pd(4503599627370496.0);
+   const __m128d twoPi = _mm_set1_pd(TWO_PI);
+   __m128d turns = _mm_add_pd(_mm_div_pd(M, twoPi), _mm_set1_pd(0.5));
+   __m128d size = _mm_andnot_pd(signMask, turns);
+   __m128d rounded = _mm_or_pd(_mm_sub_pd(_mm_add_pd(size, twoTo52), twoTo52), _mm_and_pd(turns, signMask));
+   rounded = _mm_sub_pd(rounded, _mm_and_pd(_mm_cmpgt_pd(rounded, turns), _mm_set1_pd(1.0)));
+   __m128d isWhole = _mm_cmpge_pd(size, twoTo52);
+   __m128d floored = _mm_or_pd(_mm_and_pd(isWhole, turns), _mm_andnot_pd(isWhole, rounded));
+   return _mm_sub_pd(M, _mm_mul_pd(twoPi, floored));
+}
+#endif
+
+static void solveKeplerBatch(const double* meanAnomaly, const double* eccentricity,
+   double* E, double* sinE, double* cosE, int count, bool isWarm)
+{
+   int simdCount = 0;
+
+#ifdef KEPLER_SIMD
+   // Each Newton step is one pass over a block of orbits rather than a loop
+   // per orbit, so consecutive orbits overlap in the pipeline instead of
+   // waiting on each other's divide and polynomial latency. Once steps are
+   // small the sine and cosine are carried along by rotation rather than
+   // re-evaluated.
+   simdCount = count & ~1;
+   const __m128d signMask = _mm_set1_pd(-0.0);
+   const __m128d smallStep = _mm_set1_pd(SMALL_STEP);
+   const __m128d tinyStep = _mm_set1_pd(TINY_STEP);
+   const __m128d tolerance = _mm_set1_pd(TOLERANCE);
+   const __m128d one = _mm_set1_pd(1.0);
+   const __m128d warmMaxStep = _mm_set1_pd(WARM_MAX_STEP);
+
+   for (int blockStart = 0; blockStart < simdCount; blockStart += BLOCK_SIZE)
+   {
+      int blockEnd = blockStart + BLOCK_SIZE < simdCount ? blockStart + BLOCK_SIZE : simdCount;
+
+      // starting guess, the series for moderate e and Danby's otherwise;
+      // the reduced mean anomalies are kept for the Newton passes
+      double reduced[BLOCK_SIZE];
+      int active[BLOCK_SIZE / 2];
+      int activeCount = 0;
+      for (int i = blockStart; i < blockEnd; i += 2)
+      {
+         __m128d M = reduceAnomaly(_mm_loadu_pd(meanAnomaly + i));
+         __m128d e = _mm_loadu_pd(eccentricity + i);
+         __m128d s, c;
+         _mm_storeu_pd(reduced + (i - blockStart), M);
+
+         // from the previous solution, which solved the mean anomaly
+         // E - e sin E, to second order in the change; the whole turns
+         // between the two move E with them
+         if (isWarm)
+         {
+            __m128d x = _mm_loadu_pd(E + i);
+            s = _mm_loadu_pd(sinE + i);
+            c = _mm_loadu_pd(cosE + i);
+            __m128d change = _mm_sub_pd(M, _mm_sub_pd(x, _mm_mul_pd(e, s)));
+            __m128d wrapped = change;
+            if (_mm_movemask_pd(_mm_cmpgt_pd(_mm_andnot_pd(signMask, change), _mm_set1_pd(PI))) != 0)
+               wrapped = reduceAnomaly(change);
+            __m128d inverse = _mm_div_pd(one, _mm_sub_pd(one, _mm_mul_pd(e, c)));
+            __m128d step = _mm_mul_pd(wrapped, inverse);
+            __m128d curve = _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(0.5), _mm_mul_pd(e, s)), inverse);
+            step = _mm_sub_pd(step, _mm_mul_pd(curve, _mm_mul_pd(step, step)));
+            __m128d size = _mm_andnot_pd(signMask, step);
+            if (_mm_movemask_pd(_mm_cmplt_pd(size, warmMaxStep)) == 3)
+            {
+               x = _mm_add_pd(_mm_add_pd(x, _mm_sub_pd(change, wrapped)), step);
+               if (_mm_movemask_pd(_mm_cmplt_pd(size, smallStep)) == 3)
+                  rotateBack(_mm_sub_pd(_mm_setzero_pd(), step), &s, &c);
+               else
+                  sincos2(x, &s, &c);
+
+               _mm_storeu_pd(E + i, x);
+               _mm_storeu_pd(sinE + i, s);
+               _mm_storeu_pd(cosE + i, c);
+               active[activeCount++] = i;
+               continue;
+            }
+         }
+
+         sincos2(M, &s, &c);
+
+         __m128d series = _mm_mul_pd(_mm_mul_pd(e, s), _mm_add_pd(one, _mm_mul_pd(e, c)));
+         __m128d danby = _mm_or_pd(_mm_mul_pd(_mm_set1_pd(0.85), e), _mm_and_pd(M, signMask));
+         __m128d useSeries = _mm_cmplt_pd(e, _mm_set1_pd(SERIES_START_MAX_E));
+         __m128d step = _mm_or_pd(_mm_and_pd(useSeries, series), _mm_andnot_pd(useSeries, danby));
+         __m128d start = _mm_add_pd(M, step);
+
+         if (_mm_movemask_pd(_mm_cmplt_pd(_mm_andnot_pd(signMask, step), smallStep)) == 3)
+            rotateBack(_mm_sub_pd(_mm_setzero_pd(), step), &s, &c);
+         else
+            sincos2(start, &s, &c);
+
+         _mm_storeu_pd(E + i, start);
+         _mm_storeu_pd(sinE + i, s);
+         _mm_storeu_pd(cosE + i, c);
+         active[activeCount++] = i;
+      }
+
+      // Newton's error after a step is about delta^2 f''/2f', at most
+      // delta^2 e / 2(1 - e); a pair of orbits drops out of the passes once
+      // that is below the tolerance for both, so the few eccentric orbits
+      // that need more steps do not hold the rest back. f' is positive, so
+      // the test multiplies through by it rather than dividing.
+      for (int k = 0; k < MAX_ITERATIONS && activeCount > 0; k++)
+      {
+         int stillActive = 0;
+         for (int j = 0; j < activeCount; j++)
+         {
+            int i = active[j];
+            __m128d M = _mm_loadu_pd(reduced + (i - blockStart));
+            __m128d e = _mm_loadu_pd(eccentricity + i);
+            __m128d x = _mm_loadu_pd(E + i);
+            __m128d s = _mm_loadu_pd(sinE + i);
+            __m128d c = _mm_loadu_pd(cosE + i);
+
+            __m128d f = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(e, s)), M);
+            __m128d df = _mm_sub_pd(one, _mm_mul_pd(e, c));
+            __m128d delta = _mm_div_pd(f, df);
+            x = _mm_sub_pd(x, delta);
+
+            __m128d size = _mm_andnot_pd(signMask, delta);
+            __m128d error = _mm_mul_pd(_mm_mul_pd(delta, delta), e);
+            __m128d bound = _mm_mul_pd(tolerance, _mm_add_pd(df, df));
+            if (_mm_movemask_pd(_mm_cmplt_pd(size, tinyStep)) == 3)
+               rotateBackTiny(delta, &s, &c);
+            else if (_mm_movemask_pd(_mm_cmplt_pd(size, smallStep)) == 3)
+               rotateBack(delta, &s, &c);
+            else
+               sincos2(x, &s, &c);
+
+            _mm_storeu_pd(E + i, x);
+            _mm_storeu_pd(sinE + i, s);
+            _mm_storeu_pd(cosE + i, c);
+            if (_mm_movemask_pd(_mm_cmplt_pd(error, bound)) != 3)
+               active[stillActive++] = i;
+         }
+         activeCount = stillActive;
+      }
+   }
+#endif
+
+   for (int i = simdCount; i < count; i++)
+   {
+      E[i] = SolveKepler(meanAnomaly[i], eccentricity[i]);
+      sinE[i] = std::sin(E[i]);
+      cosE[i] = std::cos(E[i]);
+   }
+}
+
+void SolveKeplerBatch(const double* meanAnomaly, const double* eccentricity,
+   double* E, double* sinE, double* cosE, int count)
+{
+   solveKeplerBatch(meanAnomaly, eccentricity, E, sinE, cosE, count, false);
+}
+
+void RefineKeplerBatch(const double* meanAnomaly, const double* eccentricity,
+   double* E, double* sinE, double* cosE, int count)
+{
+   solveKeplerBatch(meanAnomaly, eccentricity, E, sinE, cosE, count, true);
+}
+
+static double randomDouble(double lo, double hi)
+{
+   return lo + (hi - lo) * (rand() / double(RAND_MAX));
+}
+
+template <typename Fn>
+static double bestOf(int runs, Fn fn)
+{
+   double best = 1e30;
+   for (int r = 0; r < runs; r++)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      fn();
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+   }
+   return best;
+}
+
+void BenchmarkKepler(int count)
+{
+   // the belt's eccentricities, with a tail out to 0.99
+   std::vector<double> meanMotion(count), epoch(count), e(count), M(count);
+   std::vector<double> E(count), sinE(count), cosE(count);
+   for (int i = 0; i < count; i++)
+   {
+      meanMotion[i] = TWO_PI / randomDouble(10.0, 1000.0);
+      epoch[i] = randomDouble(-PI, PI);
+      e[i] = i % 100 == 0 ? randomDouble(0.1, 0.99) : randomDouble(0.0, 0.1);
+   }
+
+   // up to 2^31 turns the batch reduction could go through an int; the
+   // later times are past that, then past 2^52 turns, where they are whole
+   const double times[] = { 0.0, 1e3, 1e12, 1e17, 1e19 };
+   const int runs = 20;
+   printf("Kepler benchmark, %d orbits, best of %d runs\n", count, runs);
+   for (int t = 0; t < 5; t++)
+   {
+      for (int i = 0; i < count; i++)
+         M[i] = epoch[i] + meanMotion[i] * times[t];
+
+      double scalar = bestOf(runs, [&]() {
+         for (int i = 0; i < count; i++)
+            E[i] = SolveKepler(M[i], e[i]);
+      });
+      std::vector<double> reference(E);
+      double batch = bestOf(runs, [&]() { SolveKeplerBatch(&M[0], &e[0], &E[0], &sinE[0], &cosE[0], count); });
+
+      // residuals of Kepler's equation at the wrapped mean anomaly, so the
+      // garbage of times beyond double precision compares like for like
+      double maxDifference = 0.0, maxResidual = 0.0;
+      for (int i = 0; i < count; i++)
+      {
+         maxDifference = std::max(maxDifference, std::abs(E[i] - reference[i]));
+         maxResidual = std::max(maxResidual, std::abs(E[i] - e[i] * sinE[i] - wrapAngle(M[i])));
+         maxResidual = std::max(maxResidual, std::abs(sinE[i] - std::sin(E[i])) + std::abs(cosE[i] - std::cos(E[i])));
+      }
+      printf("  t = %-6g  scalar %8.3f ms   batch %8.3f ms   max difference %g, residual %g\n",
+         times[t], scalar, batch, maxDifference, maxResidual);
+
+      // a simulation step later, from this solution
+      std::vector<double> nextM(count), nextE(count), nextSinE(count), nextCosE(count);
+      for (int i = 0; i < count; i++)
+         nextM[i] = epoch[i] + meanMotion[i] * (times[t] + 1.0 / 120.0);
+      double refine = 1e30;
+      for (int r = 0; r < runs; r++)
+      {
+         nextE = E;
+         nextSinE = sinE;
+         nextCosE = cosE;
+         refine = std::min(refine, bestOf(1, [&]() {
+            RefineKeplerBatch(&nextM[0], &e[0], &nextE[0], &nextSinE[0], &nextCosE[0], count);
+         }));
+      }
+      maxDifference = 0.0;
+      for (int i = 0; i < count; i++)
+         maxDifference = std::max(maxDifference, std::abs(nextE[i] - SolveKepler(nextM[i], e[i])));
+      printf("  t + 1/120             refined from t %8.3f ms   max difference %g\n", refine, maxDifference);
+   }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+using namespace glm;
+
+// Classical orbital elements of an elliptic orbit, in double precision so
+// positions stay exact for arbitrary times and large time warps. Angles are
+// in radians, times in seconds.
+struct OrbitalElements
+{
+   double semiMajorAxis;
+   double eccentricity;        // 0 <= e < 1
+   double inclination;         // tilt of the orbit plane from the xz plane
+   double ascendingNode;       // longitude of the ascending node
+   double argPeriapsis;        // argument of periapsis
+   double meanAnomalyAtEpoch;  // mean anomaly at t = 0
+   double meanMotion;          // radians per second, 2 pi / period
+
+   OrbitalElements()
+      : semiMajorAxis(0.0), eccentricity(0.0), inclination(0.0), ascendingNode(0.0)
+      , argPeriapsis(0.0), meanAnomalyAtEpoch(0.0), meanMotion(0.0)
+   {}
+};
+
+// circular orbit of the given radius and period (0 for a fixed point)
+OrbitalElements CircularOrbit(double radius, double period, double inclination = 0.0,
+   double ascendingNode = 0.0);
+
+// solves Kepler's equation E - e sin(E) = M for the eccentric anomaly E
+double SolveKepler(double meanAnomaly, double eccentricity);
+
+// position at time t relative to the focus, in scene axes (orbit plane xz, y up)
+dvec3 OrbitPosition(const OrbitalElements& orbit, double t);
+
+// orientation of an orbit as the scene-space directions of periapsis (p) and
+// of the point 90 degrees further along the orbit (q), so that
+// position = a (cos E - e) p + b sin E q
+void OrbitBasis(const OrbitalElements& orbit, dvec3& p, dvec3& q);
+
+// vectorized solve over arrays: for each i, reduces meanAnomaly[i] into
+// [-pi, pi] and returns the eccentric anomaly with its sine and cosine,
+// which is all the position needs. Runs two orbits at a time with SSE2.
+void SolveKeplerBatch(const double* meanAnomaly, const double* eccentricity,
+   double* E, double* sinE, double* cosE, int count);
+
+// as SolveKeplerBatch, but starting from the solution already in E, sinE
+// and cosE for nearby mean anomalies, such as the previous frame's, so a
+// step or two of Newton's method finishes it; orbits whose mean anomaly
+// moved too far start afresh. E = 0, sinE = 0, cosE = 1 solves M = 0.
+void RefineKeplerBatch(const double* meanAnomaly, const double* eccentricity,
+   double* E, double* sinE, double* cosE, int count);
+
+// times the scalar and batch solvers over count orbits at a range of times,
+// out to where the mean anomaly is whole turns, and the refinement a
+// simulation step later, and prints how far they and Kepler's equation
+// disagree
+void BenchmarkKepler(int count);
@@ -0,0 +1,86 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+   : data_(0)
+   , size_(0)
+#ifdef _WIN32
+   , file_(INVALID_HANDLE_VALUE)
+   , mapping_(0)
+#endif
+{}
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+   close();
+
+#ifdef _WIN32
+   file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+   if (file_ == INVALID_HANDLE_VALUE)
+      return false;
+   LARGE_INTEGER fileSize;
+   if (!GetFileSizeEx(file_, &fileSize) || fileSize.QuadPart <= 0)
+   {
+      close();
+      return false;
+   }
+   size_ = size_t(fileSize.QuadPart);
+   mapping_ = CreateFileMappingA(file_, 0, PAGE_READONLY, 0, 0, 0);
+   if (mapping_)
+      data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+   int file = ::open(filename, O_RDONLY);
+   if (file < 0)
+      return false;
+   struct stat status;
+   if (fstat(file, &status) == 0 && status.st_size > 0)
+   {
+      size_ = size_t(status.st_size);
+      void* data = mmap(0, size_, PROT_READ, MAP_PRIVATE, file, 0);
+      if (data != MAP_FAILED)
+         data_ = data;
+   }
+   ::close(file);
+#endif
+   if (!data_)
+   {
+      close();
+      return false;
+   }
+   return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+   if (data_)
+      UnmapViewOfFile(data_);
+   if (mapping_)
+      CloseHandle(mapping_);
+   if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle(file_);
+   mapping_ = 0;
+   file_ = INVALID_HANDLE_VALUE;
+#else
+   if (data_)
+      munmap(data_, size_);
+#endif
+   data_ = 0;
+   size_ = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// A file mapped read-only into memory, its bytes valid until close() or
+// destruction.
+class MappedFile{
+public:
+   MappedFile();
+   ~MappedFile();
+
+   // maps the whole file, returning false (with nothing mapped) if it is
+   // missing, empty or cannot be mapped
+   bool open(const char* filename);
+   void close();
+   bool isOpen() const { return data_ != 0; }
+
+   const unsigned char* data() const { return static_cast<const unsigned char*>(data_); }
+   size_t size() const { return size_; }
+
+private:
+   MappedFile(const MappedFile&);
+   MappedFile& operator=(const MappedFile&);
+
+   void* data_;
+   size_t size_;
+#ifdef _WIN32
+   void* file_;
+   void* mapping_;
+#endif
+};
@@ -0,0 +1,108 @@
+#include "meshfile.h"
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// the file layout is the in-memory layout, so it must not depend on padding
+static_assert(sizeof(MeshFileHeader) == 40, "mesh file header must be packed");
+static_assert(sizeof(MeshVertex) == 24, "mesh vertex must be packed");
+
+bool WriteMeshFile(const char* filename, const vector<MeshVertex>& vertices,
+   const vector<unsigned int>& indices)
+{
+   MeshFileHeader header;
+   memcpy(header.magic, "MESH", 4);
+   header.version = MESH_FILE_VERSION;
+   header.vertexCount = (unsigned int)(vertices.size());
+   header.indexCount = (unsigned int)(indices.size());
+   header.lower = vec3(FLT_MAX);
+   header.upper = vec3(-FLT_MAX);
+   for (size_t i = 0; i < vertices.size(); i++)
+   {
+      header.lower = min(header.lower, vertices[i].position);
+      header.upper = max(header.upper, vertices[i].position);
+   }
+
+   ofstream file(filename, ios::binary);
+   if (!file)
+   {
+      cout << "ERROR: could not write mesh file " << filename << endl;
+      return false;
+   }
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   file.write(reinterpret_cast<const char*>(vertices.data()), sizeof(MeshVertex) * vertices.size());
+   file.write(reinterpret_cast<const char*>(indices.data()), sizeof(unsigned int) * indices.size());
+   if (!file)
+   {
+      cout << "ERROR: could not write mesh file " << filename << endl;
+      return false;
+   }
+   return true;
+}
+
+bool WriteMeshFile(const char* filename, const vector<vec3>& points,
+   const vector<vec3>& normals, const vector<unsigned int>& indices)
+{
+   if (points.size() != normals.size())
+   {
+      cout << "ERROR: mesh " << filename << " has " << points.size() << " points but "
+         << normals.size() << " normals" << endl;
+      return false;
+   }
+
+   vector<MeshVertex> vertices(points.size());
+   for (size_t i = 0; i < points.size(); i++)
+   {
+      vertices[i].position = points[i];
+      vertices[i].normal = normals[i];
+   }
+   return WriteMeshFile(filename, vertices, indices);
+}
+
+MappedMesh::MappedMesh()
+   : header(0)
+   , vertices(0)
+   , indices(0)
+{}
+
+MappedMesh::~MappedMesh()
+{
+   close();
+}
+
+bool MappedMesh::open(const char* filename)
+{
+   close();
+   if (!file_.open(filename) || file_.size() < sizeof(MeshFileHeader))
+   {
+      close();
+      return false;
+   }
+
+   // anything that does not add up is treated like a missing file, so a
+   // stale or truncated cache is simply written again
+   const MeshFileHeader* mapped = reinterpret_cast<const MeshFileHeader*>(file_.data());
+   size_t expected = sizeof(MeshFileHeader) + sizeof(MeshVertex) * size_t(mapped->vertexCount) +
+      sizeof(unsigned int) * size_t(mapped->indexCount);
+   if (memcmp(mapped->magic, "MESH", 4) != 0 || mapped->version != MESH_FILE_VERSION || file_.size() < expected)
+   {
+      close();
+      return false;
+   }
+
+   header = mapped;
+   vertices = reinterpret_cast<const MeshVertex*>(header + 1);
+   indices = reinterpret_cast<const unsigned int*>(vertices + header->vertexCount);
+   return true;
+}
+
+void MappedMesh::close()
+{
+   file_.close();
+   header = 0;
+   vertices = 0;
+   indices = 0;
+}
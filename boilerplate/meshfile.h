@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "glm/glm.hpp"
+#include "mappedfile.h"
+
+using namespace glm;
+
+// Binary mesh file: a header, the interleaved vertices and the 32-bit
+// triangle indices, back to back in the byte order of the machine that
+// wrote them (little-endian everywhere this builds). The layout is the one
+// the vertex buffers use, so a mapped file is uploaded as it is.
+const unsigned int MESH_FILE_VERSION = 1;
+
+struct MeshFileHeader
+{
+   char magic[4];             // "MESH"
+   unsigned int version;      // MESH_FILE_VERSION
+   unsigned int vertexCount;
+   unsigned int indexCount;
+   vec3 lower;                // bounds of the vertex positions
+   vec3 upper;
+};
+
+struct MeshVertex
+{
+   vec3 position;
+   vec3 normal;
+};
+
+// writes a mesh, returning true if successful
+bool WriteMeshFile(const char* filename, const std::vector<MeshVertex>& vertices,
+   const std::vector<unsigned int>& indices);
+
+// the same for a mesh given as separate position and normal arrays
+bool WriteMeshFile(const char* filename, const std::vector<vec3>& points,
+   const std::vector<vec3>& normals, const std::vector<unsigned int>& indices);
+
+// A mesh file mapped read-only into memory. The pointers point straight
+// into the mapping and stay valid until close() or destruction.
+class MappedMesh{
+public:
+   const MeshFileHeader* header;
+   const MeshVertex* vertices;
+   const unsigned int* indices;
+
+   MappedMesh();
+   ~MappedMesh();
+
+   // maps the file and checks its header and size, returning false (with
+   // nothing mapped) if it is missing or not a valid mesh file
+   bool open(const char* filename);
+   void close();
+   bool isOpen() const { return file_.isOpen(); }
+
+private:
+   MappedMesh(const MappedMesh&);
+   MappedMesh& operator=(const MappedMesh&);
+
+   MappedFile file_;
+};
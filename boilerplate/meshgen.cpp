@@ -0,0 +1,417 @@
+#include "meshgen.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include "jobs.h"
+
+const double TWO_PI = 6.28318530717958647692;
+const double PI = 3.14159265358979323846;
+
+// vertices per job when rows are spread over the workers
+const int VERTICES_PER_JOB = 16384;
+
+// sin and cos of count angles spaced evenly from start to end inclusive; a
+// full turn ends exactly where it started, so seam vertices are identical
+static void angleTable(std::vector<float>& sines, std::vector<float>& cosines, int count,
+   double start, double end)
+{
+   sines.resize(count);
+   cosines.resize(count);
+   for (int i = 0; i < count; i++)
+   {
+      double angle = start + (end - start) * i / std::max(count - 1, 1);
+      sines[i] = float(std::sin(angle));
+      cosines[i] = float(std::cos(angle));
+   }
+   if (count > 1 && std::abs(std::abs(end - start) - TWO_PI) < 1e-9)
+   {
+      sines[count - 1] = sines[0];
+      cosines[count - 1] = cosines[0];
+   }
+}
+
+// the two triangles of each cell in one row of a grid whose vertices are
+// stored row by row from first, columns to a row; they face the side that
+// sees the columns go counter-clockwise from the rows
+static void gridRowIndices(unsigned int* out, unsigned int first, int columns, int row)
+{
+   for (int j = 0; j < columns - 1; j++)
+   {
+      unsigned int p00 = first + row * columns + j;
+      unsigned int p01 = p00 + 1;
+      unsigned int p10 = p00 + columns;
+      unsigned int p11 = p10 + 1;
+      out[0] = p00;
+      out[1] = p01;
+      out[2] = p10;
+      out[3] = p10;
+      out[4] = p01;
+      out[5] = p11;
+      out += 6;
+   }
+}
+
+// rows per job for rows of columns vertices
+static int rowGrain(int columns)
+{
+   return std::max(1, VERTICES_PER_JOB / std::max(columns, 1));
+}
+
+void GenerateUVSphere(MeshData* mesh, float radius, int uDivisions, int vDivisions)
+{
+   // rows run from pole to pole, columns around the equator; the poles
+   // are exact so their vertices coincide
+   std::vector<float> sinTheta, cosTheta, sinPhi, cosPhi;
+   angleTable(sinTheta, cosTheta, uDivisions, 0.0, TWO_PI);
+   angleTable(sinPhi, cosPhi, vDivisions, -0.5 * PI, 0.5 * PI);
+   sinPhi.front() = -1.0f;
+   sinPhi.back() = 1.0f;
+   cosPhi.front() = 0.0f;
+   cosPhi.back() = 0.0f;
+
+   mesh->vertices.resize(uDivisions * vDivisions);
+   mesh->indices.resize(6 * (uDivisions - 1) * (vDivisions - 1));
+   MeshVertex* vertices = mesh->vertices.data();
+   unsigned int* indices = mesh->indices.data();
+
+   ParallelFor("mesh rows", vDivisions, rowGrain(uDivisions), [&](int begin, int end) {
+      for (int j = begin; j < end; j++)
+      {
+         MeshVertex* row = vertices + j * uDivisions;
+         for (int i = 0; i < uDivisions; i++)
+         {
+            vec3 normal(sinTheta[i] * cosPhi[j], cosTheta[i] * cosPhi[j], sinPhi[j]);
+            row[i].position = radius * normal;
+            row[i].normal = normal;
+         }
+         if (j < vDivisions - 1)
+            gridRowIndices(indices + 6 * j * (uDivisions - 1), 0, uDivisions, j);
+      }
+   });
+}
+
+void GenerateIcosahedron(std::vector<vec3>& points, std::vector<unsigned int>& indices)
+{
+   // corners lie on three orthogonal golden rectangles
+   float t = (1.0f + sqrt(5.0f)) / 2.0f;
+
+   vec3 corners[12] = {
+      vec3(-1, t, 0), vec3(1, t, 0), vec3(-1, -t, 0), vec3(1, -t, 0),
+      vec3(0, -1, t), vec3(0, 1, t), vec3(0, -1, -t), vec3(0, 1, -t),
+      vec3(t, 0, -1), vec3(t, 0, 1), vec3(-t, 0, -1), vec3(-t, 0, 1)
+   };
+
+   unsigned int faces[60] = {
+      0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+      1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+      3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+      4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+   };
+
+   points.resize(12);
+   for (int i = 0; i < 12; i++)
+   {
+      points[i] = normalize(corners[i]);
+   }
+   indices.assign(faces, faces + 60);
+}
+
+void GenerateIcosphere(MeshData* mesh, float radius, int frequency)
+{
+   std::vector<vec3> corners;
+   std::vector<unsigned int> faces;
+   GenerateIcosahedron(corners, faces);
+
+   // each face is a triangular grid: row i has frequency - i + 1 vertices,
+   // vertex (i, j) sits at weights (n - i - j, i, j) / n of its corners
+   int n = frequency;
+   int faceVertices = (n + 1) * (n + 2) / 2;
+   int faceTriangles = n * n;
+   mesh->vertices.resize(20 * faceVertices);
+   mesh->indices.resize(20 * 3 * faceTriangles);
+   MeshVertex* vertices = mesh->vertices.data();
+   unsigned int* indices = mesh->indices.data();
+
+   ParallelFor("mesh rows", 20, std::max(1, VERTICES_PER_JOB / faceVertices), [&](int begin, int end) {
+      for (int face = begin; face < end; face++)
+      {
+         vec3 a = corners[faces[3 * face]];
+         vec3 b = corners[faces[3 * face + 1]];
+         vec3 c = corners[faces[3 * face + 2]];
+         unsigned int first = face * faceVertices;
+
+         // the weights are exact ratios of integers, and a vertex on an
+         // edge gets the same two non-zero terms from both of its faces,
+         // which makes the sums identical whatever order they come in
+         MeshVertex* out = vertices + first;
+         for (int i = 0; i <= n; i++)
+         {
+            for (int j = 0; j <= n - i; j++)
+            {
+               float wa = float(n - i - j) / float(n);
+               float wb = float(i) / float(n);
+               float wc = float(j) / float(n);
+               vec3 normal = normalize(a * wa + b * wb + c * wc);
+               out->position = radius * normal;
+               out->normal = normal;
+               out++;
+            }
+         }
+
+         unsigned int* triangle = indices + 3 * face * faceTriangles;
+         unsigned int rowStart = first;
+         for (int i = 0; i < n; i++)
+         {
+            unsigned int nextRowStart = rowStart + (n - i + 1);
+            for (int j = 0; j < n - i; j++)
+            {
+               triangle[0] = rowStart + j;
+               triangle[1] = nextRowStart + j;
+               triangle[2] = rowStart + j + 1;
+               triangle += 3;
+               if (j < n - i - 1)
+               {
+                  triangle[0] = nextRowStart + j;
+                  triangle[1] = nextRowStart + j + 1;
+                  triangle[2] = rowStart + j + 1;
+                  triangle += 3;
+               }
+            }
+            rowStart = nextRowStart;
+         }
+      }
+   });
+}
+
+vec3 CubeFaceNormal(int face)
+{
+   static const vec3 normals[CUBE_FACES] = {
+      vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1)
+   };
+   return normals[face];
+}
+
+// u cross v is the face normal, so (s, t) is counter-clockwise seen from outside
+vec3 CubeFaceUAxis(int face)
+{
+   static const vec3 axes[CUBE_FACES] = {
+      vec3(0, 0, -1), vec3(0, 0, 1), vec3(1, 0, 0), vec3(1, 0, 0), vec3(1, 0, 0), vec3(-1, 0, 0)
+   };
+   return axes[face];
+}
+
+vec3 CubeFaceVAxis(int face)
+{
+   static const vec3 axes[CUBE_FACES] = {
+      vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 0, -1), vec3(0, 0, 1), vec3(0, 1, 0), vec3(0, 1, 0)
+   };
+   return axes[face];
+}
+
+vec3 CubeSphereDirection(int face, float s, float t)
+{
+   vec3 p = CubeFaceNormal(face) + s * CubeFaceUAxis(face) + t * CubeFaceVAxis(face);
+   vec3 p2 = p * p;
+   return vec3(
+      p.x * std::sqrt(1.0f - 0.5f * (p2.y + p2.z) + p2.y * p2.z / 3.0f),
+      p.y * std::sqrt(1.0f - 0.5f * (p2.z + p2.x) + p2.z * p2.x / 3.0f),
+      p.z * std::sqrt(1.0f - 0.5f * (p2.x + p2.y) + p2.x * p2.y / 3.0f));
+}
+
+dvec3 CubeSphereDirection(int face, double s, double t)
+{
+   dvec3 p = dvec3(CubeFaceNormal(face)) + s * dvec3(CubeFaceUAxis(face)) + t * dvec3(CubeFaceVAxis(face));
+   dvec3 p2 = p * p;
+   return dvec3(
+      p.x * std::sqrt(1.0 - 0.5 * (p2.y + p2.z) + p2.y * p2.z / 3.0),
+      p.y * std::sqrt(1.0 - 0.5 * (p2.z + p2.x) + p2.z * p2.x / 3.0),
+      p.z * std::sqrt(1.0 - 0.5 * (p2.x + p2.y) + p2.x * p2.y / 3.0));
+}
+
+void GenerateCubeSphere(MeshData* mesh, float radius, int divisions)
+{
+   // a face's rows run along v, its columns along u
+   int n = divisions;
+   int side = n + 1;
+   mesh->vertices.resize(CUBE_FACES * side * side);
+   mesh->indices.resize(CUBE_FACES * 6 * n * n);
+   MeshVertex* vertices = mesh->vertices.data();
+   unsigned int* indices = mesh->indices.data();
+
+   ParallelFor("mesh rows", CUBE_FACES * side, rowGrain(side), [&](int begin, int end) {
+      for (int r = begin; r < end; r++)
+      {
+         int face = r / side;
+         int j = r % side;
+
+         // (2i - n) / n is exact in both directions along a shared edge
+         float t = float(2 * j - n) / float(n);
+         MeshVertex* row = vertices + r * side;
+         for (int i = 0; i < side; i++)
+         {
+            float s = float(2 * i - n) / float(n);
+            vec3 normal = CubeSphereDirection(face, s, t);
+            row[i].position = radius * normal;
+            row[i].normal = normal;
+         }
+         if (j < n)
+            gridRowIndices(indices + 6 * n * (face * n + j), face * side * side, side, j);
+      }
+   });
+}
+
+void GenerateTorus(MeshData* mesh, float majorRadius, float minorRadius, int rings, int sides)
+{
+   // rows run around the tube, columns around the axis; the seams repeat
+   std::vector<float> sinRing, cosRing, sinSide, cosSide;
+   angleTable(sinRing, cosRing, rings + 1, 0.0, -TWO_PI);
+   angleTable(sinSide, cosSide, sides + 1, 0.0, TWO_PI);
+
+   int columns = rings + 1;
+   mesh->vertices.resize((sides + 1) * columns);
+   mesh->indices.resize(6 * sides * rings);
+   MeshVertex* vertices = mesh->vertices.data();
+   unsigned int* indices = mesh->indices.data();
+
+   ParallelFor("mesh rows", sides + 1, rowGrain(columns), [&](int begin, int end) {
+      for (int j = begin; j < end; j++)
+      {
+         MeshVertex* row = vertices + j * columns;
+         for (int i = 0; i < columns; i++)
+         {
+            vec3 outward(cosRing[i], 0.0f, sinRing[i]);
+            vec3 normal = cosSide[j] * outward + vec3(0.0f, sinSide[j], 0.0f);
+            row[i].position = majorRadius * outward + minorRadius * normal;
+            row[i].normal = normal;
+         }
+         if (j < sides)
+            gridRowIndices(indices + 6 * j * rings, 0, columns, j);
+      }
+   });
+}
+
+void GenerateDisk(MeshData* mesh, float innerRadius, float outerRadius, int segments, int rings)
+{
+   // rows run outwards, columns around; the seam repeats
+   std::vector<float> sines, cosines;
+   angleTable(sines, cosines, segments + 1, 0.0, TWO_PI);
+
+   int columns = segments + 1;
+   mesh->vertices.resize((rings + 1) * columns);
+   mesh->indices.resize(6 * rings * segments);
+   MeshVertex* vertices = mesh->vertices.data();
+   unsigned int* indices = mesh->indices.data();
+
+   ParallelFor("mesh rows", rings + 1, rowGrain(columns), [&](int begin, int end) {
+      for (int j = begin; j < end; j++)
+      {
+         float radius = innerRadius + (outerRadius - innerRadius) * float(j) / float(rings);
+         MeshVertex* row = vertices + j * columns;
+         for (int i = 0; i < columns; i++)
+         {
+            row[i].position = vec3(radius * cosines[i], 0.0f, radius * sines[i]);
+            row[i].normal = vec3(0.0f, 1.0f, 0.0f);
+         }
+         if (j < rings)
+            gridRowIndices(indices + 6 * j * segments, 0, columns, j);
+      }
+   });
+}
+
+// --------------------------------------------------------------------------
+// Benchmark
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+// the sphere generator this library replaced: four double precision trig
+// calls per vertex and vectors grown one push_back at a time
+static void referenceSphere(std::vector<vec3>& points, std::vector<vec3>& normals,
+   std::vector<unsigned int>& indices, float r, int uDivisions, int vDivisions)
+{
+   float uStep = 1.f / (float)(uDivisions - 1);
+   float vStep = 1.f / (float)(vDivisions - 1);
+   for (int i = 0; i < uDivisions; i++)
+   {
+      for (int j = 0; j < vDivisions; j++)
+      {
+         float u = i * uStep;
+         float v = j * vStep;
+         vec3 pos = vec3(r * sin(2.0 * PI * u) * cos(PI * (v - 0.5)),
+            r * cos(2.0 * PI * u) * cos(PI * (v - 0.5)), r * sin(PI * (v - 0.5)));
+         points.push_back(pos);
+         normals.push_back(normalize(pos));
+      }
+   }
+   for (int i = 0; i < uDivisions - 1; i++)
+   {
+      for (int j = 0; j < vDivisions - 1; j++)
+      {
+         unsigned int p00 = i * vDivisions + j;
+         indices.push_back(p00);
+         indices.push_back(p00 + vDivisions);
+         indices.push_back(p00 + 1);
+         indices.push_back(p00 + 1);
+         indices.push_back(p00 + vDivisions);
+         indices.push_back(p00 + vDivisions + 1);
+      }
+   }
+}
+
+static void report(const char* name, const MeshData& mesh, double milliseconds)
+{
+   printf("%-12s %9d vertices %9d triangles %8.2f ms\n", name, int(mesh.vertices.size()),
+      int(mesh.indices.size() / 3), milliseconds);
+}
+
+void BenchmarkMeshGeneration(int vertexCount)
+{
+   printf("mesh generation at about %d vertices, %d threads\n", vertexCount, JobThreadCount());
+
+   int u = std::max(3, int(std::sqrt(2.0 * vertexCount)));
+   int v = std::max(2, u / 2);
+   std::vector<vec3> points, normals;
+   std::vector<unsigned int> indices;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   referenceSphere(points, normals, indices, 1.0f, u, v);
+   printf("%-12s %9d vertices %9d triangles %8.2f ms\n", "old sphere", int(points.size()),
+      int(indices.size() / 3), millisecondsSince(start));
+
+   // each run into a fresh mesh, so allocation is part of the time
+   {
+      MeshData mesh;
+      start = std::chrono::steady_clock::now();
+      GenerateUVSphere(&mesh, 1.0f, u, v);
+      report("uv sphere", mesh, millisecondsSince(start));
+   }
+   {
+      MeshData mesh;
+      start = std::chrono::steady_clock::now();
+      GenerateIcosphere(&mesh, 1.0f, std::max(1, int(std::sqrt(vertexCount / 10.0))));
+      report("icosphere", mesh, millisecondsSince(start));
+   }
+   {
+      MeshData mesh;
+      start = std::chrono::steady_clock::now();
+      GenerateCubeSphere(&mesh, 1.0f, std::max(1, int(std::sqrt(vertexCount / 6.0))));
+      report("cube sphere", mesh, millisecondsSince(start));
+   }
+   {
+      MeshData mesh;
+      int rings = std::max(3, int(std::sqrt(4.0 * vertexCount)));
+      start = std::chrono::steady_clock::now();
+      GenerateTorus(&mesh, 1.0f, 0.25f, rings, std::max(3, vertexCount / rings));
+      report("torus", mesh, millisecondsSince(start));
+   }
+   {
+      MeshData mesh;
+      int segments = std::max(3, int(std::sqrt(16.0 * vertexCount)));
+      start = std::chrono::steady_clock::now();
+      GenerateDisk(&mesh, 0.5f, 1.0f, segments, std::max(1, vertexCount / segments));
+      report("disk", mesh, millisecondsSince(start));
+   }
+}
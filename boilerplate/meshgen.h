@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "meshfile.h"
+
+using namespace glm;
+
+// Parametric mesh generators. Each one sizes its output once, then fills
+// it a row of vertices and a row of triangles at a time, with the rows
+// spread over the job system. Angles come from tables built once per mesh
+// (one sin/cos per grid column or row instead of several per vertex).
+// Triangles wind counter-clockwise seen from outside, the same as the
+// tessellated and procedural spheres.
+
+// interleaved vertices and triangle indices, ready for WriteMeshFile() or
+// a vertex buffer
+struct MeshData
+{
+   std::vector<MeshVertex> vertices;
+   std::vector<unsigned int> indices;
+};
+
+// latitude/longitude grid of uDivisions by vDivisions vertices, the same
+// grid the bufferless procedural sphere builds in the vertex shader
+void GenerateUVSphere(MeshData* mesh, float radius, int uDivisions, int vDivisions);
+
+// icosahedron with each face cut into frequency^2 triangles, pushed out to
+// the sphere; vertices on face edges are repeated per face, but bit for
+// bit identical, so the surface has no cracks
+void GenerateIcosphere(MeshData* mesh, float radius, int frequency);
+
+// cube with each face a divisions by divisions grid, spherified; shared
+// edge vertices are bit for bit identical as above
+void GenerateCubeSphere(MeshData* mesh, float radius, int divisions);
+
+// torus around the y axis, rings around the axis by sides around the tube
+void GenerateTorus(MeshData* mesh, float majorRadius, float minorRadius, int rings, int sides);
+
+// flat annulus in the xz plane facing +y, e.g. for planetary rings; an
+// inner radius of 0 gives a disk
+void GenerateDisk(MeshData* mesh, float innerRadius, float outerRadius, int segments, int rings);
+
+// the 12 corners (unit length) and 20 faces of the icosahedron
+void GenerateIcosahedron(std::vector<vec3>& points, std::vector<unsigned int>& indices);
+
+// cube face numbering: +x, -x, +y, -y, +z, -z. A point of a face is
+// normal + s * uAxis + t * vAxis, with s and t in [-1, 1].
+const int CUBE_FACES = 6;
+vec3 CubeFaceNormal(int face);
+vec3 CubeFaceUAxis(int face);
+vec3 CubeFaceVAxis(int face);
+
+// unit direction of face point (s, t) after spherifying, which spreads the
+// grid far more evenly over the sphere than normalizing would
+vec3 CubeSphereDirection(int face, float s, float t);
+
+// the same in double precision, for surfaces finer than floats resolve
+dvec3 CubeSphereDirection(int face, double s, double t);
+
+// times every generator at about vertexCount vertices
+void BenchmarkMeshGeneration(int vertexCount);
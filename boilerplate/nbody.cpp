@@ -0,0 +1,760 @@
+#include "nbody.h"
+#include "bodies.h"
+#include "cpuinfo.h"
+#include "jobs.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+#define NBODY_SIMD
+#endif
+
+// octree depth limit; Morton keys hold KEY_BITS bits per axis
+static const int KEY_BITS = 16;
+static const int MAX_LEVEL = KEY_BITS;
+
+// subtrees below this level are built in parallel, 64 of them at level 2
+static const int SPLIT_LEVEL = 2;
+
+// cells with this many particles or fewer become leaves
+static const int LEAF_SIZE = 16;
+
+// radix sort digit width, four passes cover the 48 bit keys
+static const int RADIX_BITS = 12;
+static const int RADIX_BUCKETS = 1 << RADIX_BITS;
+
+// particles handed to a worker at a time when the cost per particle varies
+static const int GRAIN = 256;
+
+// the tree walk takes cells of at most this many particles, or leaves, as
+// groups that share one walk and one interaction list
+static const int GROUP_SIZE = 64;
+
+// groups handed to a worker at a time in the tree walk
+static const int GROUP_GRAIN = 4;
+
+// mass per unit volume of bodies without satellites, small enough that a
+// million belt particles weigh a few percent of a typical sun
+static const float BODY_DENSITY = 0.02f;
+
+// --------------------------------------------------------------------------
+// Threading
+
+// calls fn(chunk, begin, end) for chunks equal pieces of [0, count) as jobs;
+// the split is the same every call for the same count, which the radix
+// sort's per-chunk offsets rely on
+template <typename Fn>
+static void parallelChunks(const char* name, int count, int chunks, const Fn& fn)
+{
+   ParallelFor(name, chunks, 1, [&](int first, int last) {
+      for (int c = first; c < last; c++)
+         fn(c, int((long long)count * c / chunks), int((long long)count * (c + 1) / chunks));
+   });
+}
+
+// --------------------------------------------------------------------------
+// Morton keys and sorting
+
+// spreads the low 16 bits of v so there are two zero bits between each
+static unsigned long long spreadBits(unsigned int v)
+{
+   unsigned long long x = v & 0xffff;
+   x = (x | x << 16) & 0x0000ff0000ffULL;
+   x = (x | x << 8) & 0x00f00f00f00fULL;
+   x = (x | x << 4) & 0x0c30c30c30c3ULL;
+   x = (x | x << 2) & 0x249249249249ULL;
+   return x;
+}
+
+// stable parallel LSD radix sort of keys, carrying order along. Each pass
+// every thread counts digits in its chunk, the counts are turned into
+// per-thread write offsets, then each thread scatters its chunk.
+static void radixSort(std::vector<unsigned long long>& keys, std::vector<int>& order,
+   std::vector<unsigned long long>& keyScratch, std::vector<int>& orderScratch)
+{
+   int count = int(keys.size());
+   int chunks = JobThreadCount();
+   std::vector<int> offsets(chunks * RADIX_BUCKETS);
+
+   for (int shift = 0; shift < 3 * KEY_BITS; shift += RADIX_BITS)
+   {
+      parallelChunks("radix count", count, chunks, [&](int chunk, int begin, int end) {
+         int* histogram = &offsets[chunk * RADIX_BUCKETS];
+         std::fill(histogram, histogram + RADIX_BUCKETS, 0);
+         for (int i = begin; i < end; i++)
+            histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+      });
+
+      // a digit shared by every key leaves the order as it is
+      bool trivial = false;
+      int sum = 0;
+      for (int b = 0; b < RADIX_BUCKETS; b++)
+      {
+         int bucketStart = sum;
+         for (int c = 0; c < chunks; c++)
+         {
+            int n = offsets[c * RADIX_BUCKETS + b];
+            offsets[c * RADIX_BUCKETS + b] = sum;
+            sum += n;
+         }
+         trivial = trivial || sum - bucketStart == count;
+      }
+      if (trivial)
+         continue;
+
+      parallelChunks("radix scatter", count, chunks, [&](int chunk, int begin, int end) {
+         int* offset = &offsets[chunk * RADIX_BUCKETS];
+         for (int i = begin; i < end; i++)
+         {
+            int to = offset[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            keyScratch[to] = keys[i];
+            orderScratch[to] = order[i];
+         }
+      });
+      keys.swap(keyScratch);
+      order.swap(orderScratch);
+   }
+}
+
+// --------------------------------------------------------------------------
+// Simulation
+
+NBodySim::NBodySim()
+   : method(BARNES_HUT)
+   , theta(0.5f)
+   , softening(0.01f)
+   , boxMin_(0.0f)
+   , boxSize_(0.0f)
+   , accelerationsValid_(false)
+{}
+
+int NBodySim::addParticle(vec3 position, vec3 velocity, float particleMass)
+{
+   x.push_back(position.x);
+   y.push_back(position.y);
+   z.push_back(position.z);
+   vx.push_back(velocity.x);
+   vy.push_back(velocity.y);
+   vz.push_back(velocity.z);
+   ax.push_back(0.0f);
+   ay.push_back(0.0f);
+   az.push_back(0.0f);
+   mass.push_back(particleMass);
+   accelerationsValid_ = false;
+   return size() - 1;
+}
+
+void NBodySim::clear()
+{
+   Method m = method;
+   float openingAngle = theta;
+   float length = softening;
+   *this = NBodySim();
+   method = m;
+   theta = openingAngle;
+   softening = length;
+}
+
+void NBodySim::step(float dt, float maxStep)
+{
+   int count = size();
+   if (count == 0 || dt <= 0.0f)
+      return;
+
+   int steps = std::min(int(std::ceil(dt / maxStep)), int(MAX_SUBSTEPS));
+   float h = dt / steps;
+   if (!accelerationsValid_)
+      computeAccelerations();
+
+   for (int s = 0; s < steps; s++)
+   {
+      ParallelFor("kick drift", count, 4096, [&](int begin, int end) {
+         for (int i = begin; i < end; i++)
+         {
+            vx[i] += ax[i] * 0.5f * h;
+            vy[i] += ay[i] * 0.5f * h;
+            vz[i] += az[i] * 0.5f * h;
+            x[i] += vx[i] * h;
+            y[i] += vy[i] * h;
+            z[i] += vz[i] * h;
+         }
+      });
+
+      computeAccelerations();
+
+      ParallelFor("kick", count, 4096, [&](int begin, int end) {
+         for (int i = begin; i < end; i++)
+         {
+            vx[i] += ax[i] * 0.5f * h;
+            vy[i] += ay[i] * 0.5f * h;
+            vz[i] += az[i] * 0.5f * h;
+         }
+      });
+   }
+}
+
+void NBodySim::computeAccelerations()
+{
+   if (size() == 0)
+      return;
+
+   if (method == DIRECT_SUM)
+      directAccelerations();
+   else
+   {
+      buildTree();
+      treeAccelerations();
+   }
+   accelerationsValid_ = true;
+}
+
+void NBodySim::removeNetMomentum()
+{
+   double m = 0.0, px = 0.0, py = 0.0, pz = 0.0;
+   for (int i = 0; i < size(); i++)
+   {
+      m += mass[i];
+      px += double(mass[i]) * vx[i];
+      py += double(mass[i]) * vy[i];
+      pz += double(mass[i]) * vz[i];
+   }
+   if (m <= 0.0)
+      return;
+
+   float cx = float(px / m), cy = float(py / m), cz = float(pz / m);
+   for (int i = 0; i < size(); i++)
+   {
+      vx[i] -= cx;
+      vy[i] -= cy;
+      vz[i] -= cz;
+   }
+}
+
+void NBodySim::directAccelerations()
+{
+   bool avx2 = CpuHasAVX2();
+   ParallelFor("direct sum", size(), GRAIN, [&](int begin, int end) {
+      if (avx2)
+         DirectSumAVX2(&x[0], &y[0], &z[0], &mass[0], size(), softening, begin, end, &ax[0], &ay[0], &az[0]);
+      else
+         DirectSumSSE2(&x[0], &y[0], &z[0], &mass[0], size(), softening, begin, end, &ax[0], &ay[0], &az[0]);
+   });
+}
+
+// Sorts the particles along a Morton curve over their bounding cube, so
+// every octree cell is a contiguous run of the sorted arrays, then builds
+// the cells below SPLIT_LEVEL in parallel and joins them under the top.
+void NBodySim::buildTree()
+{
+   int count = size();
+   int chunks = JobThreadCount();
+
+   std::vector<vec3> lows(chunks, vec3(1e30f)), highs(chunks, vec3(-1e30f));
+   parallelChunks("tree bounds", count, chunks, [&](int chunk, int begin, int end) {
+      vec3 lo(1e30f), hi(-1e30f);
+      for (int i = begin; i < end; i++)
+      {
+         vec3 p(x[i], y[i], z[i]);
+         lo = min(lo, p);
+         hi = max(hi, p);
+      }
+      lows[chunk] = lo;
+      highs[chunk] = hi;
+   });
+   vec3 lo = lows[0], hi = highs[0];
+   for (int c = 1; c < chunks; c++)
+   {
+      lo = min(lo, lows[c]);
+      hi = max(hi, highs[c]);
+   }
+   boxSize_ = std::max(std::max(hi.x - lo.x, hi.y - lo.y), std::max(hi.z - lo.z, 1e-6f)) * 1.0001f;
+   boxMin_ = lo;
+
+   keys_.resize(count);
+   order_.resize(count);
+   keyScratch_.resize(count);
+   orderScratch_.resize(count);
+   float scale = float(1 << KEY_BITS) / boxSize_;
+   ParallelFor("tree keys", count, 4096, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+         unsigned int cx = std::min((unsigned int)((x[i] - boxMin_.x) * scale), (1u << KEY_BITS) - 1);
+         unsigned int cy = std::min((unsigned int)((y[i] - boxMin_.y) * scale), (1u << KEY_BITS) - 1);
+         unsigned int cz = std::min((unsigned int)((z[i] - boxMin_.z) * scale), (1u << KEY_BITS) - 1);
+         keys_[i] = spreadBits(cx) << 2 | spreadBits(cy) << 1 | spreadBits(cz);
+         order_[i] = i;
+      }
+   });
+   radixSort(keys_, order_, keyScratch_, orderScratch_);
+
+   sortedX_.resize(count);
+   sortedY_.resize(count);
+   sortedZ_.resize(count);
+   sortedMass_.resize(count);
+   ParallelFor("tree gather", count, 4096, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+         int from = order_[i];
+         sortedX_[i] = x[from];
+         sortedY_[i] = y[from];
+         sortedZ_[i] = z[from];
+         sortedMass_[i] = mass[from];
+      }
+   });
+
+   // one subtree per occupied cell of the split level
+   const int cells = 1 << (3 * SPLIT_LEVEL);
+   const int shift = 3 * (MAX_LEVEL - SPLIT_LEVEL);
+   std::vector<std::vector<Node> > subtrees(cells);
+   ParallelFor("tree build", cells, 1, [&](int begin, int end) {
+      for (int c = begin; c < end; c++)
+      {
+         int first = int(std::lower_bound(keys_.begin(), keys_.end(), (unsigned long long)(c) << shift) - keys_.begin());
+         int last = int(std::lower_bound(keys_.begin(), keys_.end(), (unsigned long long)(c + 1) << shift) - keys_.begin());
+         if (first == last)
+            continue;
+
+         ivec3 cell(0);
+         for (int level = 0; level < SPLIT_LEVEL; level++)
+         {
+            int digit = (c >> (3 * (SPLIT_LEVEL - 1 - level))) & 7;
+            cell = cell * 2 + ivec3((digit >> 2) & 1, (digit >> 1) & 1, digit & 1);
+         }
+         buildNode(first, last, SPLIT_LEVEL, cell, subtrees[c], 0);
+      }
+   });
+
+   nodes_.clear();
+   buildNode(0, count, 0, ivec3(0), nodes_, &subtrees);
+
+   // depth first is Morton order, so neighbouring groups are near in space
+   groups_.clear();
+   for (int n = 0; n < int(nodes_.size()); )
+   {
+      const Node& node = nodes_[n];
+      if (node.skip == 1 || node.end - node.begin <= GROUP_SIZE)
+      {
+         groups_.push_back(n);
+         n += node.skip;
+      }
+      else
+         n++;
+   }
+}
+
+// Appends the subtree of the cell holding sorted particles [begin, end) to
+// out, depth first. With prebuilt set, cells at SPLIT_LEVEL are copied from
+// it instead of being built again.
+void NBodySim::buildNode(int begin, int end, int level, ivec3 cell, std::vector<Node>& out,
+   const std::vector<std::vector<Node> >* prebuilt) const
+{
+   if (prebuilt && level == SPLIT_LEVEL)
+   {
+      int c = int(keys_[begin] >> (3 * (MAX_LEVEL - SPLIT_LEVEL)));
+      out.insert(out.end(), (*prebuilt)[c].begin(), (*prebuilt)[c].end());
+      return;
+   }
+
+   int index = int(out.size());
+   out.push_back(Node());
+
+   Node node;
+   node.begin = begin;
+   node.end = end;
+   double m = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+   if (end - begin <= LEAF_SIZE || level == MAX_LEVEL)
+   {
+      for (int i = begin; i < end; i++)
+      {
+         m += sortedMass_[i];
+         mx += sortedMass_[i] * sortedX_[i];
+         my += sortedMass_[i] * sortedY_[i];
+         mz += sortedMass_[i] * sortedZ_[i];
+      }
+   }
+   else
+   {
+      // the cell's particles share the key bits above this level, the next
+      // three bits pick the child octant
+      int shift = 3 * (MAX_LEVEL - level - 1);
+      unsigned long long prefix = keys_[begin] >> (shift + 3) << (shift + 3);
+      int childBegin = begin;
+      for (int digit = 0; digit < 8; digit++)
+      {
+         int childEnd = end;
+         if (digit < 7)
+            childEnd = int(std::lower_bound(keys_.begin() + childBegin, keys_.begin() + end,
+               prefix + ((unsigned long long)(digit + 1) << shift)) - keys_.begin());
+         if (childEnd > childBegin)
+         {
+            int child = int(out.size());
+            buildNode(childBegin, childEnd, level + 1,
+               cell * 2 + ivec3((digit >> 2) & 1, (digit >> 1) & 1, digit & 1), out, prebuilt);
+            const Node& c = out[child];
+            m += c.mass;
+            mx += double(c.mass) * c.x;
+            my += double(c.mass) * c.y;
+            mz += double(c.mass) * c.z;
+         }
+         childBegin = childEnd;
+      }
+   }
+
+   float size = boxSize_ / float(1 << level);
+   vec3 center = boxMin_ + (vec3(cell) + 0.5f) * size;
+   vec3 com = m > 0.0 ? vec3(float(mx / m), float(my / m), float(mz / m)) : center;
+
+   // Barnes' size / distance < theta, measured from the centre of mass but
+   // widened by its offset from the cell centre, so a heavy particle near a
+   // cell corner cannot sit almost inside an accepted cell
+   float open = size / theta + distance(com, center);
+   node.x = com.x;
+   node.y = com.y;
+   node.z = com.z;
+   node.mass = float(m);
+   node.openDistance2 = open * open;
+   node.skip = int(out.size()) - index;
+   out[index] = node;
+}
+
+// Particles are walked a group at a time, a small cell's worth of
+// neighbours on the Morton curve. A group shares one walk of the depth
+// first node array that opens a node when it is too close to any point of
+// the group's bounding box. The accepted nodes, as point masses, and the
+// particles of the nearby leaves become one interaction list, which the
+// direct-sum kernel sums for the whole group. Each job takes a run of
+// neighbouring groups, so its walks touch the same nodes.
+void NBodySim::treeAccelerations()
+{
+   int nodeCount = int(nodes_.size());
+   bool avx2 = CpuHasAVX2();
+
+   ParallelFor("tree walk", int(groups_.size()), GROUP_GRAIN, [&](int first, int last) {
+      // the interaction list starts with the group itself, padded with
+      // massless copies to a whole number of eight wide blocks
+      std::vector<float> listX, listY, listZ, listMass;
+      std::vector<float> groupX, groupY, groupZ;
+      for (int g = first; g < last; g++)
+      {
+         const Node& group = nodes_[groups_[g]];
+         int groupCount = group.end - group.begin;
+         int padded = (groupCount + 7) / 8 * 8;
+         listX.assign(sortedX_.begin() + group.begin, sortedX_.begin() + group.end);
+         listY.assign(sortedY_.begin() + group.begin, sortedY_.begin() + group.end);
+         listZ.assign(sortedZ_.begin() + group.begin, sortedZ_.begin() + group.end);
+         listMass.assign(sortedMass_.begin() + group.begin, sortedMass_.begin() + group.end);
+         listX.resize(padded, listX[0]);
+         listY.resize(padded, listY[0]);
+         listZ.resize(padded, listZ[0]);
+         listMass.resize(padded, 0.0f);
+
+         vec3 lo(listX[0], listY[0], listZ[0]), hi = lo;
+         for (int k = 1; k < groupCount; k++)
+         {
+            vec3 p(listX[k], listY[k], listZ[k]);
+            lo = min(lo, p);
+            hi = max(hi, p);
+         }
+         vec3 center = (lo + hi) * 0.5f, halfSize = (hi - lo) * 0.5f;
+
+         bool isGroupOpened = false;
+         int n = 0;
+         while (n < nodeCount)
+         {
+            const Node& node = nodes_[n];
+            float dx = std::max(std::abs(node.x - center.x) - halfSize.x, 0.0f);
+            float dy = std::max(std::abs(node.y - center.y) - halfSize.y, 0.0f);
+            float dz = std::max(std::abs(node.z - center.z) - halfSize.z, 0.0f);
+            if (dx * dx + dy * dy + dz * dz > node.openDistance2)
+            {
+               listX.push_back(node.x);
+               listY.push_back(node.y);
+               listZ.push_back(node.z);
+               listMass.push_back(node.mass);
+               n += node.skip;
+            }
+            else if (n == groups_[g])
+            {
+               // the group's own particles are already at the front
+               isGroupOpened = true;
+               n += node.skip;
+            }
+            else if (node.skip == 1)
+            {
+               listX.insert(listX.end(), sortedX_.begin() + node.begin, sortedX_.begin() + node.end);
+               listY.insert(listY.end(), sortedY_.begin() + node.begin, sortedY_.begin() + node.end);
+               listZ.insert(listZ.end(), sortedZ_.begin() + node.begin, sortedZ_.begin() + node.end);
+               listMass.insert(listMass.end(), sortedMass_.begin() + node.begin, sortedMass_.begin() + node.end);
+               n++;
+            }
+            else
+               n++;
+         }
+
+         // with a large theta an ancestor of the group can be accepted, and
+         // then the group's own mass is already in it
+         if (!isGroupOpened)
+            std::fill(listMass.begin(), listMass.begin() + groupCount, 0.0f);
+
+         groupX.resize(padded);
+         groupY.resize(padded);
+         groupZ.resize(padded);
+         if (avx2)
+            DirectSumAVX2(&listX[0], &listY[0], &listZ[0], &listMass[0], int(listX.size()), softening,
+               0, padded, &groupX[0], &groupY[0], &groupZ[0]);
+         else
+            DirectSumSSE2(&listX[0], &listY[0], &listZ[0], &listMass[0], int(listX.size()), softening,
+               0, padded, &groupX[0], &groupY[0], &groupZ[0]);
+
+         for (int k = 0; k < groupCount; k++)
+         {
+            int to = order_[group.begin + k];
+            ax[to] = groupX[k];
+            ay[to] = groupY[k];
+            az[to] = groupZ[k];
+         }
+      }
+   });
+}
+
+// --------------------------------------------------------------------------
+// Direct-sum kernels
+
+void DirectSumScalar(const float* x, const float* y, const float* z, const float* mass,
+   int count, float softening, int begin, int end, float* ax, float* ay, float* az)
+{
+   float eps2 = softening * softening;
+   for (int i = begin; i < end; i++)
+   {
+      float px = x[i], py = y[i], pz = z[i];
+      float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+      for (int j = 0; j < count; j++)
+      {
+         float dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+         float r2 = dx * dx + dy * dy + dz * dz + eps2;
+         if (r2 <= 0.0f)
+            continue;
+         float inv = 1.0f / std::sqrt(r2);
+         float f = mass[j] * inv * inv * inv;
+         sx += f * dx;
+         sy += f * dy;
+         sz += f * dz;
+      }
+      ax[i] = sx;
+      ay[i] = sy;
+      az[i] = sz;
+   }
+}
+
+void DirectSumSSE2(const float* x, const float* y, const float* z, const float* mass,
+   int count, float softening, int begin, int end, float* ax, float* ay, float* az)
+{
+   int simdEnd = begin;
+#ifdef NBODY_SIMD
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 eps2 = _mm_set1_ps(softening * softening);
+   const __m128 half = _mm_set1_ps(0.5f);
+   const __m128 threeHalves = _mm_set1_ps(1.5f);
+
+   simdEnd = begin + (end - begin) / 4 * 4;
+   for (int i = begin; i < simdEnd; i++)
+   {
+      ax[i] = 0.0f;
+      ay[i] = 0.0f;
+      az[i] = 0.0f;
+   }
+
+   for (int tile = 0; tile < count; tile += DIRECT_SUM_TILE)
+   {
+      int tileEnd = std::min(tile + DIRECT_SUM_TILE, count);
+      for (int i = begin; i < simdEnd; i += 4)
+      {
+         __m128 px = _mm_loadu_ps(x + i);
+         __m128 py = _mm_loadu_ps(y + i);
+         __m128 pz = _mm_loadu_ps(z + i);
+         __m128 sx = zero, sy = zero, sz = zero;
+
+         for (int j = tile; j < tileEnd; j++)
+         {
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(x[j]), px);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(y[j]), py);
+            __m128 dz = _mm_sub_ps(_mm_set1_ps(z[j]), pz);
+            __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+               _mm_add_ps(_mm_mul_ps(dz, dz), eps2));
+
+            __m128 inv = _mm_rsqrt_ps(r2);
+            inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(inv, inv))));
+            __m128 f = _mm_mul_ps(_mm_set1_ps(mass[j]), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+            f = _mm_and_ps(f, _mm_cmpgt_ps(r2, zero));
+
+            sx = _mm_add_ps(sx, _mm_mul_ps(f, dx));
+            sy = _mm_add_ps(sy, _mm_mul_ps(f, dy));
+            sz = _mm_add_ps(sz, _mm_mul_ps(f, dz));
+         }
+
+         _mm_storeu_ps(ax + i, _mm_add_ps(_mm_loadu_ps(ax + i), sx));
+         _mm_storeu_ps(ay + i, _mm_add_ps(_mm_loadu_ps(ay + i), sy));
+         _mm_storeu_ps(az + i, _mm_add_ps(_mm_loadu_ps(az + i), sz));
+      }
+   }
+#endif
+
+   if (simdEnd < end)
+      DirectSumScalar(x, y, z, mass, count, softening, simdEnd, end, ax, ay, az);
+}
+
+// --------------------------------------------------------------------------
+// Seeding from a body system
+
+void AddBodiesToSimulation(NBodySim* sim, const BodySystem& bodies, double t,
+   int anchor, float anchorMass)
+{
+   int count = bodies.size();
+   int first = sim->size();
+
+   // Kepler's third law, G M = n^2 a^3, from each body's first satellite
+   std::vector<float> masses(count, -1.0f);
+   for (int i = 0; i < count; i++)
+   {
+      int p = bodies.parent[i];
+      if (p >= 0 && masses[p] < 0.0f)
+      {
+         double a = bodies.semiMajorAxis[i];
+         double n = bodies.meanMotion[i];
+         masses[p] = float(n * n * a * a * a);
+      }
+   }
+   for (int i = 0; i < count; i++)
+   {
+      if (i == anchor)
+         masses[i] = anchorMass;
+      else if (masses[i] <= 0.0f)
+         masses[i] = BODY_DENSITY * bodies.radius[i] * bodies.radius[i] * bodies.radius[i];
+   }
+
+   // parents come first, so their velocity is known when a child needs it
+   for (int i = 0; i < count; i++)
+   {
+      vec3 velocity(0.0f);
+      int p = bodies.parent[i];
+      if (p >= 0)
+      {
+         velocity = vec3(bodies.getOrbitalVelocity(i, t, masses[p] + masses[i]));
+         velocity += vec3(sim->vx[first + p], sim->vy[first + p], sim->vz[first + p]);
+      }
+      sim->addParticle(vec3(bodies.x[i], bodies.y[i], bodies.z[i]), velocity, masses[i]);
+   }
+}
+
+// --------------------------------------------------------------------------
+// Benchmark
+
+static float randomFloat(float lo, float hi)
+{
+   return lo + (hi - lo) * (rand() / float(RAND_MAX));
+}
+
+typedef void (*DirectSumKernel)(const float*, const float*, const float*, const float*,
+   int, float, int, int, float*, float*, float*);
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+void BenchmarkNBody(int count)
+{
+   // a heavy centre with a light disk on circular orbits around it
+   NBodySim sim;
+   float centralMass = 100.0f;
+   sim.addParticle(vec3(0.0f), vec3(0.0f), centralMass);
+   for (int i = 1; i < count; i++)
+   {
+      float r = randomFloat(2.0f, 20.0f);
+      float angle = randomFloat(0.0f, 6.2831853f);
+      float speed = std::sqrt(centralMass / r);
+      sim.addParticle(vec3(r * std::cos(angle), randomFloat(-0.2f, 0.2f), r * std::sin(angle)),
+         vec3(-speed * std::sin(angle), 0.0f, speed * std::cos(angle)), 1.0f / count);
+   }
+   const float* x = &sim.x[0];
+   const float* y = &sim.y[0];
+   const float* z = &sim.z[0];
+   const float* m = &sim.mass[0];
+
+   // the single thread kernels run over a sample of about 4e7 pairs, with
+   // a double precision sum as the reference for every error below
+   int sampleCount = std::min(std::max(std::min(int(4e7 / count), 2000), 64), count);
+   double samplePairs = double(sampleCount) * count;
+   std::vector<dvec3> reference(sampleCount, dvec3(0.0));
+   double eps2 = double(sim.softening) * sim.softening;
+   for (int i = 0; i < sampleCount; i++)
+      for (int j = 0; j < count; j++)
+      {
+         dvec3 d(double(x[j]) - x[i], double(y[j]) - y[i], double(z[j]) - z[i]);
+         double r2 = dot(d, d) + eps2;
+         reference[i] += double(m[j]) / (r2 * std::sqrt(r2)) * d;
+      }
+
+   std::vector<float> ax(count), ay(count), az(count);
+   auto worstError = [&]() -> double {
+      double worst = 0.0;
+      for (int i = 0; i < sampleCount; i++)
+         worst = std::max(worst, length(dvec3(ax[i], ay[i], az[i]) - reference[i]) / length(reference[i]));
+      return worst;
+   };
+
+   const char* names[] = { "scalar", "sse2", "avx2" };
+   DirectSumKernel kernels[] = { DirectSumScalar, DirectSumSSE2, DirectSumAVX2 };
+   int kernelCount = CpuHasAVX2() ? 3 : 2;
+   double kernelTimes[3], kernelErrors[3];
+   for (int k = 0; k < kernelCount; k++)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      kernels[k](x, y, z, m, count, sim.softening, 0, sampleCount, &ax[0], &ay[0], &az[0]);
+      kernelTimes[k] = millisecondsSince(start);
+      kernelErrors[k] = worstError();
+   }
+
+   // all threads, the full sum only where it finishes in reasonable time
+   double directTime = 0.0;
+   if (count <= 20000)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      sim.directAccelerations();
+      directTime = millisecondsSince(start);
+   }
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   sim.buildTree();
+   double buildTime = millisecondsSince(start);
+   start = std::chrono::steady_clock::now();
+   sim.treeAccelerations();
+   double walkTime = millisecondsSince(start);
+
+   double errorSum = 0.0, worst = 0.0;
+   for (int i = 0; i < sampleCount; i++)
+   {
+      double error = length(dvec3(sim.ax[i], sim.ay[i], sim.az[i]) - reference[i]) / length(reference[i]);
+      errorSum += error * error;
+      worst = std::max(worst, error);
+   }
+
+   printf("N-body benchmark, %d particles, %d threads\n", count, JobThreadCount());
+   printf("  direct sum kernels, one thread, %d x %d pairs\n", sampleCount, count);
+   for (int k = 0; k < kernelCount; k++)
+      printf("    %-6s  %9.2f ms  %8.3f G pairs/s  worst error %.1e\n", names[k], kernelTimes[k],
+         samplePairs / kernelTimes[k] * 1e-6, kernelErrors[k]);
+   if (kernelCount < 3)
+      printf("    avx2    not supported by this CPU\n");
+   if (count <= 20000)
+      printf("  direct sum, all threads  %9.2f ms  %8.3f G pairs/s\n", directTime,
+         double(count) * count / directTime * 1e-6);
+   printf("  octree, theta %.2f, build %.2f ms, walk %.2f ms\n", sim.theta, buildTime, walkTime);
+   printf("  tree force error, rms %.2e, worst %.2e (over %d particles)\n",
+      std::sqrt(errorSum / sampleCount), worst, sampleCount);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+using namespace glm;
+
+class BodySystem;
+
+// Gravitational N-body simulation of point masses in units where G = 1.
+// Accelerations come from a Barnes-Hut octree, O(N log N), or from direct
+// summation, O(N^2), which is exact up to rounding and is there to check
+// the tree against. Tree building, traversal and integration are all split
+// across the cores. Particles step with kick-drift-kick leapfrog, which
+// keeps orbits from drifting in energy over long runs.
+class NBodySim{
+public:
+   enum Method { BARNES_HUT, DIRECT_SUM };
+
+   // per-particle state, one array per component
+   std::vector<float> x, y, z;
+   std::vector<float> vx, vy, vz;
+   std::vector<float> ax, ay, az;
+   std::vector<float> mass;
+
+   Method method;
+   float theta;       // opening angle, smaller is slower and more accurate
+   float softening;   // Plummer softening length, keeps close passes finite
+
+   NBodySim();
+
+   // adds a particle and returns its index, particles keep their index
+   int addParticle(vec3 position, vec3 velocity, float mass);
+
+   void clear();
+   int size() const { return int(x.size()); }
+
+   // advances by dt seconds in leapfrog steps of at most maxStep; a dt
+   // needing more than MAX_SUBSTEPS steps takes longer steps instead
+   void step(float dt, float maxStep = 1.0f / 60.0f);
+
+   // fills ax, ay and az for the current positions with the current method
+   void computeAccelerations();
+
+   // shifts every velocity by the same amount so the total momentum is
+   // zero, stopping the whole system from drifting away
+   void removeNetMomentum();
+
+   static const int MAX_SUBSTEPS = 8;
+
+private:
+   friend void BenchmarkNBody(int count);
+
+   // octree node, stored depth first so a subtree is a contiguous run that
+   // traversal skips in one jump
+   struct Node{
+      float x, y, z, mass;   // centre of mass and total mass
+      float openDistance2;   // closer particles have to open the node
+      int skip;              // nodes in this subtree, 1 for a leaf
+      int begin, end;        // range of sorted particles inside
+   };
+
+   void buildTree();
+   void buildNode(int begin, int end, int level, ivec3 cell, std::vector<Node>& out,
+      const std::vector<std::vector<Node> >* prebuilt) const;
+   void treeAccelerations();
+   void directAccelerations();
+
+   std::vector<Node> nodes_;
+   std::vector<int> groups_;   // nodes the tree walk starts from, in Morton order
+   std::vector<unsigned long long> keys_, keyScratch_;
+   std::vector<int> order_, orderScratch_;
+   std::vector<float> sortedX_, sortedY_, sortedZ_, sortedMass_;
+   vec3 boxMin_;
+   float boxSize_;
+   bool accelerationsValid_;
+};
+
+// Direct-sum kernels: for each i in [begin, end), the acceleration of
+// particle i from all count particles, written to ax, ay and az. The SIMD
+// kernels hold a block of i particles in registers and walk the j particles
+// in tiles of DIRECT_SUM_TILE, which stay in L1 while every block of the
+// range passes over them; 1/r comes from rsqrt plus one Newton step.
+// A zero distance adds nothing, so a particle skips itself.
+const int DIRECT_SUM_TILE = 1024;
+void DirectSumScalar(const float* x, const float* y, const float* z, const float* mass,
+   int count, float softening, int begin, int end, float* ax, float* ay, float* az);
+void DirectSumSSE2(const float* x, const float* y, const float* z, const float* mass,
+   int count, float softening, int begin, int end, float* ax, float* ay, float* az);
+
+// eight wide with FMA, built with AVX2 enabled in nbody_avx2.cpp; only call
+// it when CpuHasAVX2()
+void DirectSumAVX2(const float* x, const float* y, const float* z, const float* mass,
+   int count, float softening, int begin, int end, float* ax, float* ay, float* az);
+
+// adds every body of a body system as a particle, keeping their order, at
+// the positions of their last update(t). The anchor body weighs anchorMass;
+// other bodies with satellites weigh what their first satellite's period
+// implies (Kepler's third law), the rest get a small mass from their
+// radius. Each body starts on its orbit at the speed these masses give.
+void AddBodiesToSimulation(NBodySim* sim, const BodySystem& bodies, double t,
+   int anchor, float anchorMass);
+
+// times the tree and the direct-sum kernels on a random disk of count
+// particles, reports pair interactions per second and force errors, and
+// prints the results to the console
+void BenchmarkNBody(int count);
@@ -0,0 +1,59 @@
+#include "nbody.h"
+#include <algorithm>
+#include <immintrin.h>
+
+// This file is compiled with AVX2 enabled (see the project settings), so
+// nothing here may run before CpuHasAVX2() said yes.
+
+void DirectSumAVX2(const float* x, const float* y, const float* z, const float* mass,
+   int count, float softening, int begin, int end, float* ax, float* ay, float* az)
+{
+   const __m256 zero = _mm256_setzero_ps();
+   const __m256 eps2 = _mm256_set1_ps(softening * softening);
+   const __m256 half = _mm256_set1_ps(0.5f);
+   const __m256 threeHalves = _mm256_set1_ps(1.5f);
+
+   int simdEnd = begin + (end - begin) / 8 * 8;
+   for (int i = begin; i < simdEnd; i++)
+   {
+      ax[i] = 0.0f;
+      ay[i] = 0.0f;
+      az[i] = 0.0f;
+   }
+
+   for (int tile = 0; tile < count; tile += DIRECT_SUM_TILE)
+   {
+      int tileEnd = std::min(tile + DIRECT_SUM_TILE, count);
+      for (int i = begin; i < simdEnd; i += 8)
+      {
+         __m256 px = _mm256_loadu_ps(x + i);
+         __m256 py = _mm256_loadu_ps(y + i);
+         __m256 pz = _mm256_loadu_ps(z + i);
+         __m256 sx = zero, sy = zero, sz = zero;
+
+         for (int j = tile; j < tileEnd; j++)
+         {
+            __m256 dx = _mm256_sub_ps(_mm256_broadcast_ss(x + j), px);
+            __m256 dy = _mm256_sub_ps(_mm256_broadcast_ss(y + j), py);
+            __m256 dz = _mm256_sub_ps(_mm256_broadcast_ss(z + j), pz);
+            __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps2)));
+
+            __m256 inv = _mm256_rsqrt_ps(r2);
+            inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), threeHalves));
+            __m256 f = _mm256_mul_ps(_mm256_broadcast_ss(mass + j), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+            f = _mm256_and_ps(f, _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+
+            sx = _mm256_fmadd_ps(f, dx, sx);
+            sy = _mm256_fmadd_ps(f, dy, sy);
+            sz = _mm256_fmadd_ps(f, dz, sz);
+         }
+
+         _mm256_storeu_ps(ax + i, _mm256_add_ps(_mm256_loadu_ps(ax + i), sx));
+         _mm256_storeu_ps(ay + i, _mm256_add_ps(_mm256_loadu_ps(ay + i), sy));
+         _mm256_storeu_ps(az + i, _mm256_add_ps(_mm256_loadu_ps(az + i), sz));
+      }
+   }
+
+   if (simdEnd < end)
+      DirectSumScalar(x, y, z, mass, count, softening, simdEnd, end, ax, ay, az);
+}
@@ -0,0 +1,428 @@
+#include "resample.h"
+#include "cpuinfo.h"
+#include "jobs.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <emmintrin.h>
+#include <stb_image.h>
+
+using namespace std;
+
+// output rows per job
+const int RESAMPLE_ROWS_PER_JOB = 32;
+
+// linear light is turned back into sRGB bytes by table lookup at this
+// many steps, fine enough that every byte comes out as it would exactly
+const int SRGB_STEPS = 1 << 16;
+
+struct ColourTables
+{
+   float toLinear[256];                   // of sRGB bytes
+   float toUnit[256];                     // of bytes that are not sRGB
+   unsigned char toSRGB[SRGB_STEPS];      // of linear light in [0, 1]
+
+   ColourTables()
+   {
+      for (int i = 0; i < 256; i++)
+      {
+         float s = i / 255.0f;
+         toLinear[i] = s <= 0.04045f ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+         toUnit[i] = s;
+      }
+      for (int i = 0; i < SRGB_STEPS; i++)
+      {
+         double linear = double(i) / (SRGB_STEPS - 1);
+         double s = linear <= 0.0031308 ? linear * 12.92 : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+         toSRGB[i] = (unsigned char)(s * 255.0 + 0.5);
+      }
+   }
+};
+
+// built before main, so the jobs only ever read them
+static const ColourTables tables_;
+
+typedef void (*FilterRowKernel)(const float* in, float* out, int count, const int* first, const float* weights,
+   int taps);
+typedef void (*BlendRowsKernel)(const float* const* rows, const float* weights, int taps, float* out, int count);
+
+static float filterRadius(ResampleFilter filter)
+{
+   switch (filter)
+   {
+   case RESAMPLE_MITCHELL:
+      return 2.0f;
+   case RESAMPLE_LANCZOS3:
+      return 3.0f;
+   default:
+      return 0.5f;
+   }
+}
+
+static double filterWeight(ResampleFilter filter, double x)
+{
+   x = fabs(x);
+   switch (filter)
+   {
+   case RESAMPLE_MITCHELL:
+      if (x < 1.0)
+         return (7.0 * x * x * x - 12.0 * x * x + 16.0 / 3.0) / 6.0;
+      if (x < 2.0)
+         return (-7.0 / 3.0 * x * x * x + 12.0 * x * x - 20.0 * x + 32.0 / 3.0) / 6.0;
+      return 0.0;
+   case RESAMPLE_LANCZOS3:
+   {
+      if (x < 1e-6)
+         return 1.0;
+      if (x >= 3.0)
+         return 0.0;
+      double pix = 3.14159265358979 * x;
+      return 3.0 * sin(pix) * sin(pix / 3.0) / (pix * pix);
+   }
+   default:
+      return x < 0.5 ? 1.0 : 0.0;
+   }
+}
+
+// the source texels blended into each texel along one axis: taps of them
+// from first[i], possibly off either end, weighted by weights[i * taps]
+struct Taps
+{
+   vector<int> first;
+   vector<float> weights;
+   int taps;
+   int lowest;        // of the texels any tap reads
+   int highest;
+};
+
+// a downscale widens the filter to cover all of the source texels under
+// each output texel
+static void computeTaps(int srcSize, int dstSize, ResampleFilter filter, Taps* taps)
+{
+   double scale = double(srcSize) / dstSize;
+   double support = filterRadius(filter) * std::max(scale, 1.0);
+   double filterScale = 1.0 / std::max(scale, 1.0);
+
+   // weighed over a window wide enough for any texel, then trimmed to the
+   // widest run of non-zero weights
+   int window = int(ceil(2.0 * support)) + 2;
+   vector<vector<double> > weights(dstSize, vector<double>(window));
+   vector<int> first(dstSize);
+   taps->taps = 1;
+   for (int i = 0; i < dstSize; i++)
+   {
+      double center = (i + 0.5) * scale;
+      first[i] = int(floor(center - support - 0.5));
+      double sum = 0.0;
+      for (int t = 0; t < window; t++)
+      {
+         weights[i][t] = filterWeight(filter, (first[i] + t + 0.5 - center) * filterScale);
+         sum += weights[i][t];
+      }
+
+      // a box exactly between two texels takes the nearer
+      if (sum == 0.0)
+         weights[i][int(floor(center)) - first[i]] = sum = 1.0;
+      for (int t = 0; t < window; t++)
+         weights[i][t] /= sum;
+      while (weights[i][0] == 0.0)
+      {
+         weights[i].erase(weights[i].begin());
+         weights[i].push_back(0.0);
+         first[i]++;
+      }
+      int last = window - 1;
+      while (weights[i][last] == 0.0)
+         last--;
+      taps->taps = std::max(taps->taps, last + 1);
+   }
+
+   // an even count, so the AVX2 kernel can take taps in pairs
+   taps->taps = (taps->taps + 1) & ~1;
+   taps->first = first;
+   taps->weights.assign(size_t(dstSize) * taps->taps, 0.0f);
+   taps->lowest = INT_MAX;
+   taps->highest = INT_MIN;
+   for (int i = 0; i < dstSize; i++)
+   {
+      for (int t = 0; t < taps->taps && t < window; t++)
+         taps->weights[size_t(i) * taps->taps + t] = float(weights[i][t]);
+      taps->lowest = std::min(taps->lowest, first[i]);
+      taps->highest = std::max(taps->highest, first[i] + taps->taps - 1);
+   }
+}
+
+// bytes of a row into four floats a pixel, linear light for sRGB
+template <int Components>
+static void unpackRow(const unsigned char* pixels, int count, const float* const* tables, float* out)
+{
+   for (int x = 0; x < count; x++)
+   {
+      for (int c = 0; c < Components; c++)
+         out[4 * x + c] = tables[c][pixels[Components * x + c]];
+   }
+}
+
+// four floats a pixel back into bytes, sRGB through the table, the rest
+// rounded; scales are SRGB_STEPS - 1 for sRGB components, 255 for others
+template <int Components>
+static void packRow(const float* in, int count, const bool* isSRGB, __m128 scales, unsigned char* pixels)
+{
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 one = _mm_set1_ps(1.0f);
+   const __m128 half = _mm_set1_ps(0.5f);
+   for (int x = 0; x < count; x++)
+   {
+      __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + 4 * x), zero), one);
+      __m128i steps = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scales), half));
+      int step[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(step), steps);
+      for (int c = 0; c < Components; c++)
+         pixels[Components * x + c] = isSRGB[c] ? tables_.toSRGB[step[c]] : (unsigned char)step[c];
+   }
+}
+
+static void filterRowScalar(const float* in, float* out, int count, const int* first, const float* weights, int taps)
+{
+   for (int i = 0; i < count; i++)
+   {
+      const float* pixel = in + 4 * first[i];
+      const float* weight = weights + size_t(i) * taps;
+      float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (int t = 0; t < taps; t++)
+      {
+         for (int c = 0; c < 4; c++)
+            sum[c] += weight[t] * pixel[4 * t + c];
+      }
+      for (int c = 0; c < 4; c++)
+         out[4 * i + c] = sum[c];
+   }
+}
+
+static void blendRowsScalar(const float* const* rows, const float* weights, int taps, float* out, int count)
+{
+   for (int i = 0; i < count; i++)
+   {
+      float sum = 0.0f;
+      for (int t = 0; t < taps; t++)
+         sum += weights[t] * rows[t][i];
+      out[i] = sum;
+   }
+}
+
+// a pixel's four floats are one register
+static void filterRowSSE2(const float* in, float* out, int count, const int* first, const float* weights, int taps)
+{
+   for (int i = 0; i < count; i++)
+   {
+      const float* pixel = in + 4 * first[i];
+      const float* weight = weights + size_t(i) * taps;
+      __m128 sum = _mm_setzero_ps();
+      for (int t = 0; t < taps; t++)
+         sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[t]), _mm_loadu_ps(pixel + 4 * t)));
+      _mm_storeu_ps(out + 4 * i, sum);
+   }
+}
+
+// count is a multiple of four, rows hold whole pixels
+static void blendRowsSSE2(const float* const* rows, const float* weights, int taps, float* out, int count)
+{
+   for (int i = 0; i < count; i += 4)
+   {
+      __m128 sum = _mm_setzero_ps();
+      for (int t = 0; t < taps; t++)
+         sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(rows[t] + i)));
+      _mm_storeu_ps(out + i, sum);
+   }
+}
+
+static void resample(const unsigned char* src, int srcWidth, int srcHeight, int components,
+   unsigned char* dst, int dstWidth, int dstHeight, ResampleFilter filter, bool isSRGB, bool isWrappedX,
+   FilterRowKernel filterRow, BlendRowsKernel blendRows, bool isParallel)
+{
+   Taps across, down;
+   computeTaps(srcWidth, dstWidth, filter, &across);
+   computeTaps(srcHeight, dstHeight, filter, &down);
+
+   // rows are filtered across from a copy padded on both sides for the
+   // taps past the ends, wrapped or clamped
+   int padLeft = std::max(-across.lowest, 0);
+   int paddedWidth = padLeft + std::max(across.highest + 1, srcWidth);
+   vector<int> firstAcross(across.first);
+   for (size_t i = 0; i < firstAcross.size(); i++)
+      firstAcross[i] += padLeft;
+   vector<int> columns(paddedWidth);
+   for (int x = 0; x < paddedWidth; x++)
+   {
+      int column = x - padLeft;
+      columns[x] = isWrappedX ? (column % srcWidth + srcWidth) % srcWidth :
+         std::min(std::max(column, 0), srcWidth - 1);
+   }
+
+   // alpha is never sRGB
+   bool isChannelSRGB[4];
+   const float* tables[4];
+   float scales[4];
+   for (int c = 0; c < 4; c++)
+   {
+      isChannelSRGB[c] = isSRGB && !((components == 2 && c == 1) || (components == 4 && c == 3));
+      tables[c] = isChannelSRGB[c] ? tables_.toLinear : tables_.toUnit;
+      scales[c] = isChannelSRGB[c] ? float(SRGB_STEPS - 1) : 255.0f;
+   }
+   typedef void (*UnpackRow)(const unsigned char*, int, const float* const*, float*);
+   typedef void (*PackRow)(const float*, int, const bool*, __m128, unsigned char*);
+   UnpackRow unpackRows[] = { unpackRow<1>, unpackRow<2>, unpackRow<3>, unpackRow<4> };
+   PackRow packRows[] = { packRow<1>, packRow<2>, packRow<3>, packRow<4> };
+   UnpackRow unpack = unpackRows[components - 1];
+   PackRow pack = packRows[components - 1];
+   __m128 scale = _mm_loadu_ps(scales);
+
+   auto band = [&](int begin, int end) {
+      // the rows filtered across lately, a ring indexed by source row
+      int ringSize = down.taps;
+      size_t rowFloats = size_t(dstWidth) * 4;
+      vector<float> ring(ringSize * rowFloats);
+      vector<int> ringRow(ringSize, INT_MIN);
+      vector<float> padded(size_t(paddedWidth) * 4, 0.0f);
+      vector<const float*> rows(down.taps);
+      vector<float> weights(down.taps);
+      vector<float> out(rowFloats);
+      for (int y = begin; y < end; y++)
+      {
+         int taps = 0;
+         for (int t = 0; t < down.taps; t++)
+         {
+            float weight = down.weights[size_t(y) * down.taps + t];
+            if (weight == 0.0f)
+               continue;
+            int row = down.first[y] + t;
+            int slot = (row % ringSize + ringSize) % ringSize;
+            float* filtered = &ring[slot * rowFloats];
+            if (ringRow[slot] != row)
+            {
+               int sourceRow = std::min(std::max(row, 0), srcHeight - 1);
+               unpack(src + size_t(sourceRow) * srcWidth * components, srcWidth, tables, &padded[4 * padLeft]);
+               for (int x = 0; x < padLeft; x++)
+                  memcpy(&padded[4 * x], &padded[4 * (padLeft + columns[x])], 4 * sizeof(float));
+               for (int x = padLeft + srcWidth; x < paddedWidth; x++)
+                  memcpy(&padded[4 * x], &padded[4 * (padLeft + columns[x])], 4 * sizeof(float));
+               filterRow(&padded[0], filtered, dstWidth, &firstAcross[0], &across.weights[0], across.taps);
+               ringRow[slot] = row;
+            }
+            rows[taps] = filtered;
+            weights[taps] = weight;
+            taps++;
+         }
+         blendRows(&rows[0], &weights[0], taps, &out[0], int(rowFloats));
+
+         pack(&out[0], dstWidth, isChannelSRGB, scale, dst + size_t(y) * dstWidth * components);
+      }
+   };
+   if (isParallel)
+      ParallelFor("resample rows", dstHeight, RESAMPLE_ROWS_PER_JOB, band);
+   else
+      band(0, dstHeight);
+}
+
+void ResampleImage(const unsigned char* src, int srcWidth, int srcHeight, int components,
+   unsigned char* dst, int dstWidth, int dstHeight, ResampleFilter filter, bool isSRGB, bool isWrappedX)
+{
+   bool avx2 = CpuHasAVX2();
+   resample(src, srcWidth, srcHeight, components, dst, dstWidth, dstHeight, filter, isSRGB, isWrappedX,
+      avx2 ? FilterRowAVX2 : filterRowSSE2, avx2 ? BlendRowsAVX2 : blendRowsSSE2, true);
+}
+
+void FitImageSize(int width, int height, int maxSize, int* fitWidth, int* fitHeight)
+{
+   *fitWidth = width;
+   *fitHeight = height;
+   if (maxSize <= 0 || std::max(width, height) <= maxSize)
+      return;
+   if (width >= height)
+   {
+      *fitWidth = maxSize;
+      *fitHeight = std::max(int((double(height) * maxSize + width / 2) / width), 1);
+   }
+   else
+   {
+      *fitHeight = maxSize;
+      *fitWidth = std::max(int((double(width) * maxSize + height / 2) / height), 1);
+   }
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+void BenchmarkResample(int iterations)
+{
+   iterations = std::max(iterations, 1);
+   const char* filename = "textures/stars_milkyway.jpg";
+   int width, height, components;
+   unsigned char* pixels = stbi_load(filename, &width, &height, &components, 0);
+   if (!pixels)
+   {
+      printf("ERROR: Could not load image %s\n", filename);
+      return;
+   }
+
+   // a mip level, a fit to a smaller maximum size, and an enlargement
+   int sizes[3][2] = { { width / 2, height / 2 }, { width * 7 / 10, height * 7 / 10 }, { width * 2, height * 2 } };
+   const char* filterNames[] = { "box", "mitchell", "lanczos3" };
+   FilterRowKernel filterRows[] = { filterRowScalar, filterRowSSE2, FilterRowAVX2 };
+   BlendRowsKernel blendRows[] = { blendRowsScalar, blendRowsSSE2, BlendRowsAVX2 };
+   int kernelCount = CpuHasAVX2() ? 3 : 2;
+
+   printf("Resampling benchmark, %s, %d iterations, sRGB, kernels on one thread, best on %d threads\n",
+      filename, iterations, JobThreadCount());
+   if (kernelCount < 3)
+      printf("  avx2 not supported by this CPU\n");
+   for (int s = 0; s < 3; s++)
+   {
+      int dstWidth = sizes[s][0], dstHeight = sizes[s][1];
+      double megapixels = double(dstWidth) * dstHeight * 1e-6;
+      printf("  %dx%d to %dx%d, ms (output MP/s)\n", width, height, dstWidth, dstHeight);
+      printf("    %-9s  %-16s  %-16s  %-16s  %-16s  differs by\n", "filter", "scalar", "sse2", "avx2", "threads");
+      for (int f = 0; f < 3; f++)
+      {
+         ResampleFilter filter = ResampleFilter(f);
+         vector<unsigned char> reference(size_t(dstWidth) * dstHeight * components);
+         vector<unsigned char> out(reference.size());
+         double times[4] = { 0.0, 0.0, 0.0, 0.0 };
+         int difference = 0;
+         for (int k = 0; k < 4; k++)
+         {
+            bool isThreaded = k == 3;
+            int kernel = isThreaded ? kernelCount - 1 : k;
+            if (kernel >= kernelCount)
+               continue;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++)
+            {
+               resample(pixels, width, height, components, k == 0 ? &reference[0] : &out[0], dstWidth, dstHeight,
+                  filter, true, true, filterRows[kernel], blendRows[kernel], isThreaded);
+            }
+            times[k] = millisecondsSince(start) / iterations;
+            for (size_t i = 0; k > 0 && i < out.size(); i++)
+               difference = std::max(difference, abs(int(out[i]) - int(reference[i])));
+         }
+         printf("    %-9s", filterNames[f]);
+         for (int k = 0; k < 4; k++)
+         {
+            if (times[k] > 0.0)
+               printf("  %7.2f (%6.1f)", times[k], megapixels / times[k] * 1e3);
+            else
+               printf("  %-16s", "-");
+         }
+         printf("  %d\n", difference);
+      }
+   }
+   stbi_image_free(pixels);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Resizing of 8-bit images with a separable filter: every row is filtered
+// across into floats, then the filtered rows are blended down into the
+// output rows, as jobs over bands of output rows. Colour is filtered in
+// linear light when it is sRGB, which keeps downscaled textures from
+// darkening; alpha (the second of two components or the fourth of four)
+// always filters as it is. Pixels are held as four floats whatever their
+// components, so a pixel is one SSE register.
+
+enum ResampleFilter {
+   RESAMPLE_BOX,          // averages the texels under each output texel, for exact halvings
+   RESAMPLE_MITCHELL,     // cubic, B = C = 1/3, soft with hardly any ringing
+   RESAMPLE_LANCZOS3,     // windowed sinc over three lobes, sharpest, rings at hard edges
+};
+
+// resizes pixels of srcWidth by srcHeight, with components bytes each, into
+// dst, of dstWidth by dstHeight; rows wrap around from the right edge to
+// the left if isWrappedX (equirectangular images), else clamp like the
+// columns
+void ResampleImage(const unsigned char* src, int srcWidth, int srcHeight, int components,
+   unsigned char* dst, int dstWidth, int dstHeight, ResampleFilter filter, bool isSRGB, bool isWrappedX = false);
+
+// the size of an image of width by height scaled down, keeping its aspect,
+// until neither side is larger than maxSize; unchanged if it fits already
+// or maxSize is 0
+void FitImageSize(int width, int height, int maxSize, int* fitWidth, int* fitHeight);
+
+// the filtering kernels, built with AVX2 enabled in resample_avx2.cpp; only
+// call them when CpuHasAVX2(). FilterRowAVX2 filters pixels of in across
+// into count output pixels, the i-th blending taps pixels from first[i]
+// with weights[i * taps]; BlendRowsAVX2 sums count floats of each of taps
+// rows, weighted.
+void FilterRowAVX2(const float* in, float* out, int count, const int* first, const float* weights, int taps);
+void BlendRowsAVX2(const float* const* rows, const float* weights, int taps, float* out, int count);
+
+// times each filter and kernel resizing the milky way texture, iterations
+// times each, on one thread and on all of them, and prints the throughput
+void BenchmarkResample(int iterations);
@@ -0,0 +1,45 @@
+#include "resample.h"
+#include <immintrin.h>
+
+// This file is compiled with AVX2 enabled (see the project settings), so
+// nothing here may run before CpuHasAVX2() said yes.
+
+// two taps at a time, a pixel in each half of the register, the halves
+// added at the end; the tap count is even
+void FilterRowAVX2(const float* in, float* out, int count, const int* first, const float* weights, int taps)
+{
+   const __m256i pairs = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+   for (int i = 0; i < count; i++)
+   {
+      const float* pixel = in + 4 * first[i];
+      const float* weight = weights + size_t(i) * taps;
+      __m256 sum = _mm256_setzero_ps();
+      for (int t = 0; t < taps; t += 2)
+      {
+         __m128 weightPair = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(weight + t)));
+         __m256 w = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(weightPair), pairs);
+         sum = _mm256_fmadd_ps(w, _mm256_loadu_ps(pixel + 4 * t), sum);
+      }
+      _mm_storeu_ps(out + 4 * i, _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+   }
+}
+
+// two pixels a step, the odd one out on its own; count is a multiple of four
+void BlendRowsAVX2(const float* const* rows, const float* weights, int taps, float* out, int count)
+{
+   int i = 0;
+   for (; i + 8 <= count; i += 8)
+   {
+      __m256 sum = _mm256_setzero_ps();
+      for (int t = 0; t < taps; t++)
+         sum = _mm256_fmadd_ps(_mm256_broadcast_ss(weights + t), _mm256_loadu_ps(rows[t] + i), sum);
+      _mm256_storeu_ps(out + i, sum);
+   }
+   if (i < count)
+   {
+      __m128 sum = _mm_setzero_ps();
+      for (int t = 0; t < taps; t++)
+         sum = _mm_fmadd_ps(_mm_broadcast_ss(weights + t), _mm_loadu_ps(rows[t] + i), sum);
+      _mm_storeu_ps(out + i, sum);
+   }
+}
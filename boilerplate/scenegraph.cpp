@@ -0,0 +1,115 @@
+#include "scenegraph.h"
+#include "jobs.h"
+#include <algorithm>
+
+// matrices per job in the batched passes; small scenes stay in one job
+static const int BATCH_GRAIN = 4096;
+
+int SceneGraph::addNode(int parent, vec3 translation, quat rotation, vec3 scale)
+{
+   // appending keeps parents ahead of their children
+   if (parent >= size())
+      return -1;
+
+   parent_.push_back(parent);
+   depth_.push_back(parent >= 0 ? depth_[parent] + 1 : 0);
+   translation_.push_back(translation);
+   rotation_.push_back(rotation);
+   scale_.push_back(scale);
+   world_.resize(size());
+   world_.set(size() - 1, mat4(1.0f));
+   normal_.resize(size());
+   normal_.set(size() - 1, mat4(1.0f));
+   dirty_.push_back(1);
+   return size() - 1;
+}
+
+void SceneGraph::setTranslation(int node, vec3 translation)
+{
+   translation_[node] = translation;
+   dirty_[node] = 1;
+}
+
+void SceneGraph::setRotation(int node, quat rotation)
+{
+   rotation_[node] = rotation;
+   dirty_[node] = 1;
+}
+
+void SceneGraph::setScale(int node, vec3 scale)
+{
+   scale_[node] = scale;
+   dirty_[node] = 1;
+}
+
+void SceneGraph::update()
+{
+   // a changed parent has already been visited, so its flag is final
+   changed_.clear();
+   for (int i = 0; i < size(); i++)
+   {
+      int parent = parent_[i];
+      if (parent >= 0 && dirty_[parent])
+         dirty_[i] = 1;
+      if (dirty_[i])
+         changed_.push_back(i);
+   }
+   if (changed_.empty())
+      return;
+
+   // a world matrix needs its parent's, so the products run one depth at a
+   // time, each as one batch over that depth's changed nodes gathered into
+   // contiguous arrays, then scattered back
+   std::stable_sort(changed_.begin(), changed_.end(), [this](int a, int b) {
+      return depth_[a] < depth_[b];
+   });
+   int changedCount = int(changed_.size());
+   batchA_.resize(changedCount);
+   batchB_.resize(changedCount);
+   batchOut_.resize(changedCount);
+   for (int begin = 0, end = 0; begin < changedCount; begin = end)
+   {
+      int depth = depth_[changed_[begin]];
+      for (end = begin; end < changedCount && depth_[changed_[end]] == depth; end++)
+      {
+         int i = changed_[end];
+
+         // local = T * R * S, built directly rather than through three products
+         mat3 r = mat3_cast(rotation_[i]);
+         mat4 local(vec4(r[0] * scale_[i].x, 0.0f),
+            vec4(r[1] * scale_[i].y, 0.0f),
+            vec4(r[2] * scale_[i].z, 0.0f),
+            vec4(translation_[i], 1.0f));
+         if (depth == 0)
+         {
+            batchOut_.set(end, local);
+         }
+         else
+         {
+            batchA_.copy(end, world_, parent_[i]);
+            batchB_.set(end, local);
+         }
+      }
+
+      if (depth > 0)
+      {
+         int first = begin;
+         ParallelFor("world matrices", end - begin, BATCH_GRAIN, [&](int b, int e) {
+            BatchMultiply(batchA_, batchB_, batchOut_, first + b, first + e);
+         });
+      }
+      for (int k = begin; k < end; k++)
+         world_.copy(changed_[k], batchOut_, k);
+   }
+
+   // the inverse is the expensive part, so it runs in batches over the
+   // changed nodes' world matrices rather than inside the hierarchy walk
+   ParallelFor("normal matrices", changedCount, BATCH_GRAIN, [&](int begin, int end) {
+      BatchNormalMatrix(batchOut_, batchA_, begin, end);
+   });
+   for (int k = 0; k < changedCount; k++)
+   {
+      normal_.copy(changed_[k], batchA_, k);
+      dirty_[changed_[k]] = 0;
+   }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "transformbatch.h"
+
+using namespace glm;
+
+// Hierarchy of transform nodes stored contiguously in parent-before-child
+// order, so changes propagate to descendants in one linear pass. Each node
+// keeps a local translation/rotation/scale, and its cached world and normal
+// matrices are only recomputed when the node or one of its ancestors has
+// changed, in batches of the changed nodes at each depth. The matrices are
+// kept as affine structures of arrays so the batches run several nodes per
+// simd register.
+class SceneGraph{
+public:
+   // adds a node below parent (-1 for a root) and returns its index; the
+   // parent must already be in the graph
+   int addNode(int parent, vec3 translation = vec3(0.0f),
+      quat rotation = quat(), vec3 scale = vec3(1.0f));
+
+   void setTranslation(int node, vec3 translation);
+   void setRotation(int node, quat rotation);
+   void setScale(int node, vec3 scale);
+
+   // recompute the world and normal matrices of changed nodes and their
+   // descendants
+   void update();
+
+   mat4 getWorldMatrix(int node) const { return world_.get(node); }
+   // only the upper 3x3 is meaningful; the translation is zero
+   mat4 getNormalMatrix(int node) const { return normal_.get(node); }
+   int getParent(int node) const { return parent_[node]; }
+   int size() const { return int(parent_.size()); }
+
+private:
+   std::vector<int> parent_;
+   std::vector<vec3> translation_;
+   std::vector<quat> rotation_;
+   std::vector<vec3> scale_;
+   AffineArrays world_;
+   AffineArrays normal_;
+   std::vector<unsigned char> dirty_;
+   std::vector<int> depth_;           // 0 for roots
+
+   // the nodes changed since the last update, by depth, and scratch for
+   // gathering their matrices into contiguous batches
+   std::vector<int> changed_;
+   AffineArrays batchA_, batchB_, batchOut_;
+};
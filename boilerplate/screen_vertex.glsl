@@ -0,0 +1,15 @@
+// ==========================================================================
+// Vertex program for full-screen passes: one triangle covering the
+// viewport, made from gl_VertexID with no buffers bound
+// ==========================================================================
+#version 410
+
+out vec2 UV; // 0 to 1 across the viewport
+
+void main()
+{
+    // (-1,-1), (3,-1), (-1,3): the viewport is the triangle's lower left
+    vec2 corner = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;
+    UV = 0.5 * corner + 0.5;
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
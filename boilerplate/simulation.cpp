@@ -0,0 +1,282 @@
+#include "simulation.h"
+#include <chrono>
+#include <cmath>
+
+// gravity mode; the scene's distances are compressed, so the earth has to
+// be far heavier than it should be to hold on to the moon
+const float SUN_MASS = 100.0f;
+const float EARTH_MASS = 30.0f;
+const float MOON_MASS = 0.3f;
+
+// Angles
+const float EARTH_AXIS = radians(23.f);
+const float MOON_AXIS = radians(6.68f);
+const float MOON_INCLINATION = radians(6.68f);
+
+// Rates in radians per second, everything is evaluated at the current
+// simulation time so seeking and time warp need no stepping
+const double SUN_RATE = radians(0.24) * 60.0;
+const double EARTH_RATE = radians(0.1) * 60.0;
+const double MOON_RATE = radians(0.22) * 60.0;
+const double EARTH_ORBIT_RATE = -radians(0.22) * 60.0;
+const double MOON_ORBIT_RATE = radians(0.2) * 60.0;
+
+// angle reached after t seconds at a constant rate, wrapped in double
+// precision so it stays exact at large times
+static float angleAt(double rate, double t)
+{
+   return float(fmod(rate * t, 2.0 * 3.14159265358979323846));
+}
+
+Simulation::Simulation()
+   : time(0.0)
+   , timeWarp(1.0)
+   , isPaused(false)
+   , isGravity(false)
+   , isDirectSum(false)
+   , earthParticle_(0)
+   , moonParticle_(0)
+   , shownTime_(-1.0)
+   , gravityShown_(false)
+   , running_(false)
+   , hasFrame_(false)
+   , sequence_(0)
+   , bodyStaticVersion_(0)
+{
+   // extra bodies orbiting alongside the sun, earth and moon
+   sunBody = bodies.addBody(-1, 0.0f, OrbitalElements());
+
+   // Scene graph, parents added before their children. The earth's orbit
+   // pivot hangs off the sun, so it also follows the sun's spin. Orbit
+   // pivots and spinning bodies are separate nodes so the moon follows the
+   // earth's position without picking up its spin.
+   sunNode_ = scene_.addNode(-1);
+   earthOrbitNode_ = scene_.addNode(sunNode_, vec3(0.0f), quat(), vec3(0.65f));
+   earthAnchorNode_ = scene_.addNode(earthOrbitNode_, vec3(12.0f, 0.0f, 0.0f));
+   earthNode_ = scene_.addNode(earthAnchorNode_);
+   moonOrbitNode_ = scene_.addNode(earthAnchorNode_);
+   moonNode_ = scene_.addNode(moonOrbitNode_, vec3(3.0f, 0.0f, 0.0f), quat(), vec3(0.5f));
+   galaxyNode_ = scene_.addNode(-1, vec3(0.0f), quat(), vec3(50.0f));
+}
+
+Simulation::~Simulation()
+{
+   stop();
+}
+
+void Simulation::start(double rate)
+{
+   stop();
+   running_.store(true);
+   thread_ = std::thread([this, rate]() { run(rate); });
+}
+
+void Simulation::stop()
+{
+   if (!thread_.joinable())
+      return;
+   running_.store(false);
+   thread_.join();
+}
+
+void Simulation::queueCommand(SimCommand command)
+{
+   std::lock_guard<std::mutex> lock(commandMutex_);
+   commands_.push_back(command);
+}
+
+const FramePacket* Simulation::latestFrame()
+{
+   if (frames_.update())
+      hasFrame_ = true;
+   return hasFrame_ ? &frames_.front() : 0;
+}
+
+// steps at a fixed rate; a step that overruns its slot is followed by the
+// next one straight away rather than trying to catch up
+void Simulation::run(double rate)
+{
+   typedef std::chrono::steady_clock Clock;
+   Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / rate));
+   Clock::time_point last = Clock::now();
+   Clock::time_point next = last;
+
+   while (running_.load())
+   {
+      Clock::time_point now = Clock::now();
+      std::chrono::duration<double> elapsed = now - last;
+      last = now;
+      if (step(elapsed.count()) || sequence_ == 0)
+         publish();
+
+      next += period;
+      if (next < now)
+         next = now;
+      std::this_thread::sleep_until(next);
+   }
+}
+
+// applies queued input and advances the clock, posing the scene if the
+// time moved; returns true if it did
+bool Simulation::step(double elapsed)
+{
+   std::vector<SimCommand> commands;
+   {
+      std::lock_guard<std::mutex> lock(commandMutex_);
+      commands.swap(commands_);
+   }
+   for (size_t i = 0; i < commands.size(); i++)
+      applyCommand(commands[i]);
+
+   if (!isPaused)
+      time += elapsed * timeWarp;
+
+   // only pose the scene when the time moved, a seek works while paused
+   if (time == shownTime_ && isGravity == gravityShown_)
+      return false;
+   pose();
+   return true;
+}
+
+void Simulation::applyCommand(SimCommand command)
+{
+   switch (command)
+   {
+   case TOGGLE_PAUSE:
+      isPaused = !isPaused; break;
+   case WARP_SLOWER:
+      timeWarp *= 0.5; break;
+   case WARP_FASTER:
+      timeWarp *= 2.0; break;
+   case RESET_TIME:
+      time = 0.0; break;
+   case TOGGLE_GRAVITY:
+      isGravity = !isGravity; break;
+   case TOGGLE_DIRECT_SUM:
+      isDirectSum = !isDirectSum; break;
+   }
+}
+
+// places the scene and the bodies at the current time
+void Simulation::pose()
+{
+   // gravity carries on from its own state; switching it on, or seeking
+   // backwards, starts it again from the analytic orbits
+   bool seedGravity = isGravity && (!gravityShown_ || time < shownTime_);
+   float elapsed = float(time - shownTime_);
+   shownTime_ = time;
+   gravityShown_ = isGravity;
+   float sunAngle = angleAt(SUN_RATE, time);
+   float earthAngle = angleAt(EARTH_RATE, time);
+   float moonAngle = angleAt(MOON_RATE, time);
+   float earthOrbit = angleAt(EARTH_ORBIT_RATE, time);
+   float moonOrbit = angleAt(MOON_ORBIT_RATE, time);
+
+   vec3 yAxis(0, 1, 0);
+   quat earthTilt = angleAxis(EARTH_AXIS, vec3(1, 0, 0));
+   scene_.setRotation(sunNode_, angleAxis(sunAngle, yAxis));
+   scene_.setRotation(earthOrbitNode_, angleAxis(earthOrbit, yAxis));
+   scene_.setRotation(earthNode_, earthTilt * angleAxis(earthAngle, yAxis));
+   scene_.setRotation(moonOrbitNode_, earthTilt *
+      angleAxis(MOON_INCLINATION, vec3(1, 0, 0)) * angleAxis(moonOrbit, yAxis));
+   scene_.setRotation(moonNode_, angleAxis(MOON_AXIS, vec3(1, 0, 0)) * angleAxis(moonAngle, yAxis));
+   scene_.setTranslation(sunNode_, vec3(0.0f));
+   scene_.setTranslation(earthAnchorNode_, vec3(12.0f, 0.0f, 0.0f));
+   scene_.setTranslation(moonNode_, vec3(3.0f, 0.0f, 0.0f));
+
+   if (!isGravity || seedGravity)
+      bodies.update(time);
+   bodies.updateSpins(time);
+
+   if (seedGravity)
+   {
+      gravity.clear();
+      AddBodiesToSimulation(&gravity, bodies, time, sunBody, SUN_MASS);
+
+      // the earth and moon start on circular orbits; the earth keeps its
+      // direction, its pivot also turns with the sun. At a quarter of the
+      // earth's distance the moon is beyond where prograde orbits stay
+      // bound (about half the Hill radius), so it starts retrograde, which
+      // holds out to about 0.7.
+      scene_.update();
+      vec3 earthPosition = vec3(scene_.getWorldMatrix(earthNode_)[3]);
+      vec3 moonPosition = vec3(scene_.getWorldMatrix(moonNode_)[3]);
+      vec3 moonOffset = moonPosition - earthPosition;
+      vec3 moonNormal = normalize(mat3(scene_.getWorldMatrix(moonOrbitNode_)) * yAxis);
+
+      float earthSpeed = sqrt((SUN_MASS + EARTH_MASS) / length(earthPosition));
+      float earthDirection = SUN_RATE + EARTH_ORBIT_RATE < 0.0 ? -1.0f : 1.0f;
+      vec3 earthVelocity = earthDirection * earthSpeed * normalize(cross(yAxis, earthPosition));
+      float moonSpeed = sqrt((EARTH_MASS + MOON_MASS) / length(moonOffset));
+      float moonDirection = -earthDirection;
+      vec3 moonVelocity = earthVelocity + moonDirection * moonSpeed * normalize(cross(moonNormal, moonOffset));
+
+      earthParticle_ = gravity.addParticle(earthPosition, earthVelocity, EARTH_MASS);
+      moonParticle_ = gravity.addParticle(moonPosition, moonVelocity, MOON_MASS);
+      gravity.removeNetMomentum();
+   }
+   else if (isGravity)
+   {
+      gravity.method = isDirectSum ? NBodySim::DIRECT_SUM : NBodySim::BARNES_HUT;
+      gravity.step(elapsed);
+   }
+
+   // place everything at the simulated positions; the spins above stay
+   // analytic. The earth's pivot cancels the sun's spin and the moon's
+   // pivot is left unrotated, so translations are world offsets scaled by
+   // the earth orbit's 0.65.
+   if (isGravity)
+   {
+      for (int i = 0; i < bodies.size(); i++)
+      {
+         bodies.x[i] = gravity.x[i];
+         bodies.y[i] = gravity.y[i];
+         bodies.z[i] = gravity.z[i];
+      }
+      vec3 sunPosition(gravity.x[sunBody], gravity.y[sunBody], gravity.z[sunBody]);
+      vec3 earthPosition(gravity.x[earthParticle_], gravity.y[earthParticle_], gravity.z[earthParticle_]);
+      vec3 moonPosition(gravity.x[moonParticle_], gravity.y[moonParticle_], gravity.z[moonParticle_]);
+      scene_.setTranslation(sunNode_, sunPosition);
+      scene_.setRotation(earthOrbitNode_, inverse(angleAxis(sunAngle, yAxis)));
+      scene_.setTranslation(earthAnchorNode_, (earthPosition - sunPosition) / 0.65f);
+      scene_.setRotation(moonOrbitNode_, quat());
+      scene_.setTranslation(moonNode_, (moonPosition - earthPosition) / 0.65f);
+   }
+
+   // only nodes that changed are recomputed
+   scene_.update();
+}
+
+// copies the current state into the free slot of the triple buffer
+void Simulation::publish()
+{
+   FramePacket& packet = frames_.back();
+   packet.sequence = ++sequence_;
+   packet.time = time;
+
+   int nodes[OBJECT_COUNT] = { sunNode_, earthNode_, moonNode_, galaxyNode_ };
+   for (int i = 0; i < OBJECT_COUNT; i++)
+   {
+      packet.model[i] = scene_.getWorldMatrix(nodes[i]);
+      packet.normal[i] = scene_.getNormalMatrix(nodes[i]);
+   }
+   packet.light = vec3(packet.model[OBJECT_SUN][3]);
+
+   // the slot's vectors keep their capacity, so this allocates only when
+   // bodies were added
+   packet.bodyX = bodies.x;
+   packet.bodyY = bodies.y;
+   packet.bodyZ = bodies.z;
+   packet.bodySpin = bodies.spinAngle;
+   if (bodies.takeStaticChanged())
+   {
+      bodyStatic_ = std::shared_ptr<const std::vector<vec4> >(
+         new std::vector<vec4>(bodies.getStaticInstances()));
+      bodyStaticVersion_++;
+   }
+   packet.bodyStatic = bodyStatic_;
+   packet.bodyStaticVersion = bodyStaticVersion_;
+
+   frames_.publish();
+}
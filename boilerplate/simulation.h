@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "glm/glm.hpp"
+#include "scenegraph.h"
+#include "bodies.h"
+#include "nbody.h"
+#include "triplebuffer.h"
+
+using namespace glm;
+
+// scene graph objects the renderer draws one by one
+enum SceneObject
+{
+   OBJECT_SUN,
+   OBJECT_EARTH,
+   OBJECT_MOON,
+   OBJECT_GALAXY,
+   OBJECT_COUNT
+};
+
+// Everything the renderer needs to draw one frame. The simulation thread
+// fills a packet and publishes it, after which it is not written again
+// until the renderer has moved on to a newer one.
+struct FramePacket
+{
+   int sequence;             // goes up by one per published packet
+   double time;              // simulated time shown
+   vec3 light;               // world position of the sun
+   mat4 model[OBJECT_COUNT];
+   mat4 normal[OBJECT_COUNT];
+
+   // body positions and spin angles, plus their static data, which is
+   // shared between packets and only replaced, under a new version, when
+   // bodies are added
+   std::vector<float> bodyX;
+   std::vector<float> bodyY;
+   std::vector<float> bodyZ;
+   std::vector<float> bodySpin;
+   std::shared_ptr<const std::vector<vec4> > bodyStatic;
+   int bodyStaticVersion;
+
+   FramePacket() : sequence(0), time(0.0), bodyStaticVersion(0) {}
+};
+
+// input the window thread hands on to the simulation; the camera is not
+// part of it, it moves with the rendered frames
+enum SimCommand
+{
+   TOGGLE_PAUSE,
+   WARP_SLOWER,
+   WARP_FASTER,
+   RESET_TIME,
+   TOGGLE_GRAVITY,
+   TOGGLE_DIRECT_SUM
+};
+
+// The sun, earth and moon scene plus the body system and gravity, stepped
+// on a thread of its own at a fixed rate. Each step that changes anything
+// publishes a frame packet through a triple buffer, so the renderer always
+// draws the latest finished state and a slow step never holds up a frame.
+// The public state is set up before start() and owned by the simulation
+// thread until stop().
+class Simulation{
+public:
+   BodySystem bodies;
+   int sunBody;              // body the belts and loaded bodies orbit
+   NBodySim gravity;
+   double time;              // seconds of simulated time
+   double timeWarp;          // simulated seconds per real second
+   bool isPaused;
+   bool isGravity;           // bodies move under gravity instead of on fixed orbits
+   bool isDirectSum;         // exact O(N^2) gravity instead of the octree
+
+   Simulation();
+   ~Simulation();
+
+   // runs the simulation thread at rate steps per second
+   void start(double rate = 120.0);
+   void stop();
+
+   // queues input for the next step, from any thread
+   void queueCommand(SimCommand command);
+
+   // the latest published packet, null before the first one; it stays
+   // valid until the next call. Renderer thread only.
+   const FramePacket* latestFrame();
+
+private:
+   void run(double rate);
+   bool step(double elapsed);
+   void applyCommand(SimCommand command);
+   void pose();
+   void publish();
+
+   Simulation(const Simulation&);
+   Simulation& operator=(const Simulation&);
+
+   SceneGraph scene_;
+   int sunNode_;
+   int earthOrbitNode_;
+   int earthAnchorNode_;
+   int earthNode_;
+   int moonOrbitNode_;
+   int moonNode_;
+   int galaxyNode_;
+   int earthParticle_;
+   int moonParticle_;
+   double shownTime_;
+   bool gravityShown_;
+
+   std::thread thread_;
+   std::atomic<bool> running_;
+   std::mutex commandMutex_;
+   std::vector<SimCommand> commands_;
+
+   TripleBuffer<FramePacket> frames_;
+   bool hasFrame_;            // renderer only
+   int sequence_;
+   int bodyStaticVersion_;
+   std::shared_ptr<const std::vector<vec4> > bodyStatic_;
+};
@@ -0,0 +1,762 @@
+#include "terrain.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb_image.h>
+#include "meshgen.h"
+
+const double PI = 3.14159265358979323846;
+
+// noise octaves, from a few features around the sphere down to about four
+// triangles of the finest chunks
+const int NOISE_OCTAVES = 14;
+const double NOISE_FREQUENCY = 2.0;
+
+// half the width of the box filter that softens the land mask's coasts
+const int COAST_BLUR = 2;
+
+// a node is split while the eye is within this many of its widths, which
+// keeps triangles at a few pixels; each level morphs from MORPH_START of
+// its range to the end of it
+const float LOD_RANGE = 4.0f;
+const float MORPH_START = 0.75f;
+
+// chunk builds queued at once per worker thread, and built per frame when
+// there are no workers
+const int BUILDS_PER_WORKER = 2;
+const int SYNC_BUILDS_PER_FRAME = 2;
+
+// nodes unvisited for this many frames lose their children
+const int PRUNE_FRAMES = 300;
+
+// --------------------------------------------------------------------------
+// Height field
+
+static unsigned int hashLattice(int x, int y, int z)
+{
+   unsigned int h = unsigned(x) * 73856093u ^ unsigned(y) * 19349663u ^ unsigned(z) * 83492791u;
+   h ^= h >> 13;
+   h *= 0x5bd1e995u;
+   h ^= h >> 15;
+   return h;
+}
+
+// smooth value noise in [0, 1]
+static double valueNoise(dvec3 p)
+{
+   dvec3 cell = floor(p);
+   dvec3 f = p - cell;
+   dvec3 w = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);
+   int x = int(cell.x);
+   int y = int(cell.y);
+   int z = int(cell.z);
+
+   double corners[8];
+   for (int i = 0; i < 8; i++)
+      corners[i] = hashLattice(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2)) / 4294967295.0;
+   double x00 = mix(corners[0], corners[1], w.x);
+   double x10 = mix(corners[2], corners[3], w.x);
+   double x01 = mix(corners[4], corners[5], w.x);
+   double x11 = mix(corners[6], corners[7], w.x);
+   return mix(mix(x00, x10, w.y), mix(x01, x11, w.y), w.z);
+}
+
+// octaves of value noise, each twice the frequency and half the amplitude
+// of the last, in [0, 1]
+static double fractalNoise(dvec3 p)
+{
+   double sum = 0.0;
+   double amplitude = 1.0;
+   double total = 0.0;
+   double frequency = NOISE_FREQUENCY;
+   for (int i = 0; i < NOISE_OCTAVES; i++)
+   {
+      // shifted per octave so the lattices do not line up at the origin
+      sum += amplitude * valueNoise(p * frequency + double(i) * 17.31);
+      total += amplitude;
+      amplitude *= 0.5;
+      frequency *= 2.0;
+   }
+   return sum / total;
+}
+
+HeightField::HeightField()
+   : scale(0.01f)
+   , width_(0)
+   , height_(0)
+   , isHeightMap_(false)
+{}
+
+bool HeightField::loadHeightMap(const char* filename)
+{
+   int components;
+   unsigned char* data = stbi_load(filename, &width_, &height_, &components, 1);
+   if (!data)
+   {
+      std::cout << "ERROR: Could not load heightmap " << filename << std::endl;
+      return false;
+   }
+   map_.assign(data, data + width_ * height_);
+   stbi_image_free(data);
+   isHeightMap_ = true;
+   return true;
+}
+
+void HeightField::setLandMask(const unsigned char* pixels, int width, int height, int components)
+{
+   if (isHeightMap_ || !pixels || components < 3)
+      return;
+
+   std::vector<unsigned char> mask(width * height);
+   for (int i = 0; i < width * height; i++)
+   {
+      const unsigned char* p = pixels + i * components;
+      bool isSea = p[2] > p[0] + 8 && p[2] >= p[1];
+      mask[i] = isSea ? 0 : 255;
+   }
+
+   // a box filter along rows, wrapping, then along columns, clamped
+   map_.resize(width * height);
+   int taps = 2 * COAST_BLUR + 1;
+   for (int y = 0; y < height; y++)
+   {
+      for (int x = 0; x < width; x++)
+      {
+         int sum = 0;
+         for (int k = -COAST_BLUR; k <= COAST_BLUR; k++)
+            sum += mask[y * width + (x + k + width) % width];
+         map_[y * width + x] = (unsigned char)(sum / taps);
+      }
+   }
+   mask = map_;
+   for (int y = 0; y < height; y++)
+   {
+      for (int x = 0; x < width; x++)
+      {
+         int sum = 0;
+         for (int k = -COAST_BLUR; k <= COAST_BLUR; k++)
+            sum += mask[clamp(y + k, 0, height - 1) * width + x];
+         map_[y * width + x] = (unsigned char)(sum / taps);
+      }
+   }
+   width_ = width;
+   height_ = height;
+}
+
+// the map sampled the way the fragment shader samples the surface texture
+float HeightField::base(const dvec3& dir) const
+{
+   if (map_.empty())
+      return 1.0f;
+
+   double u = std::atan2(dir.x, dir.z) / (2.0 * PI) + 0.5;
+   double v = std::asin(clamp(dir.y, -1.0, 1.0)) / PI + 0.5;
+   double x = u * width_ - 0.5;
+   double y = clamp(v * height_ - 0.5, 0.0, double(height_ - 1));
+   int x0 = int(std::floor(x));
+   int y0 = int(y);
+   float fx = float(x - x0);
+   float fy = float(y - y0);
+   int x1 = (x0 + 1 + width_) % width_;
+   x0 = (x0 + width_) % width_;
+   int y1 = std::min(y0 + 1, height_ - 1);
+
+   const unsigned char* row0 = &map_[y0 * width_];
+   const unsigned char* row1 = &map_[y1 * width_];
+   float top = mix(float(row0[x0]), float(row0[x1]), fx);
+   float bottom = mix(float(row1[x0]), float(row1[x1]), fx);
+   return mix(top, bottom, fy) / 255.0f;
+}
+
+double HeightField::height(const dvec3& dir) const
+{
+   float b = base(dir);
+   if (b <= 0.0f)
+      return 0.0;
+   return scale * b * fractalNoise(dir);
+}
+
+// --------------------------------------------------------------------------
+// Quadtree
+
+// the angle a node of depth spans, about
+static float nodeSize(int depth)
+{
+   return float(0.5 * PI) / float(1 << depth);
+}
+
+PlanetTerrain::PlanetTerrain()
+   : frame_(0)
+   , buildCount_(0)
+   , inFlight_(0)
+   , eye_(0.0)
+{
+   chunks_.resize(TERRAIN_MAX_CHUNKS);
+   for (int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+   {
+      chunks_[i].node = -1;
+      chunks_[i].state = CHUNK_FREE;
+      chunks_[i].lastUsed = 0;
+   }
+
+   // the roots are drawn from anywhere
+   ranges_.resize(TERRAIN_MAX_DEPTH + 1);
+   ranges_[0] = 1e30f;
+   for (int depth = 1; depth <= TERRAIN_MAX_DEPTH; depth++)
+      ranges_[depth] = LOD_RANGE * nodeSize(depth);
+
+   for (int face = 0; face < CUBE_FACES; face++)
+      roots_[face] = -1;
+}
+
+PlanetTerrain::~PlanetTerrain()
+{
+   // the jobs write into the chunks
+   waitForBuilds();
+}
+
+void PlanetTerrain::initialize()
+{
+   for (int face = 0; face < CUBE_FACES; face++)
+   {
+      roots_[face] = addNode(face, 0, 0, 0);
+      nodes_[roots_[face]].chunk = face;
+      chunks_[face].node = roots_[face];
+      chunks_[face].state = CHUNK_BUILDING;
+   }
+   inFlight_ += CUBE_FACES;
+   ParallelFor("terrain chunk", CUBE_FACES, 1, [&](int begin, int end) {
+      for (int face = begin; face < end; face++)
+         buildChunk(face, face, 0, 0, 0);
+   });
+}
+
+int PlanetTerrain::addNode(int face, int depth, int x, int y)
+{
+   Node node;
+   node.face = face;
+   node.depth = depth;
+   node.x = x;
+   node.y = y;
+   node.children = -1;
+   node.chunk = -1;
+   node.lastVisited = frame_;
+   boundNode(node);
+   nodes_.push_back(node);
+   return int(nodes_.size()) - 1;
+}
+
+// a box around the node's patch at every height the field allows, from a
+// few directions across it, grown by how far the sphere bulges between them
+void PlanetTerrain::boundNode(Node& node) const
+{
+   const int SAMPLES = 5;
+   int size = 1 << node.depth;
+   dvec3 lower(DBL_MAX);
+   dvec3 upper(-DBL_MAX);
+   for (int j = 0; j < SAMPLES; j++)
+   {
+      for (int i = 0; i < SAMPLES; i++)
+      {
+         double s = (2.0 * (node.x + i / double(SAMPLES - 1)) - size) / size;
+         double t = (2.0 * (node.y + j / double(SAMPLES - 1)) - size) / size;
+         dvec3 dir = normalize(CubeSphereDirection(node.face, s, t));
+         lower = min(lower, min(dir, dir * (1.0 + heights.scale)));
+         upper = max(upper, max(dir, dir * (1.0 + heights.scale)));
+      }
+   }
+
+   // spherified cells are at most about half again the average size
+   double step = 1.5 * nodeSize(node.depth) / (SAMPLES - 1);
+   double bulge = (1.0 + heights.scale) * step * step / 8.0;
+   node.lower = vec3(lower - bulge);
+   node.upper = vec3(upper + bulge);
+}
+
+void PlanetTerrain::split(int index)
+{
+   int children;
+   if (!freeBlocks_.empty())
+   {
+      children = freeBlocks_.back();
+      freeBlocks_.pop_back();
+   }
+   else
+   {
+      children = int(nodes_.size());
+      nodes_.resize(nodes_.size() + 4);
+   }
+
+   Node parent = nodes_[index];
+   for (int q = 0; q < 4; q++)
+   {
+      Node& child = nodes_[children + q];
+      child.face = parent.face;
+      child.depth = parent.depth + 1;
+      child.x = 2 * parent.x + (q & 1);
+      child.y = 2 * parent.y + (q >> 1);
+      child.children = -1;
+      child.chunk = -1;
+      child.lastVisited = frame_;
+      boundNode(child);
+   }
+   nodes_[index].children = children;
+}
+
+// drops the children of nodes whose children are leaves without chunks
+// that have not been visited for a while
+void PlanetTerrain::prune()
+{
+   for (size_t i = 0; i < nodes_.size(); i++)
+   {
+      int children = nodes_[i].children;
+      if (children < 0)
+         continue;
+
+      bool isStale = true;
+      for (int q = 0; q < 4; q++)
+      {
+         const Node& child = nodes_[children + q];
+         if (child.children >= 0 || child.chunk >= 0 || child.lastVisited > frame_ - PRUNE_FRAMES)
+            isStale = false;
+      }
+      if (isStale)
+      {
+         nodes_[i].children = -1;
+         freeBlocks_.push_back(children);
+      }
+   }
+}
+
+void PlanetTerrain::update(dvec3 eye, const mat4& eyeViewProj)
+{
+   frame_++;
+   eye_ = eye;
+   draws.clear();
+   requests_.clear();
+
+   // frustum planes from the rows of the matrix, in the eye's frame
+   for (int i = 0; i < 3; i++)
+   {
+      vec4 row(eyeViewProj[0][i], eyeViewProj[1][i], eyeViewProj[2][i], eyeViewProj[3][i]);
+      vec4 w(eyeViewProj[0][3], eyeViewProj[1][3], eyeViewProj[2][3], eyeViewProj[3][3]);
+      planes_[2 * i] = w + row;
+      planes_[2 * i + 1] = w - row;
+   }
+
+   for (int face = 0; face < CUBE_FACES; face++)
+   {
+      int root = roots_[face];
+      if (root >= 0 && chunks_[nodes_[root].chunk].state == CHUNK_RESIDENT)
+         select(root);
+   }
+   startBuilds();
+
+   if (frame_ % 60 == 0)
+      prune();
+}
+
+bool PlanetTerrain::isInRange(const Node& node, int depth) const
+{
+   dvec3 nearest = clamp(eye_, dvec3(node.lower), dvec3(node.upper));
+   return length(nearest - eye_) < ranges_[depth];
+}
+
+bool PlanetTerrain::isCulled(const Node& node) const
+{
+   vec3 lower = vec3(dvec3(node.lower) - eye_);
+   vec3 upper = vec3(dvec3(node.upper) - eye_);
+   for (int i = 0; i < 6; i++)
+   {
+      vec3 normal(planes_[i]);
+      vec3 farthest(normal.x > 0.0f ? upper.x : lower.x, normal.y > 0.0f ? upper.y : lower.y,
+         normal.z > 0.0f ? upper.z : lower.z);
+      if (dot(normal, farthest) + planes_[i].w < 0.0f)
+         return true;
+   }
+
+   // behind the horizon of the sea level sphere: every corner inside the
+   // cone it shadows and beyond the plane of its horizon
+   double limb = dot(eye_, eye_) - 1.0;
+   if (limb <= 0.0)
+      return false;
+   for (int i = 0; i < 8; i++)
+   {
+      dvec3 corner(i & 1 ? node.upper.x : node.lower.x, i & 2 ? node.upper.y : node.lower.y,
+         i & 4 ? node.upper.z : node.lower.z);
+      dvec3 toCorner = corner - eye_;
+      double along = -dot(toCorner, eye_);
+      if (along <= limb || along * along / dot(toCorner, toCorner) <= limb)
+         return false;
+   }
+   return true;
+}
+
+// returns false if the node is out of its range, so its parent has to
+// cover it; true if it or its children took care of it
+bool PlanetTerrain::select(int index)
+{
+   nodes_[index].lastVisited = frame_;
+   int depth = nodes_[index].depth;
+   if (depth > 0 && !isInRange(nodes_[index], depth))
+      return false;
+   if (isCulled(nodes_[index]))
+      return true;
+
+   chunks_[nodes_[index].chunk].lastUsed = frame_;
+   if (depth == TERRAIN_MAX_DEPTH || !isInRange(nodes_[index], depth + 1))
+   {
+      draw(index, 15);
+      return true;
+   }
+
+   if (nodes_[index].children < 0)
+      split(index);
+
+   // this node draws the quadrants out of its children's range, and those
+   // whose chunk is not resident yet
+   int quadrants = 0;
+   for (int q = 0; q < 4; q++)
+   {
+      int child = nodes_[index].children + q;
+      int chunk = nodes_[child].chunk;
+      if (chunk >= 0 && chunks_[chunk].state == CHUNK_RESIDENT)
+      {
+         if (!select(child) && !isCulled(nodes_[child]))
+            quadrants |= 1 << q;
+         continue;
+      }
+
+      nodes_[child].lastVisited = frame_;
+      if (isCulled(nodes_[child]))
+         continue;
+      if (isInRange(nodes_[child], depth + 1))
+         request(child);
+      quadrants |= 1 << q;
+   }
+   if (quadrants)
+      draw(index, quadrants);
+   return true;
+}
+
+void PlanetTerrain::draw(int index, int quadrants)
+{
+   const Node& node = nodes_[index];
+   const Chunk& chunk = chunks_[node.chunk];
+   TerrainDraw draw;
+   draw.chunk = node.chunk;
+   draw.quadrants = quadrants;
+   draw.offset = vec3(chunk.origin - eye_);
+   draw.morphRange = vec2(MORPH_START * ranges_[node.depth], ranges_[node.depth]);
+   draws.push_back(draw);
+}
+
+// coarse levels first, since they stand in for everything below them,
+// then the nearest
+void PlanetTerrain::request(int index)
+{
+   const Node& node = nodes_[index];
+   if (node.chunk >= 0)
+      return;
+   dvec3 nearest = clamp(eye_, dvec3(node.lower), dvec3(node.upper));
+   float distance = float(length(nearest - eye_)) / ranges_[node.depth];
+   requests_.push_back(std::make_pair(float(node.depth) + std::min(distance, 0.99f), index));
+}
+
+// a free chunk, or the least recently used one that is not a root's and
+// was not needed this frame
+int PlanetTerrain::allocateChunk()
+{
+   int oldest = -1;
+   for (int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+   {
+      const Chunk& chunk = chunks_[i];
+      if (chunk.state == CHUNK_FREE)
+         return i;
+      if (chunk.state == CHUNK_RESIDENT && chunk.lastUsed < frame_ && nodes_[chunk.node].depth > 0 &&
+         (oldest < 0 || chunk.lastUsed < chunks_[oldest].lastUsed))
+         oldest = i;
+   }
+   if (oldest >= 0)
+   {
+      nodes_[chunks_[oldest].node].chunk = -1;
+      chunks_[oldest].node = -1;
+      chunks_[oldest].state = CHUNK_FREE;
+   }
+   return oldest;
+}
+
+void PlanetTerrain::startBuilds()
+{
+   bool isAsync = JobThreadCount() > 1;
+   int budget = isAsync ? BUILDS_PER_WORKER * JobThreadCount() - inFlight_ : SYNC_BUILDS_PER_FRAME;
+   if (budget <= 0 || requests_.empty())
+      return;
+
+   std::sort(requests_.begin(), requests_.end());
+   for (size_t i = 0; i < requests_.size() && budget > 0; i++)
+   {
+      int index = requests_[i].second;
+      if (nodes_[index].chunk >= 0)
+         continue;
+      int chunk = allocateChunk();
+      if (chunk < 0)
+         break;
+
+      Node& node = nodes_[index];
+      node.chunk = chunk;
+      chunks_[chunk].node = index;
+      chunks_[chunk].state = CHUNK_BUILDING;
+      chunks_[chunk].lastUsed = frame_;
+      inFlight_++;
+      budget--;
+
+      int face = node.face;
+      int depth = node.depth;
+      int x = node.x;
+      int y = node.y;
+      if (isAsync)
+         RunJob("terrain chunk", [=]() { buildChunk(chunk, face, depth, x, y); }, &building_);
+      else
+         buildChunk(chunk, face, depth, x, y);
+   }
+}
+
+// runs as a job; only touches the chunk's mesh and bounds until it hands
+// the chunk over through built_
+void PlanetTerrain::buildChunk(int index, int face, int depth, int x, int y)
+{
+   const int n = TERRAIN_GRID - 1;
+   const int side = TERRAIN_GRID + 2;
+   int size = n << depth;
+   Chunk& chunk = chunks_[index];
+
+   // surface points with a border of one for the normals; (2k - size) /
+   // size is exact, so neighbouring chunks, on other faces too, place the
+   // vertices they share identically
+   std::vector<dvec3> points(side * side);
+   for (int j = 0; j < side; j++)
+   {
+      double t = double(2 * (y * n + j - 1) - size) / size;
+      for (int i = 0; i < side; i++)
+      {
+         double s = double(2 * (x * n + i - 1) - size) / size;
+         dvec3 dir = normalize(CubeSphereDirection(face, s, t));
+         points[j * side + i] = dir * (1.0 + heights.height(dir));
+      }
+   }
+   double middle = double(2 * (x * n + n / 2) - size) / size;
+   double centre = double(2 * (y * n + n / 2) - size) / size;
+   chunk.origin = normalize(CubeSphereDirection(face, middle, centre));
+
+   std::vector<dvec3> normals(TERRAIN_GRID * TERRAIN_GRID);
+   dvec3 lower(DBL_MAX);
+   dvec3 upper(-DBL_MAX);
+   for (int j = 0; j < TERRAIN_GRID; j++)
+   {
+      for (int i = 0; i < TERRAIN_GRID; i++)
+      {
+         const dvec3* p = &points[(j + 1) * side + i + 1];
+         normals[j * TERRAIN_GRID + i] = normalize(cross(p[1] - p[-1], p[side] - p[-side]));
+         lower = min(lower, *p);
+         upper = max(upper, *p);
+      }
+   }
+   chunk.lower = vec3(lower);
+   chunk.upper = vec3(upper);
+
+   // odd vertices morph to the middle of the parent's edge or diagonal
+   // they lie on; the diagonal is the one the index buffer cuts cells by
+   chunk.vertices.resize(TERRAIN_GRID * TERRAIN_GRID);
+   for (int j = 0; j < TERRAIN_GRID; j++)
+   {
+      for (int i = 0; i < TERRAIN_GRID; i++)
+      {
+         int a = j * TERRAIN_GRID + i;
+         int b = a;
+         if (i % 2 && j % 2)
+         {
+            a = (j - 1) * TERRAIN_GRID + i + 1;
+            b = (j + 1) * TERRAIN_GRID + i - 1;
+         }
+         else if (i % 2)
+         {
+            a--;
+            b++;
+         }
+         else if (j % 2)
+         {
+            a -= TERRAIN_GRID;
+            b += TERRAIN_GRID;
+         }
+
+         int k = j * TERRAIN_GRID + i;
+         dvec3 point = points[(j + 1) * side + i + 1];
+         dvec3 coarse = 0.5 * (points[(a / TERRAIN_GRID + 1) * side + a % TERRAIN_GRID + 1] +
+            points[(b / TERRAIN_GRID + 1) * side + b % TERRAIN_GRID + 1]);
+         TerrainVertex& vertex = chunk.vertices[k];
+         vertex.position = vec3(point - chunk.origin);
+         vertex.normal = vec3(normals[k]);
+         vertex.morphOffset = vec3(coarse - point);
+         vertex.morphNormal = vec3(normalize(normals[a] + normals[b]));
+      }
+   }
+
+   std::lock_guard<std::mutex> lock(builtMutex_);
+   built_.push_back(index);
+}
+
+void PlanetTerrain::collectBuilt()
+{
+   std::lock_guard<std::mutex> lock(builtMutex_);
+   for (size_t i = 0; i < built_.size(); i++)
+   {
+      chunks_[built_[i]].state = CHUNK_BUILT;
+      uploads_.push_back(built_[i]);
+      inFlight_--;
+      buildCount_++;
+   }
+   built_.clear();
+}
+
+int PlanetTerrain::nextUpload()
+{
+   if (uploads_.empty())
+      collectBuilt();
+   if (uploads_.empty())
+      return -1;
+
+   // the coarsest first, they are the ones standing in for the rest
+   std::vector<int>::iterator next = std::min_element(uploads_.begin(), uploads_.end(),
+      [this](int a, int b) { return nodes_[chunks_[a].node].depth < nodes_[chunks_[b].node].depth; });
+   int chunk = *next;
+   uploads_.erase(next);
+   return chunk;
+}
+
+const std::vector<TerrainVertex>& PlanetTerrain::chunkVertices(int chunk) const
+{
+   return chunks_[chunk].vertices;
+}
+
+void PlanetTerrain::finishUpload(int index)
+{
+   Chunk& chunk = chunks_[index];
+   chunk.state = CHUNK_RESIDENT;
+   chunk.lastUsed = frame_;
+   std::vector<TerrainVertex>().swap(chunk.vertices);
+
+   // the built mesh bounds the node far more tightly than the guess
+   Node& node = nodes_[chunk.node];
+   node.lower = chunk.lower;
+   node.upper = chunk.upper;
+}
+
+int PlanetTerrain::residentCount() const
+{
+   int count = 0;
+   for (int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+      count += chunks_[i].state == CHUNK_RESIDENT;
+   return count;
+}
+
+void PlanetTerrain::gridIndices(std::vector<unsigned int>& indices)
+{
+   const int n = TERRAIN_GRID - 1;
+   const int half = n / 2;
+   indices.clear();
+   indices.reserve(4 * TERRAIN_QUADRANT_INDICES);
+   for (int q = 0; q < 4; q++)
+   {
+      int x0 = (q & 1) * half;
+      int y0 = (q >> 1) * half;
+      for (int j = y0; j < y0 + half; j++)
+      {
+         for (int i = x0; i < x0 + half; i++)
+         {
+            unsigned int p00 = j * TERRAIN_GRID + i;
+            unsigned int p01 = p00 + 1;
+            unsigned int p10 = p00 + TERRAIN_GRID;
+            unsigned int p11 = p10 + 1;
+            unsigned int cell[6] = { p00, p01, p10, p10, p01, p11 };
+            indices.insert(indices.end(), cell, cell + 6);
+         }
+      }
+   }
+}
+
+// --------------------------------------------------------------------------
+// Benchmark
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   return elapsed.count();
+}
+
+void BenchmarkTerrain(int frames)
+{
+   PlanetTerrain terrain;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   terrain.initialize();
+   int chunk;
+   while ((chunk = terrain.nextUpload()) >= 0)
+      terrain.finishUpload(chunk);
+   double initializeTime = millisecondsSince(start);
+
+   // straight down from four radii to just above the ground, the altitude
+   // falling geometrically, then holding there while the planet turns
+   dvec3 down = normalize(dvec3(0.3, 0.8, 0.5));
+   double ground = 1.0 + terrain.heights.height(down);
+   double highest = 3.0;
+   double lowest = 1e-4;
+   int descent = std::max(frames / 2, 1);
+   double slowest = 0.0;
+   double total = 0.0;
+   double building = 0.0;
+   size_t drawCount = 0;
+   for (int frame = 0; frame < frames; frame++)
+   {
+      double f = std::min(frame / double(descent), 1.0);
+      double altitude = highest * std::pow(lowest / highest, f);
+      dvec3 dir = down;
+      if (frame > descent)
+      {
+         double angle = 1e-4 * (frame - descent);
+         dir = normalize(dvec3(down.x * std::cos(angle) - down.z * std::sin(angle), down.y,
+            down.x * std::sin(angle) + down.z * std::cos(angle)));
+      }
+      dvec3 eye = dir * (ground + altitude);
+
+      // looking at the centre, the near plane at half the altitude
+      float nearPlane = float(std::min(0.5 * altitude, 0.1));
+      mat4 proj = perspective(radians(80.0f), 1.0f, nearPlane, 1000.0f);
+      mat4 view = lookAt(vec3(0.0f), vec3(-dir), abs(dir.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0));
+
+      start = std::chrono::steady_clock::now();
+      terrain.update(eye, proj * view);
+      while ((chunk = terrain.nextUpload()) >= 0)
+         terrain.finishUpload(chunk);
+      double time = millisecondsSince(start);
+      total += time;
+      slowest = std::max(slowest, time);
+      drawCount += terrain.draws.size();
+
+      // the workers get the rest of the frame, here they get to finish
+      start = std::chrono::steady_clock::now();
+      terrain.waitForBuilds();
+      building += millisecondsSince(start);
+   }
+
+   printf("terrain: roots %.2f ms; %d frames from orbit to %.0e radii on %d threads\n",
+      initializeTime, frames, lowest, JobThreadCount());
+   printf("update %.3f ms average, %.3f ms worst (chunks are built in it without workers), "
+      "%.0f draws average\n", total / frames, slowest, double(drawCount) / frames);
+   printf("%d chunks built, %.3f ms each waiting for workers, %d resident, %d nodes\n",
+      terrain.buildCount(), building / std::max(terrain.buildCount(), 1), terrain.residentCount(),
+      terrain.nodeCount());
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "glm/glm.hpp"
+#include "jobs.h"
+
+using namespace glm;
+
+// Heights of a planet's surface over the sphere of radius 1, in radii. A
+// base map (a heightmap, or a land mask made from the surface texture)
+// scales fractal noise, which carries the detail far below the map's
+// resolution. Only read once chunks are being built, so it is safe to
+// sample from any thread.
+class HeightField{
+public:
+   float scale;   // highest height, in radii
+
+   HeightField();
+
+   // equirectangular greyscale heightmap, white the highest; loaded with
+   // the same vertical flip as the textures
+   bool loadHeightMap(const char* filename);
+
+   // land wherever the pixel is not mostly blue, for a surface texture with
+   // the same layout; ignored once a heightmap is loaded
+   void setLandMask(const unsigned char* pixels, int width, int height, int components);
+
+   // height along the unit direction dir
+   double height(const dvec3& dir) const;
+
+private:
+   float base(const dvec3& dir) const;
+
+   std::vector<unsigned char> map_;
+   int width_;
+   int height_;
+   bool isHeightMap_;
+};
+
+// Chunks are square grids of TERRAIN_GRID vertices a side; the finest have
+// TERRAIN_MAX_DEPTH splits of the cube face above them.
+const int TERRAIN_GRID = 33;
+const int TERRAIN_MAX_DEPTH = 14;
+const int TERRAIN_MAX_CHUNKS = 512;
+
+// triangles of a chunk are ordered by quadrant, so a quadrant is drawn as
+// TERRAIN_QUADRANT_INDICES indices from q times that
+const int TERRAIN_QUADRANT_INDICES = 6 * (TERRAIN_GRID - 1) * (TERRAIN_GRID - 1) / 4;
+
+// vertex of a chunk; positions are relative to the chunk's origin
+struct TerrainVertex
+{
+   vec3 position;
+   vec3 normal;
+   vec3 morphOffset;    // to the vertex's place on the parent's coarser grid
+   vec3 morphNormal;    // the normal there
+};
+
+// a node, or some of its quadrants, to draw this frame
+struct TerrainDraw
+{
+   int chunk;           // chunk slot holding its mesh
+   int quadrants;       // bit q draws quadrant q
+   vec3 offset;         // chunk origin minus the eye
+   vec2 morphRange;     // eye distances where morphing starts and ends
+};
+
+// Cube-sphere quadtree terrain with continuous LOD, after CDLOD: every
+// node is a chunk mesh displaced by the height field, chosen by distance
+// ranges that double per level, culled against the frustum and the
+// horizon, and morphed towards its parent's grid towards the end of its
+// range so levels meet without cracks or pops. Chunk meshes are built as
+// jobs and reach the renderer through nextUpload(); until a node's chunk
+// is resident its parent draws that quadrant. Everything is in the
+// planet's object space, radius 1.
+class PlanetTerrain{
+public:
+   HeightField heights;
+   std::vector<TerrainDraw> draws;   // filled by update()
+
+   PlanetTerrain();
+   ~PlanetTerrain();
+
+   // builds the six root chunks, which stay resident
+   void initialize();
+
+   // selects this frame's draws for an eye at eye, and queues the chunks
+   // it is missing; eyeViewProj takes positions relative to the eye to
+   // clip space, which keeps precision right down at the surface
+   void update(dvec3 eye, const mat4& eyeViewProj);
+
+   // a chunk whose mesh is built and waits for upload, or -1; once its
+   // vertices are copied finishUpload() makes it drawable
+   int nextUpload();
+   const std::vector<TerrainVertex>& chunkVertices(int chunk) const;
+   void finishUpload(int chunk);
+
+   // runs queued chunk builds on this thread until none is left
+   void waitForBuilds() { WaitForCounter(&building_); }
+
+   // index buffer shared by every chunk
+   static void gridIndices(std::vector<unsigned int>& indices);
+
+   int nodeCount() const { return int(nodes_.size() - freeBlocks_.size() * 4); }
+   int residentCount() const;
+   int buildCount() const { return buildCount_; }
+
+private:
+   struct Node
+   {
+      int face;
+      int depth;
+      int x;            // position in the face's grid of 2^depth nodes
+      int y;
+      vec3 lower;       // bounds, conservative until the chunk is built
+      vec3 upper;
+      int children;     // first of four, or -1
+      int chunk;        // slot of its mesh, or -1
+      int lastVisited;
+   };
+
+   enum ChunkState { CHUNK_FREE, CHUNK_BUILDING, CHUNK_BUILT, CHUNK_RESIDENT };
+
+   struct Chunk
+   {
+      int node;
+      ChunkState state;
+      int lastUsed;
+      dvec3 origin;
+      vec3 lower;
+      vec3 upper;
+      std::vector<TerrainVertex> vertices;
+   };
+
+   PlanetTerrain(const PlanetTerrain&);
+   PlanetTerrain& operator=(const PlanetTerrain&);
+
+   int addNode(int face, int depth, int x, int y);
+   void split(int node);
+   void prune();
+   bool select(int node);
+   void draw(int node, int quadrants);
+   bool isCulled(const Node& node) const;
+   bool isInRange(const Node& node, int depth) const;
+   void request(int node);
+   void startBuilds();
+   void boundNode(Node& node) const;
+   int allocateChunk();
+   void buildChunk(int chunk, int face, int depth, int x, int y);
+   void collectBuilt();
+
+   std::vector<Node> nodes_;
+   std::vector<int> freeBlocks_;      // child blocks of pruned nodes
+   std::vector<Chunk> chunks_;
+   std::vector<std::pair<float, int> > requests_;  // priority, node missing a chunk
+   std::vector<int> uploads_;         // built chunks not yet uploaded
+   std::vector<float> ranges_;        // node depth to the range it is drawn in
+   int roots_[6];
+   int frame_;
+   int buildCount_;
+   int inFlight_;
+
+   dvec3 eye_;
+   vec4 planes_[6];
+
+   // chunks the jobs have finished, collected on the next update()
+   std::mutex builtMutex_;
+   std::vector<int> built_;
+   JobCounter building_;
+};
+
+// times LOD selection and chunk building on a descent from orbit to the
+// surface over the given number of frames
+void BenchmarkTerrain(int frames);
@@ -0,0 +1,43 @@
+// ==========================================================================
+// Vertex program for the planet terrain chunks, drawn with fragment.glsl
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// InitializeTerrain() function of the main program
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec3 VertexNormal;
+layout(location = 2) in vec3 MorphOffset;
+layout(location = 3) in vec3 MorphNormal;
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Normal;
+out vec3 VertNormal;
+out vec3 Position;
+
+// positions are taken relative to the eye in the planet's object space, so
+// they stay precise right down at the surface
+uniform mat4 eyeViewProj;   // from there to clip space
+uniform mat4 model;
+uniform mat4 normalMatrix;  // inverse transpose of model
+uniform vec3 eye;           // in world space
+uniform vec3 eyeObject;     // in object space
+
+// per chunk: its origin relative to the eye, and the eye distances over
+// which its vertices morph onto the parent's grid
+uniform vec3 chunkOffset;
+uniform vec2 morphRange;
+
+void main()
+{
+    vec3 relative = chunkOffset + VertexPosition;
+    float morph = clamp((length(relative) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    relative += morph * MorphOffset;
+    vec3 normal = normalize(mix(VertexNormal, MorphNormal, morph));
+
+    gl_Position = eyeViewProj * vec4(relative, 1.0);
+
+    Normal = normalize(mat3(normalMatrix) * normal);
+    VertNormal = normalize(eyeObject + relative);
+    Position = eye + mat3(model) * relative;
+}
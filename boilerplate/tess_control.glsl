@@ -0,0 +1,52 @@
+// ==========================================================================
+// Tessellation control program for the tessellated sphere
+//
+// Chooses per-edge tessellation levels from the screen-space size of each
+// icosahedron edge, so close bodies get smooth silhouettes and far away
+// bodies stay at the bare 20 triangles
+// ==========================================================================
+#version 410
+
+layout(vertices = 3) out;
+
+in vec3 ControlPosition[];
+out vec3 EvaluationPosition[];
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 proj;
+
+uniform vec2 viewport;       // viewport size in pixels
+uniform float edgePixels;    // desired length of a tessellated edge in pixels
+
+// tessellation level for the edge between two corners, computed only from
+// the (unordered) pair of corners so neighbouring patches agree on it
+float edgeLevel(vec3 a, vec3 b)
+{
+    vec4 p0 = model * vec4(a, 1.0);
+    vec4 p1 = model * vec4(b, 1.0);
+
+    // project a sphere enclosing the edge rather than the edge itself, which
+    // keeps the level independent of the edge's orientation on screen
+    float diameter = distance(p0.xyz, p1.xyz);
+    vec4 centre = view * (0.5 * (p0 + p1));
+    float depth = max(-centre.z, 0.1);
+    float pixels = diameter * proj[1][1] * 0.5 * viewport.y / depth;
+
+    return clamp(pixels / edgePixels, 1.0, 64.0);
+}
+
+void main()
+{
+    EvaluationPosition[gl_InvocationID] = ControlPosition[gl_InvocationID];
+
+    if (gl_InvocationID == 0)
+    {
+        // outer level i is the edge opposite corner i
+        gl_TessLevelOuter[0] = edgeLevel(ControlPosition[1], ControlPosition[2]);
+        gl_TessLevelOuter[1] = edgeLevel(ControlPosition[2], ControlPosition[0]);
+        gl_TessLevelOuter[2] = edgeLevel(ControlPosition[0], ControlPosition[1]);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[0],
+                                   max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+    }
+}
@@ -0,0 +1,34 @@
+// ==========================================================================
+// Tessellation evaluation program for the tessellated sphere
+//
+// Projects the tessellated icosahedron onto the unit sphere and produces the
+// same outputs as vertex.glsl for the shared fragment program
+// ==========================================================================
+#version 410
+
+layout(triangles, fractional_odd_spacing, ccw) in;
+
+in vec3 EvaluationPosition[];
+
+out vec3 Normal;
+out vec3 VertNormal;
+out vec3 Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 proj;
+uniform mat4 mvp;
+uniform mat4 normalMatrix;
+
+void main()
+{
+    vec3 position = normalize(gl_TessCoord.x * EvaluationPosition[0] +
+                              gl_TessCoord.y * EvaluationPosition[1] +
+                              gl_TessCoord.z * EvaluationPosition[2]);
+
+    gl_Position = mvp*vec4(position, 1.0);
+
+    Normal = normalize(mat3(normalMatrix)*position);
+    VertNormal = position;
+    Position = (model * vec4(position, 1)).xyz;
+}
@@ -0,0 +1,16 @@
+// ==========================================================================
+// Vertex program for the tessellated sphere
+//
+// Passes the coarse icosahedron corners through in object space, all of
+// the transformation work happens after tessellation
+// ==========================================================================
+#version 410
+
+layout(location = 0) in vec3 VertexPosition;
+
+out vec3 ControlPosition;
+
+void main()
+{
+    ControlPosition = VertexPosition;
+}
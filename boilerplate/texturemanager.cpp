@@ -0,0 +1,391 @@
+#include "texturemanager.h"
+#include "jpegdecode.h"
+#include "resample.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stb_image.h>
+
+using namespace std;
+
+// a texture is reloaded coarser once it is drawn this many levels smaller
+// than it is resident, not sooner, so it does not flip back and forth
+const int SHRINK_LEVELS = 2;
+
+// images larger than the GPU takes are fitted to it with the sharpest
+// filter; mips are filtered softer, as each is filtered from the last
+const ResampleFilter FIT_FILTER = RESAMPLE_LANCZOS3;
+const ResampleFilter MIP_FILTER = RESAMPLE_MITCHELL;
+
+// fills in the mip chain below an image's finest level, each level
+// filtered from the one above in linear light
+static void buildMips(TextureImage* image)
+{
+   while (image->mipWidth(int(image->mips.size()) - 1) > 1 || image->mipHeight(int(image->mips.size()) - 1) > 1)
+   {
+      int mip = int(image->mips.size()) - 1;
+      vector<unsigned char> half(size_t(image->mipWidth(mip + 1)) * image->mipHeight(mip + 1) * image->components);
+      ResampleImage(image->mips[mip].data(), image->mipWidth(mip), image->mipHeight(mip), image->components,
+         half.data(), image->mipWidth(mip + 1), image->mipHeight(mip + 1), MIP_FILTER, true);
+      image->mips.push_back(half);
+   }
+}
+
+static string thumbnailFile(const string& filename)
+{
+   return filename + ".thumb";
+}
+
+// the bytes of a file, from the asset pack if it is packed; null if it
+// could not be read
+static const unsigned char* readAsset(const AssetPack* assets, const string& filename, size_t* size,
+   vector<unsigned char>* buffer)
+{
+   const unsigned char* bytes = assets ? assets->load(filename, size, buffer) : 0;
+   if (bytes)
+      return bytes;
+   ifstream file(filename.c_str(), ios::binary);
+   if (!file)
+      return 0;
+   buffer->assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+   *size = buffer->size();
+   return buffer->data();
+}
+
+// reads an image's cached thumbnail, which has to be of the given level
+// of the image's size
+static bool readThumbnail(const AssetPack* assets, const string& filename, int width, int height, int level,
+   TextureImage* image)
+{
+   vector<unsigned char> buffer;
+   size_t size;
+   const unsigned char* bytes = readAsset(assets, thumbnailFile(filename), &size, &buffer);
+   ThumbnailHeader header;
+   if (!bytes || size < sizeof(header))
+      return false;
+   memcpy(&header, bytes, sizeof(header));
+   if (memcmp(header.magic, "THMB", 4) != 0 || header.level != level ||
+      header.components < 1 || header.components > 4 ||
+      header.width != std::max(width >> header.level, 1) || header.height != std::max(height >> header.level, 1) ||
+      size - sizeof(header) < size_t(header.width) * header.height * header.components)
+      return false;
+
+   const unsigned char* pixels = bytes + sizeof(header);
+   image->mips.assign(1, vector<unsigned char>(pixels, pixels + size_t(header.width) * header.height * header.components));
+   image->width = header.width;
+   image->height = header.height;
+   image->components = header.components;
+   image->level = header.level;
+   buildMips(image);
+   return true;
+}
+
+// writes the thumbnail out of the mip chain of an image decoded at full
+// resolution, returning true if successful
+static bool writeThumbnail(const string& filename, const TextureImage& image)
+{
+   int mip = 0;
+   while (std::max(image.mipWidth(mip), image.mipHeight(mip)) > THUMBNAIL_SIZE)
+      mip++;
+
+   ThumbnailHeader header;
+   memcpy(header.magic, "THMB", 4);
+   header.width = image.mipWidth(mip);
+   header.height = image.mipHeight(mip);
+   header.components = image.components;
+   header.level = image.level + mip;
+   ofstream file(thumbnailFile(filename).c_str(), ios::binary);
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   file.write(reinterpret_cast<const char*>(image.mips[mip].data()), image.mips[mip].size());
+   return bool(file);
+}
+
+TextureManager::TextureManager()
+   : budget(size_t(32) << 20)
+   , maxSize(0)
+   , assets(0)
+   , residentBytes_(0)
+   , loadingBytes_(0)
+   , frame_(0)
+{}
+
+TextureManager::~TextureManager()
+{
+   waitForLoads();
+}
+
+int TextureManager::acquire(const string& filename)
+{
+   for (size_t i = 0; i < textures_.size(); i++)
+   {
+      if (textures_[i].filename == filename)
+      {
+         textures_[i].refs++;
+         return int(i);
+      }
+   }
+
+   // only the header is read now, for the size the budget needs
+   Texture texture;
+   texture.filename = filename;
+   texture.refs = 1;
+   int components;
+   vector<unsigned char> buffer;
+   size_t size;
+   const unsigned char* bytes = assets ? assets->load(filename, &size, &buffer) : 0;
+   if (bytes ? !stbi_info_from_memory(bytes, int(size), &texture.width, &texture.height, &components) :
+      !stbi_info(filename.c_str(), &texture.width, &texture.height, &components))
+   {
+      cout << "ERROR: Could not load image " << filename << endl;
+      texture.width = texture.height = 0;
+   }
+   FitImageSize(texture.width, texture.height, maxSize, &texture.width, &texture.height);
+   texture.lastUsed = -1;
+   texture.pixels = 0.0f;
+   texture.residentLevel = -1;
+   texture.loadingLevel = -1;
+
+   // the thumbnail goes up first, standing in while the image decodes
+   if (texture.width > 0 &&
+      readThumbnail(assets, filename, texture.width, texture.height, coarsestLevel(texture), &texture.image))
+   {
+      texture.loadingLevel = texture.image.level;
+      loadingBytes_ += levelBytes(texture, texture.loadingLevel);
+      uploads_.push_back(int(textures_.size()));
+   }
+   textures_.push_back(texture);
+   return int(textures_.size() - 1);
+}
+
+void TextureManager::release(int texture)
+{
+   textures_[texture].refs--;
+}
+
+void TextureManager::use(int index, float pixels)
+{
+   Texture& texture = textures_[index];
+   if (texture.lastUsed != frame_)
+      texture.pixels = 0.0f;
+   texture.lastUsed = frame_;
+   texture.pixels = std::max(texture.pixels, pixels);
+}
+
+int TextureManager::coarsestLevel(const Texture& texture) const
+{
+   int level = 0;
+   while (std::max(texture.width, texture.height) >> level > THUMBNAIL_SIZE)
+      level++;
+   return level;
+}
+
+int TextureManager::wantedLevel(const Texture& texture) const
+{
+   // a sphere shows the width of its texture around its circumference,
+   // pi times the pixels across it
+   float texels = 3.14159265f * texture.pixels;
+   if (texels >= float(texture.width))
+      return 0;
+   int level = int(floor(log2(float(texture.width) / std::max(texels, 1.0f))));
+   return std::min(level, coarsestLevel(texture));
+}
+
+size_t TextureManager::levelBytes(const Texture& texture, int level) const
+{
+   size_t texels = size_t(std::max(texture.width >> level, 1)) * size_t(std::max(texture.height >> level, 1));
+   return texels * 4 * 4 / 3;
+}
+
+void TextureManager::update()
+{
+   collectLoaded();
+
+   vector<int> requests;
+   for (size_t i = 0; i < textures_.size(); i++)
+   {
+      Texture& texture = textures_[i];
+      if (texture.refs <= 0 && texture.residentLevel >= 0 && texture.loadingLevel < 0)
+      {
+         evict(int(i));
+         continue;
+      }
+      if (texture.lastUsed != frame_ || texture.width == 0 || texture.loadingLevel >= 0)
+         continue;
+
+      int wanted = wantedLevel(texture);
+      if (texture.residentLevel < 0 || texture.residentLevel > wanted)
+         requests.push_back(int(i));
+      else if (texture.residentLevel + SHRINK_LEVELS <= wanted)
+         startLoad(int(i), wanted);
+   }
+
+   // textures with nothing resident first, then the largest on screen
+   std::sort(requests.begin(), requests.end(), [this](int a, int b) {
+      const Texture& textureA = textures_[a];
+      const Texture& textureB = textures_[b];
+      if ((textureA.residentLevel < 0) != (textureB.residentLevel < 0))
+         return textureA.residentLevel < 0;
+      return textureA.pixels > textureB.pixels;
+   });
+   for (size_t i = 0; i < requests.size(); i++)
+   {
+      const Texture& texture = textures_[requests[i]];
+      int level = wantedLevel(texture);
+      int coarsest = coarsestLevel(texture);
+      size_t replaced = texture.residentLevel >= 0 ? levelBytes(texture, texture.residentLevel) : 0;
+
+      // the level it wants if there is room or room can be made, else
+      // the finest that fits
+      while (residentBytes_ + loadingBytes_ + levelBytes(texture, level) > budget + replaced)
+      {
+         if (evictOldest())
+            continue;
+         if (level == coarsest)
+            break;
+         level++;
+      }
+      bool isFitting = residentBytes_ + loadingBytes_ + levelBytes(texture, level) <= budget + replaced;
+      bool isFiner = texture.residentLevel < 0 || level < texture.residentLevel;
+      if ((isFitting || texture.residentLevel < 0) && isFiner)
+         startLoad(requests[i], level);
+   }
+   frame_++;
+}
+
+bool TextureManager::evictOldest()
+{
+   int oldest = -1;
+   for (size_t i = 0; i < textures_.size(); i++)
+   {
+      const Texture& texture = textures_[i];
+      if (texture.residentLevel >= 0 && texture.loadingLevel < 0 && texture.lastUsed < frame_ &&
+         (oldest < 0 || texture.lastUsed < textures_[oldest].lastUsed))
+         oldest = int(i);
+   }
+   if (oldest < 0)
+      return false;
+   evict(oldest);
+   return true;
+}
+
+void TextureManager::evict(int index)
+{
+   Texture& texture = textures_[index];
+   residentBytes_ -= levelBytes(texture, texture.residentLevel);
+   texture.residentLevel = -1;
+   evictions_.push_back(index);
+}
+
+void TextureManager::startLoad(int index, int level)
+{
+   Texture& texture = textures_[index];
+   texture.loadingLevel = level;
+   loadingBytes_ += levelBytes(texture, level);
+
+   // without workers the decode runs here, nothing else would run it
+   string filename = texture.filename;
+   const AssetPack* pack = assets;
+   int width = texture.width, height = texture.height;
+   std::function<void()> decode = [=]() {
+      TextureImage image;
+      vector<unsigned char> buffer;
+      size_t size;
+      const unsigned char* bytes = pack ? pack->load(filename, &size, &buffer) : 0;
+      unsigned char* data = bytes ?
+         DecodeImageParallel(bytes, size, &image.width, &image.height, &image.components) :
+         LoadImageParallel(filename.c_str(), &image.width, &image.height, &image.components);
+      if (data)
+      {
+         image.mips.push_back(vector<unsigned char>(size_t(width) * height * image.components));
+         if (image.width != width || image.height != height)
+         {
+            ResampleImage(data, image.width, image.height, image.components, image.mips[0].data(), width, height,
+               FIT_FILTER, true);
+            image.width = width;
+            image.height = height;
+         }
+         else
+         {
+            memcpy(image.mips[0].data(), data, image.mips[0].size());
+         }
+         stbi_image_free(data);
+         buildMips(&image);
+
+         // a packed image comes with its thumbnail, if it ever will
+         if (!bytes && !ifstream(thumbnailFile(filename).c_str()))
+            writeThumbnail(filename, image);
+
+         // only the chain from the level wanted down is kept
+         image.mips.erase(image.mips.begin(), image.mips.begin() + level);
+         image.width = image.mipWidth(level);
+         image.height = image.mipHeight(level);
+         image.level = level;
+      }
+      else
+      {
+         cout << "ERROR: Could not load image " << filename << endl;
+      }
+
+      std::lock_guard<std::mutex> lock(loadedMutex_);
+      loaded_.push_back(std::make_pair(index, image));
+   };
+   if (JobThreadCount() > 1)
+      RunJob("decode texture", decode, &loading_);
+   else
+      decode();
+}
+
+void TextureManager::collectLoaded()
+{
+   std::lock_guard<std::mutex> lock(loadedMutex_);
+   for (size_t i = 0; i < loaded_.size(); i++)
+   {
+      int index = loaded_[i].first;
+      Texture& texture = textures_[index];
+      if (loaded_[i].second.mips.empty())
+      {
+         // a file that stopped decoding is not tried again
+         loadingBytes_ -= levelBytes(texture, texture.loadingLevel);
+         texture.loadingLevel = -1;
+         texture.width = texture.height = 0;
+         continue;
+      }
+      std::swap(texture.image, loaded_[i].second);
+      uploads_.push_back(index);
+   }
+   loaded_.clear();
+}
+
+int TextureManager::nextUpload()
+{
+   if (uploads_.empty())
+      collectLoaded();
+   if (uploads_.empty())
+      return -1;
+   int texture = uploads_.front();
+   uploads_.erase(uploads_.begin());
+   return texture;
+}
+
+void TextureManager::finishUpload(int index)
+{
+   Texture& texture = textures_[index];
+   if (texture.residentLevel >= 0)
+      residentBytes_ -= levelBytes(texture, texture.residentLevel);
+   loadingBytes_ -= levelBytes(texture, texture.loadingLevel);
+   texture.residentLevel = texture.loadingLevel;
+   texture.loadingLevel = -1;
+   residentBytes_ += levelBytes(texture, texture.residentLevel);
+   texture.image = TextureImage();
+}
+
+int TextureManager::nextEviction()
+{
+   if (evictions_.empty())
+      return -1;
+   int texture = evictions_.back();
+   evictions_.pop_back();
+   return texture;
+}
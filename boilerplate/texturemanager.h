@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "assetpack.h"
+#include "jobs.h"
+
+// pixels of a texture decoded on the CPU at some level of its file's
+// resolution, with their mip chain down to 1x1, waiting to be uploaded
+struct TextureImage
+{
+   std::vector<std::vector<unsigned char> > mips;   // finest first
+   int width;         // of the finest
+   int height;
+   int components;
+   int level;         // of the finest, in halvings of the file's full resolution
+
+   TextureImage() : width(0), height(0), components(0), level(0)
+   {}
+
+   int mipWidth(int mip) const { return width >> mip > 0 ? width >> mip : 1; }
+   int mipHeight(int mip) const { return height >> mip > 0 ? height >> mip : 1; }
+};
+
+// Thumbnail file, written next to an image the first time it is decoded:
+// a header and the pixels of the image's level whose longer side is at
+// most THUMBNAIL_SIZE, small enough to read and upload before the first
+// frame while the image itself decodes.
+const int THUMBNAIL_SIZE = 64;
+
+struct ThumbnailHeader
+{
+   char magic[4];             // "THMB"
+   int width;                 // of the thumbnail
+   int height;
+   int components;
+   int level;                 // halvings of the image's full resolution
+};
+
+// Keeps the textures of image files on the GPU within a memory budget.
+// Textures are shared through reference-counted handles. Every frame the
+// renderer reports the textures it draws on screen and how many pixels
+// across; update() then loads, as jobs, those missing or too coarse for
+// their size, at the finest level that fits the budget, and makes room by
+// evicting textures not drawn lately, least recently drawn first, and by
+// reloading ones drawn much smaller than they are resident at a coarser
+// level. Decoded images reach the renderer through nextUpload(), and
+// textures to delete through nextEviction(). A texture never goes coarser
+// than its thumbnail, which, once cached, is the first thing uploaded.
+class TextureManager{
+public:
+   // bytes of texture memory, counting 4 bytes a texel and a full mip chain
+   size_t budget;
+
+   // longest side a texture may have, GL_MAX_TEXTURE_SIZE; larger images
+   // are resampled down to it as they decode, and their levels count from
+   // there; 0 for no limit, set before the first acquire()
+   int maxSize;
+
+   // images and thumbnails are read from here if they are packed, else
+   // from their files; null for files only
+   const AssetPack* assets;
+
+   TextureManager();
+   ~TextureManager();
+
+   // a handle to the texture of an image file, the same one for every
+   // acquire of the file, each to be matched by a release(); only the
+   // thumbnail is read now, the texture itself is loaded once it is drawn
+   int acquire(const std::string& filename);
+   void release(int texture);
+
+   // the texture is drawn this frame, about pixels across on screen
+   void use(int texture, float pixels);
+
+   // evicts and queues loads for this frame's uses
+   void update();
+
+   // a texture whose image is decoded and waits for upload, or -1; once
+   // all of its mips are uploaded finishUpload() makes it resident,
+   // replacing the resident level, if any
+   int nextUpload();
+   const TextureImage& uploadImage(int texture) const { return textures_[texture].image; }
+   void finishUpload(int texture);
+
+   // a texture evicted since the last call, to be deleted, or -1
+   int nextEviction();
+
+   // level resident on the GPU, or -1 if none is
+   int residentLevel(int texture) const { return textures_[texture].residentLevel; }
+   size_t residentBytes() const { return residentBytes_; }
+   int textureCount() const { return int(textures_.size()); }
+
+   // runs queued decodes on this thread until none is left
+   void waitForLoads() { WaitForCounter(&loading_); }
+
+private:
+   struct Texture
+   {
+      std::string filename;
+      int refs;
+      int width;           // of the file fitted within maxSize, 0 if it could not be read
+      int height;
+      int lastUsed;        // frame it was last drawn on screen
+      float pixels;        // most pixels across it was drawn this frame
+      int residentLevel;
+      int loadingLevel;    // level being decoded, or -1
+      TextureImage image;
+   };
+
+   TextureManager(const TextureManager&);
+   TextureManager& operator=(const TextureManager&);
+
+   int wantedLevel(const Texture& texture) const;
+   int coarsestLevel(const Texture& texture) const;
+   size_t levelBytes(const Texture& texture, int level) const;
+   bool evictOldest();
+   void evict(int texture);
+   void startLoad(int texture, int level);
+   void collectLoaded();
+
+   std::vector<Texture> textures_;
+   std::vector<int> uploads_;         // decoded textures not yet uploaded
+   std::vector<int> evictions_;       // evicted textures not yet deleted
+   size_t residentBytes_;
+   size_t loadingBytes_;              // promised to the decodes in flight
+   int frame_;
+
+   // images the jobs have decoded, collected on the next update()
+   std::mutex loadedMutex_;
+   std::vector<std::pair<int, TextureImage> > loaded_;
+   JobCounter loading_;
+};
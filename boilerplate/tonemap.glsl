@@ -0,0 +1,35 @@
+// ==========================================================================
+// Fragment program resolving the HDR target to the screen: adds the bloom
+// and brings values over 1 back into range. Colours up to the knee pass
+// through unchanged, so only the sun and its glow are compressed; above
+// it the brightest channel rolls off towards 1 and the others keep their
+// ratio to it, which keeps the sun's hue instead of washing it to white.
+// ==========================================================================
+#version 410
+
+in vec2 UV;
+
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloomStrength;   // 0 with bloom off
+uniform float exposure;
+
+out vec4 FragmentColour;
+
+const float KNEE = 0.8;
+
+void main(void)
+{
+    vec3 colour = texture(scene, UV).rgb + texture(bloom, UV).rgb * bloomStrength;
+    colour *= exposure;
+
+    // exponential shoulder, continuous in value and slope at the knee
+    float peak = max(colour.r, max(colour.g, colour.b));
+    if (peak > KNEE)
+    {
+        float mapped = KNEE + (1.0 - KNEE) * (1.0 - exp(-(peak - KNEE) / (1.0 - KNEE)));
+        colour *= mapped / peak;
+    }
+
+    FragmentColour = vec4(colour, 1.0);
+}
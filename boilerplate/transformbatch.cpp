@@ -0,0 +1,383 @@
+#include "transformbatch.h"
+#include "cpuinfo.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#define TRANSFORM_SIMD
+
+// glm's matrices are not 16 byte aligned unless GLM_FORCE_ALIGNED is set,
+// so columns go through unaligned loads and stores
+static inline void loadColumns(const mat4& m, glm_vec4 out[4])
+{
+   const float* p = &m[0][0];
+   out[0] = _mm_loadu_ps(p);
+   out[1] = _mm_loadu_ps(p + 4);
+   out[2] = _mm_loadu_ps(p + 8);
+   out[3] = _mm_loadu_ps(p + 12);
+}
+
+static inline void storeColumns(const glm_vec4 in[4], mat4& m)
+{
+   float* p = &m[0][0];
+   _mm_storeu_ps(p, in[0]);
+   _mm_storeu_ps(p + 4, in[1]);
+   _mm_storeu_ps(p + 8, in[2]);
+   _mm_storeu_ps(p + 12, in[3]);
+}
+#endif
+
+void BatchMultiply(const mat4* a, const mat4* b, mat4* out, int count)
+{
+#ifdef TRANSFORM_SIMD
+   glm_vec4 ma[4], mb[4], r[4];
+   for (int i = 0; i < count; i++)
+   {
+      loadColumns(a[i], ma);
+      loadColumns(b[i], mb);
+      glm_mat4_mul(ma, mb, r);
+      storeColumns(r, out[i]);
+   }
+#else
+   BatchMultiplyScalar(a, b, out, count);
+#endif
+}
+
+void BatchMultiply(const mat4& m, const mat4* b, mat4* out, int count)
+{
+#ifdef TRANSFORM_SIMD
+   // the shared left hand matrix stays in registers for the whole batch
+   glm_vec4 mm[4], mb[4], r[4];
+   loadColumns(m, mm);
+   for (int i = 0; i < count; i++)
+   {
+      loadColumns(b[i], mb);
+      glm_mat4_mul(mm, mb, r);
+      storeColumns(r, out[i]);
+   }
+#else
+   BatchMultiplyScalar(m, b, out, count);
+#endif
+}
+
+void BatchNormalMatrix(const mat4* models, mat4* out, int count)
+{
+#ifdef TRANSFORM_SIMD
+   glm_vec4 m[4], inv[4], r[4];
+   for (int i = 0; i < count; i++)
+   {
+      loadColumns(models[i], m);
+      glm_mat4_inverse(m, inv);
+      glm_mat4_transpose(inv, r);
+      storeColumns(r, out[i]);
+   }
+#else
+   BatchNormalMatrixScalar(models, out, count);
+#endif
+}
+
+void BatchMultiplyScalar(const mat4* a, const mat4* b, mat4* out, int count)
+{
+   for (int i = 0; i < count; i++)
+      out[i] = a[i] * b[i];
+}
+
+void BatchMultiplyScalar(const mat4& m, const mat4* b, mat4* out, int count)
+{
+   for (int i = 0; i < count; i++)
+      out[i] = m * b[i];
+}
+
+void BatchNormalMatrixScalar(const mat4* models, mat4* out, int count)
+{
+   for (int i = 0; i < count; i++)
+      out[i] = transpose(inverse(models[i]));
+}
+
+// --------------------------------------------------------------------------
+// Affine transforms as a structure of arrays
+
+void AffineArrays::resize(int count)
+{
+   for (int k = 0; k < 12; k++)
+      m[k].resize(count);
+}
+
+mat4 AffineArrays::get(int i) const
+{
+   return mat4(m[0][i], m[1][i], m[2][i], 0.0f,
+      m[3][i], m[4][i], m[5][i], 0.0f,
+      m[6][i], m[7][i], m[8][i], 0.0f,
+      m[9][i], m[10][i], m[11][i], 1.0f);
+}
+
+void AffineArrays::set(int i, const mat4& transform)
+{
+   for (int c = 0; c < 4; c++)
+      for (int r = 0; r < 3; r++)
+         m[3 * c + r][i] = transform[c][r];
+}
+
+void AffineArrays::copy(int i, const AffineArrays& from, int j)
+{
+   for (int k = 0; k < 12; k++)
+      m[k][i] = from.m[k][j];
+}
+
+void BatchMultiplyScalar(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end)
+{
+   for (int i = begin; i < end; i++)
+   {
+      float x[12], y[12];
+      for (int k = 0; k < 12; k++)
+      {
+         x[k] = a.m[k][i];
+         y[k] = b.m[k][i];
+      }
+      for (int c = 0; c < 4; c++)
+         for (int r = 0; r < 3; r++)
+         {
+            float sum = x[r] * y[3 * c] + x[3 + r] * y[3 * c + 1] + x[6 + r] * y[3 * c + 2];
+            out.m[3 * c + r][i] = c == 3 ? sum + x[9 + r] : sum;
+         }
+   }
+}
+
+void BatchNormalMatrixScalar(const AffineArrays& models, AffineArrays& out, int begin, int end)
+{
+   for (int i = begin; i < end; i++)
+   {
+      // the rows of the inverse are the cross products of the columns over
+      // the determinant, and the transpose makes them the columns
+      vec3 c0(models.m[0][i], models.m[1][i], models.m[2][i]);
+      vec3 c1(models.m[3][i], models.m[4][i], models.m[5][i]);
+      vec3 c2(models.m[6][i], models.m[7][i], models.m[8][i]);
+      vec3 n0 = cross(c1, c2), n1 = cross(c2, c0), n2 = cross(c0, c1);
+      float inverseDet = 1.0f / dot(c0, n0);
+      for (int r = 0; r < 3; r++)
+      {
+         out.m[r][i] = n0[r] * inverseDet;
+         out.m[3 + r][i] = n1[r] * inverseDet;
+         out.m[6 + r][i] = n2[r] * inverseDet;
+         out.m[9 + r][i] = 0.0f;
+      }
+   }
+}
+
+#ifdef TRANSFORM_SIMD
+// four transforms a step, the tail on the scalar kernel
+static void batchMultiplySSE2(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end)
+{
+   int i = begin;
+   for (; i + 4 <= end; i += 4)
+   {
+      __m128 x[12], y[12];
+      for (int k = 0; k < 12; k++)
+      {
+         x[k] = _mm_loadu_ps(&a.m[k][i]);
+         y[k] = _mm_loadu_ps(&b.m[k][i]);
+      }
+      for (int c = 0; c < 4; c++)
+         for (int r = 0; r < 3; r++)
+         {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[r], y[3 * c]), _mm_mul_ps(x[3 + r], y[3 * c + 1])),
+               _mm_mul_ps(x[6 + r], y[3 * c + 2]));
+            _mm_storeu_ps(&out.m[3 * c + r][i], c == 3 ? _mm_add_ps(sum, x[9 + r]) : sum);
+         }
+   }
+   BatchMultiplyScalar(a, b, out, i, end);
+}
+
+static inline __m128 crossComponent(__m128 a1, __m128 a2, __m128 b1, __m128 b2)
+{
+   return _mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1));
+}
+
+static void batchNormalMatrixSSE2(const AffineArrays& models, AffineArrays& out, int begin, int end)
+{
+   int i = begin;
+   for (; i + 4 <= end; i += 4)
+   {
+      __m128 x[9];
+      for (int k = 0; k < 9; k++)
+         x[k] = _mm_loadu_ps(&models.m[k][i]);
+      __m128 n[9];
+      for (int r = 0; r < 3; r++)
+      {
+         int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+         n[r] = crossComponent(x[3 + r1], x[3 + r2], x[6 + r1], x[6 + r2]);
+         n[3 + r] = crossComponent(x[6 + r1], x[6 + r2], x[r1], x[r2]);
+         n[6 + r] = crossComponent(x[r1], x[r2], x[3 + r1], x[3 + r2]);
+      }
+      __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], n[0]), _mm_mul_ps(x[1], n[1])), _mm_mul_ps(x[2], n[2]));
+      __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+      for (int k = 0; k < 9; k++)
+         _mm_storeu_ps(&out.m[k][i], _mm_mul_ps(n[k], inverseDet));
+      for (int k = 9; k < 12; k++)
+         _mm_storeu_ps(&out.m[k][i], _mm_setzero_ps());
+   }
+   BatchNormalMatrixScalar(models, out, i, end);
+}
+#endif
+
+void BatchMultiply(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end)
+{
+   if (CpuHasAVX2())
+      BatchMultiplyAVX2(a, b, out, begin, end);
+   else
+#ifdef TRANSFORM_SIMD
+      batchMultiplySSE2(a, b, out, begin, end);
+#else
+      BatchMultiplyScalar(a, b, out, begin, end);
+#endif
+}
+
+void BatchNormalMatrix(const AffineArrays& models, AffineArrays& out, int begin, int end)
+{
+   if (CpuHasAVX2())
+      BatchNormalMatrixAVX2(models, out, begin, end);
+   else
+#ifdef TRANSFORM_SIMD
+      batchNormalMatrixSSE2(models, out, begin, end);
+#else
+      BatchNormalMatrixScalar(models, out, begin, end);
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Benchmark
+
+static float randomFloat(float lo, float hi)
+{
+   return lo + (hi - lo) * (rand() / float(RAND_MAX));
+}
+
+// runs fn repeatedly and returns the best time of one run in milliseconds
+template <typename Fn>
+static double bestOf(int runs, Fn fn)
+{
+   double best = 1e30;
+   for (int r = 0; r < runs; r++)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      fn();
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      best = elapsed.count() < best ? elapsed.count() : best;
+   }
+   return best;
+}
+
+void BenchmarkTransforms(int count)
+{
+   mat4 I(1.0f);
+   std::vector<mat4> parents(count), locals(count), world(count), mvp(count), normals(count);
+   for (int i = 0; i < count; i++)
+   {
+      vec3 axis = normalize(vec3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(0.1f, 1)));
+      locals[i] = translate(I, vec3(randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-10, 10))) *
+         rotate(I, randomFloat(0, 6.28f), axis) * scale(I, vec3(randomFloat(0.5f, 2.0f)));
+      parents[i] = rotate(I, randomFloat(0, 6.28f), vec3(0, 1, 0));
+   }
+   mat4 viewProj = perspective(radians(80.0f), 1.0f, 0.1f, 1000.0f) *
+      lookAt(vec3(0, 10, -10), vec3(0.0f), vec3(0, 1, 0));
+
+   const int runs = 20;
+   double worldScalar = bestOf(runs, [&]() { BatchMultiplyScalar(&parents[0], &locals[0], &world[0], count); });
+   double mvpScalar = bestOf(runs, [&]() { BatchMultiplyScalar(viewProj, &world[0], &mvp[0], count); });
+   double normalScalar = bestOf(runs, [&]() { BatchNormalMatrixScalar(&world[0], &normals[0], count); });
+   std::vector<mat4> reference(normals);
+
+   double worldSimd = bestOf(runs, [&]() { BatchMultiply(&parents[0], &locals[0], &world[0], count); });
+   double mvpSimd = bestOf(runs, [&]() { BatchMultiply(viewProj, &world[0], &mvp[0], count); });
+   double normalSimd = bestOf(runs, [&]() { BatchNormalMatrix(&world[0], &normals[0], count); });
+
+   float maxError = 0.0f;
+   for (int i = 0; i < count; i++)
+      for (int c = 0; c < 4; c++)
+         for (int r = 0; r < 4; r++)
+            maxError = max(maxError, abs(normals[i][c][r] - reference[i][c][r]));
+
+#ifdef TRANSFORM_SIMD
+   const char* path = "sse2";
+#else
+   const char* path = "scalar fallback";
+#endif
+   printf("Transform benchmark, %d transforms, best of %d runs (%s)\n", count, runs, path);
+   printf("  world  (a*b)         scalar %8.3f ms   simd %8.3f ms   x%.2f\n", worldScalar, worldSimd, worldScalar / worldSimd);
+   printf("  mvp    (viewProj*b)  scalar %8.3f ms   simd %8.3f ms   x%.2f\n", mvpScalar, mvpSimd, mvpScalar / mvpSimd);
+   printf("  normal (inv^T)       scalar %8.3f ms   simd %8.3f ms   x%.2f\n", normalScalar, normalSimd, normalScalar / normalSimd);
+   printf("  max normal matrix difference %g\n", maxError);
+
+   // the same world and normal passes over the affine structure of arrays
+   AffineArrays parentArrays, localArrays, worldArrays, normalArrays;
+   parentArrays.resize(count);
+   localArrays.resize(count);
+   worldArrays.resize(count);
+   normalArrays.resize(count);
+   for (int i = 0; i < count; i++)
+   {
+      parentArrays.set(i, parents[i]);
+      localArrays.set(i, locals[i]);
+   }
+   double affineWorld[3] = {}, affineNormal[3] = {};
+   float affineError[3] = {};
+   const char* affineNames[3] = { "scalar", "sse2", "avx2" };
+   bool hasAVX2 = CpuHasAVX2();
+   for (int path = 0; path < 3; path++)
+   {
+#ifdef TRANSFORM_SIMD
+      if (path == 2 && !hasAVX2)
+         continue;
+#else
+      if (path > 0)
+         continue;
+#endif
+      affineWorld[path] = bestOf(runs, [&]() {
+         if (path == 0)
+            BatchMultiplyScalar(parentArrays, localArrays, worldArrays, 0, count);
+#ifdef TRANSFORM_SIMD
+         else if (path == 1)
+            batchMultiplySSE2(parentArrays, localArrays, worldArrays, 0, count);
+#endif
+         else
+            BatchMultiplyAVX2(parentArrays, localArrays, worldArrays, 0, count);
+      });
+      affineNormal[path] = bestOf(runs, [&]() {
+         if (path == 0)
+            BatchNormalMatrixScalar(worldArrays, normalArrays, 0, count);
+#ifdef TRANSFORM_SIMD
+         else if (path == 1)
+            batchNormalMatrixSSE2(worldArrays, normalArrays, 0, count);
+#endif
+         else
+            BatchNormalMatrixAVX2(worldArrays, normalArrays, 0, count);
+      });
+
+      // against the 4x4 results above; normals only use their upper 3x3
+      for (int i = 0; i < count; i++)
+      {
+         mat4 w = worldArrays.get(i), n = normalArrays.get(i);
+         for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 3; r++)
+            {
+               affineError[path] = max(affineError[path], abs(w[c][r] - world[i][c][r]));
+               if (c < 3)
+                  affineError[path] = max(affineError[path], abs(n[c][r] - reference[i][c][r]));
+            }
+      }
+   }
+   printf("Affine structure of arrays, best of %d runs\n", runs);
+   for (int path = 0; path < 3; path++)
+   {
+      if (affineWorld[path] == 0.0)
+         printf("  %-6s               not available\n", affineNames[path]);
+      else
+         printf("  %-6s  world %8.3f ms   normal %8.3f ms   x%.2f over 4x4 scalar   max difference %g\n",
+            affineNames[path], affineWorld[path], affineNormal[path],
+            (worldScalar + normalScalar) / (affineWorld[path] + affineNormal[path]), affineError[path]);
+   }
+}
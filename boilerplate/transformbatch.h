@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+using namespace glm;
+
+// Batched 4x4 transform kernels over contiguous arrays of matrices. When glm
+// is built for SSE2 (GLM_FORCE_SSE2) these run on glm's simd matrix routines,
+// otherwise they fall back to the plain glm operators. Input and output
+// arrays may be the same array.
+
+// out[i] = a[i] * b[i]
+void BatchMultiply(const mat4* a, const mat4* b, mat4* out, int count);
+
+// out[i] = m * b[i], e.g. the view-projection matrix times each model matrix
+void BatchMultiply(const mat4& m, const mat4* b, mat4* out, int count);
+
+// out[i] = transpose(inverse(models[i])), for transforming normals to world space
+void BatchNormalMatrix(const mat4* models, mat4* out, int count);
+
+// scalar glm versions of the kernels above, kept as the benchmark reference
+void BatchMultiplyScalar(const mat4* a, const mat4* b, mat4* out, int count);
+void BatchMultiplyScalar(const mat4& m, const mat4* b, mat4* out, int count);
+void BatchNormalMatrixScalar(const mat4* models, mat4* out, int count);
+
+// Affine transforms (bottom row 0 0 0 1, as every translate/rotate/scale
+// product is) stored as a structure of arrays: element (row r, column c) of
+// transform i is m[3 * c + r][i]. The kernels below work on four (SSE2) or
+// eight (AVX2) transforms at a time, one per lane, so there is no shuffling
+// and the bottom row is never loaded or multiplied.
+struct AffineArrays{
+   std::vector<float> m[12];
+
+   int size() const { return int(m[0].size()); }
+   void resize(int count);
+   mat4 get(int i) const;
+   void set(int i, const mat4& transform);
+   // this[i] = from[j]
+   void copy(int i, const AffineArrays& from, int j);
+};
+
+// out[i] = a[i] * b[i] for i in [begin, end), on the AVX2 kernel when the CPU
+// has it; out may be a or b
+void BatchMultiply(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end);
+
+// out[i] = the inverse transpose of models[i]'s upper 3x3, with a zero
+// translation, for [begin, end); out may be models
+void BatchNormalMatrix(const AffineArrays& models, AffineArrays& out, int begin, int end);
+
+// the scalar versions, which also finish the tails the simd kernels leave
+void BatchMultiplyScalar(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end);
+void BatchNormalMatrixScalar(const AffineArrays& models, AffineArrays& out, int begin, int end);
+
+// the affine kernels built with AVX2 enabled in transformbatch_avx2.cpp; only
+// call them when CpuHasAVX2()
+void BatchMultiplyAVX2(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end);
+void BatchNormalMatrixAVX2(const AffineArrays& models, AffineArrays& out, int begin, int end);
+
+// times the scalar and simd kernels over count random transforms and prints
+// the results to the console
+void BenchmarkTransforms(int count);
@@ -0,0 +1,62 @@
+#include "transformbatch.h"
+#include <immintrin.h>
+
+// This file is compiled with AVX2 enabled (see the project settings), so
+// nothing here may run before CpuHasAVX2() said yes.
+
+// eight transforms a step, the tail on the scalar kernel
+void BatchMultiplyAVX2(const AffineArrays& a, const AffineArrays& b, AffineArrays& out, int begin, int end)
+{
+   int i = begin;
+   for (; i + 8 <= end; i += 8)
+   {
+      __m256 x[12], y[12];
+      for (int k = 0; k < 12; k++)
+      {
+         x[k] = _mm256_loadu_ps(&a.m[k][i]);
+         y[k] = _mm256_loadu_ps(&b.m[k][i]);
+      }
+      for (int c = 0; c < 4; c++)
+         for (int r = 0; r < 3; r++)
+         {
+            __m256 sum = c == 3 ? x[9 + r] : _mm256_setzero_ps();
+            sum = _mm256_fmadd_ps(x[r], y[3 * c], sum);
+            sum = _mm256_fmadd_ps(x[3 + r], y[3 * c + 1], sum);
+            sum = _mm256_fmadd_ps(x[6 + r], y[3 * c + 2], sum);
+            _mm256_storeu_ps(&out.m[3 * c + r][i], sum);
+         }
+   }
+   BatchMultiplyScalar(a, b, out, i, end);
+}
+
+// one component of a cross product, a1 * b2 - a2 * b1
+static inline __m256 crossComponent(__m256 a1, __m256 a2, __m256 b1, __m256 b2)
+{
+   return _mm256_fmsub_ps(a1, b2, _mm256_mul_ps(a2, b1));
+}
+
+void BatchNormalMatrixAVX2(const AffineArrays& models, AffineArrays& out, int begin, int end)
+{
+   int i = begin;
+   for (; i + 8 <= end; i += 8)
+   {
+      __m256 x[9];
+      for (int k = 0; k < 9; k++)
+         x[k] = _mm256_loadu_ps(&models.m[k][i]);
+      __m256 n[9];
+      for (int r = 0; r < 3; r++)
+      {
+         int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+         n[r] = crossComponent(x[3 + r1], x[3 + r2], x[6 + r1], x[6 + r2]);
+         n[3 + r] = crossComponent(x[6 + r1], x[6 + r2], x[r1], x[r2]);
+         n[6 + r] = crossComponent(x[r1], x[r2], x[3 + r1], x[3 + r2]);
+      }
+      __m256 det = _mm256_fmadd_ps(x[2], n[2], _mm256_fmadd_ps(x[1], n[1], _mm256_mul_ps(x[0], n[0])));
+      __m256 inverseDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+      for (int k = 0; k < 9; k++)
+         _mm256_storeu_ps(&out.m[k][i], _mm256_mul_ps(n[k], inverseDet));
+      for (int k = 9; k < 12; k++)
+         _mm256_storeu_ps(&out.m[k][i], _mm256_setzero_ps());
+   }
+   BatchNormalMatrixScalar(models, out, i, end);
+}
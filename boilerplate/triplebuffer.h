@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free triple buffer between one producer and one consumer thread. The
+// producer fills its back slot and publishes it by swapping it with the
+// middle slot; the consumer swaps the middle slot in as its front whenever
+// it holds something newer. Neither side ever waits for the other, the
+// consumer just skips values it was too slow to see, and a slot is never
+// written while the consumer may be reading it.
+template <typename T>
+class TripleBuffer{
+public:
+   TripleBuffer() : middle_(1), back_(2), front_(0) {}
+
+   // producer: the slot to fill, then publish() it; the slot still holds
+   // whatever was written to it three publishes ago
+   T& back() { return slots_[back_]; }
+   void publish() { back_ = middle_.exchange(back_ | FRESH) & INDEX; }
+
+   // consumer: takes the latest published value as front(), returns false
+   // if nothing was published since the last call
+   bool update()
+   {
+      if (!(middle_.load() & FRESH))
+         return false;
+      front_ = middle_.exchange(front_) & INDEX;
+      return true;
+   }
+   const T& front() const { return slots_[front_]; }
+
+private:
+   enum { INDEX = 3, FRESH = 4 };
+
+   TripleBuffer(const TripleBuffer&);
+   TripleBuffer& operator=(const TripleBuffer&);
+
+   T slots_[3];
+   std::atomic<int> middle_;  // slot index, plus FRESH while unseen
+   int back_;                 // producer only
+   int front_;                // consumer only
+};
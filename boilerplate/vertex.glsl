@@ -1,32 +1,93 @@
-// ==========================================================================
-// Vertex program for barebones GLFW boilerplate
-//
-// Author:  Sonny Chan, University of Calgary
-// Date:    December 2015
-// ==========================================================================
-#version 410
-
-// location indices for these attributes correspond to those specified in the
-// InitializeGeometry() function of the main program
-layout(location = 0) in vec3 VertexPosition;
-layout(location = 1) in vec3 VertexNormal;
-
-// output to be interpolated between vertices and passed to the fragment stage
-out vec3 Normal;
-out vec3 VertNormal;
-out vec3 Position;
-
-// uniforms
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
-
-void main()
-{
-    // transformations applied right to left, order matters
-    gl_Position = proj*view*model*vec4(VertexPosition, 1.0);
-
-	Normal = normalize(model*vec4(VertexNormal,0)).xyz;
-	VertNormal = VertexNormal;
-	Position = (model * vec4(Normal, 1)).xyz; 
-}
+// ==========================================================================
+// Vertex program for barebones GLFW boilerplate
+//
+// Author:  Sonny Chan, University of Calgary
+// Date:    December 2015
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// InitializeGeometry() function of the main program
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec3 VertexNormal;
+
+// per-instance body data for instanced drawing, world position and spin
+// angle straight from the body system's x, y, z and spin arrays, plus the
+// static properties (radius, axis tilt, spin rate, texture layer)
+layout(location = 2) in float InstanceX;
+layout(location = 3) in float InstanceY;
+layout(location = 4) in float InstanceZ;
+layout(location = 5) in vec4 InstanceStatic;
+layout(location = 6) in float InstanceSpin;
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Normal;
+out vec3 VertNormal;
+out vec3 Position;
+
+// uniforms
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 proj;
+uniform mat4 mvp;           // proj*view*model, from the CPU per draw
+uniform mat4 normalMatrix;  // inverse transpose of model
+
+// procedural sphere: no vertex buffers bound, the unit sphere is rebuilt
+// from gl_VertexID on a resolution.x by resolution.y grid
+uniform bool isProcedural;
+uniform ivec2 resolution;
+
+// instanced bodies are placed from the instance attributes instead of model
+uniform bool isInstanced;
+
+const float PI = 3.14159265;
+
+// corner offsets of the two triangles of a grid quad, same winding as the
+// index buffer GenerateUVSphere() builds in meshgen.cpp
+const ivec2 corners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1),
+                                  ivec2(0, 1), ivec2(1, 0), ivec2(1, 1));
+
+vec3 proceduralSphere(int id)
+{
+    int quad = id / 6;
+    ivec2 cell = ivec2(quad / (resolution.y - 1), quad % (resolution.y - 1)) + corners[id % 6];
+    vec2 uv = vec2(cell) / vec2(resolution - 1);
+
+    float theta = 2.0 * PI * uv.x;
+    float phi = PI * (uv.y - 0.5);
+    return vec3(sin(theta) * cos(phi), cos(theta) * cos(phi), sin(phi));
+}
+
+void main()
+{
+    vec3 position = VertexPosition;
+    vec3 normal = VertexNormal;
+    if (isProcedural)
+    {
+        position = proceduralSphere(gl_VertexID);
+        normal = position;
+    }
+
+    if (isInstanced)
+    {
+        // spin about y, then tilt the spin axis about x
+        float spin = InstanceSpin;
+        float tilt = InstanceStatic.y;
+        mat3 rotation = mat3(1, 0, 0, 0, cos(tilt), sin(tilt), 0, -sin(tilt), cos(tilt)) *
+                        mat3(cos(spin), 0, -sin(spin), 0, 1, 0, sin(spin), 0, cos(spin));
+        vec3 world = InstanceStatic.x * (rotation * position) + vec3(InstanceX, InstanceY, InstanceZ);
+
+        gl_Position = proj*view*vec4(world, 1.0);
+        Normal = rotation * normal;
+        VertNormal = normal;
+        Position = world;
+        return;
+    }
+
+    // transformations applied right to left, order matters
+    gl_Position = mvp*vec4(position, 1.0);
+
+	Normal = normalize(mat3(normalMatrix)*normal);
+	VertNormal = normal;
+	Position = (model * vec4(position, 1)).xyz;
+}
@@ -0,0 +1,451 @@
+#include "virtualtexture.h"
+#include "jpegdecode.h"
+#include "resample.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stb_image.h>
+
+using namespace std;
+
+static_assert(sizeof(VirtualTextureHeader) == 32, "virtual texture header must be packed");
+
+// tile loads in flight per worker thread; without workers, tiles loaded
+// on the render thread per frame
+const int LOADS_PER_WORKER = 4;
+const int SYNC_LOADS_PER_FRAME = 4;
+
+static bool isPowerOfTwo(int n)
+{
+   return n > 0 && (n & (n - 1)) == 0;
+}
+
+// the power of two nearest n, by ratio
+static int nearestPowerOfTwo(int n)
+{
+   int lower = 1;
+   while (lower * 2 <= n)
+      lower *= 2;
+   return double(n) * n >= 2.0 * lower * lower ? lower * 2 : lower;
+}
+
+static int log2Int(int n)
+{
+   int log = 0;
+   while ((1 << (log + 1)) <= n)
+      log++;
+   return log;
+}
+
+bool BuildVirtualTexture(const char* imageFile, const char* filename)
+{
+   // rows from the bottom up, like the textures the shaders sample
+   stbi_set_flip_vertically_on_load(true);
+   int width, height, components;
+   unsigned char* data = LoadImageParallel(imageFile, &width, &height, &components, 3);
+   if (!data)
+   {
+      cout << "ERROR: Could not load image " << imageFile << endl;
+      return false;
+   }
+   vector<unsigned char> level(data, data + size_t(width) * height * 3);
+   stbi_image_free(data);
+
+   // other sizes are resampled to the nearest powers of two
+   if (!isPowerOfTwo(width) || !isPowerOfTwo(height) || width < VT_TILE_SIZE || height < VT_TILE_SIZE)
+   {
+      int powerWidth = std::max(nearestPowerOfTwo(width), VT_TILE_SIZE);
+      int powerHeight = std::max(nearestPowerOfTwo(height), VT_TILE_SIZE);
+      cout << "Resampling virtual texture image " << imageFile << " from " << width << "x" << height
+         << " to " << powerWidth << "x" << powerHeight << endl;
+      vector<unsigned char> resampled(size_t(powerWidth) * powerHeight * 3);
+      ResampleImage(level.data(), width, height, 3, resampled.data(), powerWidth, powerHeight, RESAMPLE_LANCZOS3,
+         true, true);
+      level.swap(resampled);
+      width = powerWidth;
+      height = powerHeight;
+   }
+
+   VirtualTextureHeader header;
+   memcpy(header.magic, "VTEX", 4);
+   header.version = VIRTUAL_TEXTURE_VERSION;
+   header.width = width;
+   header.height = height;
+   header.tileSize = VT_TILE_SIZE;
+   header.border = VT_TILE_BORDER;
+   header.levels = log2Int(std::min(width, height) / VT_TILE_SIZE) + 1;
+   header.reserved = 0;
+
+   ofstream file(filename, ios::binary);
+   if (!file)
+   {
+      cout << "ERROR: could not write virtual texture " << filename << endl;
+      return false;
+   }
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+   vector<unsigned char> tile(VT_TILE_BYTES);
+   for (unsigned int l = 0; l < header.levels; l++)
+   {
+      for (int y = 0; y < height / VT_TILE_SIZE; y++)
+      {
+         for (int x = 0; x < width / VT_TILE_SIZE; x++)
+         {
+            for (int ty = 0; ty < VT_TILE_STRIDE; ty++)
+            {
+               int sy = clamp(y * VT_TILE_SIZE + ty - VT_TILE_BORDER, 0, height - 1);
+               for (int tx = 0; tx < VT_TILE_STRIDE; tx++)
+               {
+                  int sx = (x * VT_TILE_SIZE + tx - VT_TILE_BORDER + width) % width;
+                  memcpy(&tile[3 * (ty * VT_TILE_STRIDE + tx)], &level[3 * (size_t(sy) * width + sx)], 3);
+               }
+            }
+            file.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+         }
+      }
+
+      // the next level is filtered from this one in linear light, wrapping
+      // around the date line
+      if (l + 1 < header.levels)
+      {
+         int halfWidth = width / 2;
+         int halfHeight = height / 2;
+         vector<unsigned char> half(size_t(halfWidth) * halfHeight * 3);
+         ResampleImage(level.data(), width, height, 3, half.data(), halfWidth, halfHeight, RESAMPLE_MITCHELL,
+            true, true);
+         level.swap(half);
+         width = halfWidth;
+         height = halfHeight;
+      }
+   }
+
+   if (!file)
+   {
+      cout << "ERROR: could not write virtual texture " << filename << endl;
+      return false;
+   }
+   return true;
+}
+
+VirtualTexture::VirtualTexture()
+   : width_(0)
+   , height_(0)
+   , levels_(0)
+   , tilesX_(0)
+   , tilesY_(0)
+   , cacheSide_(0)
+   , frame_(0)
+   , loadCount_(0)
+   , inFlight_(0)
+{}
+
+VirtualTexture::~VirtualTexture()
+{
+   waitForLoads();
+}
+
+bool VirtualTexture::open(const char* filename, int cacheSide)
+{
+   VirtualTextureHeader header;
+   ifstream file(filename, ios::binary);
+   if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+      return false;
+   if (memcmp(header.magic, "VTEX", 4) != 0 || header.version != VIRTUAL_TEXTURE_VERSION ||
+      header.tileSize != VT_TILE_SIZE || header.border != VT_TILE_BORDER || header.levels == 0 ||
+      (header.width / VT_TILE_SIZE) >> (header.levels - 1) == 0 ||
+      (header.height / VT_TILE_SIZE) >> (header.levels - 1) == 0)
+   {
+      cout << "ERROR: " << filename << " is not a virtual texture" << endl;
+      return false;
+   }
+
+   int tilesX = header.width / VT_TILE_SIZE;
+   int tilesY = header.height / VT_TILE_SIZE;
+   int coarsest = (tilesX >> (header.levels - 1)) * (tilesY >> (header.levels - 1));
+   if (cacheSide > 255 || cacheSide * cacheSide <= coarsest)
+   {
+      cout << "ERROR: a cache of " << cacheSide << "x" << cacheSide << " tiles cannot hold the "
+         << coarsest << " tiles of the coarsest level of " << filename << endl;
+      return false;
+   }
+
+   filename_ = filename;
+   width_ = header.width;
+   height_ = header.height;
+   levels_ = header.levels;
+   tilesX_ = tilesX;
+   tilesY_ = tilesY;
+   cacheSide_ = cacheSide;
+
+   levelStart_.resize(levels_ + 1);
+   levelStart_[0] = 0;
+   table_.resize(levels_);
+   dirty_.assign(levels_, ivec4(INT_MAX, INT_MAX, 0, 0));
+   for (int l = 0; l < levels_; l++)
+   {
+      ivec2 count = tiles(l);
+      levelStart_[l + 1] = levelStart_[l] + count.x * count.y;
+      table_[l].assign(4 * count.x * count.y, 0);
+   }
+   tileSlot_.assign(levelStart_[levels_], -1);
+   tileWanted_.assign(levelStart_[levels_], -1);
+
+   slots_.resize(cacheSide * cacheSide);
+   for (size_t i = 0; i < slots_.size(); i++)
+   {
+      slots_[i].tile = -1;
+      slots_[i].state = SLOT_FREE;
+      slots_[i].lastUsed = -1;
+   }
+
+   // the coarsest level is loaded now and never evicted
+   for (int tile = levelStart_[levels_ - 1]; tile < levelStart_[levels_]; tile++)
+   {
+      int slot = allocateSlot();
+      slots_[slot].tile = tile;
+      slots_[slot].state = SLOT_LOADED;
+      tileSlot_[tile] = slot;
+      if (!loadTile(slot))
+      {
+         levels_ = 0;
+         return false;
+      }
+      uploads_.push_back(slot);
+   }
+   return true;
+}
+
+int VirtualTexture::tileIndex(int level, int x, int y) const
+{
+   return levelStart_[level] + y * (tilesX_ >> level) + x;
+}
+
+int VirtualTexture::tileLevel(int tile) const
+{
+   return int(std::upper_bound(levelStart_.begin(), levelStart_.end(), tile) - levelStart_.begin()) - 1;
+}
+
+void VirtualTexture::request(int level, int x, int y)
+{
+   level = clamp(level, 0, levels_ - 1);
+   ivec2 count = tiles(level);
+   x = clamp(x, 0, count.x - 1);
+   y = clamp(y, 0, count.y - 1);
+
+   // ancestors are wanted too: they stand in while the tile loads, and
+   // are the second level trilinear filtering blends in
+   for (; level < levels_; level++, x /= 2, y /= 2)
+   {
+      int tile = tileIndex(level, x, y);
+      if (tileWanted_[tile] == frame_)
+         break;
+      tileWanted_[tile] = frame_;
+      if (tileSlot_[tile] >= 0)
+         slots_[tileSlot_[tile]].lastUsed = frame_;
+      else
+         requests_.push_back(tile);
+   }
+}
+
+void VirtualTexture::update()
+{
+   collectLoaded();
+
+   bool isAsync = JobThreadCount() > 1;
+   int budget = isAsync ? LOADS_PER_WORKER * JobThreadCount() - inFlight_ : SYNC_LOADS_PER_FRAME;
+
+   // coarse tiles first: each covers more pixels, and stands in for its
+   // descendants until they arrive
+   std::sort(requests_.begin(), requests_.end(), [this](int a, int b) {
+      int levelA = tileLevel(a);
+      int levelB = tileLevel(b);
+      return levelA != levelB ? levelA > levelB : a < b;
+   });
+   for (size_t i = 0; i < requests_.size() && budget > 0; i++)
+   {
+      int tile = requests_[i];
+      int slot = allocateSlot();
+      if (slot < 0)
+         break;
+
+      slots_[slot].tile = tile;
+      slots_[slot].state = SLOT_LOADING;
+      slots_[slot].lastUsed = frame_;
+      tileSlot_[tile] = slot;
+      inFlight_++;
+      budget--;
+
+      if (isAsync)
+      {
+         RunJob("load tile", [=]() {
+            loadTile(slot);
+            std::lock_guard<std::mutex> lock(loadedMutex_);
+            loaded_.push_back(slot);
+         }, &loading_);
+      }
+      else
+      {
+         loadTile(slot);
+         loaded_.push_back(slot);
+      }
+   }
+   requests_.clear();
+   frame_++;
+}
+
+int VirtualTexture::allocateSlot()
+{
+   int oldest = -1;
+   for (size_t i = 0; i < slots_.size(); i++)
+   {
+      const Slot& slot = slots_[i];
+      if (slot.state == SLOT_FREE)
+         return int(i);
+      if (slot.state == SLOT_RESIDENT && slot.lastUsed < frame_ && tileLevel(slot.tile) < levels_ - 1 &&
+         (oldest < 0 || slot.lastUsed < slots_[oldest].lastUsed))
+         oldest = int(i);
+   }
+   if (oldest >= 0)
+   {
+      tileSlot_[slots_[oldest].tile] = -1;
+      changed_.push_back(slots_[oldest].tile);
+      slots_[oldest].tile = -1;
+      slots_[oldest].state = SLOT_FREE;
+   }
+   return oldest;
+}
+
+bool VirtualTexture::loadTile(int index)
+{
+   // each load opens the file itself, so loads on different threads
+   // share nothing
+   Slot& slot = slots_[index];
+   slot.pixels.resize(VT_TILE_BYTES);
+   ifstream file(filename_.c_str(), ios::binary);
+   file.seekg(streamoff(sizeof(VirtualTextureHeader)) + streamoff(slot.tile) * VT_TILE_BYTES);
+   if (!file.read(reinterpret_cast<char*>(slot.pixels.data()), VT_TILE_BYTES))
+   {
+      cout << "ERROR: could not read tile " << slot.tile << " of " << filename_ << endl;
+      slot.pixels.clear();
+      return false;
+   }
+   return true;
+}
+
+void VirtualTexture::collectLoaded()
+{
+   std::lock_guard<std::mutex> lock(loadedMutex_);
+   for (size_t i = 0; i < loaded_.size(); i++)
+   {
+      Slot& slot = slots_[loaded_[i]];
+      inFlight_--;
+      if (slot.pixels.empty())
+      {
+         // a failed read leaves the tile to be requested again
+         tileSlot_[slot.tile] = -1;
+         slot.tile = -1;
+         slot.state = SLOT_FREE;
+         continue;
+      }
+      slot.state = SLOT_LOADED;
+      uploads_.push_back(loaded_[i]);
+      loadCount_++;
+   }
+   loaded_.clear();
+}
+
+int VirtualTexture::nextUpload()
+{
+   if (uploads_.empty())
+      collectLoaded();
+   if (uploads_.empty())
+      return -1;
+
+   // the coarsest first, they are the ones standing in for the rest
+   std::vector<int>::iterator next = std::max_element(uploads_.begin(), uploads_.end(),
+      [this](int a, int b) { return tileLevel(slots_[a].tile) < tileLevel(slots_[b].tile); });
+   int slot = *next;
+   uploads_.erase(next);
+   return slot;
+}
+
+void VirtualTexture::finishUpload(int index)
+{
+   Slot& slot = slots_[index];
+   slot.state = SLOT_RESIDENT;
+   slot.lastUsed = frame_;
+   vector<unsigned char>().swap(slot.pixels);
+   changed_.push_back(slot.tile);
+}
+
+void VirtualTexture::updatePageTable()
+{
+   if (changed_.empty())
+      return;
+
+   // coarse changes first, finer entries copy from the levels above them
+   std::sort(changed_.begin(), changed_.end(), [this](int a, int b) { return tileLevel(a) > tileLevel(b); });
+   for (size_t i = 0; i < changed_.size(); i++)
+   {
+      int tile = changed_[i];
+      int level = tileLevel(tile);
+      int index = tile - levelStart_[level];
+      ivec4 rect(index % tiles(level).x, index / tiles(level).x, 0, 0);
+      rect.z = rect.x + 1;
+      rect.w = rect.y + 1;
+
+      // the tile and everything below it, which may be falling back to it
+      for (int l = level; l >= 0; l--)
+      {
+         int tilesX = tiles(l).x;
+         for (int y = rect.y; y < rect.w; y++)
+         {
+            for (int x = rect.x; x < rect.z; x++)
+            {
+               unsigned char* entry = &table_[l][4 * (y * tilesX + x)];
+               int slot = tileSlot_[tileIndex(l, x, y)];
+               if (slot >= 0 && slots_[slot].state == SLOT_RESIDENT)
+               {
+                  ivec2 position = slotPosition(slot);
+                  entry[0] = (unsigned char)position.x;
+                  entry[1] = (unsigned char)position.y;
+                  entry[2] = (unsigned char)l;
+                  entry[3] = 255;
+               }
+               else if (l + 1 < levels_)
+               {
+                  memcpy(entry, &table_[l + 1][4 * ((y / 2) * tiles(l + 1).x + x / 2)], 4);
+               }
+            }
+         }
+         ivec4& dirty = dirty_[l];
+         dirty = ivec4(std::min(dirty.x, rect.x), std::min(dirty.y, rect.y),
+            std::max(dirty.z, rect.z), std::max(dirty.w, rect.w));
+         rect *= 2;
+      }
+   }
+   changed_.clear();
+}
+
+bool VirtualTexture::takeDirty(int level, ivec4* rect)
+{
+   ivec4& dirty = dirty_[level];
+   if (dirty.x >= dirty.z)
+      return false;
+   *rect = ivec4(dirty.x, dirty.y, dirty.z - dirty.x, dirty.w - dirty.y);
+   dirty = ivec4(INT_MAX, INT_MAX, 0, 0);
+   return true;
+}
+
+int VirtualTexture::residentCount() const
+{
+   int count = 0;
+   for (size_t i = 0; i < slots_.size(); i++)
+   {
+      if (slots_[i].state == SLOT_RESIDENT)
+         count++;
+   }
+   return count;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "jobs.h"
+
+using namespace glm;
+
+// Virtual texture file: a header, then every tile of every mip level back
+// to back, level 0 first and each level's tiles row by row from the
+// bottom, so a tile's place in the file follows from its index alone.
+// Tiles are VT_TILE_SIZE texels a side plus a border of VT_TILE_BORDER
+// copied from their neighbours (wrapping around in u, clamped in v), so
+// they filter bilinearly without seams; the pixels are RGB8.
+const unsigned int VIRTUAL_TEXTURE_VERSION = 1;
+const int VT_TILE_SIZE = 128;
+const int VT_TILE_BORDER = 4;
+const int VT_TILE_STRIDE = VT_TILE_SIZE + 2 * VT_TILE_BORDER;
+const int VT_TILE_BYTES = VT_TILE_STRIDE * VT_TILE_STRIDE * 3;
+
+struct VirtualTextureHeader
+{
+   char magic[4];             // "VTEX"
+   unsigned int version;      // VIRTUAL_TEXTURE_VERSION
+   unsigned int width;        // texels across level 0, a power of two
+   unsigned int height;
+   unsigned int tileSize;     // VT_TILE_SIZE
+   unsigned int border;       // VT_TILE_BORDER
+   unsigned int levels;       // down to the level whose shorter side is one tile
+   unsigned int reserved;
+};
+
+// tiles an equirectangular image into a virtual texture file, returning
+// true if successful; sides that are not powers of two of at least a tile
+// are resampled to the nearest that are
+bool BuildVirtualTexture(const char* imageFile, const char* filename);
+
+// A virtual texture streamed from its file into a fixed cache of tiles.
+// Every frame the renderer reports the tiles its pixels wanted through
+// request(); update() then loads missing ones as jobs, evicting the least
+// recently wanted, and loaded tiles reach the renderer through
+// nextUpload(). The page table has an entry per tile and level naming the
+// cache slot to sample, which for a tile that is not resident is that of
+// its nearest resident ancestor; the coarsest level never leaves the
+// cache, so every entry has one.
+class VirtualTexture{
+public:
+   VirtualTexture();
+   ~VirtualTexture();
+
+   // reads the header of a virtual texture file and loads its coarsest
+   // level, with a cache of cacheSide by cacheSide tiles; returns false if
+   // the file is missing or not a virtual texture
+   bool open(const char* filename, int cacheSide);
+   bool isOpen() const { return levels_ > 0; }
+
+   int width() const { return width_; }
+   int height() const { return height_; }
+   int levels() const { return levels_; }
+   ivec2 tiles(int level) const { return ivec2(tilesX_ >> level, tilesY_ >> level); }
+   int cacheSide() const { return cacheSide_; }
+
+   // the tile at x, y of level was wanted by some pixel this frame
+   void request(int level, int x, int y);
+
+   // starts loading this frame's missing tiles, coarsest first
+   void update();
+
+   // a cache slot whose tile is loaded and waits for upload, or -1; once
+   // its pixels are copied finishUpload() makes it resident
+   int nextUpload();
+   const unsigned char* slotPixels(int slot) const { return slots_[slot].pixels.data(); }
+   ivec2 slotPosition(int slot) const { return ivec2(slot % cacheSide_, slot / cacheSide_); }
+   void finishUpload(int slot);
+
+   // brings the page table up to date with the tiles made resident or
+   // evicted since the last call; entries are RGBA, slot x and y in the
+   // cache, resident level and 255
+   void updatePageTable();
+   const unsigned char* pageTable(int level) const { return table_[level].data(); }
+
+   // the rectangle of a level's entries changed since the last call, as
+   // x, y, width, height; false if none did
+   bool takeDirty(int level, ivec4* rect);
+
+   // runs queued tile loads on this thread until none is left
+   void waitForLoads() { WaitForCounter(&loading_); }
+
+   int residentCount() const;
+   int loadCount() const { return loadCount_; }
+
+private:
+   enum SlotState { SLOT_FREE, SLOT_LOADING, SLOT_LOADED, SLOT_RESIDENT };
+
+   struct Slot
+   {
+      int tile;
+      SlotState state;
+      int lastUsed;
+      std::vector<unsigned char> pixels;
+   };
+
+   VirtualTexture(const VirtualTexture&);
+   VirtualTexture& operator=(const VirtualTexture&);
+
+   int tileIndex(int level, int x, int y) const;
+   int tileLevel(int tile) const;
+   int allocateSlot();
+   bool loadTile(int slot);
+   void collectLoaded();
+
+   std::string filename_;
+   int width_;
+   int height_;
+   int levels_;
+   int tilesX_;                       // tiles across level 0
+   int tilesY_;
+   int cacheSide_;
+   std::vector<int> levelStart_;      // index of each level's first tile
+   std::vector<int> tileSlot_;        // resident slot of each tile, or -1
+   std::vector<int> tileWanted_;      // last frame each tile was requested
+   std::vector<Slot> slots_;
+   std::vector<int> requests_;        // tiles wanted this frame but not cached
+   std::vector<int> uploads_;         // loaded slots not yet uploaded
+   std::vector<int> changed_;         // tiles made resident or evicted
+   std::vector<std::vector<unsigned char> > table_;
+   std::vector<ivec4> dirty_;         // per level lower x, y and upper x, y
+   int frame_;
+   int loadCount_;
+   int inFlight_;
+
+   // slots the jobs have finished, collected on the next update()
+   std::mutex loadedMutex_;
+   std::vector<int> loaded_;
+   JobCounter loading_;
+};
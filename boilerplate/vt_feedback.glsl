@@ -0,0 +1,38 @@
+// ==========================================================================
+// Fragment program for the virtual texture feedback pass: each pixel
+// records the tile and level of the earth's virtual texture it would
+// sample, mirroring the lookup in fragment.glsl
+// ==========================================================================
+#version 410
+
+in vec3 VertNormal; // Normal in object space
+
+uniform ivec2 virtualTiles;    // tiles across level 0
+uniform int virtualLevels;
+uniform vec2 virtualSize;      // texels across level 0
+
+// the pass is drawn smaller than the screen, which makes every level
+// coarser by the log2 of the ratio; this takes it back off
+uniform float levelBias;
+
+out uvec4 FragmentTile;        // tile x, y, level, and 1 where drawn
+
+float PI = 3.1459;
+
+float virtualLevel(vec2 uv)
+{
+    float shifted = fract(uv.x + 0.5);
+    vec2 dx = vec2(min(abs(dFdx(uv.x)), abs(dFdx(shifted))), dFdx(uv.y)) * virtualSize;
+    vec2 dy = vec2(min(abs(dFdy(uv.x)), abs(dFdy(shifted))), dFdy(uv.y)) * virtualSize;
+    return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+void main(void)
+{
+    vec2 uv = vec2(atan(VertNormal.x, VertNormal.z) / (2.0 * PI) + 0.5, asin(VertNormal.y) / PI + 0.5);
+    float level = clamp(virtualLevel(uv) + levelBias, 0.0, float(virtualLevels - 1));
+    int fine = int(level);
+    ivec2 tiles = virtualTiles >> fine;
+    ivec2 tile = clamp(ivec2(uv * vec2(tiles)), ivec2(0), tiles - 1);
+    FragmentTile = uvec4(tile, fine, 1);
+}
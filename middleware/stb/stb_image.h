@@ -502,6 +502,24 @@ extern "C" {
 	// flip the image vertically, so the first pixel in the output array is the bottom left
 	STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+	// replace the JPEG decoder's IDCT, YCbCr-to-RGB and 2x2 upsampling kernels,
+	// e.g. with ones compiled for a newer instruction set; a null kernel keeps
+	// the built-in one. call before any decode starts, not during one
+	typedef void(*stbi_idct_kernel)(stbi_uc *out, int out_stride, short data[64]);
+	typedef void(*stbi_YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
+	typedef stbi_uc *(*stbi_resample_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+	STBIDEF void stbi_set_jpeg_kernels(stbi_idct_kernel idct, stbi_YCbCr_to_RGB_kernel YCbCr_to_RGB, stbi_resample_kernel resample_row_hv_2);
+
+	// have the JPEG decoder's upsampling and color conversion run through
+	// parallel_for, which calls body(context, begin, end) over ranges that
+	// cover [0, count) once, from any threads, and returns when all are
+	// done; null runs them on the calling thread. call before any decode
+	typedef void(*stbi_parallel_for)(void *context, int count, void(*body)(void *context, int begin, int end));
+	STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for parallel_for);
+
+	// whether stbi_set_flip_vertically_on_load() asked for flipping
+	STBIDEF int stbi_get_flip_vertically_on_load(void);
+
 	// ZLIB client - used by PNG, available for other purposes
 
 	STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -935,6 +953,29 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 	stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+STBIDEF int stbi_get_flip_vertically_on_load(void)
+{
+	return stbi__vertically_flip_on_load;
+}
+
+static stbi_idct_kernel stbi__jpeg_idct_override = NULL;
+static stbi_YCbCr_to_RGB_kernel stbi__jpeg_YCbCr_override = NULL;
+static stbi_resample_kernel stbi__jpeg_resample_override = NULL;
+
+STBIDEF void stbi_set_jpeg_kernels(stbi_idct_kernel idct, stbi_YCbCr_to_RGB_kernel YCbCr_to_RGB, stbi_resample_kernel resample_row_hv_2)
+{
+	stbi__jpeg_idct_override = idct;
+	stbi__jpeg_YCbCr_override = YCbCr_to_RGB;
+	stbi__jpeg_resample_override = resample_row_hv_2;
+}
+
+static stbi_parallel_for stbi__jpeg_parallel_for = NULL;
+
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for parallel_for)
+{
+	stbi__jpeg_parallel_for = parallel_for;
+}
+
 static unsigned char *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
 #ifndef STBI_NO_JPEG
@@ -3305,6 +3346,11 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
 #endif
 	j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+	// kernels set through stbi_set_jpeg_kernels() take precedence
+	if (stbi__jpeg_idct_override) j->idct_block_kernel = stbi__jpeg_idct_override;
+	if (stbi__jpeg_YCbCr_override) j->YCbCr_to_RGB_kernel = stbi__jpeg_YCbCr_override;
+	if (stbi__jpeg_resample_override) j->resample_row_hv_2_kernel = stbi__jpeg_resample_override;
 }
 
 // clean up the temporary component buffers
@@ -3339,6 +3385,125 @@ typedef struct
 	int ypos;    // which pre-expansion row we're on
 } stbi__resample;
 
+typedef struct
+{
+	stbi__jpeg *z;
+	stbi_uc *output;
+	int n, decode_n;
+	int failed;
+} stbi__jpeg_rows;
+
+// resample and color-convert output rows [begin, end). the resampling
+// state of the first row is worked out from the top, and each call has
+// line buffers of its own, so ranges can run on different threads
+static void stbi__jpeg_resample_rows(void *context, int begin, int end)
+{
+	stbi__jpeg_rows *rows = (stbi__jpeg_rows *)context;
+	stbi__jpeg *z = rows->z;
+	int n = rows->n, decode_n = rows->decode_n;
+	int k, j;
+	unsigned int i;
+	stbi_uc *coutput[4];
+	stbi_uc *linebuf[4] = { NULL, NULL, NULL, NULL };
+	stbi_uc *lastrow = NULL;
+	stbi__resample res_comp[4];
+	int ok = 1;
+
+	// the color conversion writes a byte past the end of the row, which
+	// for the last row of the range is another range's to write
+	if (begin < end && end < (int)z->s->img_y) {
+		lastrow = (stbi_uc *)stbi__malloc(n * z->s->img_x + 1);
+		if (!lastrow) ok = 0;
+	}
+
+	for (k = 0; k < decode_n && ok; ++k) {
+		stbi__resample *r = &res_comp[k];
+
+		// allocate line buffer big enough for upsampling off the edges
+		// with upsample factor of 4
+		linebuf[k] = (stbi_uc *)stbi__malloc(z->s->img_x + 3);
+		if (!linebuf[k]) { ok = 0; break; }
+
+		r->hs = z->img_h_max / z->img_comp[k].h;
+		r->vs = z->img_v_max / z->img_comp[k].v;
+		r->ystep = r->vs >> 1;
+		r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
+		r->ypos = 0;
+		r->line0 = r->line1 = z->img_comp[k].data;
+
+		if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+		else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+		else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+		else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+		else                               r->resample = stbi__resample_row_generic;
+
+		// step through the rows before begin
+		for (j = 0; j < begin; ++j) {
+			if (++r->ystep >= r->vs) {
+				r->ystep = 0;
+				r->line0 = r->line1;
+				if (++r->ypos < z->img_comp[k].y)
+					r->line1 += z->img_comp[k].w2;
+			}
+		}
+	}
+
+	for (j = begin; j < end && ok; ++j) {
+		stbi_uc *out = (lastrow && j == end - 1) ? lastrow : rows->output + n * z->s->img_x * j;
+		for (k = 0; k < decode_n; ++k) {
+			stbi__resample *r = &res_comp[k];
+			int y_bot = r->ystep >= (r->vs >> 1);
+			coutput[k] = r->resample(linebuf[k],
+				y_bot ? r->line1 : r->line0,
+				y_bot ? r->line0 : r->line1,
+				r->w_lores, r->hs);
+			if (++r->ystep >= r->vs) {
+				r->ystep = 0;
+				r->line0 = r->line1;
+				if (++r->ypos < z->img_comp[k].y)
+					r->line1 += z->img_comp[k].w2;
+			}
+		}
+		if (n >= 3) {
+			stbi_uc *y = coutput[0];
+			if (z->s->img_n == 3) {
+				if (z->rgb == 3) {
+					for (i = 0; i < z->s->img_x; ++i) {
+						out[0] = y[i];
+						out[1] = coutput[1][i];
+						out[2] = coutput[2][i];
+						out[3] = 255;
+						out += n;
+					}
+				}
+				else {
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+				}
+			}
+			else
+				for (i = 0; i < z->s->img_x; ++i) {
+					out[0] = out[1] = out[2] = y[i];
+					out[3] = 255; // not used if n==3
+					out += n;
+				}
+		}
+		else {
+			stbi_uc *y = coutput[0];
+			if (n == 1)
+				for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+			else
+				for (i = 0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+		}
+	}
+
+	if (ok && lastrow)
+		memcpy(rows->output + n * z->s->img_x * (end - 1), lastrow, n * z->s->img_x);
+	if (!ok) rows->failed = 1;
+	for (k = 0; k < decode_n; ++k)
+		STBI_FREE(linebuf[k]);
+	STBI_FREE(lastrow);
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
 	int n, decode_n;
@@ -3360,88 +3525,26 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
 	// resample and color-convert
 	{
-		int k;
-		unsigned int i, j;
 		stbi_uc *output;
-		stbi_uc *coutput[4];
-
-		stbi__resample res_comp[4];
-
-		for (k = 0; k < decode_n; ++k) {
-			stbi__resample *r = &res_comp[k];
-
-			// allocate line buffer big enough for upsampling off the edges
-			// with upsample factor of 4
-			z->img_comp[k].linebuf = (stbi_uc *)stbi__malloc(z->s->img_x + 3);
-			if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-			r->hs = z->img_h_max / z->img_comp[k].h;
-			r->vs = z->img_v_max / z->img_comp[k].v;
-			r->ystep = r->vs >> 1;
-			r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
-			r->ypos = 0;
-			r->line0 = r->line1 = z->img_comp[k].data;
-
-			if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-			else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-			else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-			else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-			else                               r->resample = stbi__resample_row_generic;
-		}
+		stbi__jpeg_rows rows;
 
 		// can't error after this so, this is safe
 		output = (stbi_uc *)stbi__malloc(n * z->s->img_x * z->s->img_y + 1);
 		if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-		// now go ahead and resample
-		for (j = 0; j < z->s->img_y; ++j) {
-			stbi_uc *out = output + n * z->s->img_x * j;
-			for (k = 0; k < decode_n; ++k) {
-				stbi__resample *r = &res_comp[k];
-				int y_bot = r->ystep >= (r->vs >> 1);
-				coutput[k] = r->resample(z->img_comp[k].linebuf,
-					y_bot ? r->line1 : r->line0,
-					y_bot ? r->line0 : r->line1,
-					r->w_lores, r->hs);
-				if (++r->ystep >= r->vs) {
-					r->ystep = 0;
-					r->line0 = r->line1;
-					if (++r->ypos < z->img_comp[k].y)
-						r->line1 += z->img_comp[k].w2;
-				}
-			}
-			if (n >= 3) {
-				stbi_uc *y = coutput[0];
-				if (z->s->img_n == 3) {
-					if (z->rgb == 3) {
-						for (i = 0; i < z->s->img_x; ++i) {
-							out[0] = y[i];
-							out[1] = coutput[1][i];
-							out[2] = coutput[2][i];
-							out[3] = 255;
-							out += n;
-						}
-					}
-					else {
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-					}
-				}
-				else
-					for (i = 0; i < z->s->img_x; ++i) {
-						out[0] = out[1] = out[2] = y[i];
-						out[3] = 255; // not used if n==3
-						out += n;
-					}
-			}
-			else {
-				stbi_uc *y = coutput[0];
-				if (n == 1)
-					for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-				else
-					for (i = 0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
-			}
-		}
+		// now go ahead and resample, spread over threads if the
+		// application said how
+		rows.z = z;
+		rows.output = output;
+		rows.n = n;
+		rows.decode_n = decode_n;
+		rows.failed = 0;
+		if (stbi__jpeg_parallel_for)
+			stbi__jpeg_parallel_for(&rows, (int)z->s->img_y, stbi__jpeg_resample_rows);
+		else
+			stbi__jpeg_resample_rows(&rows, 0, (int)z->s->img_y);
 		stbi__cleanup_jpeg(z);
+		if (rows.failed) { STBI_FREE(output); return stbi__errpuc("outofmem", "Out of memory"); }
 		*out_x = z->s->img_x;
 		*out_y = z->s->img_y;
 		if (comp) *comp = z->s->img_n; // report original components, not output